@@ -1 +1,10 @@
 SRC_DIR=$(CURDIR)
+
+# Set WITH_ZSTD=1 to build with zstd (libzstd), e.g. to compress the rolled
+# logs with zstd rather than gzip.
+WITH_ZSTD ?= 0
+
+ifeq ($(WITH_ZSTD),1)
+CXXFLAGS += -DMPRMPR_HAVE_ZSTD
+ZSTD_LIBS := -lzstd
+endif
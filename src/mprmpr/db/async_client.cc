@@ -0,0 +1,421 @@
+#include "mprmpr/db/async_client.h"
+
+#include <algorithm>
+
+#include <mysql/errmsg.h>
+#include <mysql/mysql.h>
+
+#include <glog/logging.h>
+
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/result.h"
+#include "mprmpr/util/thread.h"
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace mprmpr {
+namespace db {
+
+// A connection running one query at a time with the non-blocking API.
+//
+// Each step of a query is started with a mysql_*_start() call. When the
+// library would block, it returns the events it waits for (MYSQL_WAIT_READ,
+// etc.): they are watched on the loop, and the step is resumed with the
+// matching mysql_*_cont() call once they happen.
+class AsyncClient::AsyncConnection {
+ public:
+  explicit AsyncConnection(AsyncClient* client)
+      : client_(client),
+        mysql_(nullptr),
+        state_(kDisconnected),
+        connect_ret_(nullptr),
+        error_(0),
+        stored_result_(nullptr) {
+    io_.set(client_->loop_);
+    io_.set<AsyncConnection, &AsyncConnection::IoHandler>(this);
+    timer_.set(client_->loop_);
+    timer_.set<AsyncConnection, &AsyncConnection::TimerHandler>(this);
+  }
+
+  ~AsyncConnection() {
+    io_.stop();
+    timer_.stop();
+    if (busy()) {
+      Finish(Status::Aborted("The async database client is shutting down"));
+    }
+    Close();
+  }
+
+  bool busy() const {
+    return state_ != kDisconnected && state_ != kIdle;
+  }
+
+  // Runs 'query', connecting first if needed.
+  void Start(PendingQuery query) {
+    DCHECK(!busy());
+    current_ = std::move(query);
+    results_.clear();
+    if (state_ == kDisconnected) {
+      StartConnect();
+    } else {
+      StartQuery();
+    }
+  }
+
+ private:
+  enum State {
+    kDisconnected,
+    kConnecting,
+    kIdle,
+    kQuerying,
+    kStoringResult,
+    kNextResult,
+  };
+
+  void StartConnect() {
+    mysql_ = ::mysql_init(nullptr);
+    ::mysql_options(mysql_, MYSQL_OPT_NONBLOCK, 0);
+    state_ = kConnecting;
+    int status = ::mysql_real_connect_start(
+        &connect_ret_, mysql_, client_->hostname_.c_str(), client_->username_.c_str(),
+        client_->password_.c_str(), client_->database_.c_str(), 0, nullptr, client_->flags_);
+    ConnectStep(status);
+  }
+
+  void ConnectStep(int status) {
+    if (status) {
+      Wait(status);
+      return;
+    }
+    if (connect_ret_ == nullptr) {
+      Status s = Status::NetworkError(::mysql_error(mysql_));
+      Close();
+      Finish(s);
+      return;
+    }
+    StartQuery();
+  }
+
+  void StartQuery() {
+    state_ = kQuerying;
+    const string& query = current_.query;
+    int status = ::mysql_real_query_start(&error_, mysql_, query.data(), query.size());
+    QueryStep(status);
+  }
+
+  void QueryStep(int status) {
+    if (status) {
+      Wait(status);
+      return;
+    }
+    if (error_) {
+      Fail();
+      return;
+    }
+    StartStoreResult();
+  }
+
+  void StartStoreResult() {
+    state_ = kStoringResult;
+    int status = ::mysql_store_result_start(&stored_result_, mysql_);
+    StoreResultStep(status);
+  }
+
+  void StoreResultStep(int status) {
+    if (status) {
+      Wait(status);
+      return;
+    }
+    if (stored_result_) {
+      results_.emplace_back(new Result(stored_result_));
+      stored_result_ = nullptr;
+    } else if (::mysql_field_count(mysql_)) {
+      Fail();
+      return;
+    } else {
+      results_.emplace_back(new Result(::mysql_affected_rows(mysql_),
+                                       ::mysql_insert_id(mysql_)));
+    }
+
+    if (::mysql_more_results(mysql_)) {
+      state_ = kNextResult;
+      NextResultStep(::mysql_next_result_start(&error_, mysql_));
+    } else {
+      Finish(Status::OK());
+    }
+  }
+
+  void NextResultStep(int status) {
+    if (status) {
+      Wait(status);
+      return;
+    }
+    // 0: there is another result, -1: no more results, > 0: error.
+    if (error_ > 0) {
+      Fail();
+    } else if (error_ == 0) {
+      StartStoreResult();
+    } else {
+      Finish(Status::OK());
+    }
+  }
+
+  // Watches the events the library waits for.
+  void Wait(int status) {
+    int events = 0;
+    if (status & (MYSQL_WAIT_READ | MYSQL_WAIT_EXCEPT)) {
+      events |= ev::READ;
+    }
+    if (status & MYSQL_WAIT_WRITE) {
+      events |= ev::WRITE;
+    }
+    if (events) {
+      io_.set(::mysql_get_socket(mysql_), events);
+      io_.start();
+    }
+    if (status & MYSQL_WAIT_TIMEOUT) {
+      timer_.start(::mysql_get_timeout_value_ms(mysql_) / 1000.0);
+    }
+  }
+
+  void IoHandler(ev::io& watcher, int revents) {
+    int events = 0;
+    if (revents & ev::READ) {
+      events |= MYSQL_WAIT_READ;
+    }
+    if (revents & ev::WRITE) {
+      events |= MYSQL_WAIT_WRITE;
+    }
+    Resume(events);
+  }
+
+  void TimerHandler(ev::timer& watcher, int revents) {
+    Resume(MYSQL_WAIT_TIMEOUT);
+  }
+
+  // Resumes the current step once 'events' happened.
+  void Resume(int events) {
+    io_.stop();
+    timer_.stop();
+    switch (state_) {
+      case kConnecting:
+        ConnectStep(::mysql_real_connect_cont(&connect_ret_, mysql_, events));
+        break;
+      case kQuerying:
+        QueryStep(::mysql_real_query_cont(&error_, mysql_, events));
+        break;
+      case kStoringResult:
+        StoreResultStep(::mysql_store_result_cont(&stored_result_, mysql_, events));
+        break;
+      case kNextResult:
+        NextResultStep(::mysql_next_result_cont(&error_, mysql_, events));
+        break;
+      default:
+        LOG(DFATAL) << "Unexpected events in state " << state_;
+    }
+  }
+
+  // Fails the query with the error of the connection. If the connection was
+  // lost, it is reopened for the next query.
+  void Fail() {
+    unsigned int error = ::mysql_errno(mysql_);
+    Status s = Status::RuntimeError(::mysql_error(mysql_));
+    if (error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR) {
+      s = Status::NetworkError(::mysql_error(mysql_));
+      Close();
+    }
+    Finish(s);
+  }
+
+  void Finish(const Status& s) {
+    state_ = mysql_ ? kIdle : kDisconnected;
+    PendingQuery query = std::move(current_);
+    vector<shared_ptr<Result>> results;
+    if (s.ok()) {
+      results.swap(results_);
+    }
+    results_.clear();
+    query.callback(s, std::move(results));
+    client_->QueryDone();
+  }
+
+  void Close() {
+    if (mysql_) {
+      ::mysql_close(mysql_);
+      mysql_ = nullptr;
+    }
+    state_ = kDisconnected;
+  }
+
+  AsyncClient* const client_;
+  MYSQL* mysql_;
+  State state_;
+
+  ev::io io_;
+  ev::timer timer_;
+
+  // The query being run, and its results so far.
+  PendingQuery current_;
+  vector<shared_ptr<Result>> results_;
+
+  // Filled by the library when a step completes.
+  MYSQL* connect_ret_;
+  int error_;
+  MYSQL_RES* stored_result_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncConnection);
+};
+
+AsyncClientOptions::AsyncClientOptions()
+    : num_connections(8) {
+}
+
+AsyncClient::AsyncClient(const ConnectionBuilder& builder, AsyncClientOptions options)
+    : hostname_(builder.hostname()),
+      username_(builder.username()),
+      password_(builder.password()),
+      database_(builder.database()),
+      flags_(builder.flags()),
+      options_(std::move(options)),
+      loop_(ev::AUTO),
+      num_pending_queries_(0),
+      shutting_down_(false),
+      dispatching_(false),
+      dispatch_again_(false) {
+  async_.set(loop_);
+  async_.set<AsyncClient, &AsyncClient::AsyncHandler>(this);
+  async_.start();
+  for (int i = 0; i < std::max(options_.num_connections, 1); i++) {
+    connections_.emplace_back(new AsyncConnection(this));
+  }
+}
+
+AsyncClient::~AsyncClient() {
+  Shutdown();
+}
+
+Status AsyncClient::Init() {
+  return Thread::Create("db", "async-db-client", &AsyncClient::RunThread, this, &thread_);
+}
+
+void AsyncClient::RunThread() {
+  loop_.run(0);
+}
+
+void AsyncClient::Shutdown() {
+  {
+    MutexLock l(lock_);
+    if (shutting_down_) {
+      return;
+    }
+    shutting_down_ = true;
+  }
+  if (thread_) {
+    async_.send();
+    thread_->Join();
+  } else {
+    // The loop never ran: fail the queued queries here.
+    AsyncHandler(async_, 0);
+  }
+}
+
+void AsyncClient::QueryAsync(const string& query, QueryCallback callback) {
+  {
+    MutexLock l(lock_);
+    if (!shutting_down_) {
+      queue_.push_back({ query, std::move(callback) });
+      num_pending_queries_++;
+      async_.send();
+      return;
+    }
+  }
+  callback(Status::ServiceUnavailable("The async database client is shut down"),
+           vector<shared_ptr<Result>>());
+}
+
+void AsyncClient::QueryAsync(const string& query, Promise<AsyncQueryResult>* promise) {
+  QueryAsync(query, [promise](const Status& s, vector<shared_ptr<Result>> results) {
+      AsyncQueryResult result;
+      result.status = s;
+      result.results = std::move(results);
+      promise->Set(result);
+    });
+}
+
+int AsyncClient::num_pending_queries() const {
+  MutexLock l(lock_);
+  return num_pending_queries_;
+}
+
+void AsyncClient::AsyncHandler(ev::async& watcher, int revents) {
+  std::deque<PendingQuery> aborted;
+  {
+    MutexLock l(lock_);
+    if (!shutting_down_) {
+      l.Unlock();
+      DispatchQueries();
+      return;
+    }
+    aborted.swap(queue_);
+  }
+
+  // Fails the queries running, then the queued ones.
+  connections_.clear();
+  for (PendingQuery& query : aborted) {
+    query.callback(Status::Aborted("The async database client is shutting down"),
+                   vector<shared_ptr<Result>>());
+    QueryDone();
+  }
+  async_.stop();
+  if (thread_) {
+    loop_.break_loop();
+  }
+}
+
+void AsyncClient::DispatchQueries() {
+  // A query completing within Start() calls back into this function through
+  // QueryDone(). Rather than recurse, possibly once per queued query, the
+  // outer call goes over the connections again.
+  if (dispatching_) {
+    dispatch_again_ = true;
+    return;
+  }
+  dispatching_ = true;
+  bool queue_empty = false;
+  do {
+    dispatch_again_ = false;
+    for (auto& connection : connections_) {
+      if (connection->busy()) {
+        continue;
+      }
+      PendingQuery query;
+      {
+        MutexLock l(lock_);
+        if (queue_.empty()) {
+          queue_empty = true;
+          break;
+        }
+        query = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      connection->Start(std::move(query));
+    }
+  } while (dispatch_again_ && !queue_empty);
+  dispatching_ = false;
+}
+
+void AsyncClient::QueryDone() {
+  {
+    MutexLock l(lock_);
+    num_pending_queries_--;
+    if (shutting_down_) {
+      return;
+    }
+  }
+  DispatchQueries();
+}
+
+} // namespace db
+} // namespace mprmpr
@@ -0,0 +1,161 @@
+#ifndef MPRMPR_DB_ASYNC_CLIENT_H_
+#define MPRMPR_DB_ASYNC_CLIENT_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ev++.h>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/promise.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class Thread;
+
+namespace db {
+
+class ConnectionBuilder;
+class Result;
+
+struct AsyncClientOptions {
+  AsyncClientOptions();
+
+  // Maximum number of connections to the server, i.e. of queries running at
+  // a time. Further queries are queued. Default: 8.
+  int num_connections;
+};
+
+// The outcome of a query run by an AsyncClient.
+struct AsyncQueryResult {
+  Status status;
+
+  // One result per statement of the query, see Connection::GetResults().
+  std::vector<std::shared_ptr<Result>> results;
+};
+
+// Runs queries without blocking the calling thread.
+//
+// A db::Connection blocks its thread for the whole round trip of a query, so
+// that an RPC handler using it ties up a service thread until the server
+// replies. Instead, queries are handed to the client, which runs them on its
+// own connections with the non-blocking API of the MariaDB client library
+// (mysql_real_query_start() and mysql_real_query_cont(), etc.), all driven by
+// a single libev loop on a dedicated thread:
+//
+//   client->QueryAsync("UPDATE jobs SET state = 2 WHERE id = 7",
+//                      [](const Status& s, std::vector<std::shared_ptr<Result>> results) {
+//                        ...
+//                      });
+//
+// or, to wait for the result:
+//
+//   Promise<AsyncQueryResult> promise;
+//   client->QueryAsync(query, &promise);
+//   RETURN_NOT_OK(promise.Get().status);
+//
+// Connections are opened when first needed, and reopened after the server
+// closed them. Queries are run in the order they are submitted, by the first
+// idle connection: consecutive queries may run on different connections, so
+// that they must not depend on each other's session state (e.g. transactions).
+//
+// The callbacks are run on the thread of the loop: they must not block, e.g.
+// on another query.
+//
+// Requires the MariaDB client library (or MariaDB Connector/C), which
+// provides the non-blocking API.
+//
+// This class is thread-safe.
+class AsyncClient {
+ public:
+  // Called once the query is done. On success, 'results' has one result per
+  // statement of the query.
+  typedef std::function<void(const Status& status,
+                             std::vector<std::shared_ptr<Result>> results)> QueryCallback;
+
+  // Connects with the parameters of 'builder'. The statement cache capacity
+  // is ignored.
+  AsyncClient(const ConnectionBuilder& builder, AsyncClientOptions options);
+
+  // Shuts down the client, see Shutdown().
+  ~AsyncClient();
+
+  // Starts the thread of the loop.
+  Status Init();
+
+  // Stops the loop. The queries not done yet fail with Aborted, and the
+  // queries submitted after fail with ServiceUnavailable.
+  void Shutdown();
+
+  // Runs 'query', and calls 'callback' once it is done.
+  void QueryAsync(const std::string& query, QueryCallback callback);
+
+  // Runs 'query', and sets 'promise' once it is done. 'promise' must outlive
+  // the query.
+  void QueryAsync(const std::string& query, Promise<AsyncQueryResult>* promise);
+
+  // The number of queries submitted and not done yet.
+  int num_pending_queries() const;
+
+ private:
+  class AsyncConnection;
+  friend class AsyncConnection;
+
+  struct PendingQuery {
+    std::string query;
+    QueryCallback callback;
+  };
+
+  void RunThread();
+
+  // Called on the thread of the loop when queries are submitted, or on
+  // shutdown.
+  void AsyncHandler(ev::async& watcher, int revents);
+
+  // Hands the queued queries to the idle connections.
+  void DispatchQueries();
+
+  // Called by the connections when they complete a query.
+  void QueryDone();
+
+  const std::string hostname_;
+  const std::string username_;
+  const std::string password_;
+  const std::string database_;
+  const uint64_t flags_;
+  const AsyncClientOptions options_;
+
+  ev::dynamic_loop loop_;
+
+  // Used by other threads to wake up the loop.
+  ev::async async_;
+
+  scoped_refptr<Thread> thread_;
+
+  // Protects the fields below.
+  mutable Mutex lock_;
+  std::deque<PendingQuery> queue_;
+  int num_pending_queries_;
+  bool shutting_down_;
+
+  // Only used on the thread of the loop.
+  std::vector<std::unique_ptr<AsyncConnection>> connections_;
+
+  // Whether DispatchQueries() is running, and whether it should look at the
+  // queue again: queries may complete within it, e.g. when a connection fails
+  // right away. Only used on the thread of the loop.
+  bool dispatching_;
+  bool dispatch_again_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncClient);
+};
+
+} // namespace db
+} // namespace mprmpr
+#endif // MPRMPR_DB_ASYNC_CLIENT_H_
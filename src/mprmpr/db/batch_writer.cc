@@ -0,0 +1,271 @@
+#include "mprmpr/db/batch_writer.h"
+
+#include <glog/logging.h>
+#include <iterator>
+
+#include "mprmpr/base/strings/join.h"
+#include "mprmpr/util/thread.h"
+
+METRIC_DEFINE_histogram(server, db_batch_write_duration,
+                        "DB Batch Write Duration",
+                        mprmpr::MetricUnit::kMicroseconds,
+                        "Number of microseconds spent writing a batch of rows "
+                        "to the database in one statement.",
+                        60000000LU, 2);
+
+METRIC_DEFINE_histogram(server, db_batch_write_rows,
+                        "DB Batch Write Rows",
+                        mprmpr::MetricUnit::kRows,
+                        "Number of rows written to the database per batch.",
+                        1000000LU, 2);
+
+METRIC_DEFINE_counter(server, db_batch_write_errors,
+                      "DB Batch Write Errors",
+                      mprmpr::MetricUnit::kRequests,
+                      "Number of batches of rows which failed to be written "
+                      "to the database.");
+
+using std::string;
+using std::vector;
+
+namespace mprmpr {
+namespace db {
+
+namespace {
+
+string QuoteIdentifier(const string& name) {
+  string quoted("`");
+  for (char c : name) {
+    if (c == '`') {
+      quoted.push_back('`');
+    }
+    quoted.push_back(c);
+  }
+  quoted.push_back('`');
+  return quoted;
+}
+
+} // anonymous namespace
+
+BatchWriterOptions::BatchWriterOptions()
+    : max_batch_bytes(512 * 1024),
+      max_batch_rows(1000),
+      flush_interval(MonoDelta::FromMilliseconds(100)),
+      max_queued_batches(4) {
+}
+
+BatchWriter::BatchWriter(std::unique_ptr<Connection> connection,
+                         string table,
+                         vector<string> columns,
+                         vector<string> update_columns,
+                         BatchWriterOptions options,
+                         const scoped_refptr<MetricEntity>& metric_entity)
+    : connection_(std::move(connection)),
+      options_(std::move(options)),
+      columns_(std::move(columns)),
+      sealed_cond_(&lock_),
+      written_cond_(&lock_),
+      num_sealed_(0),
+      num_written_(0),
+      num_pending_rows_(0),
+      closing_(false),
+      write_duration_(METRIC_db_batch_write_duration.Instantiate(metric_entity)),
+      batch_rows_(METRIC_db_batch_write_rows.Instantiate(metric_entity)),
+      write_errors_(METRIC_db_batch_write_errors.Instantiate(metric_entity)) {
+  vector<string> quoted;
+  for (const string& column : columns_) {
+    quoted.push_back(QuoteIdentifier(column));
+  }
+  prefix_ = "INSERT INTO " + QuoteIdentifier(table) + " (" + JoinStrings(quoted, ", ") +
+            ") VALUES ";
+
+  vector<string> updates;
+  for (const string& column : update_columns) {
+    string quoted_column = QuoteIdentifier(column);
+    updates.push_back(quoted_column + " = VALUES(" + quoted_column + ")");
+  }
+  if (!updates.empty()) {
+    suffix_ = " ON DUPLICATE KEY UPDATE " + JoinStrings(updates, ", ");
+  }
+}
+
+BatchWriter::~BatchWriter() {
+  Close();
+}
+
+Status BatchWriter::Init() {
+  return Thread::Create("db", "batch-writer", &BatchWriter::FlushThread, this, &thread_);
+}
+
+Status BatchWriter::AddRow(Values row) {
+  // Enclosed in parentheses, with commas between the values.
+  size_t row_bytes = 1 + row.size();
+  for (const auto& value : row) {
+    row_bytes += value->size();
+  }
+
+  MutexLock l(lock_);
+  if (closing_) {
+    return Status::IllegalState("batch writer is closed");
+  }
+  RETURN_NOT_OK(TakeErrorUnlocked());
+
+  if (current_.num_rows > 0 &&
+      current_.num_bytes + row_bytes + 1 > options_.max_batch_bytes) {
+    SealBatchUnlocked();
+  }
+  while (sealed_.size() >= options_.max_queued_batches && !closing_) {
+    written_cond_.Wait();
+  }
+  if (closing_) {
+    return Status::IllegalState("batch writer is closed");
+  }
+
+  if (current_.num_rows == 0) {
+    current_.first_row_time = MonoTime::Now();
+    if (sealed_.empty()) {
+      // Wake up the thread to set its timer.
+      sealed_cond_.Signal();
+    }
+  } else {
+    current_.num_bytes++;
+  }
+  current_.values.insert(current_.values.end(), std::make_move_iterator(row.begin()),
+                         std::make_move_iterator(row.end()));
+  current_.num_bytes += row_bytes;
+  current_.num_rows++;
+  num_pending_rows_++;
+
+  if (current_.num_rows >= options_.max_batch_rows ||
+      current_.num_bytes >= options_.max_batch_bytes) {
+    SealBatchUnlocked();
+  }
+  return Status::OK();
+}
+
+void BatchWriter::SealBatchUnlocked() {
+  if (current_.num_rows == 0) {
+    return;
+  }
+  current_.sequence = num_sealed_++;
+  sealed_.push_back(std::move(current_));
+  current_ = Batch();
+  sealed_cond_.Signal();
+}
+
+Status BatchWriter::TakeErrorUnlocked() {
+  Status s = error_;
+  error_ = Status::OK();
+  return s;
+}
+
+Status BatchWriter::Flush() {
+  MutexLock l(lock_);
+  SealBatchUnlocked();
+  int64_t target = num_sealed_;
+  while (num_written_ < target) {
+    if (!thread_) {
+      return Status::IllegalState("batch writer is not running");
+    }
+    written_cond_.Wait();
+  }
+  return TakeErrorUnlocked();
+}
+
+void BatchWriter::Close() {
+  {
+    MutexLock l(lock_);
+    if (closing_) {
+      return;
+    }
+    closing_ = true;
+    SealBatchUnlocked();
+    sealed_cond_.Signal();
+    // Unblock Add() callers: they fail from now on.
+    written_cond_.Broadcast();
+  }
+  if (thread_) {
+    thread_->Join();
+  }
+
+  MutexLock l(lock_);
+  if (!error_.ok()) {
+    LOG(WARNING) << "Failed to write rows on close: " << error_.ToString();
+  }
+}
+
+size_t BatchWriter::num_pending_rows() const {
+  MutexLock l(lock_);
+  return num_pending_rows_;
+}
+
+void BatchWriter::FlushThread() {
+  MutexLock l(lock_);
+  while (true) {
+    if (sealed_.empty() && current_.num_rows > 0) {
+      MonoTime deadline = current_.first_row_time + options_.flush_interval;
+      MonoTime now = MonoTime::Now();
+      if (closing_ || !now.ComesBefore(deadline)) {
+        SealBatchUnlocked();
+      } else {
+        sealed_cond_.TimedWait(deadline - now);
+        continue;
+      }
+    }
+    if (sealed_.empty()) {
+      if (closing_) {
+        break;
+      }
+      sealed_cond_.Wait();
+      continue;
+    }
+
+    Batch batch = std::move(sealed_.front());
+    sealed_.pop_front();
+    // Make room for a blocked Add() while the batch is being written.
+    written_cond_.Broadcast();
+
+    Status s;
+    {
+      l.Unlock();
+      s = WriteBatch(&batch);
+      l.Lock();
+    }
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to write " << batch.num_rows << " rows: " << s.ToString();
+      write_errors_->Increment();
+      if (error_.ok()) {
+        error_ = s;
+      }
+    }
+    num_pending_rows_ -= batch.num_rows;
+    num_written_ = batch.sequence + 1;
+    written_cond_.Broadcast();
+  }
+}
+
+Status BatchWriter::WriteBatch(Batch* batch) {
+  string statement;
+  statement.reserve(prefix_.size() + batch->num_bytes + suffix_.size());
+  statement.append(prefix_);
+  for (size_t i = 0; i < batch->values.size(); i++) {
+    if (i % columns_.size() == 0) {
+      statement.append(i == 0 ? "(" : "),(");
+    } else {
+      statement.push_back(',');
+    }
+    // Escaping depends on the character set of the connection.
+    statement.append(batch->values[i]->Quote(connection_->connection_));
+  }
+  statement.push_back(')');
+  statement.append(suffix_);
+
+  MonoTime start = MonoTime::Now();
+  Status s = connection_->Query(statement);
+  write_duration_->Increment((MonoTime::Now() - start).ToMicroseconds());
+  batch_rows_->Increment(batch->num_rows);
+  return s;
+}
+
+} // namespace db
+} // namespace mprmpr
@@ -0,0 +1,193 @@
+#ifndef MPRMPR_DB_BATCH_WRITER_H_
+#define MPRMPR_DB_BATCH_WRITER_H_
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/local_parameter.h"
+#include "mprmpr/util/condition_variable.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class Thread;
+
+namespace db {
+
+struct BatchWriterOptions {
+  BatchWriterOptions();
+
+  // A batch is sent once its rows may take this many bytes, counting the
+  // strings at their longest once escaped. It must leave room for the rest
+  // of the statement under the max_allowed_packet of the server.
+  // Default: 512KB.
+  size_t max_batch_bytes;
+
+  // A batch is sent once it has this many rows. Default: 1000.
+  size_t max_batch_rows;
+
+  // A batch is sent at the latest this long after its first row was added.
+  // Default: 100 milliseconds.
+  MonoDelta flush_interval;
+
+  // Add() waits while this many full batches are waiting to be sent.
+  // Default: 4.
+  size_t max_queued_batches;
+};
+
+// Writes rows to a table in multi-row statements:
+//
+//   INSERT INTO `jobs` (`id`, `state`) VALUES (...), (...), ...
+//       ON DUPLICATE KEY UPDATE `state` = VALUES(`state`)
+//
+// so that many rows cost a single round trip to the server, instead of one
+// per row:
+//
+//   BatchWriter writer(std::move(conn), "jobs", { "id", "state" }, { "state" },
+//                      BatchWriterOptions(), metric_entity);
+//   RETURN_NOT_OK(writer.Init());
+//   RETURN_NOT_OK(writer.Add(job_id, state));
+//   ...
+//   RETURN_NOT_OK(writer.Flush());
+//
+// The values are quoted and escaped like the parameters of
+// Connection::Execute() (see LocalParameter). Rows are escaped and sent by
+// a dedicated thread, the only user of the connection of the writer, when a
+// batch reaches 'max_batch_rows' or 'max_batch_bytes', or 'flush_interval'
+// after its first row was added. Rows are written in the order they are added.
+//
+// A batch which fails is not retried: its error is returned by the next call
+// to Add() or Flush().
+//
+// This class is thread-safe.
+class BatchWriter {
+ public:
+  // Writes into the 'columns' of 'table'. On duplicate keys, the
+  // 'update_columns' of the existing rows are updated with the new values;
+  // if there are none, the statements are plain INSERTs.
+  BatchWriter(std::unique_ptr<Connection> connection,
+              std::string table,
+              std::vector<std::string> columns,
+              std::vector<std::string> update_columns,
+              BatchWriterOptions options,
+              const scoped_refptr<MetricEntity>& metric_entity);
+
+  // Sends the pending rows, see Close().
+  ~BatchWriter();
+
+  // Starts the thread sending the batches.
+  Status Init();
+
+  // Adds a row with one value per column. May wait for the batches queued
+  // before it to be sent; see 'max_queued_batches'.
+  template<typename... Args>
+  Status Add(const Args&... values) {
+    if (sizeof...(values) != columns_.size()) {
+      return Status::InvalidArgument("wrong number of values",
+                                     std::to_string(sizeof...(values)));
+    }
+    Values row;
+    row.reserve(sizeof...(values));
+    AppendValues(&row, values...);
+    return AddRow(std::move(row));
+  }
+
+  // Sends the rows added so far, and waits for them to be written. Returns
+  // the first error since the last call to Add() or Flush(), if any.
+  Status Flush();
+
+  // Sends the pending rows and stops the thread. Rows cannot be added after.
+  void Close();
+
+  // The number of rows added and not written yet.
+  size_t num_pending_rows() const;
+
+ private:
+  // Values not quoted yet.
+  typedef std::vector<std::unique_ptr<LocalParameter>> Values;
+
+  // Rows to be sent in one statement.
+  struct Batch {
+    Batch() : num_rows(0), num_bytes(0), sequence(0) {}
+
+    // The values of the rows, one per column for each row.
+    Values values;
+    size_t num_rows;
+
+    // The longest size of the rows once quoted, with their separators.
+    size_t num_bytes;
+
+    // When the first row was added.
+    MonoTime first_row_time;
+
+    // The number of batches sealed before this one.
+    int64_t sequence;
+  };
+
+  void AppendValues(Values* row) {}
+
+  template<typename T, typename... Rest>
+  void AppendValues(Values* row, const T& value, const Rest&... rest) {
+    row->emplace_back(new LocalParameter(value));
+    AppendValues(row, rest...);
+  }
+
+  Status AddRow(Values row);
+
+  // Moves the current batch, if not empty, to the queue of batches to send.
+  // Requires 'lock_'.
+  void SealBatchUnlocked();
+
+  // Returns and clears the first error of the batches sent. Requires 'lock_'.
+  Status TakeErrorUnlocked();
+
+  void FlushThread();
+
+  // Quotes the values of 'batch' and sends it in one statement.
+  Status WriteBatch(Batch* batch);
+
+  const std::unique_ptr<Connection> connection_;
+  const BatchWriterOptions options_;
+  const std::vector<std::string> columns_;
+
+  // The statement without its rows.
+  std::string prefix_;
+  std::string suffix_;
+
+  mutable Mutex lock_;
+
+  // Signaled when a batch is sealed, or on Close().
+  ConditionVariable sealed_cond_;
+
+  // Signaled when a batch has been sent.
+  ConditionVariable written_cond_;
+
+  Batch current_;
+  std::deque<Batch> sealed_;
+  int64_t num_sealed_;
+  int64_t num_written_;
+  size_t num_pending_rows_;
+  Status error_;
+  bool closing_;
+
+  scoped_refptr<Thread> thread_;
+
+  scoped_refptr<Histogram> write_duration_;
+  scoped_refptr<Histogram> batch_rows_;
+  scoped_refptr<Counter> write_errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchWriter);
+};
+
+} // namespace db
+} // namespace mprmpr
+#endif // MPRMPR_DB_BATCH_WRITER_H_
@@ -1,8 +1,11 @@
 #include "mprmpr/db/connection.h"
+#include "mprmpr/db/cursor.h"
 #include "mprmpr/db/statement.h"
 #include "mprmpr/db/local_parameter.h"
 #include "mprmpr/db/result.h"
 
+#include <algorithm>
+
 #include <glog/logging.h>
 
 namespace mprmpr {
@@ -27,6 +30,7 @@ static MysqlLibrary mysql_library_init_;
 ///
 ConnectionBuilder::ConnectionBuilder() {
   flags_ = CLIENT_IGNORE_SIGPIPE | CLIENT_MULTI_STATEMENTS;
+  statement_cache_capacity_ = Connection::kDefaultStatementCacheCapacity;
 }
 
 ConnectionBuilder& ConnectionBuilder::set_hostname(const std::string& hostname) {
@@ -54,16 +58,25 @@ ConnectionBuilder& ConnectionBuilder::set_flags(uint64_t flags) {
   return *this;
 }
 
+ConnectionBuilder& ConnectionBuilder::set_statement_cache_capacity(size_t capacity) {
+  statement_cache_capacity_ = capacity;
+  return *this;
+}
+
 Status ConnectionBuilder::Build(std::unique_ptr<Connection>* conn) const {
-  conn->reset(new Connection(hostname_, username_, password_, database_, flags_));
+  conn->reset(new Connection(hostname_, username_, password_, database_, flags_,
+                             statement_cache_capacity_));
   RETURN_NOT_OK((*conn)->Connect());
   return Status::OK();
 }
 
 ///
 Connection::Connection(const std::string& hostname, const std::string& username,
-                       const std::string& password, const std::string& database, uint64_t flags)
+                       const std::string& password, const std::string& database, uint64_t flags,
+                       size_t statement_cache_capacity)
     : connection_(::mysql_init(nullptr)) ,
+      cursor_(nullptr),
+      statement_cache_capacity_(statement_cache_capacity),
       hostname_(hostname), username_(username), password_(password), database_(database), 
       flags_(flags) {
   DCHECK(connection_);
@@ -96,7 +109,28 @@ Status Connection::Connect() {
   return Status::OK();
 }
 
+Status Connection::Ping() {
+  unsigned long thread_id = ::mysql_thread_id(connection_);
+  if (::mysql_ping(connection_)) {
+    return Status::NetworkError(::mysql_error(connection_));
+  }
+  // A new server thread means a new session: its prepared statements are gone.
+  if (::mysql_thread_id(connection_) != thread_id) {
+    LOG(INFO) << "Reconnected to " << hostname_ << ", dropping "
+              << statements_.size() << " cached statements";
+    statements_.clear();
+    statement_lru_.clear();
+  }
+  return Status::OK();
+}
+
 Connection::~Connection() {
+  if (cursor_) {
+    cursor_->Close();
+  }
+  // The statements must be closed before the connection.
+  statements_.clear();
+  statement_lru_.clear();
   if (connection_) {
     ::mysql_close(connection_);
   }
@@ -104,16 +138,41 @@ Connection::~Connection() {
 }
 
 // private
-Statement* Connection::CreateStatement(const char* query) {
+Status Connection::GetCachedStatement(const std::string& query, Statement** statement) {
   auto iter = statements_.find(query);
   if (iter != statements_.end()) {
-    return iter->second.get();
+    statement_lru_.splice(statement_lru_.begin(), statement_lru_, iter->second);
+    *statement = iter->second->second.get();
+    return Status::OK();
+  }
+
+  std::unique_ptr<Statement> st;
+  RETURN_NOT_OK(NewStatement(query, &st));
+  *statement = st.get();
+  statement_lru_.emplace_front(query, std::move(st));
+  statements_[query] = statement_lru_.begin();
+  while (statement_lru_.size() > std::max<size_t>(statement_cache_capacity_, 1)) {
+    statements_.erase(statement_lru_.back().first);
+    statement_lru_.pop_back();
   }
+  return Status::OK();
+}
 
-  auto* statement = new Statement(this, query);
-  statements_[query].reset(statement);
+Status Connection::NewStatement(const std::string& query,
+                                std::unique_ptr<Statement>* statement) {
+  statement->reset(new Statement(this, query));
+  return (*statement)->status_;
+}
 
-  return statement;
+Status Connection::ExecutePreparedBinds(const std::string& query, MYSQL_BIND* binds,
+                                        size_t count) {
+  RETURN_NOT_OK(CheckNoOpenCursor());
+  results_.clear();
+  Statement* statement;
+  RETURN_NOT_OK(GetCachedStatement(query, &statement));
+  RETURN_NOT_OK(statement->DoExecute(binds, count));
+  results_.push_back(std::move(statement->result_));
+  return Status::OK();
 }
 
 Status Connection::Prepare(const std::string& query,
@@ -148,7 +207,45 @@ Status Connection::Prepare(const std::string& query,
   return Status::OK();
 }
 
+Status Connection::CheckNoOpenCursor() const {
+  if (cursor_) {
+    return Status::IllegalState("A cursor is open on the connection");
+  }
+  return Status::OK();
+}
+
+Status Connection::KillQuery() {
+  MYSQL* killer = ::mysql_init(nullptr);
+  if (killer == nullptr) {
+    return Status::RuntimeError("Unable to init connection");
+  }
+  Status s;
+  if (::mysql_real_connect(killer, hostname_.c_str(), username_.c_str(), password_.c_str(),
+                           database_.c_str(), 0, nullptr, 0) == nullptr) {
+    s = Status::NetworkError("Unable to connect to kill query", ::mysql_error(killer));
+  } else {
+    std::string query = "KILL QUERY " + std::to_string(::mysql_thread_id(connection_));
+    if (::mysql_query(killer, query.c_str())) {
+      s = Status::RuntimeError("Unable to kill query", ::mysql_error(killer));
+    }
+  }
+  ::mysql_close(killer);
+  return s;
+}
+
+Status Connection::OpenCursor(const std::string& query, Cursor* cursor) {
+  cursor->Close();
+  RETURN_NOT_OK(CheckNoOpenCursor());
+  results_.clear();
+
+  if (::mysql_real_query(connection_, query.data(), query.size())) {
+    return Status::RuntimeError(::mysql_error(connection_));
+  }
+  return cursor->Open(this);
+}
+
 Status Connection::Query(const std::string& query) {
+  RETURN_NOT_OK(CheckNoOpenCursor());
 
   results_.clear();
 
@@ -1,19 +1,25 @@
 #ifndef MPRMPR_DB_CONNECTION_H_
 #define MPRMPR_DB_CONNECTION_H_
 
+#include <cstring>
+#include <list>
 #include <unordered_map>
 #include <memory>
 #include <functional>
+#include <string>
+#include <utility>
 
 #include <mysql/mysql.h>
 
 #include "mprmpr/base/macros.h"
 #include "mprmpr/util/status.h"
 #include "mprmpr/db/local_parameter.h"
+#include "mprmpr/db/parameter.h"
 
 namespace mprmpr {
 namespace db {
 
+class Cursor;
 class LocalParameter;
 class Statement;
 class Result;
@@ -29,12 +35,14 @@ class ConnectionBuilder {
   ConnectionBuilder& set_password(const std::string& password);
   ConnectionBuilder& set_database(const std::string& database);
   ConnectionBuilder& set_flags(uint64_t flags);
+  ConnectionBuilder& set_statement_cache_capacity(size_t capacity);
 
   const std::string& hostname() const { return hostname_; }
   const std::string& username() const { return username_; }
   const std::string& password() const { return password_; }
   const std::string& database() const { return database_; }
   uint64_t flags() const { return flags_; }
+  size_t statement_cache_capacity() const { return statement_cache_capacity_; }
 
   Status Build(std::unique_ptr<Connection>* conn) const;
 
@@ -44,24 +52,38 @@ class ConnectionBuilder {
   std::string password_;
   std::string database_;
   uint64_t flags_;
+  size_t statement_cache_capacity_;
 
   DISALLOW_COPY_AND_ASSIGN(ConnectionBuilder);
 };
 
 class Connection {
+  friend class BatchWriter;
+  friend class Cursor;
   friend class Statement;
   friend class CachedStatement;
 
  public:
+  // The default number of prepared statements cached by a connection.
+  static const size_t kDefaultStatementCacheCapacity = 64;
+
   Connection(const std::string& hostname, 
              const std::string& username, 
              const std::string& password,
-             const std::string& database, uint64_t flags);
+             const std::string& database, uint64_t flags,
+             size_t statement_cache_capacity = kDefaultStatementCacheCapacity);
 
   virtual ~Connection();
 
   Status Connect();
-  Status Query(const std::string& query);
+
+  // Checks that the connection to the server is alive. The client library
+  // reconnects if it was lost (see MYSQL_OPT_RECONNECT in Connect()); the
+  // cached statements, which belonged to the lost session, are then dropped.
+  virtual Status Ping();
+
+  // Virtual for tests.
+  virtual Status Query(const std::string& query);
 
   template<typename... Args>
   Status Execute(const std::string& query, Args... args) {
@@ -78,6 +100,31 @@ class Connection {
     return Query(ret);
   }
 
+  // Runs 'query' and opens 'cursor' on its rows, which are streamed from the
+  // server instead of being buffered in memory (see Cursor). Only the rows of
+  // the first statement are returned. Other queries fail until the cursor is
+  // closed.
+  Status OpenCursor(const std::string& query, Cursor* cursor);
+
+  // Executes 'query' as a server-side prepared statement, binding 'args' to
+  // its '?' placeholders in binary form (see Statement). The statements are
+  // cached by query text, so that a query executed repeatedly is only parsed
+  // once, by neither the client nor the server; the least recently used ones
+  // are closed beyond the capacity of the cache.
+  //
+  // Unlike Execute(), the query must be a single statement, and '!'
+  // placeholders are not supported.
+  template<typename... Args>
+  Status ExecutePrepared(const std::string& query, const Args&... args) {
+    MYSQL_BIND binds[sizeof...(args) + 1];
+    std::memset(binds, 0, sizeof(binds));
+    BindParameters(binds, args...);
+    return ExecutePreparedBinds(query, binds, sizeof...(args));
+  }
+
+  // The number of prepared statements cached by the connection.
+  size_t num_cached_statements() const { return statements_.size(); }
+
   const std::vector<Result*> GetResults() const {
     std::vector<Result*> ret;
     for (auto& v : results_) {
@@ -89,8 +136,16 @@ class Connection {
  private:
   MYSQL* connection_;
 
-  // 用于 cached statement, 目标未支持
-  std::unordered_map<const char*, std::unique_ptr<Statement>> statements_;
+  // The cursor streaming rows from the connection, if any.
+  Cursor* cursor_;
+
+  // Cached statements, the most recently used first.
+  typedef std::list<std::pair<std::string, std::unique_ptr<Statement>>> StatementList;
+  StatementList statement_lru_;
+
+  // Cached statements by query text.
+  std::unordered_map<std::string, StatementList::iterator> statements_;
+  const size_t statement_cache_capacity_;
 
   std::string hostname_;
   std::string username_;
@@ -99,8 +154,20 @@ class Connection {
   uint64_t flags_;
   std::vector<std::unique_ptr<Result>> results_;
   
-  // 用于 cached statement, 目标未支持
-  Statement* CreateStatement(const char* query);
+  // Returns the cached statement of 'query', preparing it if needed.
+  Status GetCachedStatement(const std::string& query, Statement** statement);
+
+  // Prepares 'query' on the server. Virtual for tests.
+  virtual Status NewStatement(const std::string& query, std::unique_ptr<Statement>* statement);
+
+  Status ExecutePreparedBinds(const std::string& query, MYSQL_BIND* binds, size_t count);
+
+  // Returns IllegalState if a cursor is streaming rows from the connection.
+  Status CheckNoOpenCursor() const;
+
+  // Stops the query running on the connection, by a KILL QUERY sent from a
+  // new connection to the server. The connection itself stays open.
+  Status KillQuery();
 
   // 解析query, 并且把? 占位符, 使用LocalParameter对应的值来替换.
   Status Prepare(const std::string& query, LocalParameter* parameters, size_t count, std::string& result);
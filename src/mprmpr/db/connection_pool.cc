@@ -0,0 +1,274 @@
+#include "mprmpr/db/connection_pool.h"
+
+#include <algorithm>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "mprmpr/base/stl_util.h"
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/db/connection.h"
+
+METRIC_DEFINE_histogram(server, db_connection_lease_wait_time,
+                        "DB Connection Lease Wait Time",
+                        mprmpr::MetricUnit::kMicroseconds,
+                        "Number of microseconds spent waiting for a database "
+                        "connection from the pool, including the time to open "
+                        "or validate it.",
+                        60000000LU, 2);
+
+METRIC_DEFINE_gauge_int64(server, db_connections_leased,
+                          "DB Connections Leased",
+                          mprmpr::MetricUnit::kConnections,
+                          "Number of database connections currently leased "
+                          "from the pool.");
+
+METRIC_DEFINE_counter(server, db_connection_lease_timeouts,
+                      "DB Connection Lease Timeouts",
+                      mprmpr::MetricUnit::kRequests,
+                      "Number of times no database connection could be leased "
+                      "from the pool before the lease timeout.");
+
+METRIC_DEFINE_counter(server, db_connection_errors,
+                      "DB Connection Errors",
+                      mprmpr::MetricUnit::kConnections,
+                      "Number of pooled database connections which failed to "
+                      "open, failed validation or were returned as failed.");
+
+using strings::Substitute;
+
+namespace mprmpr {
+namespace db {
+
+ConnectionPoolOptions::ConnectionPoolOptions()
+    : min_connections(1),
+      max_connections(8),
+      lease_timeout(MonoDelta::FromSeconds(5)),
+      validation_interval(MonoDelta::FromSeconds(30)),
+      idle_timeout(MonoDelta::FromSeconds(300)) {
+}
+
+///
+PooledConnection::PooledConnection()
+    : pool_(nullptr),
+      connection_(nullptr),
+      failed_(false) {
+}
+
+PooledConnection::PooledConnection(ConnectionPool* pool, Connection* connection)
+    : pool_(pool),
+      connection_(connection),
+      failed_(false) {
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other)
+    : pool_(other.pool_),
+      connection_(other.connection_),
+      failed_(other.failed_) {
+  other.pool_ = nullptr;
+  other.connection_ = nullptr;
+  other.failed_ = false;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) {
+  if (this != &other) {
+    reset();
+    pool_ = other.pool_;
+    connection_ = other.connection_;
+    failed_ = other.failed_;
+    other.pool_ = nullptr;
+    other.connection_ = nullptr;
+    other.failed_ = false;
+  }
+  return *this;
+}
+
+PooledConnection::~PooledConnection() {
+  reset();
+}
+
+void PooledConnection::reset() {
+  if (connection_) {
+    pool_->Return(connection_, failed_);
+  }
+  pool_ = nullptr;
+  connection_ = nullptr;
+  failed_ = false;
+}
+
+///
+namespace {
+
+// Returns a factory opening connections with the parameters of 'builder'.
+ConnectionPool::ConnectionFactory BuilderFactory(const ConnectionBuilder& builder) {
+  std::string hostname = builder.hostname();
+  std::string username = builder.username();
+  std::string password = builder.password();
+  std::string database = builder.database();
+  uint64_t flags = builder.flags();
+  size_t statement_cache_capacity = builder.statement_cache_capacity();
+  return [hostname, username, password, database, flags,
+          statement_cache_capacity](std::unique_ptr<Connection>* conn) {
+    ConnectionBuilder b;
+    return b.set_hostname(hostname)
+            .set_username(username)
+            .set_password(password)
+            .set_database(database)
+            .set_flags(flags)
+            .set_statement_cache_capacity(statement_cache_capacity)
+            .Build(conn);
+  };
+}
+
+} // anonymous namespace
+
+ConnectionPool::ConnectionPool(const ConnectionBuilder& builder,
+                               ConnectionPoolOptions options,
+                               const scoped_refptr<MetricEntity>& metric_entity)
+    : ConnectionPool(BuilderFactory(builder), std::move(options), metric_entity) {
+}
+
+ConnectionPool::ConnectionPool(ConnectionFactory factory,
+                               ConnectionPoolOptions options,
+                               const scoped_refptr<MetricEntity>& metric_entity)
+    : factory_(std::move(factory)),
+      options_(std::move(options)),
+      returned_cond_(&lock_),
+      num_open_(0),
+      num_leased_(0),
+      lease_wait_time_(METRIC_db_connection_lease_wait_time.Instantiate(metric_entity)),
+      connections_leased_(METRIC_db_connections_leased.Instantiate(metric_entity, 0)),
+      lease_timeouts_(METRIC_db_connection_lease_timeouts.Instantiate(metric_entity)),
+      connection_errors_(METRIC_db_connection_errors.Instantiate(metric_entity)) {
+  CHECK_GE(options_.min_connections, 0);
+  CHECK_GE(options_.max_connections, std::max(options_.min_connections, 1));
+}
+
+ConnectionPool::~ConnectionPool() {
+  MutexLock l(lock_);
+  CHECK_EQ(0, num_leased_) << "connections are still leased from the pool";
+  for (const IdleConnection& idle : idle_) {
+    delete idle.connection;
+  }
+}
+
+Status ConnectionPool::Init() {
+  std::vector<PooledConnection> conns;
+  conns.reserve(options_.min_connections);
+  for (int i = 0; i < options_.min_connections; i++) {
+    conns.emplace_back();
+    RETURN_NOT_OK_PREPEND(Lease(&conns.back()),
+                          "Unable to open the initial connections of the pool");
+  }
+  return Status::OK();
+}
+
+Status ConnectionPool::Lease(PooledConnection* conn) {
+  MonoTime start = MonoTime::Now();
+  MonoTime deadline = start + options_.lease_timeout;
+  while (true) {
+    std::unique_ptr<Connection> connection;
+    MonoTime idle_since;
+    {
+      MutexLock l(lock_);
+      while (true) {
+        if (!idle_.empty()) {
+          connection.reset(idle_.back().connection);
+          idle_since = idle_.back().idle_since;
+          idle_.pop_back();
+          break;
+        }
+        if (num_open_ < options_.max_connections) {
+          num_open_++;
+          break;
+        }
+        MonoTime now = MonoTime::Now();
+        if (!now.ComesBefore(deadline)) {
+          lease_timeouts_->Increment();
+          return Status::TimedOut(Substitute(
+              "No database connection available after $0: $1 connections leased",
+              options_.lease_timeout.ToString(), num_leased_));
+        }
+        returned_cond_.TimedWait(deadline - now);
+      }
+    }
+
+    // Connect and validate outside of the lock: both are round trips to the
+    // server.
+    if (!connection) {
+      Status s = factory_(&connection);
+      if (!s.ok()) {
+        connection_errors_->Increment();
+        MutexLock l(lock_);
+        num_open_--;
+        returned_cond_.Signal();
+        return s.CloneAndPrepend("Unable to open a database connection");
+      }
+    } else if ((idle_since + options_.validation_interval).ComesBefore(MonoTime::Now())) {
+      Status s = connection->Ping();
+      if (!s.ok()) {
+        LOG(WARNING) << "Closing broken database connection: " << s.ToString();
+        connection_errors_->Increment();
+        connection.reset();
+        MutexLock l(lock_);
+        num_open_--;
+        continue;
+      }
+    }
+
+    {
+      MutexLock l(lock_);
+      num_leased_++;
+    }
+    connections_leased_->Increment();
+    lease_wait_time_->Increment((MonoTime::Now() - start).ToMicroseconds());
+    *conn = PooledConnection(this, connection.release());
+    return Status::OK();
+  }
+}
+
+void ConnectionPool::Return(Connection* connection, bool failed) {
+  std::vector<Connection*> to_close;
+  {
+    MutexLock l(lock_);
+    num_leased_--;
+    MonoTime now = MonoTime::Now();
+    if (failed) {
+      num_open_--;
+      to_close.push_back(connection);
+    } else {
+      idle_.push_back({ connection, now });
+    }
+    CloseExpiredUnlocked(now, &to_close);
+    returned_cond_.Signal();
+  }
+  connections_leased_->Decrement();
+  if (failed) {
+    connection_errors_->Increment();
+  }
+  STLDeleteElements(&to_close);
+}
+
+void ConnectionPool::CloseExpiredUnlocked(const MonoTime& now,
+                                          std::vector<Connection*>* to_close) {
+  lock_.AssertAcquired();
+  while (!idle_.empty() && num_open_ > options_.min_connections &&
+         (idle_.front().idle_since + options_.idle_timeout).ComesBefore(now)) {
+    to_close->push_back(idle_.front().connection);
+    idle_.pop_front();
+    num_open_--;
+  }
+}
+
+int ConnectionPool::num_open() const {
+  MutexLock l(lock_);
+  return num_open_;
+}
+
+int ConnectionPool::num_leased() const {
+  MutexLock l(lock_);
+  return num_leased_;
+}
+
+} // namespace db
+} // namespace mprmpr
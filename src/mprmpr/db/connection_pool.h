@@ -0,0 +1,168 @@
+#ifndef MPRMPR_DB_CONNECTION_POOL_H_
+#define MPRMPR_DB_CONNECTION_POOL_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/condition_variable.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+namespace db {
+
+class Connection;
+class ConnectionBuilder;
+class ConnectionPool;
+
+struct ConnectionPoolOptions {
+  ConnectionPoolOptions();
+
+  // Number of connections opened by Init() and kept open while idle.
+  // Default: 1.
+  int min_connections;
+
+  // Maximum number of connections open at a time, leased or idle.
+  // Default: 8.
+  int max_connections;
+
+  // How long Lease() waits for a connection when all of them are leased.
+  // Default: 5 seconds.
+  MonoDelta lease_timeout;
+
+  // Idle connections that have not been used for this long are checked with
+  // mysql_ping before being leased. Default: 30 seconds.
+  MonoDelta validation_interval;
+
+  // Idle connections above 'min_connections' that have not been used for this
+  // long are closed. Default: 5 minutes.
+  MonoDelta idle_timeout;
+};
+
+// A connection leased from a ConnectionPool, returned to the pool when the
+// lease is destroyed or reset.
+//
+// If the connection may be left in an unusable state, e.g. after a failed
+// query in the middle of a transaction, call set_failed() so that the pool
+// closes it instead of leasing it again.
+class PooledConnection {
+ public:
+  PooledConnection();
+  PooledConnection(PooledConnection&& other);
+  PooledConnection& operator=(PooledConnection&& other);
+  ~PooledConnection();
+
+  // Returns the connection to the pool, if any.
+  void reset();
+
+  Connection* get() const { return connection_; }
+  Connection* operator->() const { return connection_; }
+  Connection& operator*() const { return *connection_; }
+  explicit operator bool() const { return connection_ != nullptr; }
+
+  void set_failed() { failed_ = true; }
+
+ private:
+  friend class ConnectionPool;
+
+  PooledConnection(ConnectionPool* pool, Connection* connection);
+
+  ConnectionPool* pool_;
+  Connection* connection_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(PooledConnection);
+};
+
+// A thread-safe pool of MySQL connections.
+//
+// A db::Connection must not be used by several threads at a time. Instead of
+// serializing on a single connection, or connecting for each request, threads
+// lease a connection from the pool for the duration of their work:
+//
+//   PooledConnection conn;
+//   RETURN_NOT_OK(pool->Lease(&conn));
+//   RETURN_NOT_OK(conn->Query("UPDATE ..."));
+//
+// Connections are opened on demand, up to 'max_connections'. The most recently
+// used idle connection is leased first, so that the surplus ones age out after
+// 'idle_timeout'. Connections which have been idle for a while are validated
+// with mysql_ping before being leased, and replaced if they are broken.
+//
+// Leases must be returned before the pool is destroyed.
+class ConnectionPool {
+ public:
+  // Opens a new connection into its argument.
+  typedef std::function<Status(std::unique_ptr<Connection>*)> ConnectionFactory;
+
+  // Creates a pool of connections opened with the parameters of 'builder'.
+  ConnectionPool(const ConnectionBuilder& builder,
+                 ConnectionPoolOptions options,
+                 const scoped_refptr<MetricEntity>& metric_entity);
+
+  ConnectionPool(ConnectionFactory factory,
+                 ConnectionPoolOptions options,
+                 const scoped_refptr<MetricEntity>& metric_entity);
+
+  ~ConnectionPool();
+
+  // Opens 'min_connections' connections.
+  Status Init();
+
+  // Leases a connection into 'conn', waiting up to 'lease_timeout' for one to
+  // be returned if all of them are leased. Returns TimedOut if none was
+  // returned in time, or the error opening a new connection.
+  Status Lease(PooledConnection* conn);
+
+  // The number of connections open, leased or idle.
+  int num_open() const;
+
+  // The number of connections currently leased.
+  int num_leased() const;
+
+ private:
+  friend class PooledConnection;
+
+  struct IdleConnection {
+    Connection* connection;
+    MonoTime idle_since;
+  };
+
+  // Called when a lease is destroyed. If 'failed', the connection is closed.
+  void Return(Connection* connection, bool failed);
+
+  // Closes the connections idle for longer than 'idle_timeout', keeping at
+  // least 'min_connections' open. Requires 'lock_'.
+  void CloseExpiredUnlocked(const MonoTime& now,
+                            std::vector<Connection*>* to_close);
+
+  const ConnectionFactory factory_;
+  const ConnectionPoolOptions options_;
+
+  mutable Mutex lock_;
+  ConditionVariable returned_cond_;
+
+  // Idle connections, the least recently used first.
+  std::deque<IdleConnection> idle_;
+
+  // The number of connections open or being opened.
+  int num_open_;
+  int num_leased_;
+
+  scoped_refptr<Histogram> lease_wait_time_;
+  scoped_refptr<AtomicGauge<int64_t>> connections_leased_;
+  scoped_refptr<Counter> lease_timeouts_;
+  scoped_refptr<Counter> connection_errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConnectionPool);
+};
+
+} // namespace db
+} // namespace mprmpr
+#endif // MPRMPR_DB_CONNECTION_POOL_H_
@@ -0,0 +1,157 @@
+#include "mprmpr/db/cursor.h"
+
+#include <glog/logging.h>
+
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/query_result_field.h"
+#include "mprmpr/db/result_impl.h"
+
+namespace mprmpr {
+namespace db {
+
+// The row buffer of a cursor: a single row of fields, pointed at the values
+// of each row as it is read.
+class CursorResultImpl : public ResultImpl {
+ public:
+  explicit CursorResultImpl(MYSQL_RES* result) {
+    auto size = ::mysql_num_fields(result);
+    row_.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+      auto field = ::mysql_fetch_field_direct(result, i);
+      fields_[std::string(field->name, field->name_length)] = i;
+      row_.emplace_back(new QueryResultField(nullptr, 0));
+    }
+  }
+
+  virtual ~CursorResultImpl() {}
+
+  const std::map<std::string, size_t>& Fields() const override {
+    return fields_;
+  }
+
+  size_t size() const override {
+    return 1;
+  }
+
+  const std::vector<std::unique_ptr<ResultFieldImpl>>& Fetch(size_t index) override {
+    DCHECK_EQ(0, index);
+    return row_;
+  }
+
+  void SetRow(MYSQL_ROW row, const unsigned long* lengths) {
+    for (size_t i = 0; i < row_.size(); ++i) {
+      static_cast<QueryResultField*>(row_[i].get())->Reset(row[i], lengths[i]);
+    }
+  }
+
+ private:
+  std::map<std::string, size_t> fields_;
+  std::vector<std::unique_ptr<ResultFieldImpl>> row_;
+};
+
+namespace {
+
+// Skips the remaining result sets of a multiple-statement query.
+void DiscardMoreResults(MYSQL* mysql) {
+  while (::mysql_next_result(mysql) == 0) {
+    MYSQL_RES* result = ::mysql_use_result(mysql);
+    if (result) {
+      ::mysql_free_result(result);
+    }
+  }
+}
+
+} // anonymous namespace
+
+Cursor::Cursor()
+    : connection_(nullptr),
+      result_(nullptr),
+      rows_read_(0) {
+}
+
+Cursor::~Cursor() {
+  Close();
+}
+
+Status Cursor::Open(Connection* connection) {
+  DCHECK(!is_open());
+  connection_ = connection;
+  impl_.reset();
+  status_ = Status::OK();
+  rows_read_ = 0;
+
+  MYSQL* mysql = connection_->connection_;
+  // MYSQL_RES* mysql_use_result(MYSQL* mysql):
+  //  Initiates a result set retrieval but does not actually read the result set
+  //  into the client like mysql_store_result() does. Each row must be retrieved
+  //  with mysql_fetch_row(), until it returns NULL.
+  result_ = ::mysql_use_result(mysql);
+  if (result_ == nullptr) {
+    if (::mysql_field_count(mysql)) {
+      status_ = Status::RuntimeError(::mysql_error(mysql));
+      return status_;
+    }
+    // The statement did not return rows, e.g. an UPDATE.
+    DiscardMoreResults(mysql);
+    return Status::OK();
+  }
+
+  impl_ = std::make_shared<CursorResultImpl>(result_);
+  connection_->cursor_ = this;
+  return Status::OK();
+}
+
+bool Cursor::Next() {
+  if (!is_open()) {
+    return false;
+  }
+  MYSQL_ROW row = ::mysql_fetch_row(result_);
+  if (row == nullptr) {
+    MYSQL* mysql = connection_->connection_;
+    if (::mysql_errno(mysql)) {
+      status_ = Status::RuntimeError(::mysql_error(mysql));
+    }
+    Close();
+    return false;
+  }
+  impl_->SetRow(row, ::mysql_fetch_lengths(result_));
+  rows_read_++;
+  return true;
+}
+
+ResultRow Cursor::row() const {
+  DCHECK(is_open());
+  return ResultRow(impl_, impl_->Fetch(0));
+}
+
+const std::map<std::string, size_t>& Cursor::fields() const {
+  static const std::map<std::string, size_t> kNoFields;
+  return impl_ ? impl_->Fields() : kNoFields;
+}
+
+void Cursor::Close() {
+  if (!is_open()) {
+    return;
+  }
+  // Rows left are read and discarded by mysql_free_result(). Past a few, the
+  // server is asked to stop sending them: it then ends the result early, with
+  // an error.
+  bool ended = false;
+  for (size_t i = 0; i < kMaxSkippedRows && !ended; ++i) {
+    ended = ::mysql_fetch_row(result_) == nullptr;
+  }
+  if (!ended) {
+    Status s = connection_->KillQuery();
+    if (!s.ok()) {
+      LOG(WARNING) << "Unable to stop the query of a closed cursor, skipping its rows: "
+                   << s.ToString();
+    }
+  }
+  ::mysql_free_result(result_);
+  result_ = nullptr;
+  DiscardMoreResults(connection_->connection_);
+  connection_->cursor_ = nullptr;
+}
+
+} // namespace db
+} // namespace mprmpr
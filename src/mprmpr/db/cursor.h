@@ -0,0 +1,91 @@
+#ifndef MPRMPR_DB_CURSOR_H_
+#define MPRMPR_DB_CURSOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <mysql/mysql.h>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/db/result_row.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+namespace db {
+
+class Connection;
+class CursorResultImpl;
+
+// Streams the rows of a query one at a time, instead of buffering the whole
+// result set in memory like Result does. Use it for scans whose results may
+// not fit in memory, e.g. of the job history:
+//
+//   Cursor cursor;
+//   RETURN_NOT_OK(conn->OpenCursor("SELECT id, state FROM jobs", &cursor));
+//   while (cursor.Next()) {
+//     ResultRow row = cursor.row();
+//     ...
+//   }
+//   RETURN_NOT_OK(cursor.status());
+//
+// Rows are read from the server as Next() is called (see mysql_use_result),
+// into a single row buffer: the fields of a row are only valid until the next
+// call to Next() or Close().
+//
+// The connection cannot run other queries while the cursor is open. The
+// cursor is closed once all rows have been read, or by Close() to stop early.
+// Close() skips a few remaining rows, and kills the query beyond that rather
+// than receive the rest of the result. Still, add a LIMIT to the query when
+// only the first rows are needed.
+//
+// The server keeps the query open until the rows are read, so that they
+// should be consumed without blocking for long.
+class Cursor {
+ public:
+  Cursor();
+  ~Cursor();
+
+  // Reads the next row. Returns false after the last row, or if an error
+  // occurred (see status()).
+  bool Next();
+
+  // The current row, valid until the next call to Next() or Close().
+  ResultRow row() const;
+
+  // The columns of the rows, by name.
+  const std::map<std::string, size_t>& fields() const;
+
+  // Stops the scan and releases the connection. Up to kMaxSkippedRows rows
+  // left are read and discarded; if there are more, the query is killed (see
+  // Connection::KillQuery()). No-op if the cursor is closed.
+  void Close();
+
+  static const size_t kMaxSkippedRows = 1000;
+
+  bool is_open() const { return result_ != nullptr; }
+
+  // The error which ended the scan, if any.
+  const Status& status() const { return status_; }
+
+  // The number of rows read so far.
+  size_t rows_read() const { return rows_read_; }
+
+ private:
+  friend class Connection;
+
+  // Starts streaming the result of the last query run on 'connection'.
+  Status Open(Connection* connection);
+
+  Connection* connection_;
+  MYSQL_RES* result_;
+  std::shared_ptr<CursorResultImpl> impl_;
+  Status status_;
+  size_t rows_read_;
+
+  DISALLOW_COPY_AND_ASSIGN(Cursor);
+};
+
+} // namespace db
+} // namespace mprmpr
+#endif // MPRMPR_DB_CURSOR_H_
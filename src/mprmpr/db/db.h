@@ -8,9 +8,12 @@
 #include "mprmpr/db/result_field.h"
 #include "mprmpr/db/result_row.h"
 #include "mprmpr/db/result.h"
+#include "mprmpr/db/result_view.h"
 #include "mprmpr/db/parameter.h"
 #include "mprmpr/db/local_parameter.h"
+#include "mprmpr/db/batch_writer.h"
 #include "mprmpr/db/connection.h"
+#include "mprmpr/db/cursor.h"
 #include "mprmpr/db/statement.h"
 
 #endif // MPRMPR_DB_DB_H_
@@ -19,12 +19,12 @@ LocalParameter::LocalParameter(double v)    : value_(std::to_string(v)), integra
 LocalParameter::LocalParameter(const std::string& v)
     : value_(v),
       integral_(false),
-      buffer_(static_cast<char*>(std::malloc(size()))) {}
+      buffer_(static_cast<char*>(std::malloc(size() + 1))) {}
 
 LocalParameter::LocalParameter(const char* v)
     : value_(v),
       integral_(false),
-      buffer_(static_cast<char*>(std::malloc(size()))) {}
+      buffer_(static_cast<char*>(std::malloc(size() + 1))) {}
 
 LocalParameter::LocalParameter(std::nullptr_t v)
     : value_("NULL"),
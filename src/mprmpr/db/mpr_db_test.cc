@@ -54,6 +54,47 @@ int main() {
   s = statement.Execute("002", "lwz");
   DCHECK(s.ok()) << "Query: " << s.ToString();
 
+  // Cached prepared statements
+  for (int i = 3; i < 10; ++i) {
+    std::string id = "00" + std::to_string(i);
+    s = conn->ExecutePrepared("INSERT INTO account (id, name, registered_at) VALUES (?, ?, NOW())",
+                              id, "cached");
+    DCHECK(s.ok()) << "ExecutePrepared: " << s.ToString();
+  }
+  DCHECK_EQ(1, conn->num_cached_statements());
+  s = conn->ExecutePrepared("SELECT * FROM account WHERE id = ?", "005");
+  DCHECK(s.ok()) << "ExecutePrepared: " << s.ToString();
+  PrintResults(conn->GetResults());
+
+  {
+    mprmpr::db::Cursor cursor;
+    s = conn->OpenCursor("SELECT * FROM account", &cursor);
+    DCHECK(s.ok()) << "OpenCursor: " << s.ToString();
+    while (cursor.Next()) {
+      for (auto field : cursor.row()) {
+        std::cout << " " << field.first << " => " << field.second << std::endl;
+      }
+      std::cout << std::endl;
+    }
+    DCHECK(cursor.status().ok()) << "Cursor: " << cursor.status().ToString();
+  }
+
+  // Close before the end: the query is killed rather than read to the end,
+  // and the connection can still be used.
+  {
+    mprmpr::db::Cursor cursor;
+    s = conn->OpenCursor("SELECT a.id FROM account a, account b, account c, account d, "
+                         "account e, account f, account g", &cursor);
+    DCHECK(s.ok()) << "OpenCursor: " << s.ToString();
+    bool has_row = cursor.Next();
+    DCHECK(has_row);
+    cursor.Close();
+    DCHECK(!cursor.is_open());
+    DCHECK_EQ(1, cursor.rows_read());
+    s = conn->Query("SELECT COUNT(*) FROM account");
+    DCHECK(s.ok()) << "Query after closed cursor: " << s.ToString();
+  }
+
   //sleep(10);
 
   s = conn->Query("SELECT * FROM account");  
@@ -2,11 +2,14 @@
 #define MPRMPR_DB_PARAMETER_H_
 
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <cstring>
 
 #include <mysql/mysql.h>
 
+#include "mprmpr/util/slice.h"
+
 namespace mprmpr {
 namespace db {
 
@@ -84,6 +87,67 @@ class Parameter : public MYSQL_BIND {
   }
 };
 
+// Binds a statement parameter to a value in place, in binary form: the value
+// is neither copied, quoted nor escaped, and must outlive the execution of
+// the statement. 'bind' must be zeroed.
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value>::type
+BindParameter(MYSQL_BIND* bind, const T& value) {
+  static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+                "unsupported integral parameter");
+  switch (sizeof(T)) {
+    case 1: bind->buffer_type = MYSQL_TYPE_TINY; break;
+    case 2: bind->buffer_type = MYSQL_TYPE_SHORT; break;
+    case 4: bind->buffer_type = MYSQL_TYPE_LONG; break;
+    case 8: bind->buffer_type = MYSQL_TYPE_LONGLONG; break;
+  }
+  bind->is_unsigned = std::is_unsigned<T>::value;
+  bind->buffer = const_cast<T*>(&value);
+}
+
+inline void BindParameter(MYSQL_BIND* bind, const float& value) {
+  bind->buffer_type = MYSQL_TYPE_FLOAT;
+  bind->buffer = const_cast<float*>(&value);
+}
+
+inline void BindParameter(MYSQL_BIND* bind, const double& value) {
+  bind->buffer_type = MYSQL_TYPE_DOUBLE;
+  bind->buffer = const_cast<double*>(&value);
+}
+
+inline void BindParameter(MYSQL_BIND* bind, const std::string& value) {
+  bind->buffer_type = MYSQL_TYPE_STRING;
+  bind->buffer = const_cast<char*>(value.data());
+  bind->buffer_length = value.size();
+}
+
+inline void BindParameter(MYSQL_BIND* bind, const char* value) {
+  bind->buffer_type = MYSQL_TYPE_STRING;
+  bind->buffer = const_cast<char*>(value);
+  bind->buffer_length = std::strlen(value);
+}
+
+// Binary data, e.g. a serialized protobuf.
+inline void BindParameter(MYSQL_BIND* bind, const Slice& value) {
+  bind->buffer_type = MYSQL_TYPE_BLOB;
+  bind->buffer = const_cast<uint8_t*>(value.data());
+  bind->buffer_length = value.size();
+}
+
+inline void BindParameter(MYSQL_BIND* bind, std::nullptr_t value) {
+  bind->buffer_type = MYSQL_TYPE_NULL;
+}
+
+inline void BindParameters(MYSQL_BIND* binds) {
+}
+
+// Binds 'binds[i]' to the i-th value. See BindParameter().
+template<typename T, typename... Args>
+void BindParameters(MYSQL_BIND* binds, const T& value, const Args&... args) {
+  BindParameter(binds, value);
+  BindParameters(binds + 1, args...);
+}
+
 } // namespace db
 } // namespace mprmpr
 #endif // MPRMPR_DB_PARAMETER_H_
@@ -13,6 +13,12 @@ class QueryResultField : public ResultFieldImpl {
 
   QueryResultField(const char* data, size_t length) : data_(data), length_(length) {}
 
+  // Points the field at the value of another row.
+  void Reset(const char* data, size_t length) {
+    data_ = data;
+    length_ = length;
+  }
+
   virtual bool IsNULL() const override {
     return data_ == nullptr;
   }
@@ -39,6 +45,10 @@ class QueryResultField : public ResultFieldImpl {
     return std::tm{};
   }   
 
+  virtual Slice ToSlice() const override {
+    return IsNULL() ? Slice() : Slice(data_, length_);
+  }
+
  private:
   const char* data_;
   size_t length_;
@@ -33,5 +33,32 @@ const std::vector<std::unique_ptr<ResultFieldImpl>>& QueryResultImpl::Fetch(size
   return rows_[index];
 }
 
+bool QueryResultImpl::GetTextCells(std::vector<Slice>* cells, std::vector<uint8_t>* nulls) {
+  const size_t num_fields = fields_.size();
+  cells->clear();
+  nulls->clear();
+  cells->reserve(size() * num_fields);
+  nulls->reserve(size() * num_fields);
+
+  // The rows stay in the buffers of the result until it is freed: only the
+  // lengths are overwritten by each mysql_fetch_row().
+  ::mysql_data_seek(result_, 0);
+  for (size_t i = 0; i < size(); ++i) {
+    auto row = ::mysql_fetch_row(result_);
+    auto lens = ::mysql_fetch_lengths(result_);
+    for (size_t j = 0; j < num_fields; ++j) {
+      if (row[j] == nullptr) {
+        cells->emplace_back();
+        nulls->push_back(1);
+      } else {
+        cells->emplace_back(row[j], lens[j]);
+        nulls->push_back(0);
+      }
+    }
+  }
+  position_ = size();
+  return true;
+}
+
 } // namespace db
 } // namespace mprmpr
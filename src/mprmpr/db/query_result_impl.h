@@ -30,6 +30,7 @@ class QueryResultImpl : public ResultImpl {
   const std::map<std::string, size_t>& Fields() const override;
   size_t size() const override;
   const std::vector<std::unique_ptr<ResultFieldImpl>>& Fetch(size_t index) override;
+  bool GetTextCells(std::vector<Slice>* cells, std::vector<uint8_t>* nulls) override;
 
  private:
   MYSQL_RES* result_;
@@ -6,20 +6,27 @@ namespace mprmpr {
 namespace db {
 
 Result::Result(MYSQL_RES* result)
-    : result_(std::make_shared<QueryResultImpl>(result)) {}
+    : result_(std::make_shared<QueryResultImpl>(result)),
+      affected_rows_(0),
+      insert_id_(0) {}
 
 Result::Result(std::shared_ptr<ResultImpl>&& impl)
-    : result_(std::move(impl)) {}
+    : result_(std::move(impl)),
+      affected_rows_(0),
+      insert_id_(0) {}
 
 Result::Result(size_t affected_rows, uint64_t insert_id)
     : affected_rows_(affected_rows),
       insert_id_(insert_id) {}
 
-Result::Result(std::nullptr_t result) {}
+Result::Result(std::nullptr_t result)
+    : affected_rows_(0),
+      insert_id_(0) {}
 
 Result::Result(Result&& other)
     : result_(std::move(other.result_)),
-      affected_rows_(other.affected_rows_) {}
+      affected_rows_(other.affected_rows_),
+      insert_id_(other.insert_id_) {}
 
 Result::~Result() {}
 
@@ -31,6 +38,10 @@ size_t Result::affected_rows() const {
   return affected_rows_;
 }
 
+uint64_t Result::insert_id() const {
+  return insert_id_;
+}
+
 Result::Iterator Result::begin() const {
   return Iterator(result_, 0);
 }
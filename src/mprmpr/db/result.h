@@ -8,6 +8,7 @@
 
 #include "mprmpr/base/macros.h"
 #include "mprmpr/db/result_row.h"
+#include "mprmpr/db/result_view.h"
 
 namespace mprmpr {
 namespace db {
@@ -80,7 +81,21 @@ class Result {
   Iterator begin() const;
   Iterator end() const;
 
+  // Decodes every row into a tuple of its first sizeof...(Ts) columns, without
+  // creating the fields of the rows, e.g.:
+  //
+  //   std::vector<std::tuple<int64_t, Slice, uint32_t>> rows;
+  //   RETURN_NOT_OK(result->As(&rows));
+  //
+  // The Slices point into the result. See ResultView.
+  template<typename... Ts>
+  Status As(std::vector<std::tuple<Ts...>>* rows) const {
+    return ResultView(*this).As(rows);
+  }
+
  private:
+  friend class ResultView;
+
   std::shared_ptr<ResultImpl> result_;
   size_t affected_rows_;
   uint64_t insert_id_;
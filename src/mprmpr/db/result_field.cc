@@ -28,6 +28,8 @@ ResultField::operator uint128() const { return *field_; }
 ResultField::operator std::string() const { return *field_; }
 ResultField::operator std::tm() const { return *field_; }
 
+Slice ResultField::ToSlice() const { return IsNULL() ? Slice() : field_->ToSlice(); }
+
 std::ostream& operator<<(std::ostream& stream, const ResultField& field) {
   if (field.IsNULL()) {
     return stream << "(NULL)";
@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "mprmpr/base/int128.h"
+#include "mprmpr/util/slice.h"
 
 namespace mprmpr {
 namespace db {
@@ -34,6 +35,10 @@ class ResultField {
 
   operator std::string() const;
   operator std::tm() const;
+
+  // The value in the result buffers, without copying it. See
+  // ResultFieldImpl::ToSlice().
+  Slice ToSlice() const;
   
  private:
   std::shared_ptr<ResultImpl> result_;
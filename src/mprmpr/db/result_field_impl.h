@@ -6,6 +6,7 @@
 #include <string>
 
 #include "mprmpr/base/int128.h"
+#include "mprmpr/util/slice.h"
 
 namespace mprmpr {
 namespace db {
@@ -29,6 +30,12 @@ class ResultFieldImpl {
 
   virtual operator std::string() const = 0;
   virtual operator std::tm() const = 0;
+
+  // The value as stored in the result buffers, without copying it: the text
+  // of the value for the results of Connection::Query(), and for the string
+  // columns of prepared statements. Other columns of prepared statements are
+  // returned in their native binary form. Empty if NULL.
+  virtual Slice ToSlice() const = 0;
 };
 
 } // namespace db
@@ -5,6 +5,7 @@
 #include <map>
 
 #include "mprmpr/db/result_field_impl.h"
+#include "mprmpr/util/slice.h"
 
 namespace mprmpr {
 namespace db {
@@ -15,6 +16,14 @@ class ResultImpl {
   virtual size_t size() const = 0;
   virtual const std::vector<std::unique_ptr<ResultFieldImpl>>& Fetch(size_t index) = 0;
 
+  // Points 'cells' at the text values of all the rows, row after row, without
+  // creating the fields of the rows, and sets the matching entries of 'nulls'
+  // to 1 for NULL values. Returns false if the values are not text, e.g. the
+  // binary values of a prepared statement. See ResultView.
+  virtual bool GetTextCells(std::vector<Slice>* cells, std::vector<uint8_t>* nulls) {
+    return false;
+  }
+
   virtual ~ResultImpl() {};
 };
 
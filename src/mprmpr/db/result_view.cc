@@ -0,0 +1,123 @@
+#include "mprmpr/db/result_view.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mprmpr/db/result.h"
+#include "mprmpr/db/result_impl.h"
+
+namespace mprmpr {
+namespace db {
+
+namespace internal {
+
+namespace {
+
+// Parses the decimal digits of an integer, with an optional sign. MySQL
+// sends integers without spaces nor exponent.
+Status ParseDecimal(const Slice& text, bool* negative, uint64_t* magnitude) {
+  const uint8_t* p = text.data();
+  const uint8_t* end = p + text.size();
+  *negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    *negative = *p == '-';
+    ++p;
+  }
+  if (p == end) {
+    return Status::InvalidArgument("invalid integer", text.ToDebugString());
+  }
+  uint64_t value = 0;
+  for (; p != end; ++p) {
+    uint32_t digit = *p - '0';
+    if (digit > 9) {
+      return Status::InvalidArgument("invalid integer", text.ToDebugString());
+    }
+    if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+      return Status::InvalidArgument("integer out of range", text.ToDebugString());
+    }
+    value = value * 10 + digit;
+  }
+  *magnitude = value;
+  return Status::OK();
+}
+
+} // anonymous namespace
+
+Status ParseText(const Slice& text, int64_t* value) {
+  bool negative;
+  uint64_t magnitude;
+  RETURN_NOT_OK(ParseDecimal(text, &negative, &magnitude));
+  const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+  if (magnitude > limit + negative) {
+    return Status::InvalidArgument("integer out of range", text.ToDebugString());
+  }
+  *value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+  return Status::OK();
+}
+
+Status ParseText(const Slice& text, uint64_t* value) {
+  bool negative;
+  RETURN_NOT_OK(ParseDecimal(text, &negative, value));
+  if (negative && *value != 0) {
+    return Status::InvalidArgument("integer out of range", text.ToDebugString());
+  }
+  return Status::OK();
+}
+
+Status ParseText(const Slice& text, double* value) {
+  // strtod() needs a NUL-terminated string.
+  char buf[64];
+  if (text.empty() || text.size() >= sizeof(buf)) {
+    return Status::InvalidArgument("invalid number", text.ToDebugString());
+  }
+  memcpy(buf, text.data(), text.size());
+  buf[text.size()] = '\0';
+  char* end;
+  *value = strtod(buf, &end);
+  if (end != buf + text.size()) {
+    return Status::InvalidArgument("invalid number", text.ToDebugString());
+  }
+  return Status::OK();
+}
+
+} // namespace internal
+
+ResultView::ResultView(const Result& result)
+    : impl_(result.result_),
+      num_rows_(impl_ ? impl_->size() : 0),
+      num_columns_(impl_ ? impl_->Fields().size() : 0),
+      text_(false) {
+  if (impl_) {
+    text_ = impl_->GetTextCells(&cells_, &nulls_);
+  }
+}
+
+ResultView::~ResultView() {
+}
+
+Status ResultView::FindColumn(const std::string& name, size_t* column) const {
+  if (impl_) {
+    auto it = impl_->Fields().find(name);
+    if (it != impl_->Fields().end()) {
+      *column = it->second;
+      return Status::OK();
+    }
+  }
+  return Status::NotFound("no such column", name);
+}
+
+bool ResultView::IsNULL(size_t row, size_t column) const {
+  DCHECK_LT(row, num_rows_);
+  DCHECK_LT(column, num_columns_);
+  if (text_) {
+    return nulls_[row * num_columns_ + column];
+  }
+  return field(row, column)->IsNULL();
+}
+
+const ResultFieldImpl* ResultView::field(size_t row, size_t column) const {
+  return impl_->Fetch(row)[column].get();
+}
+
+} // namespace db
+} // namespace mprmpr
@@ -0,0 +1,271 @@
+#ifndef MPRMPR_DB_RESULT_VIEW_H_
+#define MPRMPR_DB_RESULT_VIEW_H_
+
+#include <stdint.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/port.h"
+#include "mprmpr/db/result_field_impl.h"
+#include "mprmpr/util/slice.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+namespace db {
+
+class Result;
+class ResultImpl;
+
+// A column of numbers decoded by ResultView::GetColumn(), stored contiguously.
+template<typename T>
+class ColumnSpan {
+ public:
+  ColumnSpan() : data_(nullptr), size_(0) {}
+  ColumnSpan(const T* data, size_t size) : data_(data), size_(size) {}
+
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  const T& operator[](size_t index) const {
+    DCHECK_LT(index, size_);
+    return data_[index];
+  }
+
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+ private:
+  const T* data_;
+  size_t size_;
+};
+
+namespace internal {
+
+// 把mysql 返回的文本值解析为 'value'.
+Status ParseText(const Slice& text, int64_t* value);
+Status ParseText(const Slice& text, uint64_t* value);
+Status ParseText(const Slice& text, double* value);
+
+inline Status ParseText(const Slice& text, float* value) {
+  double d;
+  RETURN_NOT_OK(ParseText(text, &d));
+  *value = static_cast<float>(d);
+  return Status::OK();
+}
+
+inline Status ParseText(const Slice& text, Slice* value) {
+  *value = text;
+  return Status::OK();
+}
+
+inline Status ParseText(const Slice& text, std::string* value) {
+  value->assign(reinterpret_cast<const char*>(text.data()), text.size());
+  return Status::OK();
+}
+
+// The other integral types are parsed as 64-bit integers, then range-checked.
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, Status>::type
+ParseText(const Slice& text, T* value) {
+  typedef typename std::conditional<std::is_signed<T>::value,
+                                    int64_t, uint64_t>::type Wide;
+  Wide wide;
+  RETURN_NOT_OK(ParseText(text, &wide));
+  if (wide < std::numeric_limits<T>::min() || wide > std::numeric_limits<T>::max()) {
+    return Status::InvalidArgument("integer out of range", text.ToDebugString());
+  }
+  *value = static_cast<T>(wide);
+  return Status::OK();
+}
+
+// The values of prepared statements are converted by their fields.
+template<typename T>
+typename std::enable_if<std::is_arithmetic<T>::value, Status>::type
+FieldValue(const ResultFieldImpl& field, T* value) {
+  typedef typename std::conditional<
+      std::is_floating_point<T>::value, double,
+      typename std::conditional<std::is_signed<T>::value,
+                                int64_t, uint64_t>::type>::type Wide;
+  *value = static_cast<T>(static_cast<Wide>(field));
+  return Status::OK();
+}
+
+inline Status FieldValue(const ResultFieldImpl& field, Slice* value) {
+  *value = field.ToSlice();
+  return Status::OK();
+}
+
+inline Status FieldValue(const ResultFieldImpl& field, std::string* value) {
+  *value = static_cast<std::string>(field);
+  return Status::OK();
+}
+
+} // namespace internal
+
+// A typed, column-oriented view of a Result, for decoding large results.
+//
+// Looking up values through ResultRow is convenient but slow: each row
+// creates one field object per value, each lookup by name searches a map, and
+// strings are copied out. Instead, a view resolves the column indices once and
+// points at the values in the buffers of the result, so that decoding a row
+// costs little more than copying it:
+//
+//   ResultView view(*result);
+//   size_t id_column;
+//   RETURN_NOT_OK(view.FindColumn("id", &id_column));
+//   ColumnSpan<int64_t> ids;
+//   RETURN_NOT_OK(view.GetColumn(id_column, &ids));
+//
+// Or, to decode whole rows by position:
+//
+//   std::vector<std::tuple<int64_t, Slice, uint32_t>> rows;
+//   RETURN_NOT_OK(result->As(&rows));
+//
+// The text values of Connection::Query() results are parsed from the MySQL
+// row buffers. The values of prepared statements are already decoded by
+// MySQL, and are converted by their fields. Strings are returned as Slices
+// into the result: the result must outlive the view and the Slices.
+//
+// NULL values are returned as 0 or as empty strings; see IsNULL().
+class ResultView {
+ public:
+  explicit ResultView(const Result& result);
+  ~ResultView();
+
+  size_t num_rows() const { return num_rows_; }
+  size_t num_columns() const { return num_columns_; }
+
+  // Looks up the index of the column 'name'. Returns NotFound if there is
+  // no such column.
+  Status FindColumn(const std::string& name, size_t* column) const;
+
+  bool IsNULL(size_t row, size_t column) const;
+
+  // Decodes the value of 'column' in 'row' into 'value', which may be a
+  // number, a Slice or a std::string. Returns InvalidArgument if the text of
+  // the value is not a number of type T.
+  template<typename T>
+  Status Get(size_t row, size_t column, T* value) const {
+    DCHECK_LT(row, num_rows_);
+    DCHECK_LT(column, num_columns_);
+    Status s;
+    if (text_) {
+      size_t cell = row * num_columns_ + column;
+      if (nulls_[cell]) {
+        *value = T();
+        return Status::OK();
+      }
+      s = internal::ParseText(cells_[cell], value);
+    } else {
+      s = internal::FieldValue(*field(row, column), value);
+    }
+    if (PREDICT_FALSE(!s.ok())) {
+      return s.CloneAndPrepend("row " + std::to_string(row) +
+                               ", column " + std::to_string(column));
+    }
+    return Status::OK();
+  }
+
+  // Decodes the numeric 'column' of all rows into an array owned by the view,
+  // and points 'span' at it. The column is decoded on the first call only.
+  template<typename T>
+  Status GetColumn(size_t column, ColumnSpan<T>* span) {
+    static_assert(std::is_arithmetic<T>::value, "only numeric columns can be spanned");
+    DCHECK_LT(column, num_columns_);
+    std::unique_ptr<DecodedColumn>& decoded = columns_[column];
+    if (!decoded) {
+      std::unique_ptr<TypedColumn<T>> typed(new TypedColumn<T>());
+      typed->values.resize(num_rows_);
+      for (size_t row = 0; row < num_rows_; ++row) {
+        RETURN_NOT_OK(Get(row, column, &typed->values[row]));
+      }
+      decoded = std::move(typed);
+    }
+    auto typed = dynamic_cast<TypedColumn<T>*>(decoded.get());
+    if (typed == nullptr) {
+      return Status::InvalidArgument("column already decoded as another type",
+                                     std::to_string(column));
+    }
+    *span = ColumnSpan<T>(typed->values.data(), typed->values.size());
+    return Status::OK();
+  }
+
+  // Decodes every row into a tuple of its first sizeof...(Ts) columns.
+  template<typename... Ts>
+  Status As(std::vector<std::tuple<Ts...>>* rows) const;
+
+ private:
+  struct DecodedColumn {
+    virtual ~DecodedColumn() {}
+  };
+
+  template<typename T>
+  struct TypedColumn : public DecodedColumn {
+    std::vector<T> values;
+  };
+
+  const ResultFieldImpl* field(size_t row, size_t column) const;
+
+  std::shared_ptr<ResultImpl> impl_;
+  size_t num_rows_;
+  size_t num_columns_;
+
+  // Whether the values are text, in which case they are pointed at by
+  // 'cells_', row after row.
+  bool text_;
+  std::vector<Slice> cells_;
+  std::vector<uint8_t> nulls_;
+
+  // Columns decoded by GetColumn(), by index.
+  std::map<size_t, std::unique_ptr<DecodedColumn>> columns_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResultView);
+};
+
+namespace internal {
+
+// Decodes the first N columns of a row into a tuple.
+template<size_t N, typename Tuple>
+struct TupleDecoder {
+  static Status Decode(const ResultView& view, size_t row, Tuple* tuple) {
+    RETURN_NOT_OK((TupleDecoder<N - 1, Tuple>::Decode(view, row, tuple)));
+    return view.Get(row, N - 1, &std::get<N - 1>(*tuple));
+  }
+};
+
+template<typename Tuple>
+struct TupleDecoder<0, Tuple> {
+  static Status Decode(const ResultView& view, size_t row, Tuple* tuple) {
+    return Status::OK();
+  }
+};
+
+} // namespace internal
+
+template<typename... Ts>
+Status ResultView::As(std::vector<std::tuple<Ts...>>* rows) const {
+  typedef std::tuple<Ts...> Tuple;
+  if (sizeof...(Ts) > num_columns_) {
+    return Status::InvalidArgument("more values than columns",
+                                   std::to_string(num_columns_) + " columns");
+  }
+  rows->clear();
+  rows->resize(num_rows_);
+  for (size_t row = 0; row < num_rows_; ++row) {
+    RETURN_NOT_OK((internal::TupleDecoder<sizeof...(Ts), Tuple>::Decode(
+        *this, row, &(*rows)[row])));
+  }
+  return Status::OK();
+}
+
+} // namespace db
+} // namespace mprmpr
+#endif // MPRMPR_DB_RESULT_VIEW_H_
@@ -4,18 +4,41 @@
 #include "mprmpr/db/result.h"
 
 #include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
 
 #include <glog/logging.h>
 
 namespace mprmpr {
 namespace db {
 
+namespace {
+
+// Whether the statement handle was lost with the connection to the server.
+// Server-side statements do not survive a reconnection.
+bool IsStatementLost(unsigned int error) {
+  return error == CR_SERVER_LOST ||
+         error == CR_SERVER_GONE_ERROR ||
+         error == ER_UNKNOWN_STMT_HANDLER;
+}
+
+} // anonymous namespace
+
 Statement::Statement(Connection* connection, std::string statement)
     : connection_(connection),
       statement_(nullptr),
       query_(std::move(statement)),
       parameters_(0) {
-  Init();      
+  status_ = Init();
+  if (!status_.ok()) {
+    LOG(ERROR) << status_.ToString();
+  }
+}
+
+Statement::Statement(std::string statement)
+    : connection_(nullptr),
+      statement_(nullptr),
+      query_(std::move(statement)),
+      parameters_(0) {
 }
 
 Statement::Statement(Statement&& other)
@@ -23,7 +46,8 @@ Statement::Statement(Statement&& other)
       statement_(other.statement_),
       query_(other.query_),
       parameters_(other.parameters_),
-      info_(std::move(other.info_)) {
+      info_(std::move(other.info_)),
+      status_(other.status_) {
   other.connection_ = nullptr;
   other.statement_ = nullptr;
   other.parameters_ = 0;  
@@ -35,56 +59,64 @@ Statement::~Statement() {
   }
 }
 
-void Statement::Init() {
+Status Statement::Init() {
+  if (statement_) {
+    ::mysql_stmt_close(statement_);
+  }
+  parameters_ = 0;
+  info_.reset();
+
   statement_ = ::mysql_stmt_init(connection_->connection_);
-  DCHECK(statement_) << "Unable to init statement";   
+  if (statement_ == nullptr) {
+    return Status::RuntimeError("Unable to init statement", ::mysql_error(connection_->connection_));
+  }
 
   if (::mysql_stmt_prepare(statement_, query_.c_str(), query_.size())) {
-    LOG(ERROR) << ::mysql_stmt_error(statement_);
+    Status s = Status::InvalidArgument("Unable to prepare statement " + query_,
+                                       ::mysql_stmt_error(statement_));
     ::mysql_stmt_close(statement_);
     statement_ = nullptr;
-    DCHECK(false);
+    return s;
   }
   parameters_ = ::mysql_stmt_param_count(statement_);
   auto* result = ::mysql_stmt_result_metadata(statement_);
   if (result != nullptr) {
     info_.reset(new StatementResultInfo(statement_, result));
   }
+  return Status::OK();
 }
 
-Status Statement::DoExecute(Parameter* parameters, size_t count) {
+Status Statement::DoExecute(MYSQL_BIND* binds, size_t count) {
+  result_.reset();
   if (statement_ == nullptr) {
-    delete[] parameters;
-    return Status::InvalidArgument("Cannot exeucte invalid statement: ");
+    return status_.ok() ? Status::InvalidArgument("Cannot execute invalid statement") : status_;
   }
 
-  if (count != parameters_) {
-    delete[] parameters;
-    return Status::InvalidArgument("Incorrect number of arguments");
-  }
+  bool reprepared = false;
+  while (true) {
+    if (count != parameters_) {
+      return Status::InvalidArgument("Incorrect number of arguments");
+    }
 
-  if (::mysql_stmt_bind_param(statement_, parameters)) {
-    delete [] parameters;
-    return Status::RuntimeError(::mysql_stmt_error(statement_));
-  }
+    if (::mysql_stmt_bind_param(statement_, binds)) {
+      return Status::RuntimeError(::mysql_stmt_error(statement_));
+    }
+
+    if (::mysql_stmt_execute(statement_) == 0) {
+      break;
+    }
 
-  if (::mysql_stmt_execute(statement_)) {
     // 虽然我们设置了 reconnect 选项, 但是如果连接是正好在执行mysql_stmt_execute 之前断开
     // , 那么 mysql_stmt_execute 将执行失败，这与 mysql_query 的处理不同. 
-    if (::mysql_stmt_errno(statement_) == CR_SERVER_LOST) {
-      statement_ = nullptr;
-      parameters_ = 0;
-      info_.reset();
-      Init();
-      return DoExecute(parameters, count);
-    } else {
-      delete [] parameters;
+    // 重连之后, 服务端的 statement 也已经失效, 需要重新 prepare.
+    if (reprepared || !IsStatementLost(::mysql_stmt_errno(statement_))) {
       return Status::RuntimeError(::mysql_stmt_error(statement_));
     }
+    reprepared = true;
+    status_ = Init();
+    RETURN_NOT_OK(status_);
   }
 
-  delete [] parameters;
-
   if (!info_) {
     result_.reset(new Result(::mysql_stmt_affected_rows(statement_), ::mysql_stmt_insert_id(statement_)));
   } else {
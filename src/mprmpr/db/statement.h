@@ -1,6 +1,7 @@
 #ifndef MPRMPR_DB_STATEMENT_H_
 #define MPRMPR_DB_STATEMENT_H_
 
+#include <cstring>
 #include <memory>
 #include <mysql/mysql.h>
 
@@ -16,6 +17,15 @@ namespace db {
 class StatementResultInfo;
 class Result;
 
+// A server-side prepared statement.
+//
+// The query is parsed once by the server, when the statement is created.
+// Execute() then only sends the values of its '?' placeholders, bound in
+// binary form (see BindParameter()) rather than quoted and escaped into the
+// query text.
+//
+// See also Connection::ExecutePrepared(), which caches the statements of a
+// connection.
 class Statement {
  public:
   Statement(Connection* conn, std::string statement);
@@ -23,26 +33,42 @@ class Statement {
   virtual ~Statement();
 
   template<typename... Args>
-  Status Execute(Args...args) {
-    auto count = sizeof...(args);
-    auto* ps = new Parameter[sizeof...(args)]{ args... };
-    return DoExecute(ps, count);
+  Status Execute(const Args&... args) {
+    MYSQL_BIND binds[sizeof...(args) + 1];
+    std::memset(binds, 0, sizeof(binds));
+    BindParameters(binds, args...);
+    return DoExecute(binds, sizeof...(args));
   }
 
   Result* GetResult() const {
     return result_.get();
   }
 
+  const std::string& query() const { return query_; }
+
+ protected:
+  // A statement which is not prepared, for tests.
+  explicit Statement(std::string statement);
+
+  // Virtual for tests.
+  virtual Status DoExecute(MYSQL_BIND* binds, size_t count);
+
+  std::unique_ptr<Result> result_;
+
  private:
+  friend class Connection;
+
   Connection* connection_;
   MYSQL_STMT* statement_;
   std::string query_;
   size_t parameters_;
   std::unique_ptr<StatementResultInfo> info_;
-  std::unique_ptr<Result> result_;
 
-  void Init();
-  Status DoExecute(Parameter* parameters, size_t count);
+  // The outcome of preparing the statement.
+  Status status_;
+
+  // (Re-)prepares the statement.
+  Status Init();
 
   DISALLOW_COPY_AND_ASSIGN(Statement);
 };
@@ -30,6 +30,10 @@ class StatementDatetimeResultField : public StatementResultField {
     return std::string(buf);
   }
   
+  virtual Slice ToSlice() const override {
+    return IsNULL() ? Slice() : Slice(reinterpret_cast<const uint8_t*>(&value_), sizeof(value_));
+  }
+
   virtual operator std::tm() const override {
     return std::tm { (int)value_.second, 
                      (int)value_.minute, 
@@ -42,6 +42,10 @@ class StatementDynamicResultField : public StatementResultField {
     return std::tm{};
   }
 
+  virtual Slice ToSlice() const override {
+    return IsNULL() ? Slice() : Slice(value_, size_);
+  }
+
  protected:
 
   virtual bool IsDynamic() override {
@@ -24,6 +24,9 @@ class StatementIntegralResultField : public StatementResultField {
 
   virtual operator std::string() const override { return std::to_string(value_); }
   virtual operator std::tm() const override { return std::tm{}; }
+  virtual Slice ToSlice() const override {
+    return IsNULL() ? Slice() : Slice(reinterpret_cast<const uint8_t*>(&value_), sizeof(T));
+  }
 
  private:
   T value_;
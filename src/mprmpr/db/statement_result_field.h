@@ -31,6 +31,7 @@ class StatementResultField : public ResultFieldImpl {
   
   virtual operator std::string() const override = 0;
   virtual operator std::tm() const override = 0;
+  virtual Slice ToSlice() const override = 0;
       
  protected:
 
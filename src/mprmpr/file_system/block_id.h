@@ -0,0 +1,54 @@
+#ifndef ANT_FILE_SYSTEM_BLOCK_ID_H_
+#define ANT_FILE_SYSTEM_BLOCK_ID_H_
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <iosfwd>
+#include <string>
+
+#include "mprmpr/base/stringprintf.h"
+#include "mprmpr/file_system/file_system.pb.h"
+
+namespace mprmpr {
+
+// The identifier of a block of a block manager. Unique across the data
+// directories of a server.
+class BlockId {
+ public:
+  BlockId() : id_(kInvalidId) {}
+  explicit BlockId(uint64_t id) : id_(id) {}
+
+  uint64_t id() const { return id_; }
+
+  bool IsNull() const { return id_ == kInvalidId; }
+
+  std::string ToString() const {
+    return StringPrintf("%016" PRIu64, id_);
+  }
+
+  bool operator==(const BlockId& other) const { return id_ == other.id_; }
+  bool operator!=(const BlockId& other) const { return id_ != other.id_; }
+
+  static BlockId FromPB(const BlockIdPB& pb) { return BlockId(pb.id()); }
+
+  void CopyToPB(BlockIdPB* pb) const { pb->set_id(id_); }
+
+ private:
+  enum : uint64_t { kInvalidId = 0 };
+
+  uint64_t id_;
+};
+
+inline std::ostream& operator<<(std::ostream& o, const BlockId& block_id) {
+  return o << block_id.ToString();
+}
+
+struct BlockIdHash {
+  size_t operator()(const BlockId& block_id) const {
+    return block_id.id();
+  }
+};
+
+} // namespace mprmpr
+#endif // ANT_FILE_SYSTEM_BLOCK_ID_H_
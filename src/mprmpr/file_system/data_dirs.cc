@@ -0,0 +1,262 @@
+#include "mprmpr/file_system/data_dirs.h"
+
+#include <errno.h>
+
+#include <mutex>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/strings/util.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/env_util.h"
+#include "mprmpr/util/random_util.h"
+#include "mprmpr/util/threadpool.h"
+
+DEFINE_int32(fs_data_dir_io_threads, 4,
+             "Number of threads doing I/O on each data directory.");
+
+DEFINE_int64(fs_data_dirs_reserved_bytes, 0,
+             "Number of bytes to keep free on the filesystem of each data "
+             "directory. New files are not placed on a directory with less "
+             "free space than that.");
+
+DEFINE_int32(fs_data_dirs_available_space_cache_seconds, 10,
+             "Number of seconds the free space of a data directory is cached "
+             "for when placing new files.");
+
+METRIC_DEFINE_gauge_uint64(server, data_dirs_failed,
+                           "Data Directories Failed",
+                           mprmpr::MetricUnit::kDataDirectories,
+                           "Number of data directories whose disks have failed");
+
+using std::string;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+namespace {
+
+// Whether 's' denotes a broken disk, as opposed to e.g. a missing file.
+bool IsDiskFailure(const Status& s) {
+  if (!s.IsIOError()) {
+    return false;
+  }
+  switch (s.posix_code()) {
+    case EIO:
+    case ENODEV:
+    case ENXIO:
+    case EROFS:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////
+// DataDir
+////////////////////////////////////////////////////////////
+
+DataDir::DataDir(Env* env, string dir, gscoped_ptr<ThreadPool> pool)
+    : env_(env),
+      dir_(std::move(dir)),
+      pool_(std::move(pool)),
+      num_inflight_ops_(0),
+      is_failed_(false),
+      available_bytes_(0) {
+}
+
+DataDir::~DataDir() {
+  Shutdown();
+}
+
+void DataDir::Shutdown() {
+  if (pool_) {
+    pool_->Wait();
+    pool_->Shutdown();
+  }
+}
+
+Status DataDir::ExecClosure(const std::function<void()>& task) {
+  num_inflight_ops_.Increment();
+  Status s = pool_->SubmitFunc([this, task]() {
+      task();
+      num_inflight_ops_.IncrementBy(-1);
+    });
+  if (!s.ok()) {
+    num_inflight_ops_.IncrementBy(-1);
+  }
+  return s;
+}
+
+void DataDir::WaitOnClosures() {
+  pool_->Wait();
+}
+
+Status DataDir::RefreshAvailableSpace(bool force) {
+  MonoTime now = MonoTime::Now();
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    if (!force && last_space_check_.Initialized() &&
+        now < last_space_check_ +
+              MonoDelta::FromSeconds(FLAGS_fs_data_dirs_available_space_cache_seconds)) {
+      return Status::OK();
+    }
+  }
+  int64_t bytes_free;
+  RETURN_NOT_OK_PREPEND(env_->GetBytesFree(dir_, &bytes_free),
+                        Substitute("Unable to get the free space of $0", dir_));
+  std::lock_guard<simple_spinlock> l(lock_);
+  available_bytes_ = bytes_free - FLAGS_fs_data_dirs_reserved_bytes;
+  last_space_check_ = now;
+  return Status::OK();
+}
+
+int64_t DataDir::available_bytes() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return available_bytes_;
+}
+
+////////////////////////////////////////////////////////////
+// DataDirManager
+////////////////////////////////////////////////////////////
+
+DataDirManager::DataDirManager(Env* env,
+                               const scoped_refptr<MetricEntity>& metric_entity,
+                               vector<string> paths)
+    : env_(env),
+      paths_(std::move(paths)),
+      metric_entity_(metric_entity),
+      rand_(GetRandomSeed32()) {
+  if (metric_entity_) {
+    data_dirs_failed_ = METRIC_data_dirs_failed.Instantiate(metric_entity_, 0);
+  }
+}
+
+DataDirManager::~DataDirManager() {
+  Shutdown();
+}
+
+Status DataDirManager::Open(const std::map<string, string>& failed_dirs) {
+  CHECK(data_dirs_.empty()) << "Already opened";
+  for (int i = 0; i < paths_.size(); i++) {
+    const string& path = paths_[i];
+    gscoped_ptr<ThreadPool> pool;
+    RETURN_NOT_OK(ThreadPoolBuilder(Substitute("data dir $0", i))
+                  .set_max_threads(FLAGS_fs_data_dir_io_threads)
+                  .Build(&pool));
+    data_dirs_.emplace_back(new DataDir(env_, path, std::move(pool)));
+    DataDir* dir = data_dirs_.back().get();
+
+    auto failed = failed_dirs.find(path);
+    if (failed != failed_dirs.end()) {
+      MarkDataDirFailed(dir, failed->second);
+      continue;
+    }
+
+    // A directory which cannot be used from the start is failed, rather
+    // than the whole server.
+    Status s = env_util::CreateDirIfMissing(env_, path);
+    if (s.ok()) {
+      s = dir->RefreshAvailableSpace(true);
+    }
+    if (!s.ok()) {
+      MarkDataDirFailed(dir, s.ToString());
+    }
+  }
+  if (!paths_.empty() && num_healthy_data_dirs() == 0) {
+    return Status::IOError("All data directories have failed");
+  }
+  return Status::OK();
+}
+
+void DataDirManager::Shutdown() {
+  for (const auto& dir : data_dirs_) {
+    dir->Shutdown();
+  }
+}
+
+Status DataDirManager::GetNextDataDir(DataDir** dir) {
+  vector<DataDir*> candidates;
+  bool any_healthy = false;
+  for (const auto& data_dir : data_dirs_) {
+    if (data_dir->is_failed()) {
+      continue;
+    }
+    any_healthy = true;
+    Status s = data_dir->RefreshAvailableSpace(false);
+    if (!s.ok()) {
+      HandleIOError(data_dir.get(), s);
+      continue;
+    }
+    if (data_dir->available_bytes() > 0) {
+      candidates.push_back(data_dir.get());
+    }
+  }
+  if (candidates.empty()) {
+    if (!any_healthy) {
+      return Status::IOError("All data directories have failed");
+    }
+    return Status::ServiceUnavailable("No data directory has enough free space",
+                                      Substitute("--fs_data_dirs_reserved_bytes=$0",
+                                                 FLAGS_fs_data_dirs_reserved_bytes));
+  }
+
+  // Two distinct candidates, if there are two.
+  int n = candidates.size();
+  int i = rand_.Uniform(n);
+  DataDir* first = candidates[i];
+  DataDir* second = n > 1 ? candidates[(i + 1 + rand_.Uniform(n - 1)) % n] : first;
+  if (first->num_inflight_ops() != second->num_inflight_ops()) {
+    *dir = first->num_inflight_ops() < second->num_inflight_ops() ? first : second;
+  } else {
+    *dir = first->available_bytes() >= second->available_bytes() ? first : second;
+  }
+  return Status::OK();
+}
+
+Status DataDirManager::HandleIOError(DataDir* dir, const Status& s) {
+  if (IsDiskFailure(s)) {
+    MarkDataDirFailed(dir, s.ToString());
+  } else if (s.IsIOError() && s.posix_code() == ENOSPC) {
+    WARN_NOT_OK(dir->RefreshAvailableSpace(true),
+                Substitute("Unable to refresh the free space of $0", dir->dir()));
+  }
+  return s;
+}
+
+void DataDirManager::MarkDataDirFailed(DataDir* dir, const string& reason) {
+  if (!dir->MarkFailed()) {
+    return;
+  }
+  LOG(ERROR) << "Data directory " << dir->dir() << " failed: " << reason
+             << ". No new data will be placed on it.";
+  if (data_dirs_failed_) {
+    data_dirs_failed_->Increment();
+  }
+}
+
+DataDir* DataDirManager::FindDataDirByPath(const string& path) const {
+  for (const auto& dir : data_dirs_) {
+    if (path == dir->dir() || HasPrefixString(path, dir->dir() + "/")) {
+      return dir.get();
+    }
+  }
+  return nullptr;
+}
+
+int DataDirManager::num_healthy_data_dirs() const {
+  int num_healthy = 0;
+  for (const auto& dir : data_dirs_) {
+    if (!dir->is_failed()) {
+      num_healthy++;
+    }
+  }
+  return num_healthy;
+}
+
+} // namespace mprmpr
@@ -0,0 +1,162 @@
+#ifndef ANT_FILE_SYSTEM_DATA_DIRS_H_
+#define ANT_FILE_SYSTEM_DATA_DIRS_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/gscoped_ptr.h"
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/locks.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class Env;
+class ThreadPool;
+
+// A data directory, usually the root of one disk.
+//
+// Each directory has its own thread pool, so that I/O on different disks
+// proceeds in parallel rather than queueing behind the slowest one.
+//
+// This class is thread-safe.
+class DataDir {
+ public:
+  DataDir(Env* env, std::string dir, gscoped_ptr<ThreadPool> pool);
+  ~DataDir();
+
+  // Waits for the tasks submitted to the thread pool, and stops it.
+  void Shutdown();
+
+  // Runs 'task' on the thread pool of the directory. The task counts towards
+  // the I/O load of the directory until it returns.
+  Status ExecClosure(const std::function<void()>& task);
+
+  // Waits for the tasks submitted to the thread pool.
+  void WaitOnClosures();
+
+  // Refreshes the free space of the filesystem of the directory, unless it
+  // was refreshed less than --fs_data_dirs_available_space_cache_seconds ago
+  // and 'force' is false.
+  Status RefreshAvailableSpace(bool force);
+
+  // The free space as of the last refresh, minus --fs_data_dirs_reserved_bytes.
+  int64_t available_bytes() const;
+
+  // The number of I/O tasks running or queued on the directory, see
+  // ExecClosure(), plus those registered with IoScope.
+  int32_t num_inflight_ops() const { return num_inflight_ops_.Load(); }
+
+  bool is_failed() const { return is_failed_.Load(); }
+
+  const std::string& dir() const { return dir_; }
+
+  // Counts as I/O load of 'dir' for as long as it lives, for I/O done on
+  // the calling thread rather than on the thread pool.
+  class IoScope {
+   public:
+    explicit IoScope(DataDir* dir) : dir_(dir) { dir_->num_inflight_ops_.Increment(); }
+    ~IoScope() { dir_->num_inflight_ops_.IncrementBy(-1); }
+
+   private:
+    DataDir* const dir_;
+    DISALLOW_COPY_AND_ASSIGN(IoScope);
+  };
+
+ private:
+  friend class DataDirManager;
+
+  // Returns true if the directory was not failed yet.
+  bool MarkFailed() { return !is_failed_.Exchange(true); }
+
+  Env* const env_;
+  const std::string dir_;
+  gscoped_ptr<ThreadPool> pool_;
+
+  AtomicInt<int32_t> num_inflight_ops_;
+  AtomicBool is_failed_;
+
+  // Protects the fields below.
+  mutable simple_spinlock lock_;
+  int64_t available_bytes_;
+  MonoTime last_space_check_;
+
+  DISALLOW_COPY_AND_ASSIGN(DataDir);
+};
+
+// Places the data of the jobs across the data directories of a server.
+//
+// A new file goes to a directory picked with the "power of two choices": of
+// two healthy directories with enough free space drawn at random, the one
+// with the fewest I/O tasks in flight, and then the most free space. This
+// spreads the load about as well as scanning all the directories, without
+// making all the writers pick the same least loaded one at once.
+//
+// A directory is marked failed on the first I/O error which denotes a broken
+// disk (e.g. EIO): it is not used for new files anymore, and the server keeps
+// running on the others until they have all failed.
+//
+// This class is thread-safe.
+class DataDirManager {
+ public:
+  DataDirManager(Env* env,
+                 const scoped_refptr<MetricEntity>& metric_entity,
+                 std::vector<std::string> paths);
+  ~DataDirManager();
+
+  // Creates the directories if missing, and starts their thread pools. The
+  // directories of 'failed_dirs', a map of path to reason, are marked failed
+  // without being accessed, e.g. those of a root which cannot be read.
+  // Returns IOError if no directory is left.
+  Status Open(const std::map<std::string, std::string>& failed_dirs =
+                  std::map<std::string, std::string>());
+
+  // Stops the thread pools.
+  void Shutdown();
+
+  // Picks the directory of a new file. Returns IOError if all the
+  // directories have failed, or ServiceUnavailable if none has enough free
+  // space.
+  Status GetNextDataDir(DataDir** dir);
+
+  // Marks 'dir' failed if 's' is an I/O error which denotes a broken disk,
+  // or refreshes its free space if the disk is full. Returns 's'.
+  Status HandleIOError(DataDir* dir, const Status& s);
+
+  // Marks 'dir' failed: no new file will be placed on it.
+  void MarkDataDirFailed(DataDir* dir, const std::string& reason);
+
+  // Finds the directory which 'path' is in. Returns nullptr if there is
+  // none.
+  DataDir* FindDataDirByPath(const std::string& path) const;
+
+  // The number of directories which have not failed.
+  int num_healthy_data_dirs() const;
+
+  const std::vector<std::unique_ptr<DataDir>>& data_dirs() const { return data_dirs_; }
+
+ private:
+  Env* const env_;
+  const std::vector<std::string> paths_;
+  scoped_refptr<MetricEntity> metric_entity_;
+
+  // Immutable after Open().
+  std::vector<std::unique_ptr<DataDir>> data_dirs_;
+
+  ThreadSafeRandom rand_;
+
+  scoped_refptr<AtomicGauge<uint64_t>> data_dirs_failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(DataDirManager);
+};
+
+} // namespace mprmpr
+#endif // ANT_FILE_SYSTEM_DATA_DIRS_H_
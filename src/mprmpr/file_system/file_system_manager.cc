@@ -11,11 +11,19 @@
 #include <glog/stl_logging.h>
 #include <google/protobuf/message.h>
 
+#include "mprmpr/file_system/data_dirs.h"
 #include "mprmpr/file_system/file_system.pb.h"
+#include "mprmpr/file_system/log_block_manager.h"
+#include "mprmpr/base/bind.h"
 #include "mprmpr/base/strings/split.h"
 #include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/walltime.h"
 
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/net/net_util.h"
+#include "mprmpr/util/oid_generator.h"
 #include "mprmpr/util/pb_util.h"
+#include "mprmpr/util/threadpool.h"
 
 DEFINE_string(fs_wal_dir, "",
   "Directory with write-ahead logs. If this is not specified, the "
@@ -26,6 +34,32 @@ DEFINE_string(fs_data_dirs, "",
    "is not specified, fs_wal_dir will be used as the sole data "
    "block directory.");
 
+METRIC_DEFINE_gauge_int64(server, fs_startup_read_instance_metadata_duration,
+                          "Instance Metadata Read Duration",
+                          mprmpr::MetricUnit::kMilliseconds,
+                          "Time spent reading the instance metadata of the filesystem "
+                          "roots on startup");
+
+METRIC_DEFINE_gauge_int64(server, fs_startup_open_data_dirs_duration,
+                          "Data Directories Open Duration",
+                          mprmpr::MetricUnit::kMilliseconds,
+                          "Time spent opening the data directories on startup");
+
+METRIC_DEFINE_gauge_int64(server, fs_startup_open_block_manager_duration,
+                          "Block Manager Open Duration",
+                          mprmpr::MetricUnit::kMilliseconds,
+                          "Time spent loading the block containers on startup");
+
+METRIC_DEFINE_gauge_int64(server, fs_startup_clean_tmp_files_duration,
+                          "Temporary Files Cleanup Duration",
+                          mprmpr::MetricUnit::kMilliseconds,
+                          "Time spent deleting the temporary files left by the previous "
+                          "run, in the background after startup");
+
+using std::string;
+using std::vector;
+using strings::Substitute;
+
 namespace mprmpr {
 
 const char* FileSystemManager::kWalDirName = "wals";
@@ -33,6 +67,25 @@ const char* FileSystemManager::kWalFileNamePrefix = "wal";
 const char* FileSystemManager::kDataDirName = "data";
 const char* FileSystemManager::kInstanceMetadataFileName = "instance";
 
+namespace {
+
+// Filesystems stamp the modification times from a coarse clock: a temporary
+// file created right after the cleanup started may look older than it.
+const int64_t kTmpFilesCleanupMarginMicros = 1000 * 1000;
+
+// Sets the gauge 'prototype' to the time elapsed since 'start', and logs it.
+void RecordStartupPhase(const scoped_refptr<MetricEntity>& metric_entity,
+                        const GaugePrototype<int64_t>& prototype,
+                        const MonoTime& start) {
+  int64_t elapsed_ms = (MonoTime::Now() - start).ToMilliseconds();
+  LOG(INFO) << prototype.label() << ": " << elapsed_ms << " ms";
+  if (metric_entity) {
+    prototype.Instantiate(metric_entity, 0)->set_value(elapsed_ms);
+  }
+}
+
+} // anonymous namespace
+
 
 FileSystemManager::Options::Options()
     : wal_path(FLAGS_fs_wal_dir),
@@ -52,32 +105,301 @@ FileSystemManager::FileSystemManager(Env* env, const Options& options)
       data_fs_roots_(options.data_paths),
       metric_entity_(options.metric_entity),
       parent_mem_tracker_(options.parent_mem_tracker),
+      num_roots_to_clean_(0),
+      stop_cleanup_(false),
       initted_(false) {
 }
 
-FileSystemManager::~FileSystemManager() {}
+FileSystemManager::~FileSystemManager() {
+  if (cleanup_pool_) {
+    stop_cleanup_.Store(true);
+    cleanup_pool_->Shutdown();
+  }
+  block_manager_.reset();
+  if (dd_manager_) {
+    dd_manager_->Shutdown();
+  }
+}
 
-Status FileSystemManager::Open() {
+Status FileSystemManager::Init() {
+  if (initted_) {
+    return Status::OK();
+  }
+
+  // The roots may not exist yet: canonicalize their parents instead.
+  auto canonicalize = [&](const string& root, string* canonicalized) {
+    if (root.empty()) {
+      return Status::OK();
+    }
+    string parent;
+    RETURN_NOT_OK_PREPEND(env_->Canonicalize(DirName(root), &parent),
+                          Substitute("Unable to canonicalize $0", root));
+    *canonicalized = JoinPathSegments(parent, BaseName(root));
+    return Status::OK();
+  };
+
+  RETURN_NOT_OK(canonicalize(wal_fs_root_, &canonicalized_wal_fs_root_));
+  vector<string> data_dirs;
+  for (const string& root : data_fs_roots_) {
+    string canonicalized;
+    RETURN_NOT_OK(canonicalize(root, &canonicalized));
+    if (canonicalized_data_fs_roots_.insert(canonicalized).second) {
+      data_dirs.push_back(JoinPathSegments(canonicalized, kDataDirName));
+    }
+  }
+  if (data_dirs.empty() && !canonicalized_wal_fs_root_.empty()) {
+    canonicalized_data_fs_roots_.insert(canonicalized_wal_fs_root_);
+    data_dirs.push_back(JoinPathSegments(canonicalized_wal_fs_root_, kDataDirName));
+  }
 
+  canonicalized_all_fs_roots_ = canonicalized_data_fs_roots_;
+  if (!canonicalized_wal_fs_root_.empty()) {
+    canonicalized_all_fs_roots_.insert(canonicalized_wal_fs_root_);
+    canonicalized_metadata_fs_root_ = canonicalized_wal_fs_root_;
+  } else if (!canonicalized_data_fs_roots_.empty()) {
+    canonicalized_metadata_fs_root_ = *canonicalized_data_fs_roots_.begin();
+  }
+
+  dd_manager_.reset(new DataDirManager(env_, metric_entity_, std::move(data_dirs)));
+  initted_ = true;
+  return Status::OK();
+}
+
+Status FileSystemManager::Open() {
   RETURN_NOT_OK(Init());
 
+  MonoTime start = MonoTime::Now();
+  std::map<string, string> failed_data_dirs;
+  RETURN_NOT_OK(ReadInstanceMetadata(&failed_data_dirs));
+  RecordStartupPhase(metric_entity_, METRIC_fs_startup_read_instance_metadata_duration, start);
+
+  // A data dir which cannot be opened is marked failed: only fail if none
+  // is left.
+  start = MonoTime::Now();
+  RETURN_NOT_OK_PREPEND(dd_manager_->Open(failed_data_dirs), "Unable to open the data dirs");
+  RecordStartupPhase(metric_entity_, METRIC_fs_startup_open_data_dirs_duration, start);
+
+  start = MonoTime::Now();
+  block_manager_.reset(new LogBlockManager(env_, dd_manager_.get(), metric_entity_,
+                                           read_only_));
+  RETURN_NOT_OK_PREPEND(block_manager_->Open(), "Unable to open the block manager");
+  RecordStartupPhase(metric_entity_, METRIC_fs_startup_open_block_manager_duration, start);
+
+  // Walking the roots may take minutes with many files: the server needs
+  // not wait for it.
   if (!read_only_) {
-    CleanTmpFiles();
+    StartTmpFilesCleanup();
   }
+  return Status::OK();
+}
 
-  for (const std::string& root : canonicalized_all_fs_roots_) {
-    gscoped_ptr<InstanceMetadataPB> pb(new InstanceMetadataPB);
-    RETURN_NOT_OK(pb_util::ReadPBContainerFromPath(env_,
-                                                   GetInstanceMetadataPath(root),
-                                                   pb.get()));
-    
+Status FileSystemManager::ReadInstanceMetadata(std::map<string, string>* failed_data_dirs) {
+  // The roots are usually on different disks: read them all at once.
+  vector<string> roots(canonicalized_all_fs_roots_.begin(), canonicalized_all_fs_roots_.end());
+  if (roots.empty()) {
+    return Status::IllegalState("No filesystem root configured");
+  }
+  gscoped_ptr<ThreadPool> pool;
+  RETURN_NOT_OK(ThreadPoolBuilder("fs-open").set_max_threads(roots.size()).Build(&pool));
+  vector<InstanceMetadataPB> pbs(roots.size());
+  vector<Status> statuses(roots.size());
+  for (int i = 0; i < roots.size(); i++) {
+    Status s = pool->SubmitFunc([this, &roots, &pbs, &statuses, i]() {
+        statuses[i] = pb_util::ReadPBContainerFromPath(env_, GetInstanceMetadataPath(roots[i]),
+                                                       &pbs[i]);
+      });
+    if (!s.ok()) {
+      statuses[i] = s;
+    }
+  }
+  pool->Wait();
+  pool->Shutdown();
+
+  // A root which cannot be read, e.g. on a broken disk, only fails its data
+  // dir. Without the others, e.g. if the layout was never created, there is
+  // nothing to run on.
+  int num_failed = 0;
+  for (int i = 0; i < roots.size(); i++) {
+    if (!statuses[i].ok()) {
+      num_failed++;
+    }
+  }
+  if (num_failed == roots.size()) {
+    return statuses[0];
+  }
+
+  for (int i = 0; i < roots.size(); i++) {
+    const Status& s = statuses[i];
+    if (!s.ok()) {
+      if (roots[i] == canonicalized_wal_fs_root_) {
+        return s.CloneAndPrepend("Unable to read the instance metadata of the WAL root");
+      }
+      LOG(WARNING) << "Unable to read the instance metadata of filesystem root " << roots[i]
+                   << ": " << s.ToString();
+      (*failed_data_dirs)[JoinPathSegments(roots[i], kDataDirName)] =
+          Substitute("Unable to read the instance metadata of its root: $0", s.ToString());
+      continue;
+    }
+    if (!metadata_) {
+      metadata_.reset(new InstanceMetadataPB(pbs[i]));
+    } else if (pbs[i].uuid() != metadata_->uuid()) {
+      return Status::Corruption(Substitute(
+          "Mismatched UUIDs across filesystem roots: $0 vs. $1",
+          metadata_->uuid(), pbs[i].uuid()));
+    }
   }
   return Status::OK();
 }
 
-Status FileSystemManager::Init() {
-  
+Status FileSystemManager::CreateInitialFileSystemLayout(boost::optional<string> uuid) {
+  CHECK(!read_only_);
+  RETURN_NOT_OK(Init());
+
+  for (const string& root : canonicalized_all_fs_roots_) {
+    if (env_->FileExists(GetInstanceMetadataPath(root))) {
+      return Status::AlreadyPresent("Filesystem root already has instance metadata", root);
+    }
+  }
+
+  InstanceMetadataPB metadata;
+  RETURN_NOT_OK(CreateInstanceMetadata(std::move(uuid), &metadata));
+  for (const string& root : canonicalized_all_fs_roots_) {
+    RETURN_NOT_OK_PREPEND(CreateDirIfMissing(root),
+                          Substitute("Unable to create filesystem root $0", root));
+    RETURN_NOT_OK(WriteInstanceMetadata(metadata, root));
+  }
+  if (!canonicalized_wal_fs_root_.empty()) {
+    RETURN_NOT_OK(CreateDirIfMissing(JoinPathSegments(canonicalized_wal_fs_root_,
+                                                      kWalDirName)));
+  }
+  for (const string& root : canonicalized_data_fs_roots_) {
+    RETURN_NOT_OK(CreateDirIfMissing(JoinPathSegments(root, kDataDirName)));
+  }
   return Status::OK();
 }
 
+Status FileSystemManager::CreateInstanceMetadata(boost::optional<string> uuid,
+                                                 InstanceMetadataPB* metadata) {
+  ObjectIdGenerator oid_generator;
+  if (uuid) {
+    string canonicalized;
+    RETURN_NOT_OK(oid_generator.Canonicalize(uuid.get(), &canonicalized));
+    metadata->set_uuid(canonicalized);
+  } else {
+    metadata->set_uuid(oid_generator.Next());
+  }
+
+  string time_str;
+  StringAppendStrftime(&time_str, "%Y-%m-%d %H:%M:%S", time(nullptr), false);
+  string hostname;
+  if (!GetHostname(&hostname).ok()) {
+    hostname = "<unknown host>";
+  }
+  metadata->set_format_stamp(Substitute("Formatted at $0 on $1", time_str, hostname));
+  return Status::OK();
+}
+
+Status FileSystemManager::WriteInstanceMetadata(const InstanceMetadataPB& metadata,
+                                                const string& root) {
+  const string path = GetInstanceMetadataPath(root);
+  RETURN_NOT_OK_PREPEND(pb_util::WritePBContainerToPath(env_, path, metadata,
+                                                        pb_util::NO_OVERWRITE,
+                                                        pb_util::SYNC),
+                        Substitute("Unable to write instance metadata to $0", path));
+  LOG(INFO) << "Generated new instance metadata in path " << path << ":\n"
+            << metadata.DebugString();
+  return Status::OK();
+}
+
+const string& FileSystemManager::uuid() const {
+  return CHECK_NOTNULL(metadata_.get())->uuid();
+}
+
+string FileSystemManager::GetInstanceMetadataPath(const string& root) const {
+  return JoinPathSegments(root, kInstanceMetadataFileName);
+}
+
+void FileSystemManager::StartTmpFilesCleanup() {
+  DCHECK(!read_only_);
+  // The files of this run are left alone, since they may be in use.
+  cleanup_start_ = MonoTime::Now();
+  int64_t cutoff_micros = GetCurrentTimeMicros() - kTmpFilesCleanupMarginMicros;
+  Status s = ThreadPoolBuilder("fs-cleanup")
+      .set_max_threads(canonicalized_all_fs_roots_.size())
+      .Build(&cleanup_pool_);
+  if (!s.ok()) {
+    WARN_NOT_OK(s, "Unable to start the cleanup of the temporary files");
+    return;
+  }
+  num_roots_to_clean_.Store(canonicalized_all_fs_roots_.size());
+  for (const string& root : canonicalized_all_fs_roots_) {
+    s = cleanup_pool_->SubmitFunc([this, root, cutoff_micros]() {
+        CleanTmpFiles(root, cutoff_micros);
+      });
+    if (!s.ok()) {
+      WARN_NOT_OK(s, Substitute("Unable to clean temporary files in $0", root));
+      num_roots_to_clean_.IncrementBy(-1);
+    }
+  }
+}
+
+void FileSystemManager::WaitForTmpFilesCleanup() {
+  if (cleanup_pool_) {
+    cleanup_pool_->Wait();
+  }
+}
+
+void FileSystemManager::CleanTmpFiles(const string& root, int64_t cutoff_micros) {
+  if (env_->FileExists(root)) {
+    Status s = env_->Walk(root, Env::PRE_ORDER,
+                          base::Bind(&FileSystemManager::CleanTmpFile,
+                                     base::Unretained(this), cutoff_micros));
+    if (!s.IsAborted()) {
+      WARN_NOT_OK(s, Substitute("Unable to clean temporary files in $0", root));
+    }
+  }
+  if (num_roots_to_clean_.IncrementBy(-1) == 0) {
+    RecordStartupPhase(metric_entity_, METRIC_fs_startup_clean_tmp_files_duration,
+                       cleanup_start_);
+  }
+}
+
+Status FileSystemManager::CleanTmpFile(int64_t cutoff_micros, Env::FileType type,
+                                       const string& dirname, const string& basename) {
+  if (stop_cleanup_.Load()) {
+    return Status::Aborted("The filesystem manager is shutting down");
+  }
+  if (type != Env::FILE_TYPE || basename.find(kTmpInfix) == string::npos) {
+    return Status::OK();
+  }
+  string path = JoinPathSegments(dirname, basename);
+  int64_t modified_micros;
+  if (!env_->GetFileModifiedTime(path, &modified_micros).ok() ||
+      modified_micros >= cutoff_micros) {
+    return Status::OK();
+  }
+  WARN_NOT_OK(env_->DeleteFile(path), Substitute("Unable to delete temporary file $0", path));
+  return Status::OK();
+}
+
+Status FileSystemManager::CreateDirIfMissing(const std::string& path, bool* created) {
+  Status s = env_->CreateDir(path);
+  if (created != nullptr) {
+    *created = s.ok();
+  }
+  return s.IsAlreadyPresent() ? Status::OK() : s;
+}
+
+std::vector<std::string> FileSystemManager::GetDataRootDirs() const {
+  std::vector<std::string> roots = data_fs_roots_;
+  if (roots.empty() && !wal_fs_root_.empty()) {
+    roots.push_back(wal_fs_root_);
+  }
+  std::vector<std::string> dirs;
+  for (const std::string& root : roots) {
+    dirs.push_back(JoinPathSegments(root, kDataDirName));
+  }
+  return dirs;
+}
+
 } // namespace mprmpr
@@ -4,6 +4,7 @@
 #include <boost/optional.hpp>
 #include <memory>
 #include <iosfwd>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -15,8 +16,10 @@
 #include "mprmpr/base/gscoped_ptr.h"
 #include "mprmpr/base/ref_counted.h"
 
+#include "mprmpr/util/atomic.h"
 #include "mprmpr/util/mem_tracker.h"
 #include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
 
 namespace google {
 namespace protobuf {
@@ -26,7 +29,10 @@ class Message;
 
 namespace mprmpr {
 
+class DataDirManager;
+class LogBlockManager;
 class InstanceMetadataPB;
+class ThreadPool;
 
 class FileSystemManager {
  public:
@@ -48,7 +54,19 @@ class FileSystemManager {
   FileSystemManager(Env* env, const Options& options);
   ~FileSystemManager();
 
+  // Loads the instance metadata of the roots, and opens the data dirs.
+  // Returns NotFound if the layout has not been created yet, see
+  // CreateInitialFileSystemLayout().
+  //
+  // The roots and the data dirs are opened in parallel. The temporary files
+  // left by a previous run are deleted in the background afterwards, see
+  // WaitForTmpFilesCleanup().
   Status Open();
+
+  // Waits for the temporary files left by a previous run to be deleted.
+  void WaitForTmpFilesCleanup();
+
+  // Creates the roots and writes their instance metadata.
   Status CreateInitialFileSystemLayout(boost::optional<std::string> uuid = boost::none);
   void DumpFileSystemTree(std::ostream& out);
   const std::string& uuid() const;
@@ -69,7 +87,18 @@ class FileSystemManager {
   }
   
   Status CreateDirIfMissing(const std::string& path, bool* created = nullptr);
-  
+
+  // Return the directories in which data may be placed, one per data root.
+  // If no data roots were configured, the WAL root is used instead; if that is
+  // not configured either, the result is empty.
+  std::vector<std::string> GetDataRootDirs() const;
+
+  // Places new data files across the data dirs. Only usable after Open().
+  DataDirManager* dd_manager() const { return dd_manager_.get(); }
+
+  // Stores the intermediate job artifacts. Only usable after Open().
+  LogBlockManager* block_manager() const { return block_manager_.get(); }
+
  private:
   Status Init();
   Status CreateInstanceMetadata(boost::optional<std::string> uuid,
@@ -81,7 +110,20 @@ class FileSystemManager {
                           const std::string& prefix,
                           const std::string& path,
                           const std::vector<std::string>& objects);
-  void CleanTmpFiles();
+  // Reads the instance metadata of all the roots, and checks that they
+  // match. A data root which cannot be read is added to 'failed_data_dirs',
+  // a map of its data dir to the reason: only fail if none can be read, or
+  // if the WAL root cannot.
+  Status ReadInstanceMetadata(std::map<std::string, std::string>* failed_data_dirs);
+
+  // Deletes the temporary files of the roots on 'cleanup_pool_'.
+  void StartTmpFilesCleanup();
+
+  // Deletes the temporary files under 'root' last modified before
+  // 'cutoff_micros'.
+  void CleanTmpFiles(const std::string& root, int64_t cutoff_micros);
+  Status CleanTmpFile(int64_t cutoff_micros, Env::FileType type,
+                      const std::string& dirname, const std::string& basename);
 
   static const char *kDataDirName;
   static const char *kWalDirName;
@@ -105,6 +147,14 @@ class FileSystemManager {
 
   gscoped_ptr<InstanceMetadataPB> metadata_;
 
+  gscoped_ptr<DataDirManager> dd_manager_;
+  gscoped_ptr<LogBlockManager> block_manager_;
+
+  // Runs the cleanup of the temporary files, one task per root.
+  gscoped_ptr<ThreadPool> cleanup_pool_;
+  MonoTime cleanup_start_;
+  AtomicInt<int32_t> num_roots_to_clean_;
+  AtomicBool stop_cleanup_;
 
   bool initted_;
 
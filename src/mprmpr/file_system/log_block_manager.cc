@@ -0,0 +1,1017 @@
+#include "mprmpr/file_system/log_block_manager.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/casts.h"
+#include "mprmpr/base/map-util.h"
+#include "mprmpr/base/strings/strip.h"
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/strings/util.h"
+#include "mprmpr/base/walltime.h"
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/file_system/file_system.pb.h"
+#include "mprmpr/util/alignment.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/logging.h"
+#include "mprmpr/util/oid_generator.h"
+#include "mprmpr/util/path_util.h"
+#include "mprmpr/util/pb_util.h"
+
+DEFINE_int64(log_container_max_size, 10LL * 1024 * 1024 * 1024,
+             "Maximum size of a block container data file. A full container "
+             "takes no new blocks.");
+
+DEFINE_int64(log_container_preallocate_bytes, 32LL * 1024 * 1024,
+             "Number of bytes to preallocate at a time in a block container "
+             "data file, so that blocks are laid out in large extents.");
+
+DEFINE_int32(log_block_manager_max_open_files, -1,
+             "Maximum number of block container data files kept open. The "
+             "others are reopened as their blocks are read or written. If not "
+             "positive, a share of the open file limit of the process.");
+
+DEFINE_bool(log_block_manager_fsync, false,
+            "Whether to sync the data and the metadata of a block when it is "
+            "closed or deleted. Intermediate job artifacts need not survive a "
+            "crash.");
+
+METRIC_DEFINE_gauge_uint64(server, log_block_manager_blocks_under_management,
+                           "Blocks Under Management",
+                           mprmpr::MetricUnit::kBlocks,
+                           "Number of blocks stored by the log block manager");
+
+METRIC_DEFINE_gauge_uint64(server, log_block_manager_bytes_under_management,
+                           "Bytes Under Management",
+                           mprmpr::MetricUnit::kBytes,
+                           "Number of bytes of the blocks stored by the log block manager");
+
+METRIC_DEFINE_gauge_uint64(server, log_block_manager_containers,
+                           "Number of Block Containers",
+                           mprmpr::MetricUnit::kLogBlockContainers,
+                           "Number of container files of the log block manager");
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+using pb_util::BulkReadablePBContainerFile;
+using pb_util::WritablePBContainerFile;
+
+const char* LogBlockManager::kContainerDataFileSuffix = ".data";
+const char* LogBlockManager::kContainerMetadataFileSuffix = ".metadata";
+const char* LogBlockManager::kInstanceMetadataFileName = "block_manager_instance";
+const char* LogBlockManager::kContainerManifestFileName = "block_manager_manifest";
+
+namespace {
+
+const char* kBlockManagerType = "log";
+
+// Used if the filesystem does not report its block size.
+const int64_t kDefaultFsBlockSize = 4096;
+
+} // anonymous namespace
+
+namespace internal {
+
+////////////////////////////////////////////////////////////
+// LogBlockContainer
+////////////////////////////////////////////////////////////
+
+// A data file holding blocks back to back, and the metadata file logging
+// their creation and deletion.
+//
+// A container is written by one block at a time, see
+// LogBlockManager::GetAvailableContainer(). Reads, hole punching and metadata
+// appends may happen concurrently.
+class LogBlockContainer {
+ public:
+  // Creates the new container 'id' in 'dir'.
+  static Status Create(LogBlockManager* manager, DataDir* dir, int64_t fs_block_size,
+                       const string& id, unique_ptr<LogBlockContainer>* container);
+
+  // Opens the existing container 'id' of 'dir'.
+  static Status Open(LogBlockManager* manager, DataDir* dir, int64_t fs_block_size,
+                     const string& id, unique_ptr<LogBlockContainer>* container);
+
+  // Reads the records of the metadata file. If the last record was cut short
+  // by a crash, the records before it are returned, and the metadata file is
+  // truncated after them, so that the next records can be read back (or the
+  // container takes no new block if read-only).
+  Status ReadRecords(vector<BlockRecordPB>* records);
+
+  // Appends 'record' to the metadata file.
+  Status AppendRecord(const BlockRecordPB& record);
+
+  // Writes 'data' at 'offset' of the data file, preallocating it ahead.
+  Status WriteData(int64_t offset, const Slice& data);
+
+  Status ReadData(int64_t offset, size_t length, Slice* result, uint8_t* scratch) const;
+
+  Status SyncData() { return data_file_->Sync(); }
+
+  // Returns the space of the block at 'offset' to the filesystem.
+  void PunchHole(int64_t offset, int64_t length);
+
+  // Called when the block at 'offset' is closed: the next one goes after it.
+  void BlockFinished(int64_t offset, int64_t length) {
+    next_block_offset_.StoreMax(KUDU_ALIGN_UP(offset + length, fs_block_size_));
+  }
+
+  void BlockAdded() { live_blocks_.Increment(); }
+
+  // Returns true if the container is full and has no block left.
+  bool BlockDeleted() {
+    return live_blocks_.IncrementBy(-1) == 0 && full();
+  }
+
+  // Deletes the files of the container.
+  Status Delete();
+
+  // Whether the container takes no new block.
+  bool full() const {
+    return read_only_.Load() || next_block_offset_.Load() >= FLAGS_log_container_max_size;
+  }
+
+  void SetReadOnly() { read_only_.Store(true); }
+
+  int64_t next_block_offset() const { return next_block_offset_.Load(); }
+  int64_t live_blocks() const { return live_blocks_.Load(); }
+  DataDir* data_dir() const { return dir_; }
+  LogBlockManager* manager() const { return manager_; }
+  const string& id() const { return id_; }
+  const string& ToString() const { return path_; }
+
+ private:
+  LogBlockContainer(LogBlockManager* manager, DataDir* dir, int64_t fs_block_size,
+                    string id, shared_ptr<RWFile> data_file,
+                    unique_ptr<WritablePBContainerFile> metadata_file,
+                    int64_t preallocated_offset);
+
+  // Truncates the metadata file to 'size' bytes, and appends after them.
+  Status TruncateMetadata(uint64_t size);
+
+  LogBlockManager* const manager_;
+  DataDir* const dir_;
+  const int64_t fs_block_size_;
+  const string id_;
+
+  // The path of the files, without suffix.
+  const string path_;
+
+  // From the file cache of the manager.
+  shared_ptr<RWFile> data_file_;
+
+  // Appended to by concurrent threads.
+  Mutex metadata_lock_;
+  unique_ptr<WritablePBContainerFile> metadata_file_;
+
+  AtomicInt<int64_t> next_block_offset_;
+
+  // Only used by the thread writing a block.
+  int64_t preallocated_offset_;
+
+  AtomicInt<int64_t> live_blocks_;
+  AtomicBool read_only_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogBlockContainer);
+};
+
+LogBlockContainer::LogBlockContainer(LogBlockManager* manager, DataDir* dir,
+                                     int64_t fs_block_size, string id,
+                                     shared_ptr<RWFile> data_file,
+                                     unique_ptr<WritablePBContainerFile> metadata_file,
+                                     int64_t preallocated_offset)
+    : manager_(manager),
+      dir_(dir),
+      fs_block_size_(fs_block_size),
+      id_(std::move(id)),
+      path_(JoinPathSegments(dir->dir(), id_)),
+      data_file_(std::move(data_file)),
+      metadata_file_(std::move(metadata_file)),
+      next_block_offset_(0),
+      preallocated_offset_(preallocated_offset),
+      live_blocks_(0),
+      read_only_(false) {
+}
+
+Status LogBlockContainer::Create(LogBlockManager* manager, DataDir* dir, int64_t fs_block_size,
+                                 const string& id, unique_ptr<LogBlockContainer>* container) {
+  Env* env = manager->env_;
+  string path = JoinPathSegments(dir->dir(), id);
+
+  const string data_path = path + LogBlockManager::kContainerDataFileSuffix;
+  const string metadata_path = path + LogBlockManager::kContainerMetadataFileSuffix;
+  RWFileOptions opts;
+  opts.mode = Env::CREATE_NON_EXISTING;
+  {
+    unique_ptr<RWFile> data_file;
+    RETURN_NOT_OK(env->NewRWFile(opts, data_path, &data_file));
+    RETURN_NOT_OK(data_file->Close());
+  }
+  // The metadata file is created last: a data file without it is the
+  // leftover of a crash, see LogBlockManager::OpenDataDir().
+  unique_ptr<WritablePBContainerFile> metadata_file;
+  Status s = [&]() {
+    unique_ptr<RWFile> metadata_rw;
+    RETURN_NOT_OK(env->NewRWFile(opts, metadata_path, &metadata_rw));
+    metadata_file.reset(new WritablePBContainerFile(std::move(metadata_rw)));
+    RETURN_NOT_OK(metadata_file->Init(BlockRecordPB()));
+    if (FLAGS_log_block_manager_fsync) {
+      RETURN_NOT_OK(metadata_file->Sync());
+      RETURN_NOT_OK(env->SyncDir(dir->dir()));
+    }
+    return Status::OK();
+  }();
+  if (!s.ok()) {
+    // Nothing was written to the container yet.
+    metadata_file.reset();
+    if (env->FileExists(metadata_path)) {
+      WARN_NOT_OK(env->DeleteFile(metadata_path), Substitute("Unable to delete $0", metadata_path));
+    }
+    WARN_NOT_OK(env->DeleteFile(data_path), Substitute("Unable to delete $0", data_path));
+    return s;
+  }
+  shared_ptr<RWFile> data_file;
+  RETURN_NOT_OK(manager->file_cache_.OpenExistingFile(data_path, &data_file));
+
+  container->reset(new LogBlockContainer(manager, dir, fs_block_size, id,
+                                         std::move(data_file), std::move(metadata_file), 0));
+  VLOG(1) << "Created block container " << (*container)->ToString();
+  return Status::OK();
+}
+
+Status LogBlockContainer::Open(LogBlockManager* manager, DataDir* dir, int64_t fs_block_size,
+                               const string& id, unique_ptr<LogBlockContainer>* container) {
+  Env* env = manager->env_;
+  string path = JoinPathSegments(dir->dir(), id);
+
+  RWFileOptions opts;
+  opts.mode = Env::OPEN_EXISTING;
+  unique_ptr<RWFile> metadata_rw;
+  RETURN_NOT_OK(env->NewRWFile(opts, path + LogBlockManager::kContainerMetadataFileSuffix,
+                               &metadata_rw));
+  unique_ptr<WritablePBContainerFile> metadata_file(
+      new WritablePBContainerFile(std::move(metadata_rw)));
+  RETURN_NOT_OK(metadata_file->Reopen());
+  shared_ptr<RWFile> data_file;
+  RETURN_NOT_OK(manager->file_cache_.OpenExistingFile(
+      path + LogBlockManager::kContainerDataFileSuffix, &data_file));
+
+  // Preallocation extends the data file: what is past the last block is
+  // already allocated.
+  uint64_t data_size;
+  RETURN_NOT_OK(data_file->Size(&data_size));
+
+  container->reset(new LogBlockContainer(manager, dir, fs_block_size, id,
+                                         std::move(data_file), std::move(metadata_file),
+                                         data_size));
+  return Status::OK();
+}
+
+Status LogBlockContainer::ReadRecords(vector<BlockRecordPB>* records) {
+  unique_ptr<RandomAccessFile> file;
+  RETURN_NOT_OK(manager_->env_->NewRandomAccessFile(
+      path_ + LogBlockManager::kContainerMetadataFileSuffix, &file));
+  // The records are small: read them in large windows rather than two reads
+  // each. The data dirs are already opened in parallel: parse them here.
+  BulkReadablePBContainerFile::Options options;
+  options.num_parser_threads = 0;
+  BulkReadablePBContainerFile reader(std::move(file), options);
+  RETURN_NOT_OK(reader.Open());
+  Status s = reader.ReadAll(BlockRecordPB(), [&](unique_ptr<google::protobuf::Message> msg) {
+      records->push_back(std::move(*::down_cast<BlockRecordPB*>(msg.get())));
+      return Status::OK();
+    });
+  if (s.IsIncomplete()) {
+    // Records appended after it could not be read back.
+    if (manager_->read_only_) {
+      LOG(WARNING) << "Block container " << ToString() << " has a partial record, "
+                   << "probably written during a crash: it will take no new block";
+      SetReadOnly();
+      return Status::OK();
+    }
+    LOG(WARNING) << "Block container " << ToString() << " has a partial record, "
+                 << "probably written during a crash: truncating its metadata at "
+                 << reader.offset();
+    RETURN_NOT_OK_PREPEND(TruncateMetadata(reader.offset()),
+                          Substitute("Unable to truncate the metadata of block container $0",
+                                     ToString()));
+    return Status::OK();
+  }
+  RETURN_NOT_OK_PREPEND(s, Substitute("Unable to read the metadata of block container $0",
+                                      ToString()));
+  return Status::OK();
+}
+
+Status LogBlockContainer::TruncateMetadata(uint64_t size) {
+  MutexLock l(metadata_lock_);
+  RWFileOptions opts;
+  opts.mode = Env::OPEN_EXISTING;
+  unique_ptr<RWFile> file;
+  RETURN_NOT_OK(manager_->env_->NewRWFile(
+      opts, path_ + LogBlockManager::kContainerMetadataFileSuffix, &file));
+  RETURN_NOT_OK(file->Truncate(size));
+  if (FLAGS_log_block_manager_fsync) {
+    RETURN_NOT_OK(file->Sync());
+  }
+  RETURN_NOT_OK(file->Close());
+  // Appends after the new end of the file.
+  return metadata_file_->Reopen();
+}
+
+Status LogBlockContainer::AppendRecord(const BlockRecordPB& record) {
+  MutexLock l(metadata_lock_);
+  RETURN_NOT_OK(metadata_file_->Append(record));
+  if (FLAGS_log_block_manager_fsync) {
+    RETURN_NOT_OK(metadata_file_->Sync());
+  }
+  return Status::OK();
+}
+
+Status LogBlockContainer::WriteData(int64_t offset, const Slice& data) {
+  int64_t end = offset + data.size();
+  if (end > preallocated_offset_) {
+    int64_t new_end = std::max(end, preallocated_offset_ + FLAGS_log_container_preallocate_bytes);
+    RETURN_NOT_OK(data_file_->PreAllocate(preallocated_offset_,
+                                          new_end - preallocated_offset_));
+    preallocated_offset_ = new_end;
+  }
+  return data_file_->Write(offset, data);
+}
+
+Status LogBlockContainer::ReadData(int64_t offset, size_t length,
+                                   Slice* result, uint8_t* scratch) const {
+  return data_file_->Read(offset, length, result, scratch);
+}
+
+void LogBlockContainer::PunchHole(int64_t offset, int64_t length) {
+  if (length == 0) {
+    return;
+  }
+  // Blocks start on a filesystem block boundary, and the next block starts
+  // on the one after their end: the whole range can be punched.
+  Status s = data_file_->PunchHole(offset, KUDU_ALIGN_UP(length, fs_block_size_));
+  if (s.IsNotSupported()) {
+    KLOG_FIRST_N(WARNING, 1) << "The filesystem of " << ToString()
+                             << " does not support hole punching: the space of the "
+                             << "deleted blocks is reclaimed when their containers are";
+  } else if (!s.ok()) {
+    manager_->HandleIOError(dir_, s);
+    WARN_NOT_OK(s, Substitute("Unable to punch a hole in block container $0", ToString()));
+  }
+}
+
+Status LogBlockContainer::Delete() {
+  Env* env = manager_->env_;
+  // Without descriptor left, the cache deletes the data file right away.
+  data_file_.reset();
+  {
+    MutexLock l(metadata_lock_);
+    WARN_NOT_OK(metadata_file_->Close(), "Unable to close block container metadata file");
+  }
+  // The metadata file first, so that a crash leaves a leftover data file,
+  // which is cleaned up on startup.
+  RETURN_NOT_OK(env->DeleteFile(path_ + LogBlockManager::kContainerMetadataFileSuffix));
+  RETURN_NOT_OK(manager_->file_cache_.DeleteFile(
+      path_ + LogBlockManager::kContainerDataFileSuffix));
+  VLOG(1) << "Deleted block container " << ToString();
+  return Status::OK();
+}
+
+////////////////////////////////////////////////////////////
+// LogBlock
+////////////////////////////////////////////////////////////
+
+// A closed block. Referenced by the block manager until the block is deleted,
+// and by the ReadableBlocks open on it. Its space is reclaimed when it is
+// deleted and not referenced anymore.
+class LogBlock : public base::RefCountedThreadSafe<LogBlock> {
+ public:
+  LogBlock(LogBlockContainer* container, BlockId id, int64_t offset, int64_t length)
+      : container_(container),
+        id_(id),
+        offset_(offset),
+        length_(length),
+        deleted_(false) {
+  }
+
+  void MarkDeleted() { deleted_.Store(true); }
+
+  LogBlockContainer* container() const { return container_; }
+  const BlockId& id() const { return id_; }
+  int64_t offset() const { return offset_; }
+  int64_t length() const { return length_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<LogBlock>;
+
+  ~LogBlock() {
+    if (!deleted_.Load()) {
+      return;
+    }
+    container_->PunchHole(offset_, length_);
+    if (container_->BlockDeleted()) {
+      container_->manager()->RemoveContainer(container_);
+    }
+  }
+
+  LogBlockContainer* const container_;
+  const BlockId id_;
+  const int64_t offset_;
+  const int64_t length_;
+  AtomicBool deleted_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogBlock);
+};
+
+} // namespace internal
+
+using internal::LogBlock;
+using internal::LogBlockContainer;
+
+////////////////////////////////////////////////////////////
+// WritableBlock
+////////////////////////////////////////////////////////////
+
+WritableBlock::WritableBlock(LogBlockManager* manager, LogBlockContainer* container,
+                             BlockId id, int64_t offset)
+    : manager_(manager),
+      container_(container),
+      id_(id),
+      offset_(offset),
+      bytes_appended_(0),
+      closed_(false) {
+}
+
+WritableBlock::~WritableBlock() {
+  if (!closed_) {
+    WARN_NOT_OK(Abort(), Substitute("Unable to abort block $0", id_.ToString()));
+  }
+}
+
+Status WritableBlock::Append(const Slice& data) {
+  DCHECK(!closed_);
+  DataDir::IoScope io(container_->data_dir());
+  RETURN_NOT_OK(manager_->HandleIOError(container_->data_dir(),
+                                        container_->WriteData(offset_ + bytes_appended_, data)));
+  bytes_appended_ += data.size();
+  return Status::OK();
+}
+
+Status WritableBlock::Close() {
+  if (closed_) {
+    return Status::OK();
+  }
+  closed_ = true;
+
+  Status s;
+  if (FLAGS_log_block_manager_fsync) {
+    s = container_->SyncData();
+  }
+  if (s.ok()) {
+    BlockRecordPB record;
+    id_.CopyToPB(record.mutable_block_id());
+    record.set_op_type(CREATE);
+    record.set_timestamp_us(GetCurrentTimeMicros());
+    record.set_offset(offset_);
+    record.set_length(bytes_appended_);
+    s = container_->AppendRecord(record);
+  }
+  if (!s.ok()) {
+    // The metadata of the container may be broken: write no more to it.
+    container_->SetReadOnly();
+    manager_->MakeContainerAvailable(container_);
+    return manager_->HandleIOError(container_->data_dir(), s);
+  }
+
+  // Registered first: the container may become full, and must not be
+  // removed as empty meanwhile.
+  manager_->AddBlock(new LogBlock(container_, id_, offset_, bytes_appended_));
+  container_->BlockFinished(offset_, bytes_appended_);
+  manager_->MakeContainerAvailable(container_);
+  return Status::OK();
+}
+
+Status WritableBlock::Abort() {
+  if (closed_) {
+    return Status::OK();
+  }
+  closed_ = true;
+  // The next block of the container overwrites the data.
+  manager_->MakeContainerAvailable(container_);
+  return Status::OK();
+}
+
+////////////////////////////////////////////////////////////
+// ReadableBlock
+////////////////////////////////////////////////////////////
+
+ReadableBlock::ReadableBlock(scoped_refptr<LogBlock> block)
+    : block_(std::move(block)) {
+}
+
+ReadableBlock::~ReadableBlock() {
+}
+
+const BlockId& ReadableBlock::id() const {
+  return block_->id();
+}
+
+uint64_t ReadableBlock::size() const {
+  return block_->length();
+}
+
+Status ReadableBlock::Read(uint64_t offset, size_t length,
+                           Slice* result, uint8_t* scratch) const {
+  if (offset + length > block_->length()) {
+    return Status::InvalidArgument(
+        Substitute("Read of $0 bytes at offset $1 past end of $2 byte block $3",
+                   length, offset, block_->length(), block_->id().ToString()));
+  }
+  LogBlockContainer* container = block_->container();
+  DataDir::IoScope io(container->data_dir());
+  return container->manager()->HandleIOError(
+      container->data_dir(),
+      container->ReadData(block_->offset() + offset, length, result, scratch));
+}
+
+////////////////////////////////////////////////////////////
+// LogBlockManager
+////////////////////////////////////////////////////////////
+
+LogBlockManager::LogBlockManager(Env* env, DataDirManager* dd_manager,
+                                 const scoped_refptr<MetricEntity>& metric_entity,
+                                 bool read_only)
+    : env_(env),
+      dd_manager_(dd_manager),
+      read_only_(read_only),
+      file_cache_("lbm", env, FLAGS_log_block_manager_max_open_files, nullptr),
+      next_block_id_(0) {
+  if (metric_entity) {
+    blocks_under_management_ =
+        METRIC_log_block_manager_blocks_under_management.Instantiate(metric_entity, 0);
+    bytes_under_management_ =
+        METRIC_log_block_manager_bytes_under_management.Instantiate(metric_entity, 0);
+    containers_ = METRIC_log_block_manager_containers.Instantiate(metric_entity, 0);
+  }
+}
+
+LogBlockManager::~LogBlockManager() {
+  // The blocks reference the containers: release them first.
+  blocks_by_id_.clear();
+  all_containers_.clear();
+}
+
+Status LogBlockManager::Open() {
+  // The data dirs are opened in parallel, each on its own thread pool: the
+  // startup takes as long as the slowest disk rather than all of them.
+  vector<DataDir*> dirs;
+  for (const auto& dir : dd_manager_->data_dirs()) {
+    if (!dir->is_failed()) {
+      dirs.push_back(dir.get());
+      dir_states_[dir.get()].reset(new DataDirState);
+    }
+  }
+  vector<Status> statuses(dirs.size());
+  for (int i = 0; i < dirs.size(); i++) {
+    DataDir* dir = dirs[i];
+    Status* status = &statuses[i];
+    Status s = dir->ExecClosure([this, dir, status]() { *status = OpenDataDir(dir); });
+    if (!s.ok()) {
+      *status = s;
+    }
+  }
+  for (DataDir* dir : dirs) {
+    dir->WaitOnClosures();
+  }
+
+  for (int i = 0; i < dirs.size(); i++) {
+    const Status& s = statuses[i];
+    if (!s.ok()) {
+      // A broken disk fails its dir only. Other errors (e.g. corrupt
+      // metadata) need an operator.
+      HandleIOError(dirs[i], s);
+      if (!dirs[i]->is_failed()) {
+        return s.CloneAndPrepend(Substitute("Unable to open the blocks of $0", dirs[i]->dir()));
+      }
+    }
+  }
+
+  // Block IDs are never reused: start past those in use, and past those of
+  // a previous run, which may be in a data dir that failed since.
+  uint64_t max_block_id = 0;
+  {
+    MutexLock l(lock_);
+    for (const auto& entry : blocks_by_id_) {
+      max_block_id = std::max(max_block_id, entry.first.id());
+    }
+  }
+  next_block_id_.Store(std::max<uint64_t>(max_block_id, GetCurrentTimeMicros()));
+  LOG(INFO) << "Opened the log block manager: " << num_blocks() << " blocks in "
+            << num_containers() << " containers";
+  return Status::OK();
+}
+
+Status LogBlockManager::OpenDataDir(DataDir* dir) {
+  DataDirState* state = FindOrDie(dir_states_, dir).get();
+
+  // Each data dir has an instance file, which records the block manager
+  // type, so that the blocks of another type are not mistaken for ours.
+  string instance_path = JoinPathSegments(dir->dir(), kInstanceMetadataFileName);
+  PathInstanceMetadataPB instance;
+  if (env_->FileExists(instance_path)) {
+    RETURN_NOT_OK(pb_util::ReadPBContainerFromPath(env_, instance_path, &instance));
+    if (instance.block_manager_type() != kBlockManagerType) {
+      return Status::NotSupported(
+          Substitute("Data dir $0 holds blocks of an unsupported block manager: $1",
+                     dir->dir(), instance.block_manager_type()));
+    }
+  } else if (read_only_) {
+    return Status::OK();
+  } else {
+    string uuid = ObjectIdGenerator().Next();
+    instance.mutable_path_set()->set_uuid(uuid);
+    instance.mutable_path_set()->add_all_uuids(uuid);
+    instance.set_block_manager_type(kBlockManagerType);
+    uint64_t fs_block_size;
+    if (!env_->GetBlockSize(dir->dir(), &fs_block_size).ok() || fs_block_size == 0) {
+      fs_block_size = kDefaultFsBlockSize;
+    }
+    instance.set_filesystem_block_size_bytes(fs_block_size);
+    RETURN_NOT_OK(pb_util::WritePBContainerToPath(env_, instance_path, instance,
+                                                  pb_util::NO_OVERWRITE, pb_util::SYNC));
+  }
+  int64_t fs_block_size = instance.filesystem_block_size_bytes();
+  state->fs_block_size = fs_block_size;
+
+  // The manifest spares listing the dir, which may hold many other files.
+  // The dir is only listed if the manifest is missing (e.g. the dir was
+  // written by an older version) or unreadable, and the manifest is written
+  // again.
+  std::set<string> container_ids;
+  bool write_manifest = false;
+  Status s = ReadManifest(dir, &container_ids);
+  if (s.IsNotFound() || s.IsCorruption()) {
+    if (s.IsCorruption()) {
+      LOG(WARNING) << "Listing data dir " << dir->dir() << ": " << s.ToString();
+    }
+    container_ids.clear();
+    RETURN_NOT_OK(ScanDataDir(dir, &container_ids));
+    write_manifest = true;
+  } else {
+    RETURN_NOT_OK(s);
+  }
+
+  for (auto id_it = container_ids.begin(); id_it != container_ids.end();) {
+    const string& id = *id_it;
+    unique_ptr<LogBlockContainer> container;
+    s = LogBlockContainer::Open(this, dir, fs_block_size, id, &container);
+    if (s.IsNotFound()) {
+      // Added to the manifest, but a crash happened before its files were
+      // created, or before it was removed from the manifest.
+      LOG(INFO) << "Dropping block container " << id << " of " << dir->dir() << ": "
+                << s.ToString();
+      if (!read_only_) {
+        string data_path = JoinPathSegments(dir->dir(), id + kContainerDataFileSuffix);
+        if (env_->FileExists(data_path)) {
+          WARN_NOT_OK(env_->DeleteFile(data_path), Substitute("Unable to delete $0", data_path));
+        }
+      }
+      id_it = container_ids.erase(id_it);
+      write_manifest = true;
+      continue;
+    }
+    if (s.IsIncomplete() || s.IsCorruption()) {
+      // A crash while the container was created may leave its metadata file
+      // empty or without a complete header. No block was written to it then.
+      string data_path = JoinPathSegments(dir->dir(), id + kContainerDataFileSuffix);
+      string metadata_path = JoinPathSegments(dir->dir(), id + kContainerMetadataFileSuffix);
+      uint64_t data_size;
+      if (env_->GetFileSize(data_path, &data_size).ok() && data_size == 0) {
+        LOG(WARNING) << "Dropping block container " << id << " of " << dir->dir()
+                     << ", left by a crash while it was created: " << s.ToString();
+        if (!read_only_) {
+          WARN_NOT_OK(env_->DeleteFile(metadata_path),
+                      Substitute("Unable to delete $0", metadata_path));
+          WARN_NOT_OK(env_->DeleteFile(data_path), Substitute("Unable to delete $0", data_path));
+        }
+        id_it = container_ids.erase(id_it);
+        write_manifest = true;
+        continue;
+      }
+    }
+    RETURN_NOT_OK(s);
+    vector<BlockRecordPB> records;
+    RETURN_NOT_OK(container->ReadRecords(&records));
+
+    // Replays the records: the blocks created and not deleted are live.
+    std::map<uint64_t, BlockRecordPB> live_blocks;
+    for (const BlockRecordPB& record : records) {
+      if (record.op_type() == CREATE) {
+        container->BlockFinished(record.offset(), record.length());
+        live_blocks[record.block_id().id()] = record;
+      } else if (record.op_type() == DELETE) {
+        auto it = live_blocks.find(record.block_id().id());
+        if (it == live_blocks.end()) {
+          continue;
+        }
+        // The hole may not have been punched before a crash.
+        if (!read_only_) {
+          container->PunchHole(it->second.offset(), it->second.length());
+        }
+        live_blocks.erase(it);
+      }
+    }
+
+    if (live_blocks.empty() && !read_only_) {
+      Status delete_status = container->Delete();
+      WARN_NOT_OK(delete_status, Substitute("Unable to delete empty block container $0",
+                                            container->ToString()));
+      if (delete_status.ok()) {
+        id_it = container_ids.erase(id_it);
+        write_manifest = true;
+      } else {
+        ++id_it;
+      }
+      continue;
+    }
+    if (read_only_) {
+      container->SetReadOnly();
+    }
+
+    LogBlockContainer* c = container.get();
+    {
+      MutexLock l(lock_);
+      all_containers_[c] = std::move(container);
+      if (!c->full()) {
+        available_containers_[dir].push_back(c);
+      }
+    }
+    if (containers_) {
+      containers_->Increment();
+    }
+    for (const auto& entry : live_blocks) {
+      AddBlock(new LogBlock(c, BlockId(entry.first), entry.second.offset(),
+                            entry.second.length()));
+    }
+    ++id_it;
+  }
+
+  MutexLock l(state->manifest_lock);
+  state->container_ids = std::move(container_ids);
+  if (write_manifest && !read_only_) {
+    RETURN_NOT_OK(WriteManifest(dir, state->container_ids));
+  }
+  return Status::OK();
+}
+
+Status LogBlockManager::ScanDataDir(DataDir* dir, std::set<string>* container_ids) {
+  vector<string> children;
+  RETURN_NOT_OK(env_->GetChildren(dir->dir(), &children));
+  for (const string& child : children) {
+    string id;
+    if (TryStripSuffixString(child, kContainerMetadataFileSuffix, &id)) {
+      container_ids->insert(id);
+    }
+  }
+  if (!read_only_) {
+    for (const string& child : children) {
+      string id;
+      if (TryStripSuffixString(child, kContainerDataFileSuffix, &id) &&
+          !ContainsKey(*container_ids, id)) {
+        string path = JoinPathSegments(dir->dir(), child);
+        LOG(INFO) << "Deleting block container data file without metadata " << path;
+        WARN_NOT_OK(env_->DeleteFile(path), Substitute("Unable to delete $0", path));
+      }
+    }
+  }
+  return Status::OK();
+}
+
+Status LogBlockManager::ReadManifest(DataDir* dir, std::set<string>* container_ids) {
+  string path = JoinPathSegments(dir->dir(), kContainerManifestFileName);
+  LogBlockContainerManifestPB manifest;
+  RETURN_NOT_OK(pb_util::ReadPBContainerFromPath(env_, path, &manifest));
+  container_ids->insert(manifest.container_ids().begin(), manifest.container_ids().end());
+  return Status::OK();
+}
+
+Status LogBlockManager::WriteManifest(DataDir* dir, const std::set<string>& container_ids) {
+  string path = JoinPathSegments(dir->dir(), kContainerManifestFileName);
+  LogBlockContainerManifestPB manifest;
+  for (const string& id : container_ids) {
+    manifest.add_container_ids(id);
+  }
+  return pb_util::WritePBContainerToPath(env_, path, manifest,
+                                         pb_util::OVERWRITE, pb_util::SYNC);
+}
+
+Status LogBlockManager::UpdateManifest(DataDir* dir, const string& container_id, bool add) {
+  DataDirState* state = FindOrDie(dir_states_, dir).get();
+  MutexLock l(state->manifest_lock);
+  if (add) {
+    state->container_ids.insert(container_id);
+  } else {
+    state->container_ids.erase(container_id);
+  }
+  return HandleIOError(dir, WriteManifest(dir, state->container_ids));
+}
+
+Status LogBlockManager::CreateBlock(unique_ptr<WritableBlock>* block) {
+  if (read_only_) {
+    return Status::IllegalState("The block manager is read-only");
+  }
+  // Retries on another dir if the one picked turns out to be broken.
+  while (true) {
+    DataDir* dir;
+    RETURN_NOT_OK(dd_manager_->GetNextDataDir(&dir));
+    LogBlockContainer* container;
+    Status s = GetAvailableContainer(dir, &container);
+    if (!s.ok()) {
+      HandleIOError(dir, s);
+      if (dir->is_failed()) {
+        continue;
+      }
+      return s;
+    }
+    block->reset(new WritableBlock(this, container, NextBlockId(),
+                                   container->next_block_offset()));
+    return Status::OK();
+  }
+}
+
+Status LogBlockManager::GetAvailableContainer(DataDir* dir, LogBlockContainer** container) {
+  {
+    MutexLock l(lock_);
+    auto it = available_containers_.find(dir);
+    if (it != available_containers_.end()) {
+      // A container may have become read-only while waiting here: skip it.
+      while (!it->second.empty()) {
+        LogBlockContainer* c = it->second.back();
+        it->second.pop_back();
+        if (!c->full()) {
+          *container = c;
+          return Status::OK();
+        }
+      }
+    }
+  }
+
+  auto state_it = dir_states_.find(dir);
+  if (state_it == dir_states_.end() || state_it->second->fs_block_size == 0) {
+    return Status::IllegalState(Substitute("Data dir $0 was not opened", dir->dir()));
+  }
+  // The container goes to the manifest before its files are created: after
+  // a crash in between, it is dropped from the manifest on startup, rather
+  // than leaving files nothing refers to.
+  string id = ObjectIdGenerator().Next();
+  RETURN_NOT_OK_PREPEND(UpdateManifest(dir, id, true),
+                        Substitute("Unable to add a block container to $0", dir->dir()));
+  unique_ptr<LogBlockContainer> new_container;
+  RETURN_NOT_OK_PREPEND(LogBlockContainer::Create(this, dir, state_it->second->fs_block_size,
+                                                  id, &new_container),
+                        Substitute("Unable to create a block container in $0", dir->dir()));
+  *container = new_container.get();
+  {
+    MutexLock l(lock_);
+    all_containers_[*container] = std::move(new_container);
+  }
+  if (containers_) {
+    containers_->Increment();
+  }
+  return Status::OK();
+}
+
+void LogBlockManager::MakeContainerAvailable(LogBlockContainer* container) {
+  if (container->full()) {
+    return;
+  }
+  MutexLock l(lock_);
+  available_containers_[container->data_dir()].push_back(container);
+}
+
+void LogBlockManager::AddBlock(scoped_refptr<LogBlock> block) {
+  int64_t length = block->length();
+  block->container()->BlockAdded();
+  {
+    MutexLock l(lock_);
+    bool inserted = blocks_by_id_.emplace(block->id(), std::move(block)).second;
+    CHECK(inserted) << "Duplicate block ID";
+  }
+  if (blocks_under_management_) {
+    blocks_under_management_->Increment();
+    bytes_under_management_->IncrementBy(length);
+  }
+}
+
+Status LogBlockManager::OpenBlock(const BlockId& block_id, unique_ptr<ReadableBlock>* block) {
+  scoped_refptr<LogBlock> log_block;
+  {
+    MutexLock l(lock_);
+    auto it = blocks_by_id_.find(block_id);
+    if (it == blocks_by_id_.end()) {
+      return Status::NotFound("No such block", block_id.ToString());
+    }
+    log_block = it->second;
+  }
+  block->reset(new ReadableBlock(std::move(log_block)));
+  return Status::OK();
+}
+
+Status LogBlockManager::DeleteBlock(const BlockId& block_id) {
+  if (read_only_) {
+    return Status::IllegalState("The block manager is read-only");
+  }
+  scoped_refptr<LogBlock> log_block;
+  {
+    MutexLock l(lock_);
+    auto it = blocks_by_id_.find(block_id);
+    if (it == blocks_by_id_.end()) {
+      return Status::NotFound("No such block", block_id.ToString());
+    }
+    log_block = std::move(it->second);
+    blocks_by_id_.erase(it);
+  }
+
+  BlockRecordPB record;
+  block_id.CopyToPB(record.mutable_block_id());
+  record.set_op_type(DELETE);
+  record.set_timestamp_us(GetCurrentTimeMicros());
+  LogBlockContainer* container = log_block->container();
+  Status s = container->AppendRecord(record);
+  if (!s.ok()) {
+    // The block is found again on restart: keep it until then. The metadata
+    // of the container may be broken: write no more blocks to it.
+    container->SetReadOnly();
+    {
+      MutexLock l(lock_);
+      blocks_by_id_.emplace(block_id, std::move(log_block));
+    }
+    return HandleIOError(container->data_dir(), s);
+  }
+  if (blocks_under_management_) {
+    blocks_under_management_->IncrementBy(-1);
+    bytes_under_management_->IncrementBy(-log_block->length());
+  }
+
+  // The space is reclaimed once the last reader is done: it may be right
+  // now, outside of the lock.
+  log_block->MarkDeleted();
+  return Status::OK();
+}
+
+void LogBlockManager::RemoveContainer(LogBlockContainer* container) {
+  unique_ptr<LogBlockContainer> to_delete;
+  {
+    MutexLock l(lock_);
+    auto it = all_containers_.find(container);
+    if (it == all_containers_.end()) {
+      // The block manager is being destroyed.
+      return;
+    }
+    to_delete = std::move(it->second);
+    all_containers_.erase(it);
+    // A container made read-only while available is still listed.
+    auto available_it = available_containers_.find(container->data_dir());
+    if (available_it != available_containers_.end()) {
+      auto& available = available_it->second;
+      available.erase(std::remove(available.begin(), available.end(), container),
+                      available.end());
+    }
+  }
+  if (containers_) {
+    containers_->IncrementBy(-1);
+  }
+  Status s = to_delete->Delete();
+  WARN_NOT_OK(s, Substitute("Unable to delete full block container $0", to_delete->ToString()));
+  if (s.ok()) {
+    WARN_NOT_OK(UpdateManifest(to_delete->data_dir(), to_delete->id(), false),
+                Substitute("Unable to remove block container $0 from the manifest",
+                           to_delete->ToString()));
+  }
+}
+
+Status LogBlockManager::HandleIOError(DataDir* dir, const Status& s) {
+  return dd_manager_->HandleIOError(dir, s);
+}
+
+int64_t LogBlockManager::num_blocks() const {
+  MutexLock l(lock_);
+  return blocks_by_id_.size();
+}
+
+int64_t LogBlockManager::num_containers() const {
+  MutexLock l(lock_);
+  return all_containers_.size();
+}
+
+} // namespace mprmpr
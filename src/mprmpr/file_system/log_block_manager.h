@@ -0,0 +1,238 @@
+#ifndef ANT_FILE_SYSTEM_LOG_BLOCK_MANAGER_H_
+#define ANT_FILE_SYSTEM_LOG_BLOCK_MANAGER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/file_system/block_id.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/file_cache.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/slice.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class DataDir;
+class DataDirManager;
+class Env;
+class RWFile;
+class LogBlockManager;
+
+namespace internal {
+class LogBlock;
+class LogBlockContainer;
+} // namespace internal
+
+// A block being written. Not readable until closed.
+//
+// This class is not thread-safe.
+class WritableBlock {
+ public:
+  // Aborts the block if it was not closed.
+  ~WritableBlock();
+
+  const BlockId& id() const { return id_; }
+
+  // Appends 'data' to the block.
+  Status Append(const Slice& data);
+
+  // Finishes the block: it is readable from now on, and its container may
+  // take the next block.
+  Status Close();
+
+  // Discards the block.
+  Status Abort();
+
+  size_t bytes_appended() const { return bytes_appended_; }
+
+ private:
+  friend class LogBlockManager;
+
+  WritableBlock(LogBlockManager* manager, internal::LogBlockContainer* container,
+                BlockId id, int64_t offset);
+
+  LogBlockManager* const manager_;
+  internal::LogBlockContainer* const container_;
+  const BlockId id_;
+  const int64_t offset_;
+  size_t bytes_appended_;
+  bool closed_;
+
+  DISALLOW_COPY_AND_ASSIGN(WritableBlock);
+};
+
+// A closed block opened for reading. The data stays readable until the block
+// is destroyed, even if the block is deleted meanwhile.
+//
+// This class is thread-safe.
+class ReadableBlock {
+ public:
+  ~ReadableBlock();
+
+  const BlockId& id() const;
+
+  uint64_t size() const;
+
+  // Reads 'length' bytes at 'offset' of the block into 'scratch', and points
+  // 'result' to them.
+  Status Read(uint64_t offset, size_t length, Slice* result, uint8_t* scratch) const;
+
+ private:
+  friend class LogBlockManager;
+
+  explicit ReadableBlock(scoped_refptr<internal::LogBlock> block);
+
+  scoped_refptr<internal::LogBlock> block_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadableBlock);
+};
+
+// A block manager storing its blocks in a few large files, rather than one
+// file per block.
+//
+// Intermediate job artifacts (decrypted and transcoded segments, etc.) are
+// many, short-lived and written once. Creating and deleting a file for each
+// of them costs an inode, a directory entry and a journal transaction each
+// time, and serializes the writers on the directory lock. Instead, blocks are
+// appended back to back to a container data file, preallocated in large
+// extents, and their creation and deletion are logged to a metadata file of
+// BlockRecordPBs next to it:
+//
+//   <data dir>/<container id>.data
+//   <data dir>/<container id>.metadata
+//
+// The space of a deleted block is returned to the filesystem by punching a
+// hole over it (fallocate(FALLOC_FL_PUNCH_HOLE)). Blocks are aligned to the
+// filesystem block size, so that the holes cover them entirely. A container
+// whose blocks have all been deleted once it is full is removed.
+//
+// A container takes one block at a time: new blocks go to the containers of
+// the data dir picked by the DataDirManager, and to a new container if they
+// are all busy. On startup, the blocks are found again by replaying the
+// metadata of the containers, listed in a manifest in each data dir.
+//
+// This class is thread-safe.
+class LogBlockManager {
+ public:
+  static const char* kContainerDataFileSuffix;
+  static const char* kContainerMetadataFileSuffix;
+  static const char* kInstanceMetadataFileName;
+  static const char* kContainerManifestFileName;
+
+  // 'dd_manager' must be open and outlive the block manager. If 'read_only',
+  // blocks can only be read.
+  LogBlockManager(Env* env, DataDirManager* dd_manager,
+                  const scoped_refptr<MetricEntity>& metric_entity,
+                  bool read_only);
+  ~LogBlockManager();
+
+  // Loads the containers of the healthy data dirs.
+  Status Open();
+
+  // Creates a new block.
+  Status CreateBlock(std::unique_ptr<WritableBlock>* block);
+
+  // Opens the closed block 'block_id' for reading. Returns NotFound if there
+  // is no such block.
+  Status OpenBlock(const BlockId& block_id, std::unique_ptr<ReadableBlock>* block);
+
+  // Deletes the block 'block_id'. Its space is reclaimed once it is not open
+  // anymore.
+  Status DeleteBlock(const BlockId& block_id);
+
+  // The number of closed blocks.
+  int64_t num_blocks() const;
+
+  // The number of containers.
+  int64_t num_containers() const;
+
+ private:
+  friend class ReadableBlock;
+  friend class WritableBlock;
+  friend class internal::LogBlock;
+  friend class internal::LogBlockContainer;
+
+  typedef std::unordered_map<BlockId, scoped_refptr<internal::LogBlock>, BlockIdHash> BlockMap;
+
+  // The state of an opened data dir.
+  struct DataDirState {
+    DataDirState() : fs_block_size(0) {}
+
+    // Immutable after Open().
+    int64_t fs_block_size;
+
+    // Serializes the writes of the manifest.
+    Mutex manifest_lock;
+
+    // The containers listed in the manifest. Protected by 'manifest_lock'.
+    std::set<std::string> container_ids;
+  };
+
+  // Loads the block manager instance metadata of 'dir', creating it if
+  // missing, and its containers.
+  Status OpenDataDir(DataDir* dir);
+
+  // Lists the containers of 'dir' from its files, deleting the leftovers of
+  // crashes.
+  Status ScanDataDir(DataDir* dir, std::set<std::string>* container_ids);
+
+  Status ReadManifest(DataDir* dir, std::set<std::string>* container_ids);
+  Status WriteManifest(DataDir* dir, const std::set<std::string>& container_ids);
+
+  // Adds 'container_id' to the manifest of 'dir', or removes it from it.
+  Status UpdateManifest(DataDir* dir, const std::string& container_id, bool add);
+
+  // Returns a container of 'dir' not taking a block, creating one if needed.
+  Status GetAvailableContainer(DataDir* dir, internal::LogBlockContainer** container);
+
+  // Called when the block written to 'container' is closed or aborted.
+  void MakeContainerAvailable(internal::LogBlockContainer* container);
+
+  // Registers a closed block.
+  void AddBlock(scoped_refptr<internal::LogBlock> block);
+
+  // Called once all the blocks of a full container have been deleted.
+  void RemoveContainer(internal::LogBlockContainer* container);
+
+  // Marks 'dir' failed if 's' denotes a broken disk. Returns 's'.
+  Status HandleIOError(DataDir* dir, const Status& s);
+
+  BlockId NextBlockId() { return BlockId(next_block_id_.Increment()); }
+
+  Env* const env_;
+  DataDirManager* const dd_manager_;
+  const bool read_only_;
+
+  // The data files of the containers. Outlives them.
+  FileCache<RWFile> file_cache_;
+
+  AtomicInt<uint64_t> next_block_id_;
+
+  // The healthy data dirs as of Open(). The map is immutable after Open().
+  std::unordered_map<DataDir*, std::unique_ptr<DataDirState>> dir_states_;
+
+  // Protects the fields below.
+  mutable Mutex lock_;
+  BlockMap blocks_by_id_;
+  std::unordered_map<internal::LogBlockContainer*,
+                     std::unique_ptr<internal::LogBlockContainer>> all_containers_;
+  std::unordered_map<DataDir*, std::vector<internal::LogBlockContainer*>> available_containers_;
+
+  scoped_refptr<AtomicGauge<uint64_t>> blocks_under_management_;
+  scoped_refptr<AtomicGauge<uint64_t>> bytes_under_management_;
+  scoped_refptr<AtomicGauge<uint64_t>> containers_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogBlockManager);
+};
+
+} // namespace mprmpr
+#endif // ANT_FILE_SYSTEM_LOG_BLOCK_MANAGER_H_
@@ -1,6 +1,16 @@
 #include "mprmpr/master/job_manager.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+
 #include "mprmpr/util/locks.h"
 
+DEFINE_int32(master_max_tracked_jobs, 10000,
+             "Number of jobs past which the master forgets the oldest completed "
+             "ones. The jobs in progress are always tracked.");
+
 namespace mprmpr {
 
 JobManager::JobManager() {}
@@ -11,7 +21,37 @@ JobManager* JobManager::get() {
 
 void JobManager::AddJobDescriptor(const JobDescriptorPB* job_desc) {
   std::lock_guard<simple_spinlock> l(lock_);
-  jobs_.push_back(job_desc);
+  auto result = jobs_.emplace(job_desc->job_uuid(), job_desc);
+  if (!result.second) {
+    result.first->second = job_desc;
+    return;
+  }
+  job_uuids_.push_back(job_desc->job_uuid());
+  EvictCompletedJobsLocked();
+}
+
+void JobManager::EvictCompletedJobsLocked() {
+  size_t max_jobs = std::max(FLAGS_master_max_tracked_jobs, 0);
+  auto it = job_uuids_.begin();
+  while (jobs_.size() > max_jobs && it != job_uuids_.end()) {
+    auto job_it = jobs_.find(*it);
+    DCHECK(job_it != jobs_.end());
+    if (job_it->second->job_state() == JobDescriptorPB::COMPLETE) {
+      jobs_.erase(job_it);
+      it = job_uuids_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::string JobManager::GetJobTraceId(const std::string& job_uuid) const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  auto it = jobs_.find(job_uuid);
+  if (it == jobs_.end()) {
+    return "";
+  }
+  return it->second->trace_id();
 }
 
 } // namespace mprmpr
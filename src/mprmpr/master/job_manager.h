@@ -6,7 +6,10 @@
 #include "mprmpr/common/common.pb.h"
 #include "mprmpr/util/locks.h"
 
+#include <list>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace mprmpr {
 
@@ -14,14 +17,30 @@ namespace mprmpr {
 class JobManager {
  public:
   static JobManager* get();
+
+  // Tracks the job 'job_descriptor' by its UUID. Past
+  // --master_max_tracked_jobs, the oldest completed jobs are forgotten.
   void AddJobDescriptor(const JobDescriptorPB* job_descriptor);
 
+  // Returns the trace ID of the job 'job_uuid', or an empty string if the job
+  // is unknown or not traced.
+  std::string GetJobTraceId(const std::string& job_uuid) const;
+
  private:
   friend class Singleton<JobManager>;
   JobManager();
 
+  // Forgets the oldest completed jobs while more than
+  // --master_max_tracked_jobs are tracked.
+  void EvictCompletedJobsLocked();
+
   mutable simple_spinlock lock_;
-  std::vector<const JobDescriptorPB*> jobs_;
+
+  // The jobs by UUID.
+  std::unordered_map<std::string, const JobDescriptorPB*> jobs_;
+
+  // The UUIDs of 'jobs_', oldest first.
+  std::list<std::string> job_uuids_;
 
   DISALLOW_COPY_AND_ASSIGN(JobManager);
 };
@@ -0,0 +1,147 @@
+#include "mprmpr/master/job_metadata_cache.h"
+
+#include <mutex>
+
+#include <glog/logging.h>
+
+#include "mprmpr/util/mem_tracker.h"
+
+METRIC_DEFINE_counter(server, job_metadata_cache_hits,
+                      "Job Metadata Cache Hits",
+                      mprmpr::MetricUnit::kCacheHits,
+                      "Number of job lookups served from the job metadata cache");
+METRIC_DEFINE_counter(server, job_metadata_cache_misses,
+                      "Job Metadata Cache Misses",
+                      mprmpr::MetricUnit::kCacheQueries,
+                      "Number of job lookups which had to load the job from the database");
+METRIC_DEFINE_counter(server, job_metadata_cache_evictions,
+                      "Job Metadata Cache Evictions",
+                      mprmpr::MetricUnit::kEntries,
+                      "Number of jobs evicted from the job metadata cache to stay "
+                      "within its capacity");
+
+using std::shared_ptr;
+using std::string;
+
+namespace mprmpr {
+
+namespace {
+
+// Approximate memory used by the bookkeeping of an entry: the list node, the
+// hash table node and the control block of the shared_ptr.
+const int64_t kEntryOverhead = 128;
+
+} // anonymous namespace
+
+JobMetadataCache::JobMetadataCache(int64_t capacity_bytes,
+                                   Loader loader,
+                                   const shared_ptr<MemTracker>& parent_tracker,
+                                   const scoped_refptr<MetricEntity>& metric_entity)
+    : shard_capacity_(capacity_bytes / kNumShards),
+      loader_(std::move(loader)),
+      mem_tracker_(MemTracker::CreateTracker(capacity_bytes, "job_metadata_cache",
+                                             parent_tracker)),
+      hits_(METRIC_job_metadata_cache_hits.Instantiate(metric_entity)),
+      misses_(METRIC_job_metadata_cache_misses.Instantiate(metric_entity)),
+      evictions_(METRIC_job_metadata_cache_evictions.Instantiate(metric_entity)) {
+}
+
+JobMetadataCache::~JobMetadataCache() {
+  for (Shard& shard : shards_) {
+    mem_tracker_->Release(shard.usage);
+  }
+}
+
+JobMetadataCache::Shard* JobMetadataCache::ShardFor(const string& job_uuid) {
+  size_t hash = std::hash<string>()(job_uuid);
+  return &shards_[hash & (kNumShards - 1)];
+}
+
+Status JobMetadataCache::Lookup(const string& job_uuid,
+                                shared_ptr<const JobDescriptorPB>* job) {
+  Shard* shard = ShardFor(job_uuid);
+  uint64_t epoch;
+  {
+    std::lock_guard<simple_spinlock> l(shard->lock);
+    auto it = shard->entries.find(job_uuid);
+    if (it != shard->entries.end()) {
+      shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+      *job = it->second->job;
+      hits_->Increment();
+      return Status::OK();
+    }
+    epoch = shard->epoch;
+  }
+  misses_->Increment();
+
+  // Loads the job without holding the lock: it is a round trip to the
+  // database.
+  shared_ptr<JobDescriptorPB> loaded(new JobDescriptorPB());
+  RETURN_NOT_OK(loader_(job_uuid, loaded.get()));
+  *job = loaded;
+
+  std::lock_guard<simple_spinlock> l(shard->lock);
+  // If the shard was written meanwhile, the job loaded may predate a state
+  // transition: it is returned but not cached.
+  if (shard->epoch == epoch) {
+    InsertUnlocked(shard, std::move(loaded));
+  }
+  return Status::OK();
+}
+
+void JobMetadataCache::Insert(const JobDescriptorPB& job) {
+  shared_ptr<const JobDescriptorPB> copy(new JobDescriptorPB(job));
+  Shard* shard = ShardFor(job.job_uuid());
+  std::lock_guard<simple_spinlock> l(shard->lock);
+  shard->epoch++;
+  InsertUnlocked(shard, std::move(copy));
+}
+
+void JobMetadataCache::Erase(const string& job_uuid) {
+  Shard* shard = ShardFor(job_uuid);
+  std::lock_guard<simple_spinlock> l(shard->lock);
+  shard->epoch++;
+  auto it = shard->entries.find(job_uuid);
+  if (it != shard->entries.end()) {
+    EraseUnlocked(shard, it->second);
+  }
+}
+
+int64_t JobMetadataCache::num_entries() const {
+  int64_t num_entries = 0;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<simple_spinlock> l(shard.lock);
+    num_entries += shard.entries.size();
+  }
+  return num_entries;
+}
+
+void JobMetadataCache::InsertUnlocked(Shard* shard, shared_ptr<const JobDescriptorPB> job) {
+  const string& job_uuid = job->job_uuid();
+  auto it = shard->entries.find(job_uuid);
+  if (it != shard->entries.end()) {
+    EraseUnlocked(shard, it->second);
+  }
+
+  int64_t charge = job_uuid.size() * 2 + job->SpaceUsed() + kEntryOverhead;
+  shard->lru.push_front({ job_uuid, std::move(job), charge });
+  shard->entries.emplace(shard->lru.front().job_uuid, shard->lru.begin());
+  shard->usage += charge;
+  mem_tracker_->Consume(charge);
+
+  // Keeps at least the job just inserted, even if it is larger than the
+  // shard.
+  while (shard->usage > shard_capacity_ && shard->lru.size() > 1) {
+    EraseUnlocked(shard, std::prev(shard->lru.end()));
+    evictions_->Increment();
+  }
+}
+
+void JobMetadataCache::EraseUnlocked(Shard* shard, EntryList::iterator it) {
+  shard->usage -= it->charge;
+  mem_tracker_->Release(it->charge);
+  shard->entries.erase(it->job_uuid);
+  shard->lru.erase(it);
+}
+
+} // namespace mprmpr
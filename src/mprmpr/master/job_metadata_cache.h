@@ -0,0 +1,118 @@
+#ifndef MPRMPR_MASTER_JOB_METADATA_CACHE_H_
+#define MPRMPR_MASTER_JOB_METADATA_CACHE_H_
+
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/common/common.pb.h"
+#include "mprmpr/util/locks.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class MemTracker;
+
+// A read-through cache of job descriptors, keyed by job UUID, in front of the
+// database.
+//
+// The metadata of a job never changes after the job is created, and its state
+// only changes on the master, so that status polls can be served from memory:
+// a lookup which misses loads the job with the loader (e.g. from MySQL), and
+// the master keeps the cached jobs up to date by calling Insert() or Erase()
+// once a state transition has been written to the database.
+//
+// The cache is split into shards, each with its own lock and LRU list, so that
+// concurrent lookups rarely contend. The memory of the cached jobs is
+// accounted to a MemTracker, and the least recently used jobs of a shard are
+// evicted once the shard holds more than its part of the capacity.
+//
+// This class is thread-safe.
+class JobMetadataCache {
+ public:
+  // Loads the job 'job_uuid' into 'job'. Returns NotFound if there is no such
+  // job.
+  typedef std::function<Status(const std::string& job_uuid, JobDescriptorPB* job)> Loader;
+
+  // Holds up to 'capacity_bytes' of jobs, accounted to a child of
+  // 'parent_tracker'.
+  JobMetadataCache(int64_t capacity_bytes,
+                   Loader loader,
+                   const std::shared_ptr<MemTracker>& parent_tracker,
+                   const scoped_refptr<MetricEntity>& metric_entity);
+  ~JobMetadataCache();
+
+  // Looks up the job 'job_uuid', loading it if it is not cached. Returns the
+  // error of the loader if it fails; failures are not cached.
+  Status Lookup(const std::string& job_uuid, std::shared_ptr<const JobDescriptorPB>* job);
+
+  // Caches 'job', replacing the cached copy if any. Call it after writing the
+  // job to the database.
+  void Insert(const JobDescriptorPB& job);
+
+  // Drops the cached copy of the job 'job_uuid', if any.
+  void Erase(const std::string& job_uuid);
+
+  // The number of jobs cached.
+  int64_t num_entries() const;
+
+  const std::shared_ptr<MemTracker>& mem_tracker() const { return mem_tracker_; }
+
+ private:
+  enum {
+    kNumShardBits = 4,
+    kNumShards = 1 << kNumShardBits
+  };
+
+  struct Entry {
+    std::string job_uuid;
+    std::shared_ptr<const JobDescriptorPB> job;
+    int64_t charge;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  struct Shard {
+    Shard() : usage(0), epoch(0) {}
+
+    mutable simple_spinlock lock;
+
+    // Most recently used first.
+    EntryList lru;
+    std::unordered_map<std::string, EntryList::iterator> entries;
+    int64_t usage;
+
+    // Incremented by every write to the shard, so that a job loaded before a
+    // write is not cached over it.
+    uint64_t epoch;
+  };
+
+  Shard* ShardFor(const std::string& job_uuid);
+
+  // Caches 'job' in 'shard', replacing the cached copy if any, and evicts the
+  // least recently used jobs over the capacity. Requires the lock of 'shard'.
+  void InsertUnlocked(Shard* shard, std::shared_ptr<const JobDescriptorPB> job);
+
+  // Requires the lock of 'shard'.
+  void EraseUnlocked(Shard* shard, EntryList::iterator it);
+
+  const int64_t shard_capacity_;
+  const Loader loader_;
+  std::shared_ptr<MemTracker> mem_tracker_;
+  Shard shards_[kNumShards];
+
+  scoped_refptr<Counter> hits_;
+  scoped_refptr<Counter> misses_;
+  scoped_refptr<Counter> evictions_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobMetadataCache);
+};
+
+} // namespace mprmpr
+#endif // MPRMPR_MASTER_JOB_METADATA_CACHE_H_
@@ -18,6 +18,7 @@
 #include "mprmpr/rpc/messenger.h"
 #include "mprmpr/rpc/service_if.h"
 #include "mprmpr/rpc/service_pool.h"
+#include "mprmpr/server/job_trace.h"
 #include "mprmpr/server/rpc_server.h"
 #include "mprmpr/util/net/net_util.h"
 #include "mprmpr/util/net/sockaddr.h"
@@ -32,6 +33,7 @@ Master::Master(const MasterOptions& options)
     : ServerBase("Master", options, "mprmpr.master"),
       state_(kStopped),
       worker_manager_(new WorkerManager()),
+      job_trace_store_(new server::JobTraceStore()),
       options_(options),
       registration_initialized_(false) {
 }
@@ -53,7 +55,8 @@ Status Master::Init() {
   RETURN_NOT_OK(ServerBase::Init());
   // TODO: wqx
   // add web server path handlers
-  
+  AddJobTracePathHandler(web_server_.get(), job_trace_store_.get());
+
   state_ = kInitialized;
   return Status::OK();
 }
@@ -22,6 +22,9 @@ class RpcServer;
 struct RpcServerOptions;
 class ThreadPool;
 
+namespace server {
+class JobTraceStore;
+} // namespace server
 
 namespace rpc {
 class Messenger;
@@ -50,6 +53,9 @@ class Master : public server::ServerBase {
   std::string ToString() const;
   WorkerManager* worker_manager() { return worker_manager_.get(); }
 
+  // The spans of the traces of recent jobs, on all servers.
+  server::JobTraceStore* job_trace_store() { return job_trace_store_.get(); }
+
   const MasterOptions& options();
   Status GetMasterRegistration(ServerRegistrationPB* registration) const;
   bool IsShutdown() const { return state_ == kStopped; }
@@ -69,6 +75,8 @@ class Master : public server::ServerBase {
 
   gscoped_ptr<WorkerManager> worker_manager_;
 
+  gscoped_ptr<server::JobTraceStore> job_trace_store_;
+
   MasterOptions options_;
 
   ServerRegistrationPB registration_;
@@ -1,18 +1,152 @@
 #include "mprmpr/master/master_path_handlers.h"
 #include "mprmpr/server/web_server.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glog/logging.h>
 
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/strings/util.h"
+#include "mprmpr/common/timestamp.h"
+#include "mprmpr/master/job_manager.h"
+#include "mprmpr/server/hybrid_clock.h"
+#include "mprmpr/server/job_trace.h"
+#include "mprmpr/util/url_coding.h"
+
 using std::ifstream;
 using std::ostringstream;
 using std::string;
+using std::vector;
+using strings::Substitute;
 
 namespace mprmpr {
 
+namespace {
+
+const char* const kJobsPathPrefix = "/jobs/";
+const char* const kTracePathSuffix = "/trace";
+
+uint64_t SpanMicros(uint64_t timestamp) {
+  return server::HybridClock::GetPhysicalValueMicros(Timestamp(timestamp));
+}
+
+uint64_t SpanEndMicros(const JobSpanPB& span) {
+  return SpanMicros(span.has_end_timestamp() ? span.end_timestamp() : span.start_timestamp());
+}
+
+// Orders 'spans' depth-first from the roots, children by start time, setting
+// the depth of each span in the tree in 'depths'. Spans whose parent was not
+// recorded are treated as roots.
+void OrderSpans(vector<JobSpanPB>* spans, vector<int>* depths) {
+  std::sort(spans->begin(), spans->end(), [](const JobSpanPB& a, const JobSpanPB& b) {
+      return a.start_timestamp() < b.start_timestamp();
+    });
+  std::unordered_map<string, int> index_by_id;
+  for (int i = 0; i < spans->size(); i++) {
+    index_by_id[(*spans)[i].span_id()] = i;
+  }
+  vector<vector<int>> children(spans->size());
+  vector<int> roots;
+  for (int i = 0; i < spans->size(); i++) {
+    const JobSpanPB& span = (*spans)[i];
+    auto parent = span.has_parent_span_id() ? index_by_id.find(span.parent_span_id())
+                                            : index_by_id.end();
+    if (parent == index_by_id.end() || parent->second == i) {
+      roots.push_back(i);
+    } else {
+      children[parent->second].push_back(i);
+    }
+  }
+
+  vector<JobSpanPB> ordered;
+  depths->clear();
+  std::function<void(int, int)> visit = [&](int i, int depth) {
+    ordered.push_back((*spans)[i]);
+    depths->push_back(depth);
+    for (int child : children[i]) {
+      visit(child, depth + 1);
+    }
+  };
+  for (int root : roots) {
+    visit(root, 0);
+  }
+  spans->swap(ordered);
+}
+
+void JobTraceHandler(server::JobTraceStore* store,
+                     const WebServer::WebRequest& req,
+                     ostringstream* output) {
+  string job_uuid = req.path.substr(strlen(kJobsPathPrefix));
+  if (!HasSuffixString(job_uuid, kTracePathSuffix)) {
+    (*output) << "<h1>Unknown job page: " << EscapeForHtmlToString(req.path) << "</h1>\n";
+    return;
+  }
+  job_uuid.resize(job_uuid.size() - strlen(kTracePathSuffix));
+
+  // Jobs which are no longer known to the job manager can still be looked up
+  // by trace ID.
+  string trace_id = JobManager::get()->GetJobTraceId(job_uuid);
+  if (trace_id.empty()) {
+    trace_id = job_uuid;
+  }
+
+  (*output) << "<h1>Trace of job " << EscapeForHtmlToString(job_uuid) << "</h1>\n";
+  vector<JobSpanPB> spans;
+  if (!store->GetSpans(trace_id, &spans) || spans.empty()) {
+    (*output) << "<p>No trace recorded for this job.</p>\n";
+    return;
+  }
+
+  vector<int> depths;
+  OrderSpans(&spans, &depths);
+  uint64_t begin = UINT64_MAX;
+  uint64_t end = 0;
+  for (const JobSpanPB& span : spans) {
+    begin = std::min(begin, SpanMicros(span.start_timestamp()));
+    end = std::max(end, SpanEndMicros(span));
+  }
+  double total = std::max<uint64_t>(end - begin, 1);
+
+  (*output) << Substitute("<p>Trace $0: $1 spans over $2 ms.</p>\n",
+                          EscapeForHtmlToString(trace_id), spans.size(),
+                          (end - begin) / 1000.0);
+  (*output) << "<table class='table table-striped'>\n";
+  (*output) << "  <tr><th>Span</th><th>Server</th><th>Start (ms)</th>"
+            << "<th>Duration (ms)</th><th>Timeline</th></tr>\n";
+  for (int i = 0; i < spans.size(); i++) {
+    const JobSpanPB& span = spans[i];
+    uint64_t start = SpanMicros(span.start_timestamp());
+    uint64_t duration = SpanEndMicros(span) - start;
+    (*output) << "  <tr>";
+    (*output) << Substitute("<td style='padding-left: $0em'>$1",
+                            1 + depths[i] * 2, EscapeForHtmlToString(span.name()));
+    if (span.has_annotations()) {
+      (*output) << "<pre>" << EscapeForHtmlToString(span.annotations()) << "</pre>";
+    }
+    (*output) << "</td>";
+    (*output) << "<td>" << EscapeForHtmlToString(span.server_uuid()) << "</td>";
+    (*output) << Substitute("<td>$0</td>", (start - begin) / 1000.0);
+    (*output) << (span.has_end_timestamp() ? Substitute("<td>$0</td>", duration / 1000.0)
+                                           : "<td>unfinished</td>");
+    (*output) << Substitute(
+        "<td><div style='position: relative; width: 400px; height: 12px; background: #eee'>"
+        "<div style='position: absolute; left: $0%; width: $1%; min-width: 1px; height: 12px; "
+        "background: #08c'></div></div></td>",
+        100.0 * (start - begin) / total, 100.0 * duration / total);
+    (*output) << "</tr>\n";
+  }
+  (*output) << "</table>\n";
+}
+
+} // anonymous namespace
+
 static void MasterMprTranscodeHandler(const WebServer::WebRequest& req, ostringstream* output) {
   LOG(INFO) << "--1";
   
@@ -44,4 +178,11 @@ void AddMasterPathHandlers(WebServer* webserver) {
                                  MasterMprJobListHandler, false, true);
 }
 
+void AddJobTracePathHandler(WebServer* webserver, server::JobTraceStore* store) {
+  webserver->RegisterPathHandler(kJobsPathPrefix, "",
+                                 std::bind(JobTraceHandler, store,
+                                           std::placeholders::_1, std::placeholders::_2),
+                                 true, false, true);
+}
+
 } // namespace mprmpr
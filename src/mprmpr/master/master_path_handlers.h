@@ -5,8 +5,16 @@ namespace mprmpr {
 
 class WebServer;
 
+namespace server {
+class JobTraceStore;
+} // namespace server
+
 void AddMasterPathHandlers(WebServer* webserver);
 
+// Registers the /jobs/<uuid>/trace page, which shows the spans of the job's
+// trace in 'store' as a timeline.
+void AddJobTracePathHandler(WebServer* webserver, server::JobTraceStore* store);
+
 
 } // namespace mprmpr
 #endif // MPRMPR_MASTER_MASTER_PATH_HANDLERS_H_
@@ -10,6 +10,8 @@
 #include "mprmpr/master/worker_descriptor.h"
 #include "mprmpr/master/worker_manager.h"
 #include "mprmpr/rpc/rpc_context.h"
+#include "mprmpr/server/clock.h"
+#include "mprmpr/server/job_trace.h"
 #include "mprmpr/server/web_server.h"
 #include "mprmpr/base/strings/substitute.h"
 
@@ -67,6 +69,16 @@ void MasterServiceImpl::WorkerHeartbeat(const WorkerHeartbeatRequestPB* req,
   desc->UpdateHearbeatTime();
   desc->UpdateWorkerStatus(req->worker_status());
 
+  for (const JobSpanPB& span : req->job_spans()) {
+    // Move the clock past the worker's timestamps, so that the spans the
+    // master records from here on sort after the worker's.
+    if (span.has_end_timestamp()) {
+      WARN_NOT_OK(server_->clock()->Update(Timestamp(span.end_timestamp())),
+                  "Unable to update clock with job span timestamp");
+    }
+    server_->job_trace_store()->AddSpan(span);
+  }
+
   //TODO(wqx):
   LOG(INFO) << "---------- Handle worker server report";
 
@@ -63,6 +63,10 @@ OutboundCall::OutboundCall(const ConnectionId& conn_id,
   if (controller_->request_id_) {
     header_.set_allocated_request_id(controller_->request_id_.release());
   }
+
+  if (controller_->trace_context()) {
+    header_.mutable_trace_context()->CopyFrom(*controller_->trace_context());
+  }
 }
 
 OutboundCall::~OutboundCall() {
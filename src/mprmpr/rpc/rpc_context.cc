@@ -122,6 +122,10 @@ const rpc::RequestIdPB* RpcContext::request_id() const {
   return call_->header().has_request_id() ? &call_->header().request_id() : nullptr;
 }
 
+const rpc::TraceContextPB* RpcContext::trace_context() const {
+  return call_->header().has_trace_context() ? &call_->header().trace_context() : nullptr;
+}
+
 Status RpcContext::AddRpcSidecar(gscoped_ptr<RpcSidecar> car, int* idx) {
   return call_->AddRpcSidecar(std::move(car), idx);
 }
@@ -28,6 +28,7 @@ void RpcController::Swap(RpcController* other) {
 
   std::swap(timeout_, other->timeout_);
   std::swap(call_, other->call_);
+  std::swap(trace_context_, other->trace_context_);
 }
 
 void RpcController::Reset() {
@@ -77,6 +78,10 @@ void RpcController::SetRequestIdPB(std::unique_ptr<RequestIdPB> request_id) {
   request_id_ = std::move(request_id);
 }
 
+void RpcController::SetTraceContextPB(std::unique_ptr<TraceContextPB> trace_context) {
+  trace_context_ = std::move(trace_context);
+}
+
 bool RpcController::has_request_id() const {
   return request_id_ != nullptr;
 }
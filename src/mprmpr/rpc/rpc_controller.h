@@ -18,6 +18,7 @@ namespace rpc {
 class ErrorStatusPB;
 class OutboundCall;
 class RequestIdPB;
+class TraceContextPB;
 
 // Controller for managing properties of a single RPC call, on the client side.
 //
@@ -103,6 +104,13 @@ class RpcController {
   // REQUIRES: the controller has a request ID set.
   const RequestIdPB& request_id() const;
 
+  // Sets the distributed trace context sent with the next request, so that
+  // the server can record its spans as children of the caller's.
+  void SetTraceContextPB(std::unique_ptr<TraceContextPB> trace_context);
+
+  // Returns the currently set trace context, or NULL if none is set.
+  const TraceContextPB* trace_context() const { return trace_context_.get(); }
+
   // Add a requirement that the server side must support a feature with the
   // given identifier. The set of required features is sent to the server
   // with the RPC call, and if any required feature is not supported, the
@@ -176,6 +184,9 @@ class RpcController {
   // Ownership is transfered to OutboundCall once the call is sent.
   std::unique_ptr<RequestIdPB> request_id_;
 
+  // The trace context of this request. Copied into the header of every call.
+  std::unique_ptr<TraceContextPB> trace_context_;
+
   // Once the call is sent, it is tracked here.
   std::shared_ptr<OutboundCall> call_;
 
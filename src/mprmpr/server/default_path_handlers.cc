@@ -17,6 +17,7 @@
 #include <gperftools/malloc_extension.h>
 
 #include "mprmpr/base/map-util.h"
+#include "mprmpr/base/strings/numbers.h"
 #include "mprmpr/base/strings/human_readable.h"
 #include "mprmpr/base/strings/split.h"
 #include "mprmpr/base/strings/substitute.h"
@@ -26,6 +27,7 @@
 #include "mprmpr/util/mem_tracker.h"
 #include "mprmpr/util/metrics.h"
 #include "mprmpr/util/jsonwriter.h"
+#include "mprmpr/util/url_coding.h"
 
 using boost::replace_all;
 using google::CommandlineFlagsIntoString;
@@ -178,6 +180,19 @@ static void WriteMetricsAsJson(const MetricRegistry* const metrics,
       JsonWriter::COMPACT : JsonWriter::PRETTY;
   }
 
+  // A delta scrape: only return the metrics modified since the epoch handed
+  // out by the previous scrape, wrapped in an object which carries the epoch
+  // to pass next time. 'since_epoch=0' returns everything plus that epoch.
+  const string* since_epoch_param = FindOrNull(req.parsed_args, "since_epoch");
+  if (since_epoch_param != nullptr) {
+    int64 since_epoch;
+    if (!safe_strto64(*since_epoch_param, &since_epoch) || since_epoch < 0) {
+      (*output) << "Invalid since_epoch: " << EscapeForHtmlToString(*since_epoch_param);
+      return;
+    }
+    opts.only_modified_in_or_after_epoch = since_epoch;
+  }
+
   JsonWriter writer(output, json_mode);
 
   if (requested_metrics_param != nullptr) {
@@ -187,8 +202,22 @@ static void WriteMetricsAsJson(const MetricRegistry* const metrics,
     requested_metrics.push_back("*");
   }
 
+  if (since_epoch_param != nullptr) {
+    // Advance the epoch before taking the snapshot, so that any modification
+    // racing with it is stamped with the new epoch and shows up next time.
+    int64_t next_epoch = Metric::IncrementEpoch();
+    writer.StartObject();
+    writer.String("epoch");
+    writer.Int64(next_epoch);
+    writer.String("entities");
+  }
+
   WARN_NOT_OK(metrics->WriteAsJson(&writer, requested_metrics, opts),
               "Couldn't write JSON metrics over HTTP");
+
+  if (since_epoch_param != nullptr) {
+    writer.EndObject();
+  }
 }
 
 void RegisterMetricsJsonHandler(WebServer* webserver, const MetricRegistry* const metrics) {
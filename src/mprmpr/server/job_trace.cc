@@ -0,0 +1,159 @@
+#include "mprmpr/server/job_trace.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/rpc/rpc_header.pb.h"
+#include "mprmpr/server/clock.h"
+#include "mprmpr/util/oid_generator.h"
+#include "mprmpr/util/trace.h"
+
+DEFINE_int32(job_trace_max_traces, 1000,
+             "Maximum number of job traces kept in memory. The oldest traces "
+             "are evicted first.");
+
+DEFINE_int32(job_trace_max_spans_per_trace, 1000,
+             "Maximum number of spans kept for a single job trace. Further spans "
+             "of the trace are dropped.");
+
+using std::string;
+using std::vector;
+
+namespace mprmpr {
+namespace server {
+
+namespace {
+
+ObjectIdGenerator* IdGenerator() {
+  static ObjectIdGenerator* generator = new ObjectIdGenerator();
+  return generator;
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////
+// JobTraceStore
+////////////////////////////////////////////////////////////
+
+JobTraceStore::JobTraceStore()
+    : num_dropped_spans_(0) {
+}
+
+JobTraceStore::~JobTraceStore() {
+}
+
+void JobTraceStore::AddSpan(const JobSpanPB& span) {
+  std::lock_guard<simple_spinlock> l(lock_);
+  auto it = spans_by_trace_.find(span.trace_id());
+  if (it == spans_by_trace_.end()) {
+    while (!trace_ids_.empty() &&
+           trace_ids_.size() >= std::max(FLAGS_job_trace_max_traces, 1)) {
+      spans_by_trace_.erase(trace_ids_.front());
+      trace_ids_.pop_front();
+    }
+    it = spans_by_trace_.emplace(span.trace_id(), vector<JobSpanPB>()).first;
+    trace_ids_.push_back(span.trace_id());
+  }
+  if (it->second.size() >= FLAGS_job_trace_max_spans_per_trace) {
+    num_dropped_spans_++;
+    return;
+  }
+  it->second.push_back(span);
+}
+
+bool JobTraceStore::GetSpans(const string& trace_id, vector<JobSpanPB>* spans) const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  auto it = spans_by_trace_.find(trace_id);
+  if (it == spans_by_trace_.end()) {
+    return false;
+  }
+  *spans = it->second;
+  return true;
+}
+
+void JobTraceStore::TakeSpans(int max_spans,
+                              google::protobuf::RepeatedPtrField<JobSpanPB>* spans) {
+  std::lock_guard<simple_spinlock> l(lock_);
+  while (!trace_ids_.empty() && spans->size() < max_spans) {
+    vector<JobSpanPB>* trace_spans = &spans_by_trace_[trace_ids_.front()];
+    int n = std::min<int>(trace_spans->size(), max_spans - spans->size());
+    for (int i = 0; i < n; i++) {
+      spans->Add()->Swap(&(*trace_spans)[i]);
+    }
+    trace_spans->erase(trace_spans->begin(), trace_spans->begin() + n);
+    if (!trace_spans->empty()) {
+      break;
+    }
+    spans_by_trace_.erase(trace_ids_.front());
+    trace_ids_.pop_front();
+  }
+}
+
+int64_t JobTraceStore::num_dropped_spans() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return num_dropped_spans_;
+}
+
+////////////////////////////////////////////////////////////
+// JobSpan
+////////////////////////////////////////////////////////////
+
+JobSpan::JobSpan(JobTraceStore* store, Clock* clock, string server_uuid,
+                 string trace_id, string parent_span_id, string name)
+    : store_(DCHECK_NOTNULL(store)),
+      clock_(DCHECK_NOTNULL(clock)),
+      trace_(new Trace()),
+      finished_(false) {
+  span_.set_trace_id(std::move(trace_id));
+  span_.set_span_id(IdGenerator()->Next());
+  if (!parent_span_id.empty()) {
+    span_.set_parent_span_id(std::move(parent_span_id));
+  }
+  span_.set_name(std::move(name));
+  span_.set_server_uuid(std::move(server_uuid));
+  span_.set_start_timestamp(clock_->Now().ToUint64());
+}
+
+JobSpan::JobSpan(JobTraceStore* store, Clock* clock, string server_uuid,
+                 const rpc::TraceContextPB& parent, string name)
+    : JobSpan(store, clock, std::move(server_uuid), parent.trace_id(),
+              parent.parent_span_id(), std::move(name)) {
+}
+
+JobSpan::~JobSpan() {
+  Finish();
+}
+
+string JobSpan::NewTraceId() {
+  return IdGenerator()->Next();
+}
+
+std::unique_ptr<JobSpan> JobSpan::StartChild(string name) const {
+  return std::unique_ptr<JobSpan>(new JobSpan(store_, clock_, span_.server_uuid(),
+                                              span_.trace_id(), span_.span_id(),
+                                              std::move(name)));
+}
+
+void JobSpan::ToTraceContextPB(rpc::TraceContextPB* context) const {
+  context->set_trace_id(span_.trace_id());
+  context->set_parent_span_id(span_.span_id());
+}
+
+void JobSpan::Finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  span_.set_end_timestamp(clock_->Now().ToUint64());
+  string annotations = trace_->DumpToString(Trace::INCLUDE_TIME_DELTAS);
+  if (!annotations.empty()) {
+    span_.set_annotations(std::move(annotations));
+  }
+  store_->AddSpan(span_);
+}
+
+} // namespace server
+} // namespace mprmpr
@@ -0,0 +1,127 @@
+#ifndef ANT_SERVER_JOB_TRACE_H_
+#define ANT_SERVER_JOB_TRACE_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/common/common.pb.h"
+#include "mprmpr/util/locks.h"
+
+namespace mprmpr {
+
+class Trace;
+
+namespace rpc {
+class TraceContextPB;
+} // namespace rpc
+
+namespace server {
+
+class Clock;
+
+// Holds the spans (see JobSpanPB) of distributed job traces.
+//
+// On the master, this keeps the spans of recent jobs for the
+// /jobs/<uuid>/trace page, including those shipped by the workers with their
+// heartbeats. On a worker, it buffers finished spans until the next heartbeat
+// takes them.
+//
+// At most --job_trace_max_traces traces are kept, evicting the oldest, with
+// at most --job_trace_max_spans_per_trace spans each. Spans over that limit
+// are dropped.
+//
+// This class is thread-safe.
+class JobTraceStore {
+ public:
+  JobTraceStore();
+  ~JobTraceStore();
+
+  void AddSpan(const JobSpanPB& span);
+
+  // Copies the spans of trace 'trace_id' into 'spans', in the order they were
+  // added. Returns false if the trace is unknown.
+  bool GetSpans(const std::string& trace_id, std::vector<JobSpanPB>* spans) const;
+
+  // Moves up to 'max_spans' spans into 'spans', oldest traces first.
+  void TakeSpans(int max_spans, google::protobuf::RepeatedPtrField<JobSpanPB>* spans);
+
+  // The number of spans dropped because their trace was full.
+  int64_t num_dropped_spans() const;
+
+ private:
+  mutable simple_spinlock lock_;
+
+  std::unordered_map<std::string, std::vector<JobSpanPB>> spans_by_trace_;
+
+  // Trace IDs of 'spans_by_trace_', oldest first.
+  std::deque<std::string> trace_ids_;
+
+  int64_t num_dropped_spans_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobTraceStore);
+};
+
+// A span of a distributed job trace being recorded on this server.
+//
+// The span is timestamped with the server's clock when it is opened and when
+// it is finished, after which it is added to the store. Annotations traced to
+// trace() (e.g. with TRACE_TO() or ADOPT_TRACE()) in the meantime are recorded
+// with it. To continue the trace on another server, send ToTraceContextPB()
+// along with the request, e.g. with RpcController::SetTraceContextPB(), and
+// open the remote span from RpcContext::trace_context().
+//
+// Timestamps are only comparable across servers with --use_hybrid_clock.
+//
+// This class is not thread-safe.
+class JobSpan {
+ public:
+  // Opens a span named 'name' of trace 'trace_id', as a child of span
+  // 'parent_span_id', or as the root span of the trace if it is empty.
+  // 'store' and 'clock' must outlive the span.
+  JobSpan(JobTraceStore* store, Clock* clock, std::string server_uuid,
+          std::string trace_id, std::string parent_span_id, std::string name);
+
+  // Opens a span named 'name' as a child of the remote span in 'parent'.
+  JobSpan(JobTraceStore* store, Clock* clock, std::string server_uuid,
+          const rpc::TraceContextPB& parent, std::string name);
+
+  // Finishes the span if it has not been finished yet.
+  ~JobSpan();
+
+  // Returns a new, random trace ID.
+  static std::string NewTraceId();
+
+  // Opens a span named 'name' as a child of this one, on this server.
+  std::unique_ptr<JobSpan> StartChild(std::string name) const;
+
+  // Fills 'context' so that spans opened from it are children of this one.
+  void ToTraceContextPB(rpc::TraceContextPB* context) const;
+
+  // Timestamps the end of the span and adds it to the store. No-op if the
+  // span has already been finished.
+  void Finish();
+
+  Trace* trace() const { return trace_.get(); }
+  const std::string& trace_id() const { return span_.trace_id(); }
+  const std::string& span_id() const { return span_.span_id(); }
+
+ private:
+  JobTraceStore* const store_;
+  Clock* const clock_;
+  JobSpanPB span_;
+  scoped_refptr<Trace> trace_;
+  bool finished_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobSpan);
+};
+
+} // namespace server
+} // namespace mprmpr
+#endif // ANT_SERVER_JOB_TRACE_H_
@@ -2,7 +2,11 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -16,14 +20,17 @@
 #include "mprmpr/base/strings/split.h"
 #include "mprmpr/base/strings/stringpiece.h"
 #include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/stringprintf.h"
 #include "mprmpr/base/sysinfo.h"
 
 #include "mprmpr/server/web_server.h"
 #include "mprmpr/util/env.h"
 //#include "mprmpr/util/logging.h"
 #include "mprmpr/util/monotime.h"
+#include "mprmpr/util/sampling_profiler.h"
 #include "mprmpr/util/spinlock_profiling.h"
 #include "mprmpr/util/status.h"
+#include "mprmpr/util/url_coding.h"
 
 DECLARE_bool(enable_process_lifetime_heap_profiling);
 DECLARE_string(heap_profile_path);
@@ -32,7 +39,9 @@ DECLARE_string(heap_profile_path);
 using std::endl;
 using std::ifstream;
 using std::ostringstream;
+using std::map;
 using std::string;
+using std::unique_ptr;
 
 // GLog already implements symbolization. Just import their hidden symbol.
 namespace google {
@@ -46,6 +55,7 @@ bool Symbolize(void *pc, char *out, int out_size);
 namespace mprmpr {
 
 const int PPROF_DEFAULT_SAMPLE_SECS = 30; // pprof default sample time in seconds.
+const int FLAME_DEFAULT_MINUTES = 1; // Default history served by /pprof/flame.
 
 // pprof asks for the url /pprof/cmdline to figure out what application it's profiling.
 // The server should respond by sending the executable path.
@@ -99,9 +109,14 @@ static void PprofCpuProfileHandler(const WebServer::WebRequest& req, ostringstre
   }
   // Build a temporary file name that is hopefully unique.
   string tmp_prof_file_name = strings::Substitute("/tmp/kudu_cpu_profile.$0.$1", getpid(), rand());
+  // Both profilers rely on SIGPROF: pause the sampling profiler meanwhile.
+  SamplingProfiler* sampling_profiler = SamplingProfiler::Get();
+  sampling_profiler->PauseForForeignProfiler();
   ProfilerStart(tmp_prof_file_name.c_str());
   SleepFor(MonoDelta::FromSeconds(seconds));
   ProfilerStop();
+  WARN_NOT_OK(sampling_profiler->ResumeAfterForeignProfiler(),
+              "Unable to resume the sampling CPU profiler");
   ifstream prof_file(tmp_prof_file_name.c_str(), std::ios::in);
   if (!prof_file.is_open()) {
     (*output) << "Unable to open cpu profile: " << tmp_prof_file_name;
@@ -112,6 +127,113 @@ static void PprofCpuProfileHandler(const WebServer::WebRequest& req, ostringstre
 #endif
 }
 
+// A frame of a flame graph: the samples taken in a function, by callee.
+struct FlameNode {
+  FlameNode() : count(0) {}
+
+  int64_t count;
+  map<string, unique_ptr<FlameNode>> children;
+};
+
+const int kFlameGraphWidth = 1200;
+const int kFlameFrameHeight = 16;
+
+// Draws 'node' and its callees, 'depth' frames above the bottom of the graph.
+static void RenderFlameNode(const string& name, const FlameNode& node, int64_t total,
+                            double x, int depth, int max_depth, ostringstream* output) {
+  double width = static_cast<double>(node.count) * kFlameGraphWidth / total;
+  if (width < 0.1) {
+    return;
+  }
+  // Warm colors, stable for a given function.
+  uint64_t h = std::hash<string>()(name);
+  string fill = StringPrintf("rgb(%d,%d,%d)", 205 + static_cast<int>(h % 50),
+                             static_cast<int>((h >> 8) % 230),
+                             static_cast<int>((h >> 16) % 55));
+  string escaped_name = EscapeForHtmlToString(name);
+  int y = (max_depth - depth) * kFlameFrameHeight;
+  *output << strings::Substitute(
+      "<g><title>$0 ($1 samples, $2%)</title>"
+      "<rect x=\"$3\" y=\"$4\" width=\"$5\" height=\"$6\" fill=\"$7\" rx=\"2\"/>",
+      escaped_name, node.count, StringPrintf("%.2f", 100.0 * node.count / total),
+      StringPrintf("%.1f", x), y, StringPrintf("%.1f", width), kFlameFrameHeight - 1, fill);
+  // Roughly 7 pixels per character.
+  int max_chars = static_cast<int>(width - 6) / 7;
+  if (max_chars >= 3) {
+    string label = name.size() <= max_chars ? name : name.substr(0, max_chars - 2) + "..";
+    *output << strings::Substitute("<text x=\"$0\" y=\"$1\">$2</text>",
+                                   StringPrintf("%.1f", x + 3), y + kFlameFrameHeight - 4,
+                                   EscapeForHtmlToString(label));
+  }
+  *output << "</g>" << endl;
+
+  for (const auto& child : node.children) {
+    RenderFlameNode(child.first, *child.second, total, x, depth + 1, max_depth, output);
+    x += static_cast<double>(child.second->count) * kFlameGraphWidth / total;
+  }
+}
+
+// Renders 'stacks' as an SVG flame graph: each function is a box as wide as the
+// number of samples taken in it, on top of its caller.
+static void RenderFlameGraph(const FoldedStacks& stacks, ostringstream* output) {
+  FlameNode root;
+  int max_depth = 0;
+  for (const auto& entry : stacks) {
+    FlameNode* node = &root;
+    node->count += entry.second;
+    int depth = 0;
+    for (StringPiece frame : strings::Split(entry.first, ";")) {
+      unique_ptr<FlameNode>& child = node->children[frame.ToString()];
+      if (!child) {
+        child.reset(new FlameNode());
+      }
+      node = child.get();
+      node->count += entry.second;
+      depth++;
+    }
+    max_depth = std::max(max_depth, depth);
+  }
+  if (root.count == 0) {
+    *output << "<p>No samples.</p>" << endl;
+    return;
+  }
+
+  *output << strings::Substitute(
+      "<svg width=\"$0\" height=\"$1\" xmlns=\"http://www.w3.org/2000/svg\" "
+      "font-family=\"Verdana\" font-size=\"11\">",
+      kFlameGraphWidth, (max_depth + 1) * kFlameFrameHeight) << endl;
+  RenderFlameNode("all", root, root.count, 0, 0, max_depth, output);
+  *output << "</svg>" << endl;
+}
+
+// Serves the profiles collected by the sampling profiler over the last
+// 'minutes' minutes (see SamplingProfiler), as a flame graph or, with 'raw',
+// as folded stacks suitable for flamegraph.pl.
+static void PprofFlameHandler(const WebServer::WebRequest& req, ostringstream* output) {
+  string minutes_str = FindWithDefault(req.parsed_args, "minutes", "");
+  int32_t minutes = ParseLeadingInt32Value(minutes_str.c_str(), FLAME_DEFAULT_MINUTES);
+  SamplingProfiler* profiler = SamplingProfiler::Get();
+  FoldedStacks stacks;
+  profiler->GetFoldedStacks(minutes, &stacks);
+
+  if (ContainsKey(req.parsed_args, "raw")) {
+    for (const auto& entry : stacks) {
+      *output << entry.first << " " << entry.second << endl;
+    }
+    return;
+  }
+
+  *output << "<h1>CPU Flame Graph</h1>" << endl;
+  if (!profiler->running()) {
+    *output << "<p>The sampling profiler is not running.</p>" << endl;
+  }
+  *output << strings::Substitute(
+      "<p>Last $0 minute(s). $1 samples taken and $2 dropped since the process "
+      "started. <a href=\"/pprof/flame?minutes=$0&raw\">Folded stacks</a></p>",
+      minutes, profiler->num_samples(), profiler->num_dropped_samples()) << endl;
+  RenderFlameGraph(stacks, output);
+}
+
 // pprof asks for the url /pprof/growth to get heap-profiling delta (growth) information.
 // The server should respond by calling:
 // MallocExtension::instance()->GetHeapGrowthStacks(&output);
@@ -217,6 +339,8 @@ void AddPprofPathHandlers(WebServer* webserver) {
   webserver->RegisterPathHandler("/pprof/profile", "", PprofCpuProfileHandler, false, false);
   webserver->RegisterPathHandler("/pprof/symbol", "", PprofSymbolHandler, false, false);
   webserver->RegisterPathHandler("/pprof/contention", "", PprofContentionHandler, false, false);
+  webserver->RegisterPathHandler("/pprof/flame", "CPU Flame Graph", PprofFlameHandler, true,
+                                 false);
 }
 
 } // namespace kudu
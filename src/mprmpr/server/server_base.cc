@@ -30,6 +30,7 @@
 #include "mprmpr/util/metrics.h"
 #include "mprmpr/util/monotime.h"
 #include "mprmpr/util/net/sockaddr.h"
+#include "mprmpr/util/sampling_profiler.h"
 #include "mprmpr/util/spinlock_profiling.h"
 #include "mprmpr/util/thread.h"
 #include "mprmpr/util/env.h"
@@ -46,6 +47,10 @@ DEFINE_int32(min_negotiation_threads, 0,
 DEFINE_int32(max_negotiation_threads, 50, 
 "Maximum number of connection negotiation threads.");
 
+DEFINE_bool(enable_sampling_profiler, true,
+"Whether to continuously sample the CPU profile of the server, "
+"served at /pprof/flame.");
+
 DECLARE_bool(use_hybrid_clock);
 
 using std::ostringstream;
@@ -141,6 +146,11 @@ Status ServerBase::Init() {
 
   InitSpinLockContentionProfiling();
 
+  if (FLAGS_enable_sampling_profiler) {
+    WARN_NOT_OK(SamplingProfiler::Get()->Start(),
+                "Unable to start the sampling CPU profiler");
+  }
+
   RETURN_NOT_OK_PREPEND(clock_->Init(), "Cannot initialize clock");
 
   //TODO(wqx):
@@ -233,7 +243,17 @@ Status ServerBase::StartMetricsLogging() {
 
 
 void ServerBase::MetricsLoggingThread() {
-  RollingLog log(Env::Default(), FLAGS_log_dir, "metrics");
+  // Written by a thread of the log, so that a slow disk does not delay the
+  // collection of the metrics: the metrics are dropped instead.
+  const int kMaxQueuedMetricsLogs = 16;
+  std::unique_ptr<RollingLog> rolling_log(new RollingLog(Env::Default(), FLAGS_log_dir,
+                                                         "metrics"));
+  AsyncRollingLog log(std::move(rolling_log), kMaxQueuedMetricsLogs, metric_entity_);
+  Status start_status = log.Start();
+  if (!start_status.ok()) {
+    WARN_NOT_OK(start_status, "Unable to start metrics log writer");
+    return;
+  }
 
   const MonoDelta kWaitBetweenFailures = MonoDelta::FromSeconds(60);
 
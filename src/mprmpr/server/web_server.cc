@@ -24,6 +24,7 @@
 #include "mprmpr/base/strings/numbers.h"
 #include "mprmpr/base/strings/split.h"
 #include "mprmpr/base/strings/stringpiece.h"
+#include "mprmpr/base/strings/util.h"
 
 #include "mprmpr/util/env.h"
 //#include "mprmpr/util/flag_tags.h"
@@ -257,6 +258,9 @@ int WebServer::BeginRequestCallback(struct sq_connection* connection,
   {
     shared_lock<RWMutex> l(lock_);
     PathHandlerMap::const_iterator it = path_handlers_.find(request_info->uri);
+    if (it == path_handlers_.end()) {
+      it = FindPrefixPathHandler(request_info->uri);
+    }
     if (it == path_handlers_.end()) {
       // Let Mongoose deal with this request; returning NULL will fall through
       // to the default handler which will serve files.
@@ -277,6 +281,20 @@ int WebServer::BeginRequestCallback(struct sq_connection* connection,
 }
 
 
+WebServer::PathHandlerMap::const_iterator WebServer::FindPrefixPathHandler(
+    const string& uri) const {
+  // The longest registered prefix wins.
+  PathHandlerMap::const_iterator best = path_handlers_.end();
+  for (auto it = path_handlers_.begin(); it != path_handlers_.end(); ++it) {
+    const string& path = it->first;
+    if (it->second->is_prefix() && HasPrefixString(uri, path) &&
+        (best == path_handlers_.end() || path.size() > best->first.size())) {
+      best = it;
+    }
+  }
+  return best;
+}
+
 int WebServer::RunPathHandler(const PathHandler& handler,
                               struct sq_connection* connection,
                               struct sq_request_info* request_info) {
@@ -284,6 +302,7 @@ int WebServer::RunPathHandler(const PathHandler& handler,
   bool use_style = true;
 
   WebRequest req;
+  req.path = request_info->uri;
   if (request_info->query_string != nullptr) {
     req.query_string = request_info->query_string;
     BuildArgumentMap(request_info->query_string, &req.parsed_args);
@@ -353,12 +372,12 @@ int WebServer::RunPathHandler(const PathHandler& handler,
 }
 
 void WebServer::RegisterPathHandler(const string& path, const string& alias,
-    const PathHandlerCallback& callback, bool is_styled, bool is_on_nav_bar) {
+    const PathHandlerCallback& callback, bool is_styled, bool is_on_nav_bar, bool is_prefix) {
   std::lock_guard<RWMutex> l(lock_);
   auto it = path_handlers_.find(path);
   if (it == path_handlers_.end()) {
     it = path_handlers_.insert(
-        make_pair(path, new PathHandler(is_styled, is_on_nav_bar, alias))).first;
+        make_pair(path, new PathHandler(is_styled, is_on_nav_bar, is_prefix, alias))).first;
   }
   it->second->AddCallback(callback);
 }
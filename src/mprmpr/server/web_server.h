@@ -46,16 +46,18 @@ class WebServer : public WebCallbackRegistry {
                                    const std::string& alias,
                                    const PathHandlerCallback& callback,
                                    bool is_styled = true,
-                                   bool is_on_nav_bar = true) override;
+                                   bool is_on_nav_bar = true,
+                                   bool is_prefix = false) override;
 
   void set_footer_html(const std::string& html);
   bool IsSecure() const;
  private:
   class PathHandler {
    public:
-    PathHandler(bool is_styled, bool is_on_nav_bar, std::string alias)
+    PathHandler(bool is_styled, bool is_on_nav_bar, bool is_prefix, std::string alias)
         : is_styled_(is_styled),
           is_on_nav_bar_(is_on_nav_bar),
+          is_prefix_(is_prefix),
           alias_(std::move(alias)) {}
 
     void AddCallback(const PathHandlerCallback& callback) {
@@ -64,12 +66,14 @@ class WebServer : public WebCallbackRegistry {
 
     bool is_styled() const { return is_styled_; }
     bool is_on_nav_bar() const { return is_on_nav_bar_; }
+    bool is_prefix() const { return is_prefix_; }
     const std::string& alias() const { return alias_; }
     const std::vector<PathHandlerCallback>& callbacks() const { return callbacks_; }
 
    private:
     bool is_styled_;
     bool is_on_nav_bar_;
+    bool is_prefix_;
     std::string alias_;
     std::vector<PathHandlerCallback> callbacks_;
   };  
@@ -82,6 +86,12 @@ class WebServer : public WebCallbackRegistry {
   int BeginRequestCallback(struct sq_connection* connection,
                            struct sq_request_info* request_info);
 
+  typedef std::map<std::string, PathHandler*> PathHandlerMap;
+
+  // Returns the prefix handler with the longest path starting 'uri', or
+  // path_handlers_.end() if there is none. Requires 'lock_'.
+  PathHandlerMap::const_iterator FindPrefixPathHandler(const std::string& uri) const;
+
   int RunPathHandler(const PathHandler& handler,
                      struct sq_connection* connection,
                      struct sq_request_info* request_info);
@@ -97,7 +107,6 @@ class WebServer : public WebCallbackRegistry {
 
   RWMutex lock_;
 
-  typedef std::map<std::string, PathHandler*> PathHandlerMap;
   PathHandlerMap path_handlers_;
 
   std::string footer_html_;
@@ -0,0 +1,171 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/db/async_client.h"
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/result.h"
+#include "mprmpr/util/countdown_latch.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/promise.h"
+#include "mprmpr/util/test_util.h"
+
+DEFINE_string(mysql_hostname, "",
+              "If set, the tests run queries on this MySQL server. Otherwise "
+              "only the failure paths are tested.");
+DEFINE_string(mysql_username, "root", "MySQL user of the tests");
+DEFINE_string(mysql_password, "", "MySQL password of the tests");
+DEFINE_string(mysql_database, "test", "MySQL database of the tests");
+DEFINE_int32(async_num_queries, 500, "Number of queries run concurrently by the benchmark");
+
+using std::shared_ptr;
+using std::vector;
+
+namespace mprmpr {
+namespace db {
+
+class AsyncClientTest : public AntTest {
+ public:
+  void CreateClient(const std::string& hostname, int num_connections) {
+    ConnectionBuilder builder;
+    builder.set_hostname(hostname)
+           .set_username(FLAGS_mysql_username)
+           .set_password(FLAGS_mysql_password)
+           .set_database(FLAGS_mysql_database);
+    AsyncClientOptions options;
+    options.num_connections = num_connections;
+    client_.reset(new AsyncClient(builder, options));
+    ASSERT_OK(client_->Init());
+  }
+
+ protected:
+  std::unique_ptr<AsyncClient> client_;
+};
+
+TEST_F(AsyncClientTest, TestConnectFailure) {
+  NO_FATALS(CreateClient("unknown-host.invalid", 2));
+  Promise<AsyncQueryResult> promise;
+  client_->QueryAsync("SELECT 1", &promise);
+  const AsyncQueryResult& result = promise.Get();
+  EXPECT_TRUE(result.status.IsNetworkError()) << result.status.ToString();
+  EXPECT_TRUE(result.results.empty());
+  AssertEventually([&]() {
+      ASSERT_EQ(0, client_->num_pending_queries());
+    });
+}
+
+// A connection failing right away completes its query within the dispatch
+// of the queue: the queued queries must then be failed one after the other,
+// not by recursing once per query.
+TEST_F(AsyncClientTest, TestConnectFailureWithQueuedQueries) {
+  const int kNumQueries = 200;
+  ConnectionBuilder builder;
+  builder.set_hostname("unknown-host.invalid");
+  AsyncClientOptions options;
+  options.num_connections = 1;
+  AsyncClient client(builder, options);
+
+  // Queued before the loop runs, so that they are dispatched at once.
+  CountDownLatch latch(kNumQueries);
+  int num_network_errors = 0;
+  uintptr_t min_stack = UINTPTR_MAX;
+  uintptr_t max_stack = 0;
+  for (int i = 0; i < kNumQueries; i++) {
+    client.QueryAsync("SELECT 1", [&](const Status& s, vector<shared_ptr<Result>> results) {
+        char marker;
+        uintptr_t stack = reinterpret_cast<uintptr_t>(&marker);
+        min_stack = std::min(min_stack, stack);
+        max_stack = std::max(max_stack, stack);
+        if (s.IsNetworkError()) {
+          num_network_errors++;
+        }
+        latch.CountDown();
+      });
+  }
+  ASSERT_OK(client.Init());
+  latch.Wait();
+  EXPECT_EQ(kNumQueries, num_network_errors);
+  // The callbacks all ran at about the same depth of the stack.
+  EXPECT_LT(max_stack - min_stack, 4096);
+}
+
+TEST_F(AsyncClientTest, TestShutdown) {
+  NO_FATALS(CreateClient("unknown-host.invalid", 1));
+  client_->Shutdown();
+  Promise<AsyncQueryResult> promise;
+  client_->QueryAsync("SELECT 1", &promise);
+  EXPECT_TRUE(promise.Get().status.IsServiceUnavailable()) << promise.Get().status.ToString();
+}
+
+TEST_F(AsyncClientTest, TestShutdownWithoutInit) {
+  ConnectionBuilder builder;
+  AsyncClient client(builder, AsyncClientOptions());
+  Status status;
+  client.QueryAsync("SELECT 1", [&](const Status& s, vector<shared_ptr<Result>> results) {
+      status = s;
+    });
+  client.Shutdown();
+  EXPECT_TRUE(status.IsAborted()) << status.ToString();
+}
+
+TEST_F(AsyncClientTest, TestQueries) {
+  if (FLAGS_mysql_hostname.empty()) {
+    LOG(INFO) << "Skipping test: --mysql_hostname is not set";
+    return;
+  }
+  NO_FATALS(CreateClient(FLAGS_mysql_hostname, 2));
+
+  Promise<AsyncQueryResult> promise;
+  client_->QueryAsync("SELECT 1 AS a, 'x' AS b; SELECT 2 AS a", &promise);
+  const AsyncQueryResult& result = promise.Get();
+  ASSERT_OK(result.status);
+  ASSERT_EQ(2, result.results.size());
+  ASSERT_EQ(1, result.results[0]->size());
+  EXPECT_EQ(1, static_cast<int32_t>((*result.results[0])[0]["a"]));
+  EXPECT_EQ(2, static_cast<int32_t>((*result.results[1])[0]["a"]));
+
+  Promise<AsyncQueryResult> error;
+  client_->QueryAsync("SELECT * FROM no_such_table", &error);
+  EXPECT_TRUE(error.Get().status.IsRuntimeError()) << error.Get().status.ToString();
+}
+
+// Keeps many slow queries in flight from a single thread.
+TEST_F(AsyncClientTest, TestManyQueriesInFlight) {
+  if (FLAGS_mysql_hostname.empty()) {
+    LOG(INFO) << "Skipping test: --mysql_hostname is not set";
+    return;
+  }
+  const int kNumConnections = 50;
+  NO_FATALS(CreateClient(FLAGS_mysql_hostname, kNumConnections));
+
+  CountDownLatch latch(FLAGS_async_num_queries);
+  std::atomic<int> num_errors(0);
+  MonoTime start = MonoTime::Now();
+  for (int i = 0; i < FLAGS_async_num_queries; i++) {
+    client_->QueryAsync("SELECT SLEEP(0.1)",
+                        [&](const Status& s, vector<shared_ptr<Result>> results) {
+                          if (!s.ok()) {
+                            num_errors++;
+                          }
+                          latch.CountDown();
+                        });
+  }
+  latch.Wait();
+  MonoDelta elapsed = MonoTime::Now() - start;
+  LOG(INFO) << FLAGS_async_num_queries << " queries of 100ms on " << kNumConnections
+            << " connections took " << elapsed.ToString();
+  EXPECT_EQ(0, num_errors.load());
+  // Run serially, they would take 100ms each.
+  EXPECT_LT(elapsed.ToSeconds(), FLAGS_async_num_queries * 0.1 / 2);
+}
+
+} // namespace db
+} // namespace mprmpr
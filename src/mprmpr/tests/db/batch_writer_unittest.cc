@@ -0,0 +1,214 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/db/batch_writer.h"
+#include "mprmpr/db/connection.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/test_util.h"
+
+METRIC_DECLARE_histogram(db_batch_write_duration);
+METRIC_DECLARE_histogram(db_batch_write_rows);
+METRIC_DECLARE_counter(db_batch_write_errors);
+
+using std::string;
+using std::vector;
+
+namespace mprmpr {
+namespace db {
+
+// The statements run by a MockConnection.
+class StatementLog {
+ public:
+  StatementLog() : fail_(false) {}
+
+  Status Run(const string& statement) {
+    MutexLock l(lock_);
+    if (fail_) {
+      return Status::RuntimeError("Deadlock found when trying to get lock");
+    }
+    statements_.push_back(statement);
+    return Status::OK();
+  }
+
+  vector<string> statements() const {
+    MutexLock l(lock_);
+    return statements_;
+  }
+
+  void set_fail(bool fail) {
+    MutexLock l(lock_);
+    fail_ = fail;
+  }
+
+ private:
+  mutable Mutex lock_;
+  vector<string> statements_;
+  bool fail_;
+};
+
+// A connection which logs its queries instead of sending them to a server.
+class MockConnection : public Connection {
+ public:
+  explicit MockConnection(StatementLog* log)
+      : Connection("", "", "", "", 0),
+        log_(log) {
+  }
+
+  virtual Status Query(const string& query) OVERRIDE {
+    return log_->Run(query);
+  }
+
+ private:
+  StatementLog* log_;
+};
+
+class BatchWriterTest : public AntTest {
+ public:
+  BatchWriterTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "batch-writer-test")) {
+    // Only flush on size or explicitly, unless a test says otherwise.
+    options_.flush_interval = MonoDelta::FromSeconds(3600);
+  }
+
+  void CreateWriter(vector<string> update_columns) {
+    writer_.reset(new BatchWriter(std::unique_ptr<Connection>(new MockConnection(&log_)),
+                                  "jobs", { "id", "name" }, std::move(update_columns),
+                                  options_, entity_));
+    ASSERT_OK(writer_->Init());
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  BatchWriterOptions options_;
+  StatementLog log_;
+  std::unique_ptr<BatchWriter> writer_;
+};
+
+TEST_F(BatchWriterTest, TestStatements) {
+  NO_FATALS(CreateWriter({ "name" }));
+  ASSERT_OK(writer_->Add(1, "first"));
+  ASSERT_OK(writer_->Add(2, "it's"));
+  ASSERT_OK(writer_->Add(3, nullptr));
+  ASSERT_EQ(3, writer_->num_pending_rows());
+  ASSERT_OK(writer_->Flush());
+  ASSERT_EQ(0, writer_->num_pending_rows());
+
+  vector<string> statements = log_.statements();
+  ASSERT_EQ(1, statements.size());
+  EXPECT_EQ("INSERT INTO `jobs` (`id`, `name`) VALUES (1,'first'),(2,'it\\'s'),(3,NULL)"
+            " ON DUPLICATE KEY UPDATE `name` = VALUES(`name`)", statements[0]);
+
+  // Nothing to write.
+  ASSERT_OK(writer_->Flush());
+  ASSERT_EQ(1, log_.statements().size());
+
+  Status s = writer_->Add(4);
+  EXPECT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
+
+TEST_F(BatchWriterTest, TestInsertWithoutUpdate) {
+  NO_FATALS(CreateWriter({}));
+  ASSERT_OK(writer_->Add(1, "first"));
+  ASSERT_OK(writer_->Flush());
+  ASSERT_EQ("INSERT INTO `jobs` (`id`, `name`) VALUES (1,'first')", log_.statements()[0]);
+}
+
+TEST_F(BatchWriterTest, TestBatchLimits) {
+  options_.max_batch_rows = 3;
+  options_.max_batch_bytes = 30;
+  NO_FATALS(CreateWriter({ "name" }));
+
+  // Full batches are sent without waiting for Flush().
+  for (int i = 0; i < 7; i++) {
+    ASSERT_OK(writer_->Add(i, "x"));
+  }
+  AssertEventually([&]() {
+      ASSERT_EQ(2, log_.statements().size());
+    });
+  ASSERT_EQ(1, writer_->num_pending_rows());
+
+  // Rows of up to 40 bytes once escaped: one per batch.
+  ASSERT_OK(writer_->Add(100, string(16, 'y')));
+  ASSERT_OK(writer_->Add(101, string(16, 'z')));
+  ASSERT_OK(writer_->Flush());
+
+  vector<string> statements = log_.statements();
+  ASSERT_EQ(5, statements.size());
+  ASSERT_STR_CONTAINS(statements[0], "VALUES (0,'x'),(1,'x'),(2,'x') ON");
+  ASSERT_STR_CONTAINS(statements[1], "VALUES (3,'x'),(4,'x'),(5,'x') ON");
+  ASSERT_STR_CONTAINS(statements[2], "VALUES (6,'x') ON");
+  ASSERT_STR_CONTAINS(statements[3], "VALUES (100,'yyyyyyyyyyyyyyyy') ON");
+  ASSERT_STR_CONTAINS(statements[4], "VALUES (101,'zzzzzzzzzzzzzzzz') ON");
+
+  scoped_refptr<Histogram> rows = METRIC_db_batch_write_rows.Instantiate(entity_);
+  EXPECT_EQ(5, rows->TotalCount());
+  EXPECT_EQ(3, rows->MaxValueForTests());
+  EXPECT_EQ(5, METRIC_db_batch_write_duration.Instantiate(entity_)->TotalCount());
+}
+
+TEST_F(BatchWriterTest, TestTimedFlush) {
+  options_.flush_interval = MonoDelta::FromMilliseconds(10);
+  NO_FATALS(CreateWriter({ "name" }));
+  ASSERT_OK(writer_->Add(1, "first"));
+  AssertEventually([&]() {
+      ASSERT_EQ(1, log_.statements().size());
+    });
+  ASSERT_EQ(0, writer_->num_pending_rows());
+}
+
+TEST_F(BatchWriterTest, TestErrors) {
+  NO_FATALS(CreateWriter({ "name" }));
+  log_.set_fail(true);
+  ASSERT_OK(writer_->Add(1, "first"));
+  Status s = writer_->Flush();
+  EXPECT_TRUE(s.IsRuntimeError()) << s.ToString();
+  EXPECT_EQ(1, METRIC_db_batch_write_errors.Instantiate(entity_)->value());
+
+  // The error is returned once.
+  log_.set_fail(false);
+  ASSERT_OK(writer_->Add(2, "second"));
+  ASSERT_OK(writer_->Flush());
+  ASSERT_EQ(1, log_.statements().size());
+}
+
+TEST_F(BatchWriterTest, TestClose) {
+  NO_FATALS(CreateWriter({ "name" }));
+  ASSERT_OK(writer_->Add(1, "first"));
+  writer_->Close();
+  ASSERT_EQ(1, log_.statements().size());
+  Status s = writer_->Add(2, "second");
+  EXPECT_TRUE(s.IsIllegalState()) << s.ToString();
+}
+
+TEST_F(BatchWriterTest, TestConcurrentWriters) {
+  options_.max_batch_rows = 10;
+  options_.max_queued_batches = 1;
+  NO_FATALS(CreateWriter({ "name" }));
+
+  const int kNumThreads = 4;
+  const int kRowsPerThread = 1000;
+  vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+        for (int i = 0; i < kRowsPerThread; i++) {
+          CHECK_OK(writer_->Add(t * kRowsPerThread + i, "row"));
+        }
+      });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_OK(writer_->Flush());
+  EXPECT_EQ(kNumThreads * kRowsPerThread / 10, log_.statements().size());
+}
+
+} // namespace db
+} // namespace mprmpr
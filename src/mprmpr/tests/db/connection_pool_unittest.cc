@@ -0,0 +1,265 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/connection_pool.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/test_util.h"
+
+DEFINE_string(mysql_hostname, "",
+              "If set, the benchmark leases connections to this MySQL server "
+              "and runs 'SELECT 1' on them, instead of using mock connections.");
+DEFINE_string(mysql_username, "root", "MySQL user of the benchmark");
+DEFINE_string(mysql_password, "", "MySQL password of the benchmark");
+DEFINE_string(mysql_database, "test", "MySQL database of the benchmark");
+DEFINE_int32(benchmark_num_threads, 16, "Number of threads leasing connections");
+DEFINE_int32(benchmark_max_connections, 4, "Size of the benchmarked pool");
+
+METRIC_DECLARE_histogram(db_connection_lease_wait_time);
+METRIC_DECLARE_gauge_int64(db_connections_leased);
+METRIC_DECLARE_counter(db_connection_lease_timeouts);
+METRIC_DECLARE_counter(db_connection_errors);
+
+namespace mprmpr {
+namespace db {
+
+// A connection which never connects to a server.
+class MockConnection : public Connection {
+ public:
+  explicit MockConnection(std::atomic<bool>* healthy)
+      : Connection("", "", "", "", 0),
+        healthy_(healthy) {
+  }
+
+  virtual Status Ping() OVERRIDE {
+    if (!*healthy_) {
+      return Status::NetworkError("MySQL server has gone away");
+    }
+    return Status::OK();
+  }
+
+ private:
+  std::atomic<bool>* healthy_;
+};
+
+class ConnectionPoolTest : public AntTest {
+ public:
+  ConnectionPoolTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "connection-pool-test")),
+        healthy_(true),
+        factory_fails_(false),
+        num_created_(0) {
+  }
+
+ protected:
+  std::unique_ptr<ConnectionPool> CreatePool(const ConnectionPoolOptions& options) {
+    return std::unique_ptr<ConnectionPool>(new ConnectionPool(
+        [this](std::unique_ptr<Connection>* conn) {
+          if (factory_fails_) {
+            return Status::NetworkError("Can't connect to MySQL server");
+          }
+          num_created_++;
+          conn->reset(new MockConnection(&healthy_));
+          return Status::OK();
+        },
+        options, entity_));
+  }
+
+  int64_t CounterValue(CounterPrototype& proto) {
+    return proto.Instantiate(entity_)->value();
+  }
+
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  std::atomic<bool> healthy_;
+  std::atomic<bool> factory_fails_;
+  std::atomic<int> num_created_;
+};
+
+TEST_F(ConnectionPoolTest, TestLeaseAndReturn) {
+  ConnectionPoolOptions options;
+  options.min_connections = 2;
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+  ASSERT_OK(pool->Init());
+  ASSERT_EQ(2, pool->num_open());
+  ASSERT_EQ(2, num_created_);
+
+  Connection* first;
+  {
+    PooledConnection conn;
+    ASSERT_OK(pool->Lease(&conn));
+    ASSERT_TRUE(conn);
+    first = conn.get();
+    ASSERT_EQ(1, pool->num_leased());
+    ASSERT_EQ(1, METRIC_db_connections_leased.Instantiate(entity_, 0)->value());
+  }
+  ASSERT_EQ(0, pool->num_leased());
+  ASSERT_EQ(0, METRIC_db_connections_leased.Instantiate(entity_, 0)->value());
+
+  // The most recently used connection is leased again.
+  PooledConnection conn;
+  ASSERT_OK(pool->Lease(&conn));
+  ASSERT_EQ(first, conn.get());
+  ASSERT_EQ(2, num_created_);
+  ASSERT_EQ(3, METRIC_db_connection_lease_wait_time.Instantiate(entity_)->TotalCount());
+
+  // Leases can be moved.
+  PooledConnection moved(std::move(conn));
+  ASSERT_FALSE(conn);
+  ASSERT_EQ(first, moved.get());
+  moved.reset();
+  ASSERT_EQ(0, pool->num_leased());
+}
+
+TEST_F(ConnectionPoolTest, TestLeaseTimeout) {
+  ConnectionPoolOptions options;
+  options.max_connections = 2;
+  options.lease_timeout = MonoDelta::FromMilliseconds(100);
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+
+  PooledConnection a, b, c;
+  ASSERT_OK(pool->Lease(&a));
+  ASSERT_OK(pool->Lease(&b));
+  MonoTime start = MonoTime::Now();
+  Status s = pool->Lease(&c);
+  ASSERT_TRUE(s.IsTimedOut()) << s.ToString();
+  ASSERT_GE((MonoTime::Now() - start).ToMilliseconds(), 100);
+  ASSERT_EQ(1, CounterValue(METRIC_db_connection_lease_timeouts));
+}
+
+TEST_F(ConnectionPoolTest, TestLeaseWaitsForReturn) {
+  ConnectionPoolOptions options;
+  options.max_connections = 1;
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+
+  PooledConnection a, b;
+  ASSERT_OK(pool->Lease(&a));
+  Connection* leased = a.get();
+  std::thread returner([&]() {
+    SleepFor(MonoDelta::FromMilliseconds(50));
+    a.reset();
+  });
+  ASSERT_OK(pool->Lease(&b));
+  returner.join();
+  ASSERT_EQ(leased, b.get());
+  ASSERT_EQ(1, pool->num_open());
+  ASSERT_GE(METRIC_db_connection_lease_wait_time.Instantiate(entity_)->MaxValueForTests(),
+            50000);
+}
+
+TEST_F(ConnectionPoolTest, TestValidation) {
+  ConnectionPoolOptions options;
+  options.validation_interval = MonoDelta::FromMilliseconds(0);
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+  ASSERT_OK(pool->Init());
+  ASSERT_EQ(1, num_created_);
+
+  // The idle connection is broken: it is replaced by a new one.
+  healthy_ = false;
+  SleepFor(MonoDelta::FromMilliseconds(1));
+  PooledConnection conn;
+  ASSERT_OK(pool->Lease(&conn));
+  ASSERT_EQ(2, num_created_);
+  ASSERT_EQ(1, pool->num_open());
+  ASSERT_EQ(1, CounterValue(METRIC_db_connection_errors));
+}
+
+TEST_F(ConnectionPoolTest, TestFailedConnectionsAreClosed) {
+  ConnectionPoolOptions options;
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+  {
+    PooledConnection conn;
+    ASSERT_OK(pool->Lease(&conn));
+    conn.set_failed();
+  }
+  ASSERT_EQ(0, pool->num_open());
+  ASSERT_EQ(1, CounterValue(METRIC_db_connection_errors));
+
+  factory_fails_ = true;
+  PooledConnection conn;
+  Status s = pool->Lease(&conn);
+  ASSERT_TRUE(s.IsNetworkError()) << s.ToString();
+  ASSERT_FALSE(conn);
+  ASSERT_EQ(0, pool->num_open());
+  ASSERT_EQ(2, CounterValue(METRIC_db_connection_errors));
+}
+
+TEST_F(ConnectionPoolTest, TestIdleConnectionsAreClosed) {
+  ConnectionPoolOptions options;
+  options.min_connections = 1;
+  options.idle_timeout = MonoDelta::FromMilliseconds(0);
+  std::unique_ptr<ConnectionPool> pool = CreatePool(options);
+
+  PooledConnection a, b, c;
+  ASSERT_OK(pool->Lease(&a));
+  ASSERT_OK(pool->Lease(&b));
+  ASSERT_OK(pool->Lease(&c));
+  a.reset();
+  b.reset();
+  ASSERT_EQ(3, pool->num_open());
+  SleepFor(MonoDelta::FromMilliseconds(10));
+  // Returning a connection closes the expired ones, down to min_connections.
+  c.reset();
+  ASSERT_EQ(1, pool->num_open());
+}
+
+// Measures the lease throughput of a pool shared by more threads than it has
+// connections.
+TEST_F(ConnectionPoolTest, TestBenchmarkLease) {
+  ConnectionPoolOptions options;
+  options.max_connections = FLAGS_benchmark_max_connections;
+  options.lease_timeout = MonoDelta::FromSeconds(60);
+  std::unique_ptr<ConnectionPool> pool;
+  if (FLAGS_mysql_hostname.empty()) {
+    pool = CreatePool(options);
+  } else {
+    ConnectionBuilder builder;
+    builder.set_hostname(FLAGS_mysql_hostname)
+           .set_username(FLAGS_mysql_username)
+           .set_password(FLAGS_mysql_password)
+           .set_database(FLAGS_mysql_database);
+    pool.reset(new ConnectionPool(builder, options, entity_));
+  }
+  ASSERT_OK(pool->Init());
+
+  MonoDelta duration = MonoDelta::FromSeconds(AllowSlowTests() ? 10 : 1);
+  MonoTime deadline = MonoTime::Now() + duration;
+  std::atomic<int64_t> num_leases(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < FLAGS_benchmark_num_threads; i++) {
+    threads.emplace_back([&]() {
+      while (MonoTime::Now().ComesBefore(deadline)) {
+        PooledConnection conn;
+        CHECK_OK(pool->Lease(&conn));
+        if (!FLAGS_mysql_hostname.empty()) {
+          CHECK_OK(conn->Query("SELECT 1"));
+        }
+        num_leases++;
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  scoped_refptr<Histogram> wait_time =
+      METRIC_db_connection_lease_wait_time.Instantiate(entity_);
+  LOG(INFO) << num_leases << " leases by " << FLAGS_benchmark_num_threads
+            << " threads over " << options.max_connections << " connections in "
+            << duration.ToString() << ": "
+            << num_leases / duration.ToSeconds() << " leases/s, mean wait "
+            << wait_time->MeanValueForTests() << "us, max wait "
+            << wait_time->MaxValueForTests() << "us";
+  ASSERT_LE(pool->num_open(), options.max_connections);
+  ASSERT_EQ(0, CounterValue(METRIC_db_connection_lease_timeouts));
+}
+
+} // namespace db
+} // namespace mprmpr
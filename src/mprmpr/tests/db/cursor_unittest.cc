@@ -0,0 +1,167 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/cursor.h"
+#include "mprmpr/util/test_util.h"
+
+DEFINE_string(mysql_hostname, "",
+              "If set, the tests run queries on this MySQL server. Otherwise "
+              "only the failure paths are tested.");
+DEFINE_string(mysql_username, "root", "MySQL user of the tests");
+DEFINE_string(mysql_password, "", "MySQL password of the tests");
+DEFINE_string(mysql_database, "test", "MySQL database of the tests");
+
+using std::string;
+
+namespace mprmpr {
+namespace db {
+
+class CursorTest : public AntTest {
+ public:
+  void Connect() {
+    ConnectionBuilder builder;
+    builder.set_hostname(FLAGS_mysql_hostname)
+           .set_username(FLAGS_mysql_username)
+           .set_password(FLAGS_mysql_password)
+           .set_database(FLAGS_mysql_database);
+    ASSERT_OK(builder.Build(&conn_));
+  }
+
+  // A query of the numbers from 0 to 10^'digits' - 1, as column 'n'.
+  static string NumbersQuery(int digits) {
+    const string kDigits = "(SELECT 0 AS d UNION ALL SELECT 1 UNION ALL SELECT 2 UNION ALL "
+                           "SELECT 3 UNION ALL SELECT 4 UNION ALL SELECT 5 UNION ALL "
+                           "SELECT 6 UNION ALL SELECT 7 UNION ALL SELECT 8 UNION ALL "
+                           "SELECT 9)";
+    string select = "d0.d";
+    string from = kDigits + " d0";
+    for (int i = 1; i < digits; i++) {
+      string table = "d" + std::to_string(i);
+      select = table + ".d + 10 * (" + select + ")";
+      from += ", " + kDigits + " " + table;
+    }
+    return "SELECT " + select + " AS n FROM " + from;
+  }
+
+ protected:
+  std::unique_ptr<Connection> conn_;
+};
+
+TEST_F(CursorTest, TestClosedCursor) {
+  Cursor cursor;
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_FALSE(cursor.Next());
+  ASSERT_TRUE(cursor.fields().empty());
+  ASSERT_EQ(0, cursor.rows_read());
+  ASSERT_OK(cursor.status());
+  cursor.Close();
+}
+
+TEST_F(CursorTest, TestNotConnected) {
+  Connection conn("", "", "", "", 0);
+  Cursor cursor;
+  Status s = conn.OpenCursor("SELECT 1", &cursor);
+  ASSERT_TRUE(s.IsRuntimeError()) << s.ToString();
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_FALSE(cursor.Next());
+}
+
+TEST_F(CursorTest, TestScan) {
+  if (FLAGS_mysql_hostname.empty()) {
+    LOG(INFO) << "Skipping test: --mysql_hostname is not set";
+    return;
+  }
+  NO_FATALS(Connect());
+
+  Cursor cursor;
+  ASSERT_OK(conn_->OpenCursor("SELECT n, CONCAT('row ', n) AS name FROM (" +
+                              NumbersQuery(2) + ") numbers ORDER BY n", &cursor));
+  ASSERT_TRUE(cursor.is_open());
+  ASSERT_EQ(2, cursor.fields().size());
+  ASSERT_EQ(1, cursor.fields().at("name"));
+
+  // The connection is taken until the last row is read.
+  Status s = conn_->Query("SELECT 1");
+  ASSERT_TRUE(s.IsIllegalState()) << s.ToString();
+
+  int32_t expected = 0;
+  while (cursor.Next()) {
+    ResultRow row = cursor.row();
+    ASSERT_EQ(expected, static_cast<int32_t>(row["n"]));
+    ASSERT_EQ("row " + std::to_string(expected), static_cast<string>(row["name"]));
+    expected++;
+  }
+  ASSERT_OK(cursor.status());
+  ASSERT_EQ(100, expected);
+  ASSERT_EQ(100, cursor.rows_read());
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_OK(conn_->Query("SELECT 1"));
+}
+
+TEST_F(CursorTest, TestNoRows) {
+  if (FLAGS_mysql_hostname.empty()) {
+    LOG(INFO) << "Skipping test: --mysql_hostname is not set";
+    return;
+  }
+  NO_FATALS(Connect());
+  ASSERT_OK(conn_->Query("CREATE TEMPORARY TABLE numbers AS " + NumbersQuery(1)));
+
+  // A statement without a result set leaves the cursor closed.
+  Cursor cursor;
+  ASSERT_OK(conn_->OpenCursor("UPDATE numbers SET n = n + 1", &cursor));
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_FALSE(cursor.Next());
+
+  // So does an empty result set, once read.
+  ASSERT_OK(conn_->OpenCursor("SELECT n FROM numbers WHERE n > 100", &cursor));
+  ASSERT_FALSE(cursor.Next());
+  ASSERT_OK(cursor.status());
+  ASSERT_FALSE(cursor.is_open());
+
+  Status s = conn_->OpenCursor("SELECT * FROM no_such_table", &cursor);
+  ASSERT_TRUE(s.IsRuntimeError()) << s.ToString();
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_OK(conn_->Query("SELECT 1"));
+}
+
+// Closing a cursor skips the few rows left, and kills the query otherwise.
+TEST_F(CursorTest, TestCloseEarly) {
+  if (FLAGS_mysql_hostname.empty()) {
+    LOG(INFO) << "Skipping test: --mysql_hostname is not set";
+    return;
+  }
+  NO_FATALS(Connect());
+
+  Cursor cursor;
+  const string kQuery = NumbersQuery(6);
+  ASSERT_OK(conn_->OpenCursor(kQuery, &cursor));
+  for (size_t i = 0; i < 1000 * 1000 - Cursor::kMaxSkippedRows / 2; i++) {
+    ASSERT_TRUE(cursor.Next());
+  }
+  cursor.Close();
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_OK(conn_->Query("SELECT 1"));
+
+  ASSERT_OK(conn_->OpenCursor(kQuery, &cursor));
+  ASSERT_TRUE(cursor.Next());
+  cursor.Close();
+  ASSERT_FALSE(cursor.is_open());
+  ASSERT_EQ(1, cursor.rows_read());
+  ASSERT_OK(conn_->Query("SELECT 1"));
+
+  // The connection still runs scans.
+  ASSERT_OK(conn_->OpenCursor(NumbersQuery(3), &cursor));
+  while (cursor.Next()) {}
+  ASSERT_OK(cursor.status());
+  ASSERT_EQ(1000, cursor.rows_read());
+}
+
+} // namespace db
+} // namespace mprmpr
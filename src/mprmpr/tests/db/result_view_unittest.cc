@@ -0,0 +1,202 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "mprmpr/db/query_result_field.h"
+#include "mprmpr/db/result.h"
+#include "mprmpr/db/result_impl.h"
+#include "mprmpr/db/result_view.h"
+#include "mprmpr/util/stopwatch.h"
+#include "mprmpr/util/test_util.h"
+
+namespace mprmpr {
+namespace db {
+
+// The text values of a query result, as stored by mysql_store_result(): a
+// nullptr is a NULL value.
+typedef std::vector<std::vector<const char*>> TextRows;
+
+// A result of text values which does not come from a server.
+class FakeResultImpl : public ResultImpl {
+ public:
+  FakeResultImpl(const std::vector<std::string>& columns, TextRows rows, bool text)
+      : text_(text) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+      fields_[columns[i]] = i;
+    }
+    for (const auto& row : rows) {
+      rows_.emplace_back();
+      for (const char* value : row) {
+        rows_.back().emplace_back(new QueryResultField(value, value ? strlen(value) : 0));
+      }
+    }
+  }
+
+  const std::map<std::string, size_t>& Fields() const override {
+    return fields_;
+  }
+
+  size_t size() const override {
+    return rows_.size();
+  }
+
+  const std::vector<std::unique_ptr<ResultFieldImpl>>& Fetch(size_t index) override {
+    return rows_[index];
+  }
+
+  bool GetTextCells(std::vector<Slice>* cells, std::vector<uint8_t>* nulls) override {
+    if (!text_) {
+      return false;
+    }
+    for (const auto& row : rows_) {
+      for (const auto& field : row) {
+        cells->push_back(field->ToSlice());
+        nulls->push_back(field->IsNULL());
+      }
+    }
+    return true;
+  }
+
+ private:
+  const bool text_;
+  std::map<std::string, size_t> fields_;
+  std::vector<std::vector<std::unique_ptr<ResultFieldImpl>>> rows_;
+};
+
+class ResultViewTest : public AntTest,
+                       public ::testing::WithParamInterface<bool> {
+ public:
+  std::unique_ptr<Result> MakeResult(const std::vector<std::string>& columns,
+                                     TextRows rows) {
+    return std::unique_ptr<Result>(new Result(
+        std::make_shared<FakeResultImpl>(columns, std::move(rows), GetParam())));
+  }
+};
+
+// Runs the tests on text cells, and on the fields of the rows.
+INSTANTIATE_TEST_CASE_P(TextCells, ResultViewTest, ::testing::Bool());
+
+TEST_P(ResultViewTest, TestAsTuples) {
+  auto result = MakeResult({ "id", "name", "state" },
+                           { { "1", "first", "10" },
+                             { "-2", nullptr, "4294967295" },
+                             { "9223372036854775807", "", nullptr } });
+  std::vector<std::tuple<int64_t, Slice, uint32_t>> rows;
+  ASSERT_OK(result->As(&rows));
+  ASSERT_EQ(3, rows.size());
+  EXPECT_EQ(1, std::get<0>(rows[0]));
+  EXPECT_EQ("first", std::get<1>(rows[0]).ToString());
+  EXPECT_EQ(10, std::get<2>(rows[0]));
+  EXPECT_EQ(-2, std::get<0>(rows[1]));
+  EXPECT_TRUE(std::get<1>(rows[1]).empty());
+  EXPECT_EQ(4294967295U, std::get<2>(rows[1]));
+  EXPECT_EQ(9223372036854775807LL, std::get<0>(rows[2]));
+  EXPECT_EQ(0, std::get<2>(rows[2]));
+
+  // A prefix of the columns.
+  std::vector<std::tuple<int64_t, std::string>> prefix;
+  ASSERT_OK(result->As(&prefix));
+  EXPECT_EQ("first", std::get<1>(prefix[0]));
+
+  std::vector<std::tuple<int64_t, Slice, uint32_t, int>> too_many;
+  Status s = result->As(&too_many);
+  EXPECT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
+
+TEST_P(ResultViewTest, TestColumns) {
+  auto result = MakeResult({ "id", "ratio" },
+                           { { "3", "0.5" }, { "1", nullptr }, { "2", "-1e3" } });
+  ResultView view(*result);
+  ASSERT_EQ(3, view.num_rows());
+  ASSERT_EQ(2, view.num_columns());
+
+  size_t id_column, ratio_column, missing;
+  ASSERT_OK(view.FindColumn("id", &id_column));
+  ASSERT_OK(view.FindColumn("ratio", &ratio_column));
+  EXPECT_TRUE(view.FindColumn("missing", &missing).IsNotFound());
+
+  ColumnSpan<int32_t> ids;
+  ASSERT_OK(view.GetColumn(id_column, &ids));
+  EXPECT_EQ(std::vector<int32_t>({ 3, 1, 2 }), std::vector<int32_t>(ids.begin(), ids.end()));
+
+  // The column is decoded once.
+  ColumnSpan<int32_t> ids_again;
+  ASSERT_OK(view.GetColumn(id_column, &ids_again));
+  EXPECT_EQ(ids.data(), ids_again.data());
+  ColumnSpan<int64_t> wide_ids;
+  EXPECT_TRUE(view.GetColumn(id_column, &wide_ids).IsInvalidArgument());
+
+  ColumnSpan<double> ratios;
+  ASSERT_OK(view.GetColumn(ratio_column, &ratios));
+  EXPECT_EQ(0.5, ratios[0]);
+  EXPECT_EQ(0, ratios[1]);
+  EXPECT_TRUE(view.IsNULL(1, ratio_column));
+  EXPECT_FALSE(view.IsNULL(2, ratio_column));
+  EXPECT_EQ(-1000, ratios[2]);
+}
+
+TEST_P(ResultViewTest, TestInvalidNumbers) {
+  auto result = MakeResult({ "value" },
+                           { { "300" }, { "-1" }, { "12abc" }, { "18446744073709551616" } });
+  ResultView view(*result);
+  uint8_t u8;
+  uint64_t u64;
+  int64_t i64;
+  if (GetParam()) {
+    Status s = view.Get(0, 0, &u8);
+    EXPECT_TRUE(s.IsInvalidArgument()) << s.ToString();
+    ASSERT_STR_CONTAINS(s.ToString(), "row 0, column 0");
+    EXPECT_TRUE(view.Get(1, 0, &u64).IsInvalidArgument());
+    EXPECT_TRUE(view.Get(2, 0, &i64).IsInvalidArgument());
+    EXPECT_TRUE(view.Get(3, 0, &u64).IsInvalidArgument());
+  }
+  int16_t i16;
+  ASSERT_OK(view.Get(0, 0, &i16));
+  EXPECT_EQ(300, i16);
+  ASSERT_OK(view.Get(1, 0, &i64));
+  EXPECT_EQ(-1, i64);
+}
+
+// Compares the cost of decoding rows through ResultRow and through As().
+TEST_P(ResultViewTest, TestDecodePerformance) {
+  const int kNumRows = AllowSlowTests() ? 1000000 : 100000;
+  std::vector<std::string> values;
+  values.reserve(kNumRows);
+  for (int i = 0; i < kNumRows; i++) {
+    values.push_back(std::to_string(i));
+  }
+  TextRows rows;
+  for (int i = 0; i < kNumRows; i++) {
+    rows.push_back({ values[i].c_str(), "name", values[i].c_str() });
+  }
+  auto result = MakeResult({ "id", "name", "state" }, std::move(rows));
+
+  int64_t sum = 0;
+  LOG_TIMING(INFO, "decoding with ResultRow") {
+    for (auto row : *result) {
+      sum += static_cast<int64_t>(row["id"]);
+      sum += static_cast<std::string>(row["name"]).size();
+      sum += static_cast<uint32_t>(row["state"]);
+    }
+  }
+
+  int64_t view_sum = 0;
+  LOG_TIMING(INFO, "decoding with ResultView") {
+    std::vector<std::tuple<int64_t, Slice, uint32_t>> decoded;
+    ASSERT_OK(result->As(&decoded));
+    for (const auto& row : decoded) {
+      view_sum += std::get<0>(row) + std::get<1>(row).size() + std::get<2>(row);
+    }
+  }
+  EXPECT_EQ(sum, view_sum);
+}
+
+} // namespace db
+} // namespace mprmpr
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+
+#include <mysql/mysql.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/db/connection.h"
+#include "mprmpr/db/parameter.h"
+#include "mprmpr/db/result.h"
+#include "mprmpr/db/statement.h"
+#include "mprmpr/util/slice.h"
+#include "mprmpr/util/test_util.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace mprmpr {
+namespace db {
+
+class ParameterTest : public AntTest {
+ public:
+  ParameterTest() {
+    std::memset(binds_, 0, sizeof(binds_));
+  }
+
+ protected:
+  MYSQL_BIND binds_[4];
+};
+
+TEST_F(ParameterTest, TestBindIntegers) {
+  int8_t i8 = -8;
+  uint16_t u16 = 16;
+  int32_t i32 = -32;
+  uint64_t u64 = 64;
+  BindParameters(binds_, i8, u16, i32, u64);
+  ASSERT_EQ(MYSQL_TYPE_TINY, binds_[0].buffer_type);
+  ASSERT_FALSE(binds_[0].is_unsigned);
+  ASSERT_EQ(MYSQL_TYPE_SHORT, binds_[1].buffer_type);
+  ASSERT_TRUE(binds_[1].is_unsigned);
+  ASSERT_EQ(MYSQL_TYPE_LONG, binds_[2].buffer_type);
+  ASSERT_FALSE(binds_[2].is_unsigned);
+  ASSERT_EQ(MYSQL_TYPE_LONGLONG, binds_[3].buffer_type);
+  ASSERT_TRUE(binds_[3].is_unsigned);
+
+  // The values are bound in place.
+  ASSERT_EQ(&i8, binds_[0].buffer);
+  ASSERT_EQ(&u16, binds_[1].buffer);
+  ASSERT_EQ(&i32, binds_[2].buffer);
+  ASSERT_EQ(&u64, binds_[3].buffer);
+}
+
+TEST_F(ParameterTest, TestBindFloatingPoint) {
+  float f = 1.5;
+  double d = 2.5;
+  BindParameters(binds_, f, d);
+  ASSERT_EQ(MYSQL_TYPE_FLOAT, binds_[0].buffer_type);
+  ASSERT_EQ(&f, binds_[0].buffer);
+  ASSERT_EQ(MYSQL_TYPE_DOUBLE, binds_[1].buffer_type);
+  ASSERT_EQ(&d, binds_[1].buffer);
+  ASSERT_EQ(nullptr, binds_[2].buffer);
+}
+
+TEST_F(ParameterTest, TestBindStringsWithoutEscaping) {
+  // Quotes, backslashes and NUL bytes are sent as they are.
+  const string str("it's a \"quoted\" \\ string\0with a NUL", 35);
+  const char* c_str = "'; DROP TABLE jobs; --";
+  const uint8_t bytes[] = { 0, '\'', '\\', 0xff };
+  Slice blob(bytes, sizeof(bytes));
+  BindParameters(binds_, str, c_str, blob, nullptr);
+
+  ASSERT_EQ(MYSQL_TYPE_STRING, binds_[0].buffer_type);
+  ASSERT_EQ(str.data(), binds_[0].buffer);
+  ASSERT_EQ(str.size(), binds_[0].buffer_length);
+
+  ASSERT_EQ(MYSQL_TYPE_STRING, binds_[1].buffer_type);
+  ASSERT_EQ(c_str, binds_[1].buffer);
+  ASSERT_EQ(strlen(c_str), binds_[1].buffer_length);
+
+  ASSERT_EQ(MYSQL_TYPE_BLOB, binds_[2].buffer_type);
+  ASSERT_EQ(bytes, binds_[2].buffer);
+  ASSERT_EQ(sizeof(bytes), binds_[2].buffer_length);
+
+  ASSERT_EQ(MYSQL_TYPE_NULL, binds_[3].buffer_type);
+  ASSERT_EQ(nullptr, binds_[3].buffer);
+}
+
+// The statements prepared and executed by a FakeConnection.
+struct StatementLog {
+  vector<string> prepared;
+  vector<string> closed;
+  vector<string> executed;
+  // The types of the parameters of the last execution.
+  vector<enum_field_types> types;
+};
+
+// A statement which logs its executions instead of sending them to a
+// server. Each execution returns a result whose insert id is the number of
+// executions so far.
+class FakeStatement : public Statement {
+ public:
+  FakeStatement(const string& query, StatementLog* log)
+      : Statement(query),
+        log_(log) {
+    log_->prepared.push_back(query);
+  }
+
+  virtual ~FakeStatement() {
+    log_->closed.push_back(query());
+  }
+
+ protected:
+  virtual Status DoExecute(MYSQL_BIND* binds, size_t count) OVERRIDE {
+    log_->executed.push_back(query());
+    log_->types.clear();
+    for (size_t i = 0; i < count; i++) {
+      log_->types.push_back(binds[i].buffer_type);
+    }
+    result_.reset(new Result(count, log_->executed.size()));
+    return Status::OK();
+  }
+
+ private:
+  StatementLog* log_;
+};
+
+// A connection whose statements are FakeStatements. Queries starting with
+// "bad" fail to prepare.
+class FakeConnection : public Connection {
+ public:
+  FakeConnection(size_t capacity, StatementLog* log)
+      : Connection("", "", "", "", 0, capacity),
+        log_(log) {
+  }
+
+ private:
+  virtual Status NewStatement(const string& query,
+                              unique_ptr<Statement>* statement) OVERRIDE {
+    if (query.compare(0, 3, "bad") == 0) {
+      return Status::InvalidArgument("Unable to prepare statement " + query);
+    }
+    statement->reset(new FakeStatement(query, log_));
+    return Status::OK();
+  }
+
+  StatementLog* log_;
+};
+
+class StatementCacheTest : public AntTest {
+ protected:
+  // Executes 'query' on 'conn_', checking that it was the 'n'-th execution.
+  void Execute(const string& query, int n) {
+    ASSERT_OK(conn_->ExecutePrepared(query, 1, string("x")));
+    ASSERT_EQ(1, conn_->GetResults().size());
+    ASSERT_EQ(n, conn_->GetResults()[0]->insert_id());
+    ASSERT_EQ(query, log_.executed.back());
+  }
+
+  StatementLog log_;
+  unique_ptr<FakeConnection> conn_;
+};
+
+TEST_F(StatementCacheTest, TestHitsAndEvictions) {
+  conn_.reset(new FakeConnection(2, &log_));
+  NO_FATALS(Execute("a", 1));
+  NO_FATALS(Execute("b", 2));
+  ASSERT_EQ(vector<enum_field_types>({ MYSQL_TYPE_LONG, MYSQL_TYPE_STRING }), log_.types);
+
+  // A hit: "a" is not prepared again, and is now the most recently used.
+  NO_FATALS(Execute("a", 3));
+  ASSERT_EQ(vector<string>({ "a", "b" }), log_.prepared);
+  ASSERT_EQ(2, conn_->num_cached_statements());
+
+  // Past the capacity, the least recently used statement is closed.
+  NO_FATALS(Execute("c", 4));
+  ASSERT_EQ(vector<string>({ "b" }), log_.closed);
+  ASSERT_EQ(2, conn_->num_cached_statements());
+  NO_FATALS(Execute("b", 5));
+  ASSERT_EQ(vector<string>({ "a", "b", "c", "b" }), log_.prepared);
+  ASSERT_EQ(vector<string>({ "b", "a" }), log_.closed);
+  NO_FATALS(Execute("c", 6));
+  ASSERT_EQ(4, log_.prepared.size());
+
+  // Closing the connection closes the statements left.
+  conn_.reset();
+  ASSERT_EQ(4, log_.closed.size());
+}
+
+TEST_F(StatementCacheTest, TestPrepareFailure) {
+  conn_.reset(new FakeConnection(Connection::kDefaultStatementCacheCapacity, &log_));
+  NO_FATALS(Execute("a", 1));
+  Status s = conn_->ExecutePrepared("bad", 1);
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+  ASSERT_EQ(1, conn_->num_cached_statements());
+
+  // The cached statements still work.
+  NO_FATALS(Execute("a", 2));
+  ASSERT_EQ(1, log_.prepared.size());
+}
+
+TEST_F(StatementCacheTest, TestCapacityOfZero) {
+  // At least one statement is cached.
+  conn_.reset(new FakeConnection(0, &log_));
+  NO_FATALS(Execute("a", 1));
+  NO_FATALS(Execute("a", 2));
+  ASSERT_EQ(1, log_.prepared.size());
+  NO_FATALS(Execute("b", 3));
+  ASSERT_EQ(1, conn_->num_cached_statements());
+  ASSERT_EQ(vector<string>({ "a" }), log_.closed);
+}
+
+} // namespace db
+} // namespace mprmpr
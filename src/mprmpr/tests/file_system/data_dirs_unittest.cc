@@ -0,0 +1,161 @@
+#include <errno.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/util/countdown_latch.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/path_util.h"
+#include "mprmpr/util/test_util.h"
+
+DECLARE_int64(fs_data_dirs_reserved_bytes);
+
+METRIC_DECLARE_gauge_uint64(data_dirs_failed);
+
+using std::string;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+class DataDirsTest : public AntTest {
+ public:
+  DataDirsTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "data-dirs-test")) {
+  }
+
+  void OpenManager(int num_dirs) {
+    vector<string> paths;
+    for (int i = 0; i < num_dirs; i++) {
+      paths.push_back(GetTestPath(Substitute("data-$0", i)));
+    }
+    OpenManager(std::move(paths));
+  }
+
+  void OpenManager(vector<string> paths) {
+    dd_manager_.reset(new DataDirManager(env_, entity_, std::move(paths)));
+    ASSERT_OK(dd_manager_->Open());
+  }
+
+  DataDir* data_dir(int i) {
+    return dd_manager_->data_dirs()[i].get();
+  }
+
+  uint64_t num_failed() {
+    return METRIC_data_dirs_failed.Instantiate(entity_, 0)->value();
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  std::unique_ptr<DataDirManager> dd_manager_;
+};
+
+TEST_F(DataDirsTest, TestPlacement) {
+  NO_FATALS(OpenManager(3));
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(env_->FileExists(data_dir(i)->dir()));
+    ASSERT_GT(data_dir(i)->available_bytes(), 0);
+  }
+
+  // All the dirs get new files.
+  std::map<DataDir*, int> num_picks;
+  for (int i = 0; i < 300; i++) {
+    DataDir* dir;
+    ASSERT_OK(dd_manager_->GetNextDataDir(&dir));
+    num_picks[dir]++;
+  }
+  ASSERT_EQ(3, num_picks.size());
+
+  string path = JoinPathSegments(data_dir(1)->dir(), "scratch/file");
+  ASSERT_EQ(data_dir(1), dd_manager_->FindDataDirByPath(path));
+  ASSERT_EQ(nullptr, dd_manager_->FindDataDirByPath(data_dir(1)->dir() + "x/file"));
+}
+
+TEST_F(DataDirsTest, TestIoLoad) {
+  NO_FATALS(OpenManager(2));
+
+  // The dir busy with I/O is avoided.
+  DataDir::IoScope io(data_dir(0));
+  ASSERT_EQ(1, data_dir(0)->num_inflight_ops());
+  for (int i = 0; i < 100; i++) {
+    DataDir* dir;
+    ASSERT_OK(dd_manager_->GetNextDataDir(&dir));
+    ASSERT_EQ(data_dir(1), dir);
+  }
+}
+
+TEST_F(DataDirsTest, TestExecClosure) {
+  NO_FATALS(OpenManager(1));
+  CountDownLatch started(1);
+  CountDownLatch release(1);
+  ASSERT_OK(data_dir(0)->ExecClosure([&]() {
+      started.CountDown();
+      release.Wait();
+    }));
+  started.Wait();
+  ASSERT_EQ(1, data_dir(0)->num_inflight_ops());
+  release.CountDown();
+  data_dir(0)->WaitOnClosures();
+  ASSERT_EQ(0, data_dir(0)->num_inflight_ops());
+}
+
+TEST_F(DataDirsTest, TestFailedDirs) {
+  NO_FATALS(OpenManager(2));
+
+  // Only errors denoting a broken disk fail the dir.
+  Status s = dd_manager_->HandleIOError(data_dir(0), Status::IOError("open", "missing", ENOENT));
+  ASSERT_TRUE(s.IsIOError());
+  ASSERT_FALSE(data_dir(0)->is_failed());
+  dd_manager_->HandleIOError(data_dir(0), Status::IOError("write", "failed", EIO));
+  ASSERT_TRUE(data_dir(0)->is_failed());
+  ASSERT_EQ(1, dd_manager_->num_healthy_data_dirs());
+  ASSERT_EQ(1, num_failed());
+
+  for (int i = 0; i < 100; i++) {
+    DataDir* dir;
+    ASSERT_OK(dd_manager_->GetNextDataDir(&dir));
+    ASSERT_EQ(data_dir(1), dir);
+  }
+
+  dd_manager_->MarkDataDirFailed(data_dir(1), "injected failure");
+  DataDir* dir;
+  s = dd_manager_->GetNextDataDir(&dir);
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+  ASSERT_EQ(2, num_failed());
+}
+
+TEST_F(DataDirsTest, TestOpenWithBrokenDir) {
+  // A dir which cannot be created is failed, rather than the manager.
+  string file = GetTestPath("file");
+  std::unique_ptr<WritableFile> writer;
+  ASSERT_OK(env_->NewWritableFile(file, &writer));
+  ASSERT_OK(writer->Close());
+  NO_FATALS(OpenManager({ JoinPathSegments(file, "data"), GetTestPath("data") }));
+  ASSERT_TRUE(data_dir(0)->is_failed());
+  ASSERT_FALSE(data_dir(1)->is_failed());
+  ASSERT_EQ(1, num_failed());
+
+  dd_manager_.reset(new DataDirManager(env_, entity_, { JoinPathSegments(file, "data") }));
+  Status s = dd_manager_->Open();
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+}
+
+TEST_F(DataDirsTest, TestReservedBytes) {
+  FLAGS_fs_data_dirs_reserved_bytes = 1LL << 60;
+  NO_FATALS(OpenManager(2));
+  DataDir* dir;
+  Status s = dd_manager_->GetNextDataDir(&dir);
+  ASSERT_TRUE(s.IsServiceUnavailable()) << s.ToString();
+}
+
+} // namespace mprmpr
@@ -0,0 +1,174 @@
+#include <sys/time.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/file_system/file_system_manager.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/path_util.h"
+#include "mprmpr/util/test_util.h"
+
+using std::string;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+class FileSystemManagerTest : public AntTest {
+ public:
+  void CreateManager() {
+    FileSystemManager::Options options;
+    options.wal_path = GetTestPath("wal");
+    options.data_paths = { GetTestPath("data-0"), GetTestPath("data-1") };
+    fs_manager_.reset(new FileSystemManager(env_, options));
+  }
+
+ protected:
+  std::unique_ptr<FileSystemManager> fs_manager_;
+};
+
+TEST_F(FileSystemManagerTest, TestCreateAndOpen) {
+  CreateManager();
+  Status s = fs_manager_->Open();
+  ASSERT_TRUE(s.IsNotFound()) << s.ToString();
+
+  CreateManager();
+  ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+  ASSERT_OK(fs_manager_->Open());
+  string uuid = fs_manager_->uuid();
+  ASSERT_EQ(2, fs_manager_->dd_manager()->data_dirs().size());
+  ASSERT_EQ(2, fs_manager_->dd_manager()->num_healthy_data_dirs());
+
+  // The layout is loaded back, and not created twice.
+  CreateManager();
+  s = fs_manager_->CreateInitialFileSystemLayout();
+  ASSERT_TRUE(s.IsAlreadyPresent()) << s.ToString();
+  ASSERT_OK(fs_manager_->Open());
+  ASSERT_EQ(uuid, fs_manager_->uuid());
+}
+
+TEST_F(FileSystemManagerTest, TestOpenWithUnreadableRoot) {
+  CreateManager();
+  ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+  ASSERT_OK(fs_manager_->Open());
+  string uuid = fs_manager_->uuid();
+
+  // Make the instance metadata of a data root unreadable: a directory in its
+  // place fails with EISDIR, even when running as root.
+  auto make_unreadable = [&](const string& root) {
+    string path = fs_manager_->GetInstanceMetadataPath(root);
+    CHECK_OK(env_->DeleteFile(path));
+    CHECK_OK(env_->CreateDir(path));
+  };
+  make_unreadable(GetTestPath("data-1"));
+
+  // Only its data dir fails.
+  CreateManager();
+  ASSERT_OK(fs_manager_->Open());
+  ASSERT_EQ(uuid, fs_manager_->uuid());
+  DataDirManager* dd_manager = fs_manager_->dd_manager();
+  ASSERT_EQ(2, dd_manager->data_dirs().size());
+  ASSERT_EQ(1, dd_manager->num_healthy_data_dirs());
+  DataDir* failed = dd_manager->FindDataDirByPath(
+      JoinPathSegments(GetTestPath("data-1"), "data"));
+  ASSERT_TRUE(failed != nullptr);
+  ASSERT_TRUE(failed->is_failed());
+
+  // Without any data dir left, opening fails.
+  make_unreadable(GetTestPath("data-0"));
+  CreateManager();
+  Status s = fs_manager_->Open();
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+}
+
+TEST_F(FileSystemManagerTest, TestOpenWithWalRootUnreadable) {
+  CreateManager();
+  ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+  string path = fs_manager_->GetInstanceMetadataPath(GetTestPath("wal"));
+  ASSERT_OK(env_->DeleteFile(path));
+  ASSERT_OK(env_->CreateDir(path));
+
+  CreateManager();
+  Status s = fs_manager_->Open();
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+  ASSERT_STR_CONTAINS(s.ToString(), "WAL root");
+}
+
+TEST_F(FileSystemManagerTest, TestOpenWithMismatchedRoot) {
+  CreateManager();
+  ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+
+  // Format data-1 again, as part of another instance.
+  ASSERT_OK(env_->DeleteFile(fs_manager_->GetInstanceMetadataPath(GetTestPath("data-1"))));
+  FileSystemManager::Options options;
+  options.wal_path = GetTestPath("other-wal");
+  options.data_paths = { GetTestPath("data-1") };
+  FileSystemManager other(env_, options);
+  ASSERT_OK(other.CreateInitialFileSystemLayout());
+
+  CreateManager();
+  Status s = fs_manager_->Open();
+  ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+}
+
+TEST_F(FileSystemManagerTest, TestCleanTmpFiles) {
+  CreateManager();
+  ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+
+  auto create_tmp_file = [&](const string& name) {
+    string path = JoinPathSegments(GetTestPath("data-1"),
+                                   Substitute("data/$0$1.abc", name, kTmpInfix));
+    std::unique_ptr<WritableFile> writer;
+    CHECK_OK(env_->NewWritableFile(path, &writer));
+    CHECK_OK(writer->Close());
+    return path;
+  };
+
+  // Left by a previous run an hour ago.
+  string old_tmp = create_tmp_file("old");
+  struct timeval times[2];
+  ASSERT_EQ(0, gettimeofday(&times[0], nullptr));
+  times[0].tv_sec -= 3600;
+  times[1] = times[0];
+  ASSERT_EQ(0, utimes(old_tmp.c_str(), times));
+
+  // Possibly in use by this run.
+  string new_tmp = create_tmp_file("new");
+
+  CreateManager();
+  ASSERT_OK(fs_manager_->Open());
+  fs_manager_->WaitForTmpFilesCleanup();
+  ASSERT_FALSE(env_->FileExists(old_tmp));
+  ASSERT_TRUE(env_->FileExists(new_tmp));
+}
+
+TEST_F(FileSystemManagerTest, TestDataRootDirs) {
+  CreateManager();
+  ASSERT_EQ(vector<string>({ JoinPathSegments(GetTestPath("data-0"), "data"),
+                             JoinPathSegments(GetTestPath("data-1"), "data") }),
+            fs_manager_->GetDataRootDirs());
+
+  // Without data roots, data goes to the WAL root.
+  FileSystemManager::Options options;
+  options.wal_path = GetTestPath("wal");
+  FileSystemManager wal_only(env_, options);
+  ASSERT_EQ(vector<string>({ JoinPathSegments(GetTestPath("wal"), "data") }),
+            wal_only.GetDataRootDirs());
+
+  string dir = GetTestPath("scratch");
+  bool created;
+  ASSERT_OK(fs_manager_->CreateDirIfMissing(dir, &created));
+  ASSERT_TRUE(created);
+  ASSERT_OK(fs_manager_->CreateDirIfMissing(dir, &created));
+  ASSERT_FALSE(created);
+  Status s = fs_manager_->CreateDirIfMissing(JoinPathSegments(GetTestPath("missing"), "dir"));
+  ASSERT_TRUE(s.IsNotFound()) << s.ToString();
+}
+
+} // namespace mprmpr
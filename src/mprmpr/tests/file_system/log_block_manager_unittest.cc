@@ -0,0 +1,428 @@
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/base/strings/util.h"
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/file_system/file_system.pb.h"
+#include "mprmpr/file_system/log_block_manager.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/path_util.h"
+#include "mprmpr/util/pb_util.h"
+#include "mprmpr/util/test_util.h"
+
+DECLARE_int32(log_block_manager_max_open_files);
+DECLARE_int64(log_container_max_size);
+DECLARE_int64(log_container_preallocate_bytes);
+
+METRIC_DECLARE_gauge_uint64(log_block_manager_blocks_under_management);
+METRIC_DECLARE_gauge_uint64(log_block_manager_bytes_under_management);
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+class LogBlockManagerTest : public AntTest {
+ public:
+  LogBlockManagerTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "log-block-manager-test")) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    dd_manager_.reset(new DataDirManager(env_, entity_, { GetTestPath("data-0"),
+                                                          GetTestPath("data-1") }));
+    ASSERT_OK(dd_manager_->Open());
+    NO_FATALS(ReopenBlockManager());
+  }
+
+  void ReopenBlockManager() {
+    bm_.reset();
+    bm_.reset(new LogBlockManager(env_, dd_manager_.get(), entity_, false));
+    ASSERT_OK(bm_->Open());
+  }
+
+  BlockId WriteBlock(const string& data) {
+    unique_ptr<WritableBlock> block;
+    CHECK_OK(bm_->CreateBlock(&block));
+    CHECK_OK(block->Append(data));
+    CHECK_OK(block->Close());
+    return block->id();
+  }
+
+  void AssertBlockContents(const BlockId& id, const string& expected) {
+    unique_ptr<ReadableBlock> block;
+    ASSERT_OK(bm_->OpenBlock(id, &block));
+    ASSERT_EQ(expected.size(), block->size());
+    std::unique_ptr<uint8_t[]> scratch(new uint8_t[expected.size()]);
+    Slice result;
+    ASSERT_OK(block->Read(0, expected.size(), &result, scratch.get()));
+    ASSERT_EQ(expected, result.ToString());
+  }
+
+  // The files of the containers with the given suffix.
+  vector<string> ContainerFiles(const string& suffix) {
+    vector<string> files;
+    for (const auto& dir : dd_manager_->data_dirs()) {
+      vector<string> children;
+      CHECK_OK(env_->GetChildren(dir->dir(), &children));
+      for (const string& child : children) {
+        if (HasSuffixString(child, suffix)) {
+          files.push_back(JoinPathSegments(dir->dir(), child));
+        }
+      }
+    }
+    return files;
+  }
+
+  vector<string> ContainerDataFiles() {
+    return ContainerFiles(LogBlockManager::kContainerDataFileSuffix);
+  }
+
+  uint64_t ContainersSizeOnDisk() {
+    uint64_t total = 0;
+    for (const string& file : ContainerDataFiles()) {
+      uint64_t size;
+      CHECK_OK(env_->GetFileSizeOnDisk(file, &size));
+      total += size;
+    }
+    return total;
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  unique_ptr<DataDirManager> dd_manager_;
+  unique_ptr<LogBlockManager> bm_;
+};
+
+TEST_F(LogBlockManagerTest, TestCreateReadDelete) {
+  unique_ptr<WritableBlock> block;
+  ASSERT_OK(bm_->CreateBlock(&block));
+  ASSERT_OK(block->Append("hello "));
+  ASSERT_OK(block->Append("world"));
+  BlockId id = block->id();
+
+  // Not readable until closed.
+  unique_ptr<ReadableBlock> reader;
+  ASSERT_TRUE(bm_->OpenBlock(id, &reader).IsNotFound());
+  ASSERT_OK(block->Close());
+  NO_FATALS(AssertBlockContents(id, "hello world"));
+  ASSERT_EQ(1, bm_->num_blocks());
+  ASSERT_EQ(1, METRIC_log_block_manager_blocks_under_management.Instantiate(entity_, 0)->value());
+  ASSERT_EQ(11, METRIC_log_block_manager_bytes_under_management.Instantiate(entity_, 0)->value());
+
+  Slice result;
+  uint8_t scratch[16];
+  ASSERT_OK(bm_->OpenBlock(id, &reader));
+  ASSERT_TRUE(reader->Read(8, 8, &result, scratch).IsInvalidArgument());
+
+  ASSERT_OK(bm_->DeleteBlock(id));
+  ASSERT_TRUE(bm_->OpenBlock(id, &reader).IsNotFound());
+  ASSERT_TRUE(bm_->DeleteBlock(id).IsNotFound());
+  ASSERT_EQ(0, bm_->num_blocks());
+  ASSERT_EQ(0, METRIC_log_block_manager_blocks_under_management.Instantiate(entity_, 0)->value());
+}
+
+TEST_F(LogBlockManagerTest, TestContainersAreShared) {
+  std::set<BlockId, bool(*)(const BlockId&, const BlockId&)> ids(
+      [](const BlockId& a, const BlockId& b) { return a.id() < b.id(); });
+  for (int i = 0; i < 100; i++) {
+    ids.insert(WriteBlock(Substitute("block $0", i)));
+  }
+  ASSERT_EQ(100, ids.size());
+  ASSERT_EQ(100, bm_->num_blocks());
+  // Blocks written one after the other reuse the same few containers.
+  ASSERT_LE(bm_->num_containers(), 2);
+  ASSERT_EQ(bm_->num_containers(), ContainerDataFiles().size());
+
+  // An aborted block leaves no trace.
+  {
+    unique_ptr<WritableBlock> block;
+    ASSERT_OK(bm_->CreateBlock(&block));
+    ASSERT_OK(block->Append("aborted"));
+  }
+  ASSERT_EQ(100, bm_->num_blocks());
+  ASSERT_LE(bm_->num_containers(), 2);
+}
+
+TEST_F(LogBlockManagerTest, TestReopen) {
+  vector<BlockId> ids;
+  for (int i = 0; i < 10; i++) {
+    ids.push_back(WriteBlock(Substitute("block $0", i)));
+  }
+  for (int i = 0; i < 10; i += 2) {
+    ASSERT_OK(bm_->DeleteBlock(ids[i]));
+  }
+
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(5, bm_->num_blocks());
+  for (int i = 0; i < 10; i++) {
+    if (i % 2 == 0) {
+      unique_ptr<ReadableBlock> reader;
+      ASSERT_TRUE(bm_->OpenBlock(ids[i], &reader).IsNotFound());
+    } else {
+      NO_FATALS(AssertBlockContents(ids[i], Substitute("block $0", i)));
+    }
+  }
+
+  // New blocks go after the existing ones, with new IDs.
+  BlockId id = WriteBlock("new block");
+  for (const BlockId& old_id : ids) {
+    ASSERT_NE(old_id, id);
+  }
+  NO_FATALS(ReopenBlockManager());
+  NO_FATALS(AssertBlockContents(id, "new block"));
+  NO_FATALS(AssertBlockContents(ids[9], "block 9"));
+}
+
+TEST_F(LogBlockManagerTest, TestManifest) {
+  vector<BlockId> ids;
+  for (int i = 0; i < 10; i++) {
+    ids.push_back(WriteBlock(Substitute("block $0", i)));
+  }
+
+  // A container listed in the manifest without files is dropped, e.g. after
+  // a crash right after it was added.
+  string dir = dd_manager_->data_dirs()[0]->dir();
+  string manifest_path = JoinPathSegments(dir, LogBlockManager::kContainerManifestFileName);
+  LogBlockContainerManifestPB manifest;
+  if (env_->FileExists(manifest_path)) {
+    ASSERT_OK(pb_util::ReadPBContainerFromPath(env_, manifest_path, &manifest));
+  }
+  int num_listed = manifest.container_ids_size();
+  manifest.add_container_ids("missing");
+  ASSERT_OK(pb_util::WritePBContainerToPath(env_, manifest_path, manifest,
+                                            pb_util::OVERWRITE, pb_util::SYNC));
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(10, bm_->num_blocks());
+  ASSERT_OK(pb_util::ReadPBContainerFromPath(env_, manifest_path, &manifest));
+  ASSERT_EQ(num_listed, manifest.container_ids_size());
+
+  // Without the manifests, the containers are found by listing the dirs,
+  // and the manifests written again.
+  for (const auto& data_dir : dd_manager_->data_dirs()) {
+    string path = JoinPathSegments(data_dir->dir(), LogBlockManager::kContainerManifestFileName);
+    if (env_->FileExists(path)) {
+      ASSERT_OK(env_->DeleteFile(path));
+    }
+  }
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(10, bm_->num_blocks());
+  for (int i = 0; i < 10; i++) {
+    NO_FATALS(AssertBlockContents(ids[i], Substitute("block $0", i)));
+  }
+  ASSERT_OK(pb_util::ReadPBContainerFromPath(env_, manifest_path, &manifest));
+  ASSERT_EQ(num_listed, manifest.container_ids_size());
+}
+
+TEST_F(LogBlockManagerTest, TestHolePunching) {
+  FLAGS_log_container_preallocate_bytes = 0;
+  const string data(1024 * 1024, 'x');
+  BlockId id = WriteBlock(data);
+  WriteBlock("small block");
+  uint64_t size_before = ContainersSizeOnDisk();
+
+  // The readers keep the data readable.
+  unique_ptr<ReadableBlock> reader;
+  ASSERT_OK(bm_->OpenBlock(id, &reader));
+  ASSERT_OK(bm_->DeleteBlock(id));
+  unique_ptr<ReadableBlock> other_reader;
+  ASSERT_TRUE(bm_->OpenBlock(id, &other_reader).IsNotFound());
+  Slice result;
+  uint8_t scratch[16];
+  ASSERT_OK(reader->Read(data.size() - 16, 16, &result, scratch));
+  ASSERT_EQ(string(16, 'x'), result.ToString());
+  ASSERT_EQ(size_before, ContainersSizeOnDisk());
+  reader.reset();
+
+  uint64_t size_after = ContainersSizeOnDisk();
+  LOG(INFO) << "Containers size on disk: " << size_before << " -> " << size_after;
+  ASSERT_LE(size_after + data.size(), size_before);
+}
+
+TEST_F(LogBlockManagerTest, TestFullContainersAreRemoved) {
+  FLAGS_log_container_max_size = 4096;
+  BlockId first = WriteBlock("first");
+  BlockId second = WriteBlock("second");
+  ASSERT_EQ(2, bm_->num_containers());
+  ASSERT_OK(bm_->DeleteBlock(first));
+  ASSERT_EQ(1, bm_->num_containers());
+  ASSERT_OK(bm_->DeleteBlock(second));
+  ASSERT_EQ(0, bm_->num_containers());
+  ASSERT_TRUE(ContainerDataFiles().empty());
+}
+
+TEST_F(LogBlockManagerTest, TestMoreContainersThanOpenFiles) {
+  // Each block fills its container: the data files are reopened as the
+  // blocks are read.
+  FLAGS_log_block_manager_max_open_files = 2;
+  FLAGS_log_container_max_size = 4096;
+  NO_FATALS(ReopenBlockManager());
+  vector<BlockId> ids;
+  for (int i = 0; i < 10; i++) {
+    ids.push_back(WriteBlock(Substitute("block $0", i)));
+  }
+  ASSERT_EQ(10, bm_->num_containers());
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 10; i++) {
+      NO_FATALS(AssertBlockContents(ids[i], Substitute("block $0", i)));
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(bm_->DeleteBlock(ids[i]));
+  }
+  ASSERT_EQ(0, bm_->num_containers());
+  ASSERT_TRUE(ContainerDataFiles().empty());
+}
+
+TEST_F(LogBlockManagerTest, TestConcurrentWriters) {
+  const int kNumThreads = 8;
+  const int kBlocksPerThread = 50;
+  vector<vector<BlockId>> ids(kNumThreads);
+  vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+        for (int i = 0; i < kBlocksPerThread; i++) {
+          ids[t].push_back(WriteBlock(Substitute("thread $0 block $1", t, i)));
+        }
+      });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(kNumThreads * kBlocksPerThread, bm_->num_blocks());
+  // At most one container per writer in each data dir.
+  ASSERT_LE(bm_->num_containers(), kNumThreads * dd_manager_->data_dirs().size());
+
+  NO_FATALS(ReopenBlockManager());
+  for (int t = 0; t < kNumThreads; t++) {
+    for (int i = 0; i < kBlocksPerThread; i++) {
+      NO_FATALS(AssertBlockContents(ids[t][i], Substitute("thread $0 block $1", t, i)));
+    }
+  }
+}
+
+TEST_F(LogBlockManagerTest, TestPartialRecord) {
+  BlockId first = WriteBlock("first");
+  BlockId second = WriteBlock("second");
+
+  // A crash in the middle of a record leaves it partially written.
+  bm_.reset();
+  for (const string& path : ContainerFiles(LogBlockManager::kContainerMetadataFileSuffix)) {
+    RWFileOptions opts;
+    opts.mode = Env::OPEN_EXISTING;
+    unique_ptr<RWFile> file;
+    ASSERT_OK(env_->NewRWFile(opts, path, &file));
+    uint64_t size;
+    ASSERT_OK(file->Size(&size));
+    ASSERT_OK(file->Write(size, Slice("\x20\x00\x00", 3)));
+    ASSERT_OK(file->Close());
+  }
+
+  // The records after it must be read back on the next restart.
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(2, bm_->num_blocks());
+  ASSERT_OK(bm_->DeleteBlock(first));
+  BlockId third = WriteBlock("third");
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(2, bm_->num_blocks());
+  unique_ptr<ReadableBlock> reader;
+  ASSERT_TRUE(bm_->OpenBlock(first, &reader).IsNotFound());
+  NO_FATALS(AssertBlockContents(second, "second"));
+  NO_FATALS(AssertBlockContents(third, "third"));
+}
+
+TEST_F(LogBlockManagerTest, TestFailedCreateLeftovers) {
+  BlockId id = WriteBlock("block");
+
+  // A crash while a container was created leaves an empty data file, and a
+  // metadata file without a complete header.
+  string dir = dd_manager_->data_dirs()[0]->dir();
+  vector<string> leftovers;
+  for (const string& header : { string(), string("ant") }) {
+    string path = JoinPathSegments(dir, Substitute("leftover$0", leftovers.size()));
+    for (const string& suffix : { string(LogBlockManager::kContainerDataFileSuffix),
+                                  string(LogBlockManager::kContainerMetadataFileSuffix) }) {
+      unique_ptr<WritableFile> writer;
+      ASSERT_OK(env_->NewWritableFile(path + suffix, &writer));
+      if (suffix == LogBlockManager::kContainerMetadataFileSuffix) {
+        ASSERT_OK(writer->Append(header));
+      }
+      ASSERT_OK(writer->Close());
+      leftovers.push_back(path + suffix);
+    }
+  }
+  // Listed by scanning the dirs.
+  for (const auto& data_dir : dd_manager_->data_dirs()) {
+    string path = JoinPathSegments(data_dir->dir(), LogBlockManager::kContainerManifestFileName);
+    if (env_->FileExists(path)) {
+      ASSERT_OK(env_->DeleteFile(path));
+    }
+  }
+
+  NO_FATALS(ReopenBlockManager());
+  for (const string& path : leftovers) {
+    ASSERT_FALSE(env_->FileExists(path)) << path;
+  }
+  ASSERT_EQ(1, bm_->num_blocks());
+  NO_FATALS(AssertBlockContents(id, "block"));
+}
+
+TEST_F(LogBlockManagerTest, TestFailedDelete) {
+  // All in the same data dir.
+  dd_manager_->MarkDataDirFailed(dd_manager_->data_dirs()[1].get(), "test");
+  BlockId first = WriteBlock("first");
+  ASSERT_EQ(1, bm_->num_containers());
+
+  // The DELETE record goes past the file size limit, and fails.
+  vector<string> metadata_files = ContainerFiles(LogBlockManager::kContainerMetadataFileSuffix);
+  ASSERT_EQ(1, metadata_files.size());
+  uint64_t metadata_size;
+  ASSERT_OK(env_->GetFileSize(metadata_files[0], &metadata_size));
+  struct rlimit old_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &old_limit));
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = metadata_size;
+  sighandler_t old_handler = signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+  Status s = bm_->DeleteBlock(first);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &old_limit));
+  signal(SIGXFSZ, old_handler);
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+  NO_FATALS(AssertBlockContents(first, "first"));
+
+  // The container takes no new block.
+  BlockId second = WriteBlock("second");
+  ASSERT_EQ(2, bm_->num_containers());
+
+  // Deleting the block again removes the container, and the blocks written
+  // next do not go to it.
+  ASSERT_OK(bm_->DeleteBlock(first));
+  ASSERT_EQ(1, bm_->num_containers());
+  BlockId third = WriteBlock("third");
+  ASSERT_EQ(1, bm_->num_containers());
+  NO_FATALS(AssertBlockContents(second, "second"));
+  NO_FATALS(AssertBlockContents(third, "third"));
+
+  NO_FATALS(ReopenBlockManager());
+  ASSERT_EQ(2, bm_->num_blocks());
+  NO_FATALS(AssertBlockContents(second, "second"));
+  NO_FATALS(AssertBlockContents(third, "third"));
+}
+
+} // namespace mprmpr
@@ -1,8 +1,13 @@
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 
+#include "mprmpr/base/strings/substitute.h"
 #include "mprmpr/master/job_manager.h"
 #include "mprmpr/common/common.pb.h"
 
+DECLARE_int32(master_max_tracked_jobs);
+
+using strings::Substitute;
 
 namespace mprmpr {
 
@@ -18,4 +23,32 @@ TEST(JobManager, Basic) {
   ASSERT_EQ(JobManager::get(), JobManager::get());
 }
 
+TEST(JobManager, ForgetsOldestCompletedJobs) {
+  FLAGS_master_max_tracked_jobs = 3;
+  // Kept by pointer in the job manager.
+  static JobDescriptorPB jobs[5];
+  const JobDescriptorPB::JobState states[] = {
+    JobDescriptorPB::INIT, JobDescriptorPB::COMPLETE, JobDescriptorPB::COMPLETE,
+    JobDescriptorPB::TRANSCODE, JobDescriptorPB::COMPLETE
+  };
+  for (int i = 0; i < 5; i++) {
+    jobs[i].set_job_uuid(Substitute("job-$0", i));
+    jobs[i].set_trace_id(Substitute("trace-$0", i));
+    jobs[i].set_job_state(states[i]);
+    JobManager::get()->AddJobDescriptor(&jobs[i]);
+  }
+
+  // The jobs in progress stay, even the oldest one.
+  ASSERT_EQ("trace-0", JobManager::get()->GetJobTraceId("job-0"));
+  ASSERT_EQ("", JobManager::get()->GetJobTraceId("job-1"));
+  ASSERT_EQ("", JobManager::get()->GetJobTraceId("job-2"));
+  ASSERT_EQ("trace-3", JobManager::get()->GetJobTraceId("job-3"));
+  ASSERT_EQ("trace-4", JobManager::get()->GetJobTraceId("job-4"));
+
+  // Added again, a job is not tracked twice.
+  JobManager::get()->AddJobDescriptor(&jobs[4]);
+  ASSERT_EQ("trace-4", JobManager::get()->GetJobTraceId("job-4"));
+  ASSERT_EQ("trace-0", JobManager::get()->GetJobTraceId("job-0"));
+}
+
 } // namespace mprmpr
@@ -0,0 +1,179 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/common/common.pb.h"
+#include "mprmpr/master/job_metadata_cache.h"
+#include "mprmpr/util/mem_tracker.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/test_util.h"
+
+METRIC_DECLARE_counter(job_metadata_cache_hits);
+METRIC_DECLARE_counter(job_metadata_cache_misses);
+METRIC_DECLARE_counter(job_metadata_cache_evictions);
+
+using std::shared_ptr;
+using std::string;
+
+namespace mprmpr {
+
+class JobMetadataCacheTest : public AntTest {
+ public:
+  JobMetadataCacheTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "job-metadata-cache-test")),
+        parent_tracker_(MemTracker::CreateTracker(-1, "job-metadata-cache-test")),
+        num_loads_(0) {
+  }
+
+  void CreateCache(int64_t capacity_bytes) {
+    cache_.reset(new JobMetadataCache(
+        capacity_bytes,
+        [this](const string& job_uuid, JobDescriptorPB* job) {
+          num_loads_++;
+          if (job_uuid.find("missing") != string::npos) {
+            return Status::NotFound("no such job", job_uuid);
+          }
+          *job = MakeJob(job_uuid, JobDescriptorPB::INIT);
+          return Status::OK();
+        },
+        parent_tracker_, entity_));
+  }
+
+  static JobDescriptorPB MakeJob(const string& job_uuid, JobDescriptorPB::JobState state) {
+    JobDescriptorPB job;
+    job.set_job_uuid(job_uuid);
+    job.set_job_state(state);
+    JobMetadataPB* metadata = job.mutable_job_metadata();
+    metadata->set_source_path("/data/in/" + job_uuid);
+    metadata->set_target_path("/data/out/" + job_uuid);
+    metadata->set_decrypt_key("decrypt_key");
+    metadata->set_encrypt_key("encrypt_key");
+    metadata->set_mpr_uuid("mpr_uuid");
+    return job;
+  }
+
+  int64_t counter(CounterPrototype* prototype) {
+    return prototype->Instantiate(entity_)->value();
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  shared_ptr<MemTracker> parent_tracker_;
+  std::atomic<int> num_loads_;
+  std::unique_ptr<JobMetadataCache> cache_;
+};
+
+TEST_F(JobMetadataCacheTest, TestReadThrough) {
+  CreateCache(1024 * 1024);
+  shared_ptr<const JobDescriptorPB> job;
+  ASSERT_OK(cache_->Lookup("job-1", &job));
+  EXPECT_EQ("job-1", job->job_uuid());
+  EXPECT_EQ("/data/in/job-1", job->job_metadata().source_path());
+  ASSERT_OK(cache_->Lookup("job-1", &job));
+  EXPECT_EQ(1, num_loads_);
+  EXPECT_EQ(1, cache_->num_entries());
+  EXPECT_EQ(1, counter(&METRIC_job_metadata_cache_hits));
+  EXPECT_EQ(1, counter(&METRIC_job_metadata_cache_misses));
+
+  // Failures are not cached.
+  Status s = cache_->Lookup("missing-job", &job);
+  EXPECT_TRUE(s.IsNotFound()) << s.ToString();
+  s = cache_->Lookup("missing-job", &job);
+  EXPECT_TRUE(s.IsNotFound()) << s.ToString();
+  EXPECT_EQ(3, num_loads_);
+  EXPECT_EQ(1, cache_->num_entries());
+}
+
+TEST_F(JobMetadataCacheTest, TestStateTransitions) {
+  CreateCache(1024 * 1024);
+  shared_ptr<const JobDescriptorPB> job;
+  ASSERT_OK(cache_->Lookup("job-1", &job));
+  ASSERT_EQ(JobDescriptorPB::INIT, job->job_state());
+
+  // The master writes through the cache: lookups see the new state without
+  // loading the job again, while the job returned before is unchanged.
+  cache_->Insert(MakeJob("job-1", JobDescriptorPB::TRANSCODE));
+  shared_ptr<const JobDescriptorPB> updated;
+  ASSERT_OK(cache_->Lookup("job-1", &updated));
+  EXPECT_EQ(JobDescriptorPB::TRANSCODE, updated->job_state());
+  EXPECT_EQ(JobDescriptorPB::INIT, job->job_state());
+  EXPECT_EQ(1, num_loads_);
+
+  cache_->Erase("job-1");
+  EXPECT_EQ(0, cache_->num_entries());
+  ASSERT_OK(cache_->Lookup("job-1", &job));
+  EXPECT_EQ(2, num_loads_);
+}
+
+TEST_F(JobMetadataCacheTest, TestEviction) {
+  // Room for a few jobs per shard.
+  const int64_t kCapacity = 16 * 4 * 512;
+  CreateCache(kCapacity);
+  const int kNumJobs = 1000;
+  for (int i = 0; i < kNumJobs; i++) {
+    shared_ptr<const JobDescriptorPB> job;
+    ASSERT_OK(cache_->Lookup(strings::Substitute("job-$0", i), &job));
+  }
+  EXPECT_LT(cache_->num_entries(), kNumJobs);
+  EXPECT_GT(cache_->num_entries(), 0);
+  EXPECT_EQ(kNumJobs - cache_->num_entries(), counter(&METRIC_job_metadata_cache_evictions));
+  EXPECT_LE(cache_->mem_tracker()->consumption(), kCapacity);
+
+  // The most recently used job is still cached.
+  shared_ptr<const JobDescriptorPB> job;
+  ASSERT_OK(cache_->Lookup(strings::Substitute("job-$0", kNumJobs - 1), &job));
+  EXPECT_EQ(kNumJobs, num_loads_);
+}
+
+TEST_F(JobMetadataCacheTest, TestMemoryAccounting) {
+  CreateCache(1024 * 1024);
+  EXPECT_EQ(0, cache_->mem_tracker()->consumption());
+  shared_ptr<const JobDescriptorPB> job;
+  ASSERT_OK(cache_->Lookup("job-1", &job));
+  int64_t consumption = cache_->mem_tracker()->consumption();
+  EXPECT_GT(consumption, job->SpaceUsed());
+  EXPECT_EQ(consumption, parent_tracker_->consumption());
+
+  // Replacing a job releases the memory of the old copy.
+  cache_->Insert(MakeJob("job-1", JobDescriptorPB::COMPLETE));
+  EXPECT_EQ(consumption, cache_->mem_tracker()->consumption());
+
+  cache_->Erase("job-1");
+  EXPECT_EQ(0, cache_->mem_tracker()->consumption());
+  ASSERT_OK(cache_->Lookup("job-2", &job));
+  cache_.reset();
+  EXPECT_EQ(0, parent_tracker_->consumption());
+}
+
+TEST_F(JobMetadataCacheTest, TestConcurrentLookups) {
+  CreateCache(1024 * 1024);
+  const int kNumThreads = 8;
+  const int kNumJobs = 100;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+        for (int i = 0; i < 10000; i++) {
+          string job_uuid = strings::Substitute("job-$0", (i + t) % kNumJobs);
+          shared_ptr<const JobDescriptorPB> job;
+          CHECK_OK(cache_->Lookup(job_uuid, &job));
+          CHECK_EQ(job_uuid, job->job_uuid());
+          if (i % 100 == 0) {
+            cache_->Insert(MakeJob(job_uuid, JobDescriptorPB::PACK));
+          }
+        }
+      });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(kNumJobs, cache_->num_entries());
+}
+
+} // namespace mprmpr
@@ -0,0 +1,113 @@
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/common/common.pb.h"
+#include "mprmpr/master/job_manager.h"
+#include "mprmpr/rpc/rpc_header.pb.h"
+#include "mprmpr/server/job_trace.h"
+#include "mprmpr/server/logical_clock.h"
+
+DECLARE_int32(job_trace_max_traces);
+DECLARE_int32(job_trace_max_spans_per_trace);
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace mprmpr {
+namespace server {
+
+class JobTraceTest : public ::testing::Test {
+ public:
+  JobTraceTest()
+      : clock_(LogicalClock::CreateStartingAt(Timestamp::kInitialTimestamp)) {
+  }
+
+ protected:
+  scoped_refptr<Clock> clock_;
+  JobTraceStore store_;
+};
+
+TEST_F(JobTraceTest, SpansAcrossServers) {
+  string trace_id = JobSpan::NewTraceId();
+  rpc::TraceContextPB context;
+  string root_span_id;
+  {
+    JobSpan root(&store_, clock_.get(), "master", trace_id, "", "submit");
+    root_span_id = root.span_id();
+    unique_ptr<JobSpan> schedule = root.StartChild("schedule");
+    schedule->ToTraceContextPB(&context);
+  }
+  ASSERT_EQ(trace_id, context.trace_id());
+
+  // The worker continues the trace from the context it was sent.
+  JobTraceStore worker_store;
+  {
+    JobSpan decrypt(&worker_store, clock_.get(), "worker", context, "decrypt");
+  }
+  google::protobuf::RepeatedPtrField<JobSpanPB> shipped;
+  worker_store.TakeSpans(100, &shipped);
+  ASSERT_EQ(1, shipped.size());
+  for (const JobSpanPB& span : shipped) {
+    store_.AddSpan(span);
+  }
+
+  vector<JobSpanPB> spans;
+  ASSERT_TRUE(store_.GetSpans(trace_id, &spans));
+  ASSERT_EQ(3, spans.size());
+  // Children finish, and are added, before their parents.
+  ASSERT_EQ("schedule", spans[0].name());
+  ASSERT_EQ(root_span_id, spans[0].parent_span_id());
+  ASSERT_EQ("submit", spans[1].name());
+  ASSERT_FALSE(spans[1].has_parent_span_id());
+  ASSERT_EQ("decrypt", spans[2].name());
+  ASSERT_EQ("worker", spans[2].server_uuid());
+  ASSERT_EQ(context.parent_span_id(), spans[2].parent_span_id());
+  for (const JobSpanPB& span : spans) {
+    ASSERT_LT(span.start_timestamp(), span.end_timestamp());
+  }
+  ASSERT_FALSE(store_.GetSpans("unknown", &spans));
+}
+
+TEST_F(JobTraceTest, Limits) {
+  google::FlagSaver saver;
+  FLAGS_job_trace_max_traces = 2;
+  FLAGS_job_trace_max_spans_per_trace = 2;
+
+  for (int i = 0; i < 3; i++) {
+    JobSpan span(&store_, clock_.get(), "master", "trace-a", "", "span");
+  }
+  ASSERT_EQ(1, store_.num_dropped_spans());
+  { JobSpan span(&store_, clock_.get(), "master", "trace-b", "", "span"); }
+  { JobSpan span(&store_, clock_.get(), "master", "trace-c", "", "span"); }
+
+  // The oldest trace was evicted.
+  vector<JobSpanPB> spans;
+  ASSERT_FALSE(store_.GetSpans("trace-a", &spans));
+  ASSERT_TRUE(store_.GetSpans("trace-b", &spans));
+  ASSERT_TRUE(store_.GetSpans("trace-c", &spans));
+
+  // Spans are taken oldest trace first.
+  google::protobuf::RepeatedPtrField<JobSpanPB> taken;
+  store_.TakeSpans(1, &taken);
+  ASSERT_EQ(1, taken.size());
+  ASSERT_EQ("trace-b", taken.Get(0).trace_id());
+  ASSERT_FALSE(store_.GetSpans("trace-b", &spans));
+}
+
+TEST_F(JobTraceTest, JobManagerTraceId) {
+  // The job manager keeps a pointer to the job for the life of the process.
+  static JobDescriptorPB job;
+  job.set_job_uuid("job-with-trace");
+  job.set_trace_id("trace-of-job");
+  JobManager::get()->AddJobDescriptor(&job);
+  ASSERT_EQ("trace-of-job", JobManager::get()->GetJobTraceId("job-with-trace"));
+  ASSERT_EQ("", JobManager::get()->GetJobTraceId("unknown-job"));
+}
+
+} // namespace server
+} // namespace mprmpr
@@ -0,0 +1,273 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/util/async_io.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/random_util.h"
+#include "mprmpr/util/test_util.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+// Runs the tests on io_uring (if the kernel has it) and on the thread pool.
+class AsyncIoTest : public AntTest,
+                    public ::testing::WithParamInterface<bool> {
+ public:
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    AsyncIoQueue::Options options;
+    options.queue_depth = 8;
+    options.use_io_uring = GetParam();
+    ASSERT_OK(AsyncIoQueue::Create(options, &queue_));
+    LOG(INFO) << "Using " << queue_->name();
+    path_ = GetTestPath("file");
+  }
+
+  // Writes 'data' in 'num_chunks' operations submitted together.
+  void WriteChunks(AsyncFile* file, const string& data, int num_chunks) {
+    size_t chunk_size = data.size() / num_chunks;
+    int num_ok = 0;
+    for (int i = 0; i < num_chunks; i++) {
+      ASSERT_OK(queue_->PrepareWrite(file, i * chunk_size,
+                                     Slice(&data[i * chunk_size], chunk_size), -1,
+                                     [&](const Status& s, size_t bytes) {
+                                       if (s.ok() && bytes == chunk_size) num_ok++;
+                                     }));
+    }
+    ASSERT_OK(queue_->Submit());
+    int completed;
+    ASSERT_OK(queue_->Poll(num_chunks, &completed));
+    ASSERT_EQ(num_chunks, completed);
+    ASSERT_EQ(num_chunks, num_ok);
+    ASSERT_EQ(0, queue_->num_pending());
+  }
+
+ protected:
+  unique_ptr<AsyncIoQueue> queue_;
+  string path_;
+};
+
+INSTANTIATE_TEST_CASE_P(Backends, AsyncIoTest, ::testing::Bool());
+
+TEST_P(AsyncIoTest, TestWriteRead) {
+  Random rng(SeedRandom());
+  string data(8 * 4096, '\0');
+  RandomString(&data[0], data.size(), &rng);
+
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForWrite(path_, Env::CREATE_NON_EXISTING, &file));
+  NO_FATALS(WriteChunks(file.get(), data, 8));
+  ASSERT_OK(file->Sync());
+  uint64_t size;
+  ASSERT_OK(file->Size(&size));
+  ASSERT_EQ(data.size(), size);
+
+  // Read the chunks back in reverse order, each into its own buffer.
+  ASSERT_OK(AsyncFile::OpenForRead(path_, &file));
+  vector<string> chunks(8, string(4096, '\0'));
+  int num_ok = 0;
+  for (int i = 7; i >= 0; i--) {
+    ASSERT_OK(queue_->PrepareRead(file.get(), i * 4096, 4096,
+                                  reinterpret_cast<uint8_t*>(&chunks[i][0]), -1,
+                                  [&](const Status& s, size_t bytes) {
+                                    if (s.ok() && bytes == 4096) num_ok++;
+                                  }));
+  }
+  ASSERT_EQ(8, queue_->num_pending());
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(8, nullptr));
+  ASSERT_EQ(8, num_ok);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(data.substr(i * 4096, 4096), chunks[i]);
+  }
+}
+
+TEST_P(AsyncIoTest, TestRegisteredBuffers) {
+  string data(8 * 4096, '\0');
+  for (int i = 0; i < 8; i++) {
+    memset(&data[i * 4096], 'a' + i, 4096);
+  }
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForWrite(path_, Env::CREATE_NON_EXISTING, &file));
+  NO_FATALS(WriteChunks(file.get(), data, 8));
+
+  // Two buffers, read into alternately.
+  vector<uint8_t> buffers(2 * 4 * 4096);
+  ASSERT_OK(queue_->RegisterBuffers({ Slice(&buffers[0], 4 * 4096),
+                                      Slice(&buffers[4 * 4096], 4 * 4096) }));
+  int num_ok = 0;
+  for (int i = 0; i < 8; i++) {
+    int index = i % 2;
+    uint8_t* buf = &buffers[index * 4 * 4096 + (i / 2) * 4096];
+    ASSERT_OK(queue_->PrepareRead(file.get(), i * 4096, 4096, buf, index,
+                                  [&, buf, i](const Status& s, size_t bytes) {
+                                    if (s.ok() && bytes == 4096 &&
+                                        buf[0] == 'a' + i && buf[4095] == 'a' + i) {
+                                      num_ok++;
+                                    }
+                                  }));
+  }
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(8, nullptr));
+  ASSERT_EQ(8, num_ok);
+
+  // Registering again replaces the buffers.
+  ASSERT_OK(queue_->RegisterBuffers({ Slice(&buffers[0], buffers.size()) }));
+}
+
+TEST_P(AsyncIoTest, TestShortRead) {
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForWrite(path_, Env::CREATE_NON_EXISTING, &file));
+  NO_FATALS(WriteChunks(file.get(), string(4096, 'x'), 1));
+
+  uint8_t buf[4096];
+  Status status;
+  size_t bytes_read = 0;
+  ASSERT_OK(queue_->PrepareRead(file.get(), 4096 - 10, sizeof(buf), buf, -1,
+                                [&](const Status& s, size_t bytes) {
+                                  status = s;
+                                  bytes_read = bytes;
+                                }));
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(1, nullptr));
+  ASSERT_OK(status);
+  ASSERT_EQ(10, bytes_read);
+}
+
+TEST_P(AsyncIoTest, TestQueueFull) {
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForWrite(path_, Env::CREATE_NON_EXISTING, &file));
+  string data(8 * 512, 'x');
+  int num_ok = 0;
+  auto callback = [&](const Status& s, size_t bytes) {
+    if (s.ok()) num_ok++;
+  };
+  for (int i = 0; i < 8; i++) {
+    ASSERT_OK(queue_->PrepareWrite(file.get(), i * 512, Slice(&data[i * 512], 512), -1,
+                                   callback));
+  }
+  Status s = queue_->PrepareWrite(file.get(), 0, Slice(data), -1, callback);
+  ASSERT_TRUE(s.IsServiceUnavailable()) << s.ToString();
+
+  // Room is made as the operations complete.
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(8, nullptr));
+  ASSERT_EQ(8, num_ok);
+  ASSERT_EQ(0, queue_->num_pending());
+  ASSERT_OK(queue_->PrepareWrite(file.get(), 0, Slice(data), -1, callback));
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(1, nullptr));
+  ASSERT_EQ(9, num_ok);
+}
+
+TEST_P(AsyncIoTest, TestError) {
+  ASSERT_OK(WriteStringToFile(env_, Slice("data"), path_));
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForRead(path_, &file));
+
+  // The file is opened read-only: writing fails.
+  Status status;
+  ASSERT_OK(queue_->PrepareWrite(file.get(), 0, Slice("more data"), -1,
+                                 [&](const Status& s, size_t bytes) { status = s; }));
+  ASSERT_OK(queue_->Submit());
+  ASSERT_OK(queue_->Poll(1, nullptr));
+  ASSERT_TRUE(status.IsIOError()) << status.ToString();
+}
+
+class AsyncIoBenchmark : public AntTest {
+};
+
+// Random 4K reads over a file, at increasing queue depths, compared with
+// blocking reads from a RandomAccessFile.
+TEST_F(AsyncIoBenchmark, TestRandomReads) {
+  if (!AllowSlowTests()) {
+    LOG(INFO) << "Skipping test in quick test mode, since this reads a 1GB file";
+    return;
+  }
+  const size_t kFileSize = 1024 * 1024 * 1024;
+  const size_t kBlockSize = 4096;
+  const int kNumReads = 200000;
+
+  string path = GetTestPath("file");
+  {
+    unique_ptr<WritableFile> file;
+    ASSERT_OK(env_->NewWritableFile(path, &file));
+    string chunk(1024 * 1024, 'x');
+    for (size_t written = 0; written < kFileSize; written += chunk.size()) {
+      ASSERT_OK(file->Append(chunk));
+    }
+    ASSERT_OK(file->Close());
+  }
+  Random rng(SeedRandom());
+  vector<uint64_t> offsets(kNumReads);
+  for (auto& offset : offsets) {
+    offset = rng.Uniform(kFileSize / kBlockSize) * kBlockSize;
+  }
+  auto log_result = [&](const string& name, double seconds) {
+    LOG(INFO) << name << ": " << static_cast<int64_t>(kNumReads / seconds) << " IOPS, "
+              << (kNumReads * kBlockSize / seconds / 1e6) << " MB/s";
+  };
+
+  {
+    unique_ptr<RandomAccessFile> file;
+    ASSERT_OK(env_->NewRandomAccessFile(path, &file));
+    uint8_t scratch[kBlockSize];
+    Slice result;
+    MonoTime start = MonoTime::Now();
+    for (uint64_t offset : offsets) {
+      ASSERT_OK(file->Read(offset, kBlockSize, &result, scratch));
+    }
+    log_result("RandomAccessFile", (MonoTime::Now() - start).ToSeconds());
+  }
+
+  unique_ptr<AsyncFile> file;
+  ASSERT_OK(AsyncFile::OpenForRead(path, &file));
+  for (bool use_io_uring : { true, false }) {
+    for (int depth = 1; depth <= 128; depth *= 2) {
+      AsyncIoQueue::Options options;
+      options.queue_depth = depth;
+      options.use_io_uring = use_io_uring;
+      unique_ptr<AsyncIoQueue> queue;
+      ASSERT_OK(AsyncIoQueue::Create(options, &queue));
+      vector<uint8_t> buffer(depth * kBlockSize);
+      ASSERT_OK(queue->RegisterBuffers({ Slice(&buffer[0], buffer.size()) }));
+
+      // Keep 'depth' reads in flight, each slot reusing its part of the buffer.
+      int num_failed = 0;
+      std::function<void(int, int)> issue;
+      int next = 0;
+      issue = [&](int slot, int i) {
+        CHECK_OK(queue->PrepareRead(file.get(), offsets[i], kBlockSize,
+                                    &buffer[slot * kBlockSize], 0,
+                                    [&, slot](const Status& s, size_t bytes) {
+                                      if (!s.ok() || bytes != kBlockSize) num_failed++;
+                                      if (next < kNumReads) issue(slot, next++);
+                                    }));
+      };
+      MonoTime start = MonoTime::Now();
+      for (int slot = 0; slot < depth && next < kNumReads; slot++) {
+        issue(slot, next++);
+      }
+      while (queue->num_pending() > 0) {
+        ASSERT_OK(queue->Submit());
+        ASSERT_OK(queue->Poll(1, nullptr));
+      }
+      double seconds = (MonoTime::Now() - start).ToSeconds();
+      ASSERT_EQ(0, num_failed);
+      log_result(Substitute("$0, queue depth $1", queue->name(), depth), seconds);
+    }
+  }
+}
+
+} // namespace mprmpr
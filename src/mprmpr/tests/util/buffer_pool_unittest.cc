@@ -0,0 +1,209 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/util/faststring.h"
+#include "mprmpr/util/memory/arena.h"
+#include "mprmpr/util/memory/buffer_pool.h"
+#include "mprmpr/util/memory/memory.h"
+#include "mprmpr/util/mem_tracker.h"
+#include "mprmpr/util/test_util.h"
+
+DECLARE_int32(buffer_pool_idle_release_ms);
+
+namespace mprmpr {
+
+using std::shared_ptr;
+using std::string;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+class BufferPoolTest : public AntTest {
+ public:
+  BufferPoolTest()
+      : tracker_(MemTracker::CreateTracker(64 * 1024 * 1024, "buffer-pool-test")),
+        pool_(new PooledBufferAllocator(tracker_)) {
+    // Nothing should be released behind the tests' backs.
+    FLAGS_buffer_pool_idle_release_ms = -1;
+  }
+
+ protected:
+  static const size_t kOneMb = 1024 * 1024;
+
+  shared_ptr<MemTracker> tracker_;
+  unique_ptr<PooledBufferAllocator> pool_;
+};
+
+TEST_F(BufferPoolTest, TestSlabsAreReused) {
+  void* data;
+  {
+    unique_ptr<Buffer> buffer(pool_->Allocate(kOneMb + 1));
+    ASSERT_TRUE(buffer);
+    ASSERT_EQ(kOneMb + 1, buffer->size());
+    memset(buffer->data(), 0xab, buffer->size());
+    data = buffer->data();
+    ASSERT_EQ(2 * kOneMb, pool_->bytes_in_use());
+    ASSERT_EQ(2 * kOneMb, tracker_->consumption());
+  }
+  ASSERT_EQ(0, pool_->bytes_in_use());
+  ASSERT_EQ(2 * kOneMb, pool_->bytes_cached());
+  ASSERT_EQ(2 * kOneMb, tracker_->consumption());
+
+  // Any request of the same size class gets the cached slab back.
+  unique_ptr<Buffer> buffer(pool_->Allocate(2 * kOneMb));
+  ASSERT_EQ(data, buffer->data());
+  ASSERT_EQ(0, pool_->bytes_cached());
+  ASSERT_EQ(2 * kOneMb, tracker_->consumption());
+}
+
+TEST_F(BufferPoolTest, TestHugePageAlignment) {
+  unique_ptr<Buffer> buffer(pool_->Allocate(4 * kOneMb));
+  ASSERT_TRUE(buffer);
+  ASSERT_EQ(0, reinterpret_cast<uintptr_t>(buffer->data()) % (2 * kOneMb));
+}
+
+TEST_F(BufferPoolTest, TestSmallAndLargeRequests) {
+  // Neither is pooled, but both are tracked.
+  unique_ptr<Buffer> small(pool_->Allocate(100));
+  ASSERT_EQ(100, tracker_->consumption());
+  unique_ptr<Buffer> large(pool_->Allocate(20 * kOneMb));
+  ASSERT_EQ(100 + 20 * kOneMb, tracker_->consumption());
+  small.reset();
+  large.reset();
+  ASSERT_EQ(0, tracker_->consumption());
+  ASSERT_EQ(0, pool_->bytes_cached());
+}
+
+TEST_F(BufferPoolTest, TestReallocatePreservesContents) {
+  unique_ptr<Buffer> buffer(pool_->Allocate(64 * 1024));
+  for (size_t i = 0; i < buffer->size(); i++) {
+    static_cast<uint8_t*>(buffer->data())[i] = i % 251;
+  }
+  // Growing within the size class keeps the same slab.
+  void* data = buffer->data();
+  ASSERT_TRUE(pool_->Reallocate(64 * 1024, buffer.get()));
+  ASSERT_EQ(data, buffer->data());
+
+  ASSERT_TRUE(pool_->Reallocate(3 * kOneMb, buffer.get()));
+  ASSERT_EQ(3 * kOneMb, buffer->size());
+  for (size_t i = 0; i < 64 * 1024; i++) {
+    ASSERT_EQ(i % 251, static_cast<uint8_t*>(buffer->data())[i]);
+  }
+  ASSERT_EQ(4 * kOneMb, pool_->bytes_in_use());
+  ASSERT_EQ(64 * 1024, pool_->bytes_cached());
+}
+
+TEST_F(BufferPoolTest, TestLimit) {
+  vector<unique_ptr<Buffer>> buffers;
+  for (int i = 0; i < 4; i++) {
+    buffers.emplace_back(pool_->Allocate(16 * kOneMb));
+    ASSERT_TRUE(buffers.back());
+  }
+  ASSERT_EQ(0, pool_->Available());
+  unique_ptr<Buffer> buffer(pool_->Allocate(kOneMb));
+  ASSERT_FALSE(buffer);
+
+  // Cached slabs of other size classes are given back to make room.
+  buffers.pop_back();
+  ASSERT_EQ(16 * kOneMb, pool_->bytes_cached());
+  ASSERT_EQ(16 * kOneMb, pool_->Available());
+  buffer.reset(pool_->Allocate(8 * kOneMb));
+  ASSERT_TRUE(buffer);
+  ASSERT_EQ(0, pool_->bytes_cached());
+  ASSERT_EQ(56 * kOneMb, tracker_->consumption());
+}
+
+TEST_F(BufferPoolTest, TestReleaseIdleMemory) {
+  delete pool_->Allocate(kOneMb);
+  delete pool_->Allocate(16 * kOneMb);
+  ASSERT_EQ(17 * kOneMb, pool_->bytes_cached());
+
+  ASSERT_EQ(0, pool_->ReleaseIdleMemory(MonoDelta::FromSeconds(60)));
+  ASSERT_EQ(17 * kOneMb, pool_->ReleaseIdleMemory(MonoDelta::FromMilliseconds(0)));
+  ASSERT_EQ(0, pool_->bytes_cached());
+  ASSERT_EQ(0, tracker_->consumption());
+}
+
+TEST_F(BufferPoolTest, TestIdleMemoryReleasedWithoutFrees) {
+  FLAGS_buffer_pool_idle_release_ms = 100;
+  pool_.reset(new PooledBufferAllocator(tracker_));
+  {
+    vector<unique_ptr<Buffer>> buffers;
+    for (int i = 0; i < 8; i++) {
+      buffers.emplace_back(pool_->Allocate(kOneMb));
+    }
+  }
+  ASSERT_EQ(8 * kOneMb, pool_->bytes_cached());
+
+  // Nothing allocates or frees any more, yet the slabs are given back.
+  AssertEventually([&]() {
+    ASSERT_EQ(0, pool_->bytes_cached());
+  });
+  ASSERT_EQ(0, tracker_->consumption());
+}
+
+TEST_F(BufferPoolTest, TestMultiThreaded) {
+  vector<thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = 0; i < 200; i++) {
+        size_t size = (64 * 1024) << ((t + i) % 5);
+        unique_ptr<Buffer> buffer(pool_->Allocate(size));
+        CHECK(buffer);
+        memset(buffer->data(), t, size);
+      }
+    });
+  }
+  for (thread& thr : threads) {
+    thr.join();
+  }
+  ASSERT_EQ(0, pool_->bytes_in_use());
+  ASSERT_EQ(pool_->bytes_cached(), tracker_->consumption());
+}
+
+TEST_F(BufferPoolTest, TestFaststring) {
+  faststring str(pool_.get());
+  // Short strings stay inline.
+  str.append("abc", 3);
+  ASSERT_EQ(0, tracker_->consumption());
+
+  string chunk(100 * 1024, 'x');
+  for (int i = 0; i < 20; i++) {
+    str.append(chunk);
+  }
+  ASSERT_EQ(3 + 20 * chunk.size(), str.size());
+  ASSERT_EQ("abc", str.ToString().substr(0, 3));
+  ASSERT_GT(pool_->bytes_in_use(), 0);
+
+  gscoped_array<uint8_t> released(str.release());
+  ASSERT_EQ('x', released[3 + 20 * chunk.size() - 1]);
+  ASSERT_EQ(0, pool_->bytes_in_use());
+
+  str.append(chunk);
+  str.reset();
+  ASSERT_EQ(0, str.size());
+  ASSERT_EQ(0, pool_->bytes_in_use());
+}
+
+TEST_F(BufferPoolTest, TestMemoryTrackingArena) {
+  shared_ptr<MemTracker> arena_tracker = MemTracker::CreateTracker(-1, "arena");
+  shared_ptr<MemoryTrackingBufferAllocator> allocator(
+      new MemoryTrackingBufferAllocator(pool_.get(), arena_tracker));
+  {
+    MemoryTrackingArena arena(kOneMb, 4 * kOneMb, allocator);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_TRUE(arena.AllocateBytes(64 * 1024));
+    }
+    ASSERT_GT(pool_->bytes_in_use(), 0);
+    ASSERT_EQ(pool_->bytes_in_use(), arena_tracker->consumption());
+  }
+  ASSERT_EQ(0, pool_->bytes_in_use());
+  ASSERT_EQ(0, arena_tracker->consumption());
+}
+
+} // namespace mprmpr
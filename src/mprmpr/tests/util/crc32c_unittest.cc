@@ -1,7 +1,16 @@
-#include "tensorflow/core/lib/hash/crc32c.h"
-#include "tensorflow/core/platform/test.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
 
-namespace tensorflow {
+#include <string>
+#include <vector>
+
+#include "mprmpr/util/crc32c.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/random_util.h"
+#include "mprmpr/util/test_util.h"
+
+namespace mprmpr {
 namespace crc32c {
 
 TEST(CRC, StandardResults) {
@@ -47,5 +56,82 @@ TEST(CRC, Mask) {
   ASSERT_EQ(crc, Unmask(Unmask(Mask(Mask(crc)))));
 }
 
+namespace {
+
+typedef uint32 (*ExtendFunc)(uint32, const char*, size_t);
+
+struct NamedImplementation {
+  const char* name;
+  ExtendFunc extend;
+};
+
+// The implementations the CPU supports.
+std::vector<NamedImplementation> SupportedImplementations() {
+  std::vector<NamedImplementation> impls = { { "portable", &internal::ExtendPortable } };
+  if (internal::CpuHasSSE42()) {
+    impls.push_back({ "sse4.2", &internal::ExtendSSE42 });
+    if (internal::CpuHasPclmul()) {
+      impls.push_back({ "sse4.2+pclmul", &internal::ExtendSSE42Pclmul });
+    }
+  }
+  return impls;
+}
+
+} // anonymous namespace
+
+TEST(CRC, TestImplementationsAgree) {
+  LOG(INFO) << "Selected implementation: " << ImplementationName();
+  Random rng(SeedRandom());
+  std::string data(100 * 1024, '\0');
+  RandomString(&data[0], data.size(), &rng);
+
+  // Every length up to a few 3-way blocks, then random ones, at every
+  // alignment.
+  for (int i = 0; i < 5000; i++) {
+    size_t offset = rng.Uniform(16);
+    size_t length = i < 3000 ? i : rng.Uniform(data.size() - offset);
+    uint32 init_crc = rng.Next();
+    uint32 expected = internal::ExtendPortable(init_crc, &data[offset], length);
+    for (const auto& impl : SupportedImplementations()) {
+      ASSERT_EQ(expected, impl.extend(init_crc, &data[offset], length))
+          << impl.name << ": offset " << offset << ", length " << length;
+    }
+    ASSERT_EQ(expected, Extend(init_crc, &data[offset], length));
+  }
+}
+
+TEST(CRC, TestCombine) {
+  Random rng(SeedRandom());
+  std::string data(64 * 1024, '\0');
+  RandomString(&data[0], data.size(), &rng);
+  for (int i = 0; i < 1000; i++) {
+    size_t length = rng.Uniform(data.size());
+    size_t split = rng.Uniform(length + 1);
+    uint32 crc1 = Value(data.data(), split);
+    uint32 crc2 = Value(data.data() + split, length - split);
+    ASSERT_EQ(Value(data.data(), length), Combine(crc1, crc2, length - split))
+        << "length " << length << ", split " << split;
+  }
+  ASSERT_EQ(Value("hello world", 11), Combine(Value("hello ", 6), Value("world", 5), 5));
+  ASSERT_EQ(Value("abc", 3), Combine(Value("abc", 3), Value("", 0), 0));
+}
+
+TEST(CRC, Benchmark) {
+  const size_t kBufferSize = 1024 * 1024;
+  const int kIterations = AllowSlowTests() ? 4096 : 256;
+  std::string data(kBufferSize, 'x');
+  for (const auto& impl : SupportedImplementations()) {
+    uint32 crc = 0;
+    MonoTime start = MonoTime::Now();
+    for (int i = 0; i < kIterations; i++) {
+      crc = impl.extend(crc, data.data(), data.size());
+    }
+    double seconds = (MonoTime::Now() - start).ToSeconds();
+    LOG(INFO) << impl.name << ": "
+              << (static_cast<double>(kBufferSize) * kIterations / seconds / 1e9)
+              << " GB/s (crc " << crc << ")";
+  }
+}
+
 }  // namespace crc32c
-}  // namespace tensorflow
+}  // namespace mprmpr
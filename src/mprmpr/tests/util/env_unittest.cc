@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 
 #include <memory>
@@ -13,7 +14,10 @@
 #include "mprmpr/util/env.h"
 #include "mprmpr/util/env_util.h"
 #include "mprmpr/util/malloc.h"
+#include "mprmpr/util/monotime.h"
 #include "mprmpr/util/path_util.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/random_util.h"
 #include "mprmpr/util/status.h"
 #include "mprmpr/util/stopwatch.h"
 #include "mprmpr/util/test_util.h"
@@ -28,6 +32,8 @@
 #define FALLOC_FL_PUNCH_HOLE  0x02 /* de-allocates range */
 #endif
 
+DECLARE_bool(env_use_copy_offload);
+
 namespace mprmpr {
 
 using std::shared_ptr;
@@ -716,6 +722,43 @@ TEST_F(TestEnv, TestCopyFile) {
   NO_FATALS(ReadAndVerifyTestData(copy.get(), 0, kFileSize));
 }
 
+// Test CopyRange() with the kernel copying the data and through a buffer,
+// for whole blocks and unaligned ranges, into an existing file.
+TEST_F(TestEnv, TestCopyRange) {
+  string src_path = GetTestPath("src");
+  string dst_path = GetTestPath("dst");
+  Random rng(SeedRandom());
+  string data(4 * kOneMb + 11, '\0');
+  RandomString(&data[0], data.size(), &rng);
+  ASSERT_OK(WriteStringToFile(env_, data, src_path));
+
+  for (bool offload : { true, false }) {
+    FLAGS_env_use_copy_offload = offload;
+    string expected(kOneMb, 'x');
+    ASSERT_OK(WriteStringToFile(env_, expected, dst_path));
+    auto copy = [&](uint64_t src_offset, uint64_t dst_offset, uint64_t length) {
+      ASSERT_OK(env_->CopyRange(src_path, src_offset, dst_path, dst_offset, length));
+      if (expected.size() < dst_offset + length) {
+        expected.resize(dst_offset + length);
+      }
+      expected.replace(dst_offset, length, data, src_offset, length);
+    };
+    NO_FATALS(copy(0, 0, kOneMb));
+    NO_FATALS(copy(kOneMb, 2 * kOneMb, 2 * kOneMb + 11));
+    NO_FATALS(copy(13, 4096 + 7, 100000));
+    NO_FATALS(copy(0, 0, 0));
+
+    faststring contents;
+    ASSERT_OK(ReadFileToString(env_, dst_path, &contents));
+    ASSERT_EQ(expected.size(), contents.size());
+    ASSERT_TRUE(Slice(expected) == Slice(contents));
+  }
+
+  // Past the end of the source.
+  Status s = env_->CopyRange(src_path, data.size() - 10, dst_path, 0, 11);
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
+
 // Simple regression test for NewTempRWFile().
 TEST_F(TestEnv, TestTempRWFile) {
   string tmpl = "foo.XXXXXX";
@@ -753,4 +796,184 @@ TEST_F(TestEnv, TestGetBytesFree) {
       << "Failed after " << kIters << " attempts";
 }
 
+// The percentage of the pages of 'path' in the page cache.
+static double PageCacheResidency(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  PCHECK(fd >= 0);
+  struct stat st;
+  PCHECK(fstat(fd, &st) == 0);
+  size_t num_pages = (st.st_size + getpagesize() - 1) / getpagesize();
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  PCHECK(data != MAP_FAILED);
+  vector<unsigned char> pages(num_pages);
+  PCHECK(mincore(data, st.st_size, &pages[0]) == 0);
+  munmap(data, st.st_size);
+  close(fd);
+  int resident = 0;
+  for (unsigned char page : pages) {
+    resident += page & 1;
+  }
+  return 100.0 * resident / num_pages;
+}
+
+TEST_F(TestEnv, TestDirectIo) {
+  string path = GetTestPath("direct");
+  Random rng(SeedRandom());
+  string expected;
+
+  // Appends of all sizes, synced and flushed now and then.
+  WritableFileOptions opts;
+  opts.direct_io = true;
+  unique_ptr<WritableFile> writer;
+  ASSERT_OK(env_->NewWritableFile(opts, path, &writer));
+  for (int i = 0; i < 200; i++) {
+    string data(rng.Uniform(20000), '\0');
+    RandomString(&data[0], data.size(), &rng);
+    expected += data;
+    ASSERT_OK(writer->Append(data));
+    ASSERT_EQ(expected.size(), writer->Size());
+    if (i % 37 == 0) {
+      ASSERT_OK(writer->Sync());
+    } else if (i % 53 == 0) {
+      ASSERT_OK(writer->Flush(WritableFile::FLUSH_ASYNC));
+    }
+  }
+  ASSERT_OK(writer->Close());
+
+  // Appending to the file continues its partial last block.
+  opts.mode = Env::OPEN_EXISTING;
+  ASSERT_OK(env_->NewWritableFile(opts, path, &writer));
+  ASSERT_OK(writer->Append("the end"));
+  expected += "the end";
+  ASSERT_OK(writer->Close());
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(path, &size));
+  ASSERT_EQ(expected.size(), size);
+
+  // Unaligned reads, and reads past the end.
+  RandomAccessFileOptions read_opts;
+  read_opts.direct_io = true;
+  unique_ptr<RandomAccessFile> reader;
+  ASSERT_OK(env_->NewRandomAccessFile(read_opts, path, &reader));
+  unique_ptr<uint8_t[]> scratch(new uint8_t[kOneMb]);
+  Slice result;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t offset = rng.Uniform(expected.size());
+    size_t length = rng.Uniform(kOneMb);
+    ASSERT_OK(reader->Read(offset, length, &result, scratch.get()));
+    ASSERT_EQ(expected.substr(offset, length), result.ToString());
+  }
+  ASSERT_OK(reader->Read(expected.size() + 1, 100, &result, scratch.get()));
+  ASSERT_EQ(0, result.size());
+}
+
+// Sequential writes and reads with and without direct I/O, and how much of
+// the file they leave in the page cache.
+TEST_F(TestEnv, TestDirectIoBenchmark) {
+  if (!AllowSlowTests()) {
+    LOG(INFO) << "Skipping test in quick test mode, since this writes 4GB";
+    return;
+  }
+  const uint64_t kFileSize = 4096 * kOneMb;
+  string data(kOneMb, 'x');
+  unique_ptr<uint8_t[]> scratch(new uint8_t[kOneMb]);
+  for (bool direct_io : { false, true }) {
+    string path = GetTestPath(direct_io ? "direct" : "buffered");
+    WritableFileOptions opts;
+    opts.direct_io = direct_io;
+    unique_ptr<WritableFile> writer;
+    ASSERT_OK(env_->NewWritableFile(opts, path, &writer));
+    MonoTime start = MonoTime::Now();
+    for (uint64_t written = 0; written < kFileSize; written += data.size()) {
+      ASSERT_OK(writer->Append(data));
+    }
+    ASSERT_OK(writer->Sync());
+    ASSERT_OK(writer->Close());
+    double seconds = (MonoTime::Now() - start).ToSeconds();
+    LOG(INFO) << (direct_io ? "Direct" : "Buffered") << " writes: "
+              << (kFileSize / seconds / 1e6) << " MB/s, "
+              << PageCacheResidency(path) << "% in the page cache";
+
+    // Start the reads from a cold cache.
+    int fd = open(path.c_str(), O_RDONLY);
+    PCHECK(fd >= 0);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    RandomAccessFileOptions read_opts;
+    read_opts.direct_io = direct_io;
+    unique_ptr<RandomAccessFile> reader;
+    ASSERT_OK(env_->NewRandomAccessFile(read_opts, path, &reader));
+    Slice result;
+    start = MonoTime::Now();
+    for (uint64_t offset = 0; offset < kFileSize; offset += kOneMb) {
+      ASSERT_OK(reader->Read(offset, kOneMb, &result, scratch.get()));
+    }
+    seconds = (MonoTime::Now() - start).ToSeconds();
+    LOG(INFO) << (direct_io ? "Direct" : "Buffered") << " reads: "
+              << (kFileSize / seconds / 1e6) << " MB/s, "
+              << PageCacheResidency(path) << "% in the page cache";
+    ASSERT_OK(env_->DeleteFile(path));
+  }
+}
+
+TEST_F(TestEnv, TestMmapRandomAccessFile) {
+  string path = GetTestPath("mapped");
+  Random rng(SeedRandom());
+  string data(4 * kOneMb, '\0');
+  RandomString(&data[0], data.size(), &rng);
+  ASSERT_OK(WriteStringToFile(env_, data, path));
+
+  RandomAccessFileOptions opts;
+  opts.use_mmap = true;
+  unique_ptr<RandomAccessFile> reader;
+  ASSERT_OK(env_->NewRandomAccessFile(opts, path, &reader));
+  uint64_t size;
+  ASSERT_OK(reader->Size(&size));
+  ASSERT_EQ(data.size(), size);
+
+  // Random reads, then sequential ones, which change the advice.
+  uint8_t scratch[16];
+  Slice result;
+  for (int i = 0; i < 100; i++) {
+    uint64_t offset = rng.Uniform(data.size());
+    size_t length = rng.Uniform(64 * 1024);
+    ASSERT_OK(reader->Read(offset, length, &result, scratch));
+    ASSERT_EQ(data.substr(offset, length), result.ToString());
+  }
+  for (uint64_t offset = 0; offset < data.size(); offset += 64 * 1024) {
+    ASSERT_OK(reader->Read(offset, 64 * 1024, &result, scratch));
+    ASSERT_EQ(0, memcmp(result.data(), &data[offset], result.size()));
+  }
+  ASSERT_OK(reader->Read(data.size() + 1, sizeof(scratch), &result, scratch));
+  ASSERT_EQ(0, result.size());
+
+  // The pages of the mapping in memory are accounted for.
+  ASSERT_GE(reader->memory_footprint(), data.size());
+
+  // Empty files cannot be mapped, but can be opened.
+  ASSERT_OK(WriteStringToFile(env_, "", path));
+  ASSERT_OK(env_->NewRandomAccessFile(opts, path, &reader));
+  ASSERT_OK(reader->Read(0, sizeof(scratch), &result, scratch));
+  ASSERT_EQ(0, result.size());
+}
+
+TEST_F(TestEnv, TestMmapTruncatedFile) {
+  string path = GetTestPath("mapped");
+  ASSERT_OK(WriteStringToFile(env_, string(kOneMb, 'x'), path));
+  RandomAccessFileOptions opts;
+  opts.use_mmap = true;
+  unique_ptr<RandomAccessFile> reader;
+  ASSERT_OK(env_->NewRandomAccessFile(opts, path, &reader));
+  Slice result;
+  ASSERT_OK(reader->Read(kOneMb - 4096, 4096, &result, nullptr));
+
+  // The data past the new end of the file reads as zeros, and the next
+  // reads fail, rather than the process dying of SIGBUS.
+  ASSERT_EQ(0, truncate(path.c_str(), 4096));
+  ASSERT_EQ(0, result[100]);
+  Status s = reader->Read(0, 4096, &result, nullptr);
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+}
+
 }  // namespace mprmpr
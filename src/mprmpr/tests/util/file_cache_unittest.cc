@@ -0,0 +1,269 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/file_cache.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/test_util.h"
+#include "mprmpr/util/trace.h"
+
+DECLARE_bool(writable_file_use_fsync);
+
+METRIC_DECLARE_entity(file_cache);
+METRIC_DECLARE_counter(file_cache_hits);
+METRIC_DECLARE_counter(file_cache_misses);
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+template <class FileType>
+class FileCacheTest : public AntTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    ASSERT_OK(CountOpenFds(&initial_open_fds_));
+    cache_.reset(new FileCache<FileType>("test", env_, kMaxOpenFiles, &registry_));
+  }
+
+  // The metric entity of the cache named 'cache_name'.
+  scoped_refptr<MetricEntity> CacheEntity(const string& cache_name) {
+    return METRIC_ENTITY_file_cache.Instantiate(&registry_, cache_name);
+  }
+
+  Status CountOpenFds(int* num_fds) {
+    vector<string> children;
+    RETURN_NOT_OK(env_->GetChildren("/proc/self/fd", &children));
+    // Minus ".", ".." and the fd listing the directory.
+    *num_fds = children.size() - 3;
+    return Status::OK();
+  }
+
+  void AssertOpenFds(int expected) {
+    int num_fds;
+    ASSERT_OK(CountOpenFds(&num_fds));
+    ASSERT_EQ(initial_open_fds_ + expected, num_fds);
+  }
+
+  void WriteTestFile(const string& name, const string& data) {
+    ASSERT_OK(WriteStringToFile(env_, data, GetTestPath(name)));
+  }
+
+  void AssertFileContents(FileType* file, const string& expected) {
+    uint64_t size;
+    ASSERT_OK(file->Size(&size));
+    ASSERT_EQ(expected.size(), size);
+    string buf(expected.size(), '\0');
+    Slice result;
+    ASSERT_OK(file->Read(0, buf.size(), &result, reinterpret_cast<uint8_t*>(&buf[0])));
+    ASSERT_EQ(expected, result.ToString());
+  }
+
+ protected:
+  static const int kMaxOpenFiles = 3;
+
+  MetricRegistry registry_;
+  std::unique_ptr<FileCache<FileType>> cache_;
+  int initial_open_fds_;
+};
+
+typedef ::testing::Types<RandomAccessFile, RWFile> FileTypes;
+TYPED_TEST_CASE(FileCacheTest, FileTypes);
+
+TYPED_TEST(FileCacheTest, TestBasicOperations) {
+  // A missing file.
+  shared_ptr<TypeParam> file;
+  Status s = this->cache_->OpenExistingFile(this->GetTestPath("missing"), &file);
+  ASSERT_TRUE(s.IsNotFound()) << s.ToString();
+  NO_FATALS(this->AssertOpenFds(0));
+
+  // More files than the cache keeps open: the least recently used files are
+  // closed, and reopened as they are used.
+  vector<shared_ptr<TypeParam>> files;
+  for (int i = 0; i < 5; i++) {
+    string name = Substitute("f$0", i);
+    NO_FATALS(this->WriteTestFile(name, name));
+    ASSERT_OK(this->cache_->OpenExistingFile(this->GetTestPath(name), &file));
+    files.push_back(file);
+  }
+  ASSERT_EQ(3, this->cache_->num_open_files());
+  NO_FATALS(this->AssertOpenFds(3));
+  ASSERT_EQ(6, this->cache_->misses()); // Including the missing file.
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 5; i++) {
+      NO_FATALS(this->AssertFileContents(files[i].get(), Substitute("f$0", i)));
+    }
+  }
+  NO_FATALS(this->AssertOpenFds(3));
+
+  // Opening the same file shares the descriptor, and the file.
+  int64_t misses = this->cache_->misses();
+  int64_t hits = this->cache_->hits();
+  ASSERT_OK(this->cache_->OpenExistingFile(this->GetTestPath("f4"), &file));
+  ASSERT_EQ(files[4].get(), file.get());
+  ASSERT_EQ(misses, this->cache_->misses());
+  ASSERT_EQ(hits + 1, this->cache_->hits());
+  scoped_refptr<MetricEntity> entity = this->CacheEntity("test");
+  ASSERT_EQ(this->cache_->hits(), METRIC_file_cache_hits.Instantiate(entity)->value());
+  ASSERT_EQ(this->cache_->misses(), METRIC_file_cache_misses.Instantiate(entity)->value());
+
+  // Another cache counts its accesses apart.
+  {
+    FileCache<TypeParam> other("other", this->env_, TestFixture::kMaxOpenFiles,
+                               &this->registry_);
+    shared_ptr<TypeParam> other_file;
+    ASSERT_OK(other.OpenExistingFile(this->GetTestPath("f0"), &other_file));
+    ASSERT_EQ(1, METRIC_file_cache_misses.Instantiate(this->CacheEntity("other"))->value());
+    ASSERT_EQ(this->cache_->misses(), METRIC_file_cache_misses.Instantiate(entity)->value());
+  }
+
+  // The files stay open in the cache when the descriptors go.
+  files.clear();
+  file.reset();
+  NO_FATALS(this->AssertOpenFds(3));
+  this->cache_.reset();
+  NO_FATALS(this->AssertOpenFds(0));
+}
+
+TYPED_TEST(FileCacheTest, TestDeletion) {
+  string path = this->GetTestPath("file");
+  NO_FATALS(this->WriteTestFile("file", "data"));
+
+  // Without descriptors, the file is deleted right away.
+  shared_ptr<TypeParam> file;
+  ASSERT_OK(this->cache_->OpenExistingFile(path, &file));
+  file.reset();
+  ASSERT_OK(this->cache_->DeleteFile(path));
+  ASSERT_FALSE(this->env_->FileExists(path));
+  NO_FATALS(this->AssertOpenFds(0));
+
+  // Otherwise, it is deleted with the last descriptor, and meanwhile can be
+  // used but no longer opened.
+  NO_FATALS(this->WriteTestFile("file", "data"));
+  ASSERT_OK(this->cache_->OpenExistingFile(path, &file));
+  shared_ptr<TypeParam> other_file = file;
+  ASSERT_OK(this->cache_->DeleteFile(path));
+  ASSERT_TRUE(this->env_->FileExists(path));
+  NO_FATALS(this->AssertFileContents(file.get(), "data"));
+  shared_ptr<TypeParam> new_file;
+  Status s = this->cache_->OpenExistingFile(path, &new_file);
+  ASSERT_TRUE(s.IsNotFound()) << s.ToString();
+  s = this->cache_->DeleteFile(path);
+  ASSERT_TRUE(s.IsNotFound()) << s.ToString();
+
+  file.reset();
+  ASSERT_TRUE(this->env_->FileExists(path));
+  other_file.reset();
+  ASSERT_FALSE(this->env_->FileExists(path));
+  NO_FATALS(this->AssertOpenFds(0));
+
+  // The name can be reused.
+  NO_FATALS(this->WriteTestFile("file", "new data"));
+  ASSERT_OK(this->cache_->OpenExistingFile(path, &file));
+  NO_FATALS(this->AssertFileContents(file.get(), "new data"));
+}
+
+TYPED_TEST(FileCacheTest, TestInvalidate) {
+  string path = this->GetTestPath("file");
+  NO_FATALS(this->WriteTestFile("file", "old"));
+  shared_ptr<TypeParam> file;
+  ASSERT_OK(this->cache_->OpenExistingFile(path, &file));
+
+  // Replaced behind the back of the cache: the old file is still read, until
+  // invalidated.
+  NO_FATALS(this->WriteTestFile("file.tmp", "new data"));
+  ASSERT_OK(this->env_->RenameFile(this->GetTestPath("file.tmp"), path));
+  NO_FATALS(this->AssertFileContents(file.get(), "old"));
+  this->cache_->Invalidate(path);
+  NO_FATALS(this->AssertFileContents(file.get(), "new data"));
+}
+
+TYPED_TEST(FileCacheTest, TestConcurrentAccess) {
+  const int kNumFiles = 10;
+  for (int i = 0; i < kNumFiles; i++) {
+    string name = Substitute("f$0", i);
+    NO_FATALS(this->WriteTestFile(name, name));
+  }
+
+  vector<std::thread> threads;
+  vector<int> failures(4);
+  for (int t = 0; t < failures.size(); t++) {
+    threads.emplace_back([&, t]() {
+      Random rng(SeedRandom() + t);
+      for (int i = 0; i < 1000; i++) {
+        string name = Substitute("f$0", rng.Uniform(kNumFiles));
+        shared_ptr<TypeParam> file;
+        uint8_t buf[8];
+        Slice result;
+        if (!this->cache_->OpenExistingFile(this->GetTestPath(name), &file).ok() ||
+            !file->Read(0, name.size(), &result, buf).ok() ||
+            result != Slice(name)) {
+          failures[t]++;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int f : failures) {
+    ASSERT_EQ(0, f);
+  }
+  ASSERT_LE(this->cache_->num_open_files(), 3);
+  LOG(INFO) << "Hits: " << this->cache_->hits() << ", misses: " << this->cache_->misses();
+}
+
+class FileCacheSyncTest : public AntTest {};
+
+// The writes made before an eviction are synced through the reopened file.
+TEST_F(FileCacheSyncTest, TestSyncAfterEviction) {
+  FileCache<RWFile> cache("test", env_, 1, nullptr);
+  string path = GetTestPath("a");
+  string other_path = GetTestPath("b");
+  ASSERT_OK(WriteStringToFile(env_, "", path));
+  ASSERT_OK(WriteStringToFile(env_, "", other_path));
+  shared_ptr<RWFile> file;
+  ASSERT_OK(cache.OpenExistingFile(path, &file));
+  ASSERT_OK(file->Write(0, "data"));
+
+  // Evicts the file, closing it without syncing it.
+  shared_ptr<RWFile> other_file;
+  ASSERT_OK(cache.OpenExistingFile(other_path, &other_file));
+  ASSERT_OK(other_file->Write(0, "data"));
+  ASSERT_EQ(1, cache.num_open_files());
+
+  scoped_refptr<Trace> trace(new Trace);
+  {
+    ADOPT_TRACE(trace.get());
+    ASSERT_OK(file->Sync());
+    // Nothing was written since.
+    ASSERT_OK(file->Sync());
+  }
+  string counter = FLAGS_writable_file_use_fsync ? "fsync" : "fdatasync";
+  int64_t num_syncs = 0;
+  for (const auto& entry : trace->metrics()->Get()) {
+    if (entry.first == counter) {
+      num_syncs = entry.second;
+    }
+  }
+  ASSERT_EQ(1, num_syncs);
+}
+
+TEST(FileCacheDefaultsTest, TestCapacityFromOpenFileLimit) {
+  FileCache<RandomAccessFile> cache("test", Env::Default(), -1, nullptr);
+  ASSERT_GT(cache.max_open_files(), 0);
+  ASSERT_LT(cache.max_open_files(), Env::Default()->GetOpenFileLimit());
+}
+
+} // namespace mprmpr
@@ -212,6 +212,46 @@ TEST_F(MetricsTest, RetirementTest) {
   ASSERT_EQ(0, entity_->UnsafeMetricsMapForTests().size());
 }
 
+// Test that a delta dump only includes metrics modified since the given epoch,
+// and reports retired metrics as tombstones.
+TEST_F(MetricsTest, ModifiedSinceEpochTest) {
+  FLAGS_metrics_retirement_age_ms = 0;
+  scoped_refptr<Counter> counter = METRIC_reqs_pending.Instantiate(entity_);
+  scoped_refptr<AtomicGauge<uint64_t> > gauge =
+    METRIC_fake_memory_usage.Instantiate(entity_, 0);
+
+  MetricJsonOptions opts;
+  opts.only_modified_in_or_after_epoch = Metric::IncrementEpoch();
+  ASSERT_FALSE(counter->ModifiedInOrAfterEpoch(opts.only_modified_in_or_after_epoch));
+  counter->Increment();
+  ASSERT_TRUE(counter->ModifiedInOrAfterEpoch(opts.only_modified_in_or_after_epoch));
+
+  std::ostringstream out;
+  JsonWriter writer(&out, JsonWriter::PRETTY);
+  ASSERT_OK(entity_->WriteAsJson(&writer, { "*" }, opts));
+  ASSERT_STR_CONTAINS(out.str(), "reqs_pending");
+  ASSERT_STR_NOT_CONTAINS(out.str(), "fake_memory_usage");
+
+  // Nothing changed since the next epoch, so the entity is skipped entirely.
+  opts.only_modified_in_or_after_epoch = Metric::IncrementEpoch();
+  out.str("");
+  ASSERT_OK(entity_->WriteAsJson(&writer, { "*" }, opts));
+  ASSERT_EQ("", out.str());
+
+  // Retire the gauge; it should show up as a tombstone, but only in delta dumps.
+  gauge = nullptr;
+  entity_->RetireOldMetrics();
+  entity_->RetireOldMetrics();
+  ASSERT_EQ(1, entity_->num_tombstones());
+  out.str("");
+  ASSERT_OK(entity_->WriteAsJson(&writer, { "*" }, opts));
+  ASSERT_STR_CONTAINS(out.str(), "\"retired\": true");
+  ASSERT_STR_CONTAINS(out.str(), "fake_memory_usage");
+  out.str("");
+  ASSERT_OK(entity_->WriteAsJson(&writer, { "*" }, MetricJsonOptions()));
+  ASSERT_STR_NOT_CONTAINS(out.str(), "retired");
+}
+
 TEST_F(MetricsTest, TestRetiringEntities) {
   ASSERT_EQ(1, registry_.num_entities());
 
@@ -0,0 +1,82 @@
+#include "mprmpr/util/mpsc_ring_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/test_util.h"
+
+using std::string;
+using std::vector;
+
+namespace mprmpr {
+
+TEST(MpscRingBufferTest, TestPushPop) {
+  MpscRingBuffer<string> buffer(3);
+  ASSERT_EQ(4, buffer.capacity());
+
+  string value;
+  ASSERT_FALSE(buffer.TryPop(&value));
+
+  // Fill and empty the buffer a few times, to wrap around.
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(buffer.TryPush(std::to_string(i)));
+    }
+    string full("full");
+    ASSERT_FALSE(buffer.TryPush(std::move(full)));
+    ASSERT_EQ("full", full);
+    for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(buffer.TryPop(&value));
+      ASSERT_EQ(std::to_string(i), value);
+    }
+    ASSERT_FALSE(buffer.TryPop(&value));
+  }
+}
+
+TEST(MpscRingBufferTest, TestConcurrentProducers) {
+  const int kNumProducers = 4;
+  const int kValuesPerProducer = AllowSlowTests() ? 1000000 : 100000;
+  MpscRingBuffer<int64_t> buffer(64);
+
+  // Each producer pushes increasing values, retrying when the buffer is full.
+  AtomicInt<int64_t> num_full(0);
+  vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; p++) {
+    producers.emplace_back([&, p]() {
+      for (int64_t i = 0; i < kValuesPerProducer; i++) {
+        int64_t value = static_cast<int64_t>(p) * kValuesPerProducer + i;
+        while (!buffer.TryPush(std::move(value))) {
+          num_full.Increment(kMemOrderNoBarrier);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // The values of each producer are popped in order, once.
+  vector<int64_t> last_values(kNumProducers, -1);
+  int64_t num_popped = 0;
+  while (num_popped < kNumProducers * kValuesPerProducer) {
+    int64_t value;
+    if (!buffer.TryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int p = value / kValuesPerProducer;
+    ASSERT_EQ(last_values[p] + 1, value % kValuesPerProducer);
+    last_values[p]++;
+    num_popped++;
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  int64_t value;
+  ASSERT_FALSE(buffer.TryPop(&value));
+  LOG(INFO) << "Buffer full " << num_full.Load(kMemOrderNoBarrier) << " times";
+}
+
+} // namespace mprmpr
@@ -0,0 +1,236 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/tests/util/jsonwriter_test.pb.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/pb_util.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/random_util.h"
+#include "mprmpr/util/test_util.h"
+
+using google::protobuf::Message;
+using jsonwriter_test::TestAllTypes;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+namespace pb_util {
+
+class BulkPBContainerReaderTest : public AntTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    path_ = GetTestPath("container");
+  }
+
+  // Writes 'num_records' records, of up to 'max_record_size' bytes, and
+  // every 100th of 'large_record_size' bytes if not 0. If not 0, 'version'
+  // is the version of the container format.
+  void WriteContainer(int num_records, int max_record_size, int large_record_size,
+                      int version = 0) {
+    Random rng(SeedRandom());
+    unique_ptr<RWFile> file;
+    ASSERT_OK(env_->NewRWFile(path_, &file));
+    WritablePBContainerFile container(std::move(file));
+    if (version != 0) {
+      ASSERT_OK(container.SetVersionForTests(version));
+    }
+    ASSERT_OK(container.Init(TestAllTypes()));
+    record_offsets_.clear();
+    for (int i = 0; i < num_records; i++) {
+      uint64_t size;
+      ASSERT_OK(env_->GetFileSize(path_, &size));
+      record_offsets_.push_back(size);
+      TestAllTypes pb;
+      pb.set_optional_int64(i);
+      int record_size = (large_record_size > 0 && i % 100 == 50) ? large_record_size
+                                                                 : rng.Uniform(max_record_size);
+      string bytes(record_size, '\0');
+      RandomString(&bytes[0], bytes.size(), &rng);
+      pb.set_optional_bytes(bytes);
+      ASSERT_OK(container.Append(pb));
+    }
+    ASSERT_OK(container.Close());
+  }
+
+  // Reads the container with 'options', storing the indexes of the records
+  // read in 'indexes'.
+  Status ReadContainer(const BulkReadablePBContainerFile::Options& options, bool use_mmap,
+                       vector<int64_t>* indexes, uint64_t* offset) {
+    RandomAccessFileOptions opts;
+    opts.use_mmap = use_mmap;
+    unique_ptr<RandomAccessFile> file;
+    RETURN_NOT_OK(env_->NewRandomAccessFile(opts, path_, &file));
+    BulkReadablePBContainerFile container(std::move(file), options);
+    RETURN_NOT_OK(container.Open());
+    indexes->clear();
+    Status s = container.ReadAll(TestAllTypes(), [&](unique_ptr<Message> msg) {
+      indexes->push_back(::down_cast<TestAllTypes*>(msg.get())->optional_int64());
+      return Status::OK();
+    });
+    CHECK_EQ(indexes->size(), container.records_read());
+    *offset = container.offset();
+    return s;
+  }
+
+  // Reads a container of the given version with a corrupt, then a partial
+  // record.
+  void CheckCorruptAndIncompleteRecords(int version);
+
+ protected:
+  string path_;
+  vector<uint64_t> record_offsets_;
+};
+
+TEST_F(BulkPBContainerReaderTest, TestReadAll) {
+  // Small windows, with records across windows and larger than a window.
+  const int kNumRecords = 1000;
+  NO_FATALS(WriteContainer(kNumRecords, 1000, 20000));
+  uint64_t file_size;
+  ASSERT_OK(env_->GetFileSize(path_, &file_size));
+
+  for (bool use_mmap : { false, true }) {
+    for (int num_threads : { 0, 1, 4 }) {
+      SCOPED_TRACE(Substitute("mmap: $0, threads: $1", use_mmap, num_threads));
+      BulkReadablePBContainerFile::Options options;
+      options.window_size = 16 * 1024;
+      options.batch_size = 4 * 1024;
+      options.num_parser_threads = num_threads;
+      vector<int64_t> indexes;
+      uint64_t offset;
+      ASSERT_OK(ReadContainer(options, use_mmap, &indexes, &offset));
+      ASSERT_EQ(kNumRecords, indexes.size());
+      for (int i = 0; i < kNumRecords; i++) {
+        ASSERT_EQ(i, indexes[i]);
+      }
+      ASSERT_EQ(file_size, offset);
+    }
+  }
+}
+
+TEST_F(BulkPBContainerReaderTest, TestCorruptAndIncompleteRecords) {
+  for (int version : { 1, 2 }) {
+    SCOPED_TRACE(Substitute("version: $0", version));
+    NO_FATALS(CheckCorruptAndIncompleteRecords(version));
+  }
+}
+
+void BulkPBContainerReaderTest::CheckCorruptAndIncompleteRecords(int version) {
+  const int kNumRecords = 500;
+  NO_FATALS(WriteContainer(kNumRecords, 1000, 0, version));
+  BulkReadablePBContainerFile::Options options;
+  options.window_size = 16 * 1024;
+  options.batch_size = 4 * 1024;
+  vector<int64_t> indexes;
+  uint64_t offset;
+
+  // Corrupt the data of a record: the records before it are returned.
+  const int kBadRecord = 321;
+  {
+    unique_ptr<RWFile> file;
+    RWFileOptions opts;
+    opts.mode = Env::OPEN_EXISTING;
+    ASSERT_OK(env_->NewRWFile(opts, path_, &file));
+    uint64_t pos = record_offsets_[kBadRecord] + 10;
+    uint8_t scratch;
+    Slice byte;
+    ASSERT_OK(file->Read(pos, 1, &byte, &scratch));
+    uint8_t flipped = byte[0] ^ 0x01;
+    ASSERT_OK(file->Write(pos, Slice(&flipped, 1)));
+    Status s = ReadContainer(options, false, &indexes, &offset);
+    ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+    // As reported by ReadablePBContainerFile.
+    ASSERT_STR_CONTAINS(s.ToString(), version == 1 ? "Length and data checksum does not match"
+                                                   : "Data checksum does not match");
+    ASSERT_EQ(kBadRecord, indexes.size());
+    ASSERT_EQ(record_offsets_[kBadRecord], offset);
+
+    // Restore it, and truncate the file in the middle of the last record.
+    ASSERT_OK(file->Write(pos, byte));
+    ASSERT_OK(file->Truncate(record_offsets_[kNumRecords - 1] + 5));
+    ASSERT_OK(file->Close());
+  }
+  // Version 1 cannot tell a partial record from a corrupt one.
+  Status s = ReadContainer(options, false, &indexes, &offset);
+  ASSERT_TRUE(version == 1 ? s.IsCorruption() : s.IsIncomplete()) << s.ToString();
+  ASSERT_EQ(kNumRecords - 1, indexes.size());
+  ASSERT_EQ(record_offsets_[kNumRecords - 1], offset);
+}
+
+TEST_F(BulkPBContainerReaderTest, TestCallbackError) {
+  NO_FATALS(WriteContainer(100, 1000, 0));
+  unique_ptr<RandomAccessFile> file;
+  ASSERT_OK(env_->NewRandomAccessFile(path_, &file));
+  BulkReadablePBContainerFile container(std::move(file), BulkReadablePBContainerFile::Options());
+  ASSERT_OK(container.Open());
+  Status s = container.ReadAll(TestAllTypes(), [&](unique_ptr<Message> msg) {
+    if (::down_cast<TestAllTypes*>(msg.get())->optional_int64() == 10) {
+      return Status::Aborted("enough");
+    }
+    return Status::OK();
+  });
+  ASSERT_TRUE(s.IsAborted()) << s.ToString();
+  ASSERT_EQ(10, container.records_read());
+  ASSERT_EQ(record_offsets_[10], container.offset());
+}
+
+class BulkPBContainerReaderBenchmark : public BulkPBContainerReaderTest {
+};
+
+// Replays a container of small records with ReadablePBContainerFile, then
+// with the bulk reader.
+TEST_F(BulkPBContainerReaderBenchmark, TestReadThroughput) {
+  const int kNumRecords = AllowSlowTests() ? 2000000 : 200000;
+  NO_FATALS(WriteContainer(kNumRecords, 400, 0));
+  uint64_t file_size;
+  ASSERT_OK(env_->GetFileSize(path_, &file_size));
+  auto log_result = [&](const string& name, double seconds) {
+    LOG(INFO) << name << ": " << static_cast<int64_t>(kNumRecords / seconds) << " records/s, "
+              << (file_size / seconds / 1e6) << " MB/s";
+  };
+
+  {
+    unique_ptr<RandomAccessFile> file;
+    ASSERT_OK(env_->NewRandomAccessFile(path_, &file));
+    ReadablePBContainerFile container(std::move(file));
+    ASSERT_OK(container.Open());
+    MonoTime start = MonoTime::Now();
+    TestAllTypes pb;
+    int num_records = 0;
+    Status s;
+    while (true) {
+      s = container.ReadNextPB(&pb);
+      if (!s.ok()) break;
+      num_records++;
+    }
+    ASSERT_TRUE(s.IsEndOfFile()) << s.ToString();
+    ASSERT_EQ(kNumRecords, num_records);
+    log_result("ReadablePBContainerFile", (MonoTime::Now() - start).ToSeconds());
+  }
+
+  for (bool use_mmap : { false, true }) {
+    for (int num_threads : { 0, 1, 2, 4, 8 }) {
+      BulkReadablePBContainerFile::Options options;
+      options.num_parser_threads = num_threads;
+      vector<int64_t> indexes;
+      uint64_t offset;
+      MonoTime start = MonoTime::Now();
+      ASSERT_OK(ReadContainer(options, use_mmap, &indexes, &offset));
+      double seconds = (MonoTime::Now() - start).ToSeconds();
+      ASSERT_EQ(kNumRecords, indexes.size());
+      log_result(Substitute("BulkReadablePBContainerFile, $0, $1 parser threads",
+                            use_mmap ? "mmap" : "read", num_threads), seconds);
+    }
+  }
+}
+
+} // namespace pb_util
+} // namespace mprmpr
@@ -0,0 +1,264 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mprmpr/tests/util/jsonwriter_test.pb.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/pb_util.h"
+#include "mprmpr/util/test_util.h"
+
+METRIC_DECLARE_histogram(pb_container_group_commit_latency);
+METRIC_DECLARE_histogram(pb_container_group_commit_batch_size);
+
+using jsonwriter_test::TestAllTypes;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace mprmpr {
+namespace pb_util {
+
+// Fails the writes or the syncs of the file it wraps on demand.
+class FaultyRWFile : public RWFile {
+ public:
+  explicit FaultyRWFile(unique_ptr<RWFile> wrapped)
+      : wrapped_(std::move(wrapped)),
+        fail_writes_(false),
+        fail_syncs_(false) {
+  }
+
+  void set_fail_writes(bool fail) { fail_writes_ = fail; }
+  void set_fail_syncs(bool fail) { fail_syncs_ = fail; }
+
+  virtual Status Read(uint64_t offset, size_t length,
+                      Slice* result, uint8_t* scratch) const OVERRIDE {
+    return wrapped_->Read(offset, length, result, scratch);
+  }
+
+  virtual Status Write(uint64_t offset, const Slice& data) OVERRIDE {
+    if (fail_writes_) {
+      return Status::IOError("injected write error");
+    }
+    return wrapped_->Write(offset, data);
+  }
+
+  virtual Status PreAllocate(uint64_t offset, size_t length) OVERRIDE {
+    return wrapped_->PreAllocate(offset, length);
+  }
+
+  virtual Status Truncate(uint64_t length) OVERRIDE {
+    return wrapped_->Truncate(length);
+  }
+
+  virtual Status PunchHole(uint64_t offset, size_t length) OVERRIDE {
+    return wrapped_->PunchHole(offset, length);
+  }
+
+  virtual Status Flush(FlushMode mode, uint64_t offset, size_t length) OVERRIDE {
+    return wrapped_->Flush(mode, offset, length);
+  }
+
+  virtual Status Sync() OVERRIDE {
+    if (fail_syncs_) {
+      return Status::IOError("injected sync error");
+    }
+    return wrapped_->Sync();
+  }
+
+  virtual Status Close() OVERRIDE {
+    return wrapped_->Close();
+  }
+
+  virtual Status Size(uint64_t* size) const OVERRIDE {
+    return wrapped_->Size(size);
+  }
+
+  virtual string filename() const OVERRIDE { return wrapped_->filename(); }
+
+ private:
+  const unique_ptr<RWFile> wrapped_;
+  std::atomic<bool> fail_writes_;
+  std::atomic<bool> fail_syncs_;
+};
+
+class GroupCommitPBContainerFileTest : public AntTest {
+ public:
+  GroupCommitPBContainerFileTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "group-commit-test")) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    path_ = GetTestPath("container");
+    unique_ptr<RWFile> file;
+    ASSERT_OK(env_->NewRWFile(path_, &file));
+    container_.reset(new WritablePBContainerFile(std::move(file)));
+    ASSERT_OK(container_->Init(TestAllTypes()));
+  }
+
+  // Stores in 'values' the optional_int64 of the records of the container
+  // at 'path'.
+  void ReadContainer(const string& path, vector<int64_t>* values) {
+    unique_ptr<RandomAccessFile> file;
+    ASSERT_OK(env_->NewRandomAccessFile(path, &file));
+    ReadablePBContainerFile container(std::move(file));
+    ASSERT_OK(container.Open());
+    values->clear();
+    TestAllTypes pb;
+    Status s;
+    while (true) {
+      s = container.ReadNextPB(&pb);
+      if (!s.ok()) break;
+      values->push_back(pb.optional_int64());
+    }
+    ASSERT_TRUE(s.IsEndOfFile()) << s.ToString();
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  string path_;
+  unique_ptr<WritablePBContainerFile> container_;
+};
+
+TEST_F(GroupCommitPBContainerFileTest, TestConcurrentAppends) {
+  const int kNumThreads = 8;
+  const int kRecordsPerThread = 200;
+  GroupCommitPBContainerFile::Options options;
+  options.max_batch_bytes = 1024;
+  GroupCommitPBContainerFile group_commit(container_.get(), options, entity_);
+
+  // Each thread appends increasing values, which must be read in order.
+  vector<std::thread> threads;
+  vector<int> failures(kNumThreads);
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kRecordsPerThread; i++) {
+        TestAllTypes pb;
+        pb.set_optional_int64(t * kRecordsPerThread + i);
+        pb.set_optional_string(string(i, 'x'));
+        if (!group_commit.AppendAndSync(pb).ok()) {
+          failures[t]++;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int f : failures) {
+    ASSERT_EQ(0, f);
+  }
+
+  vector<int64_t> values;
+  NO_FATALS(ReadContainer(path_, &values));
+  ASSERT_EQ(kNumThreads * kRecordsPerThread, values.size());
+  vector<int64_t> last_values(kNumThreads, -1);
+  for (int64_t value : values) {
+    int t = value / kRecordsPerThread;
+    ASSERT_LT(last_values[t], value);
+    last_values[t] = value;
+  }
+
+  // One latency per record, one batch size per commit.
+  scoped_refptr<Histogram> latency =
+      METRIC_pb_container_group_commit_latency.Instantiate(entity_);
+  scoped_refptr<Histogram> batch_size =
+      METRIC_pb_container_group_commit_batch_size.Instantiate(entity_);
+  ASSERT_EQ(values.size(), latency->TotalCount());
+  ASSERT_LE(batch_size->TotalCount(), values.size());
+  ASSERT_NEAR(values.size(), batch_size->MeanValueForTests() * batch_size->TotalCount(), 0.5);
+  LOG(INFO) << batch_size->TotalCount() << " commits for " << values.size() << " records, "
+            << "up to " << batch_size->MaxValueForTests() << " per commit";
+}
+
+TEST_F(GroupCommitPBContainerFileTest, TestSequentialAppends) {
+  // Without metrics, and with records larger than a batch.
+  GroupCommitPBContainerFile::Options options;
+  options.max_batch_bytes = 16;
+  GroupCommitPBContainerFile group_commit(container_.get(), options, nullptr);
+  vector<int64_t> values;
+  for (int i = 0; i < 10; i++) {
+    TestAllTypes pb;
+    pb.set_optional_int64(i);
+    pb.set_optional_string(string(i * 10, 'x'));
+    ASSERT_OK(group_commit.AppendAndSync(pb));
+    NO_FATALS(ReadContainer(path_, &values));
+    ASSERT_EQ(i + 1, values.size());
+    ASSERT_EQ(i, values.back());
+  }
+
+  // The container can still be appended to directly.
+  TestAllTypes pb;
+  pb.set_optional_int64(10);
+  ASSERT_OK(container_->Append(pb));
+  ASSERT_OK(container_->Sync());
+  NO_FATALS(ReadContainer(path_, &values));
+  ASSERT_EQ(11, values.size());
+}
+
+TEST_F(GroupCommitPBContainerFileTest, TestFailedCommits) {
+  const int kNumThreads = 8;
+  string path = GetTestPath("faulty");
+  unique_ptr<RWFile> file;
+  ASSERT_OK(env_->NewRWFile(path, &file));
+  FaultyRWFile* faulty = new FaultyRWFile(std::move(file));
+  WritablePBContainerFile container((unique_ptr<RWFile>(faulty)));
+  ASSERT_OK(container.Init(TestAllTypes()));
+  GroupCommitPBContainerFile group_commit(&container, GroupCommitPBContainerFile::Options(),
+                                          nullptr);
+
+  // Appends a record from each of the threads at once, returning the
+  // number of them which failed.
+  int next_value = 0;
+  auto append_concurrently = [&]() {
+    vector<std::thread> threads;
+    std::atomic<int> num_failures(0);
+    for (int t = 0; t < kNumThreads; t++) {
+      TestAllTypes pb;
+      pb.set_optional_int64(next_value++);
+      threads.emplace_back([&, pb]() {
+          Status s = group_commit.AppendAndSync(pb);
+          if (!s.ok()) {
+            CHECK(s.IsIOError()) << s.ToString();
+            num_failures++;
+          }
+        });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    return num_failures.load();
+  };
+
+  // Every writer of a failed commit gets its error, and the later commits
+  // still work.
+  faulty->set_fail_writes(true);
+  ASSERT_EQ(kNumThreads, append_concurrently());
+  faulty->set_fail_writes(false);
+  ASSERT_EQ(0, append_concurrently());
+  vector<int64_t> values;
+  NO_FATALS(ReadContainer(path, &values));
+  ASSERT_EQ(kNumThreads, values.size());
+  for (int64_t value : values) {
+    ASSERT_GE(value, kNumThreads);
+  }
+
+  // The records of a failed sync were written, but may not be durable.
+  faulty->set_fail_syncs(true);
+  ASSERT_EQ(kNumThreads, append_concurrently());
+  faulty->set_fail_syncs(false);
+  ASSERT_EQ(0, append_concurrently());
+  NO_FATALS(ReadContainer(path, &values));
+  ASSERT_EQ(3 * kNumThreads, values.size());
+  ASSERT_OK(container.Close());
+}
+
+} // namespace pb_util
+} // namespace mprmpr
@@ -0,0 +1,196 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/prefetching_file.h"
+#include "mprmpr/util/random.h"
+#include "mprmpr/util/random_util.h"
+#include "mprmpr/util/test_util.h"
+
+METRIC_DECLARE_counter(sequential_prefetch_stall_time);
+METRIC_DECLARE_counter(sequential_prefetch_bytes_read);
+
+using std::string;
+using std::unique_ptr;
+
+namespace mprmpr {
+
+// Reads from a file slowly, or fails past 'fail_at'.
+class SlowRandomAccessFile : public RandomAccessFile {
+ public:
+  SlowRandomAccessFile(unique_ptr<RandomAccessFile> wrapped, const MonoDelta& delay,
+                       uint64_t fail_at)
+      : wrapped_(std::move(wrapped)),
+        delay_(delay),
+        fail_at_(fail_at) {
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      uint8_t *scratch) const OVERRIDE {
+    SleepFor(delay_);
+    if (offset + n > fail_at_) {
+      return Status::IOError("injected error");
+    }
+    return wrapped_->Read(offset, n, result, scratch);
+  }
+
+  virtual Status Size(uint64_t *size) const OVERRIDE {
+    return wrapped_->Size(size);
+  }
+
+  virtual string filename() const OVERRIDE { return wrapped_->filename(); }
+
+  virtual size_t memory_footprint() const OVERRIDE {
+    return wrapped_->memory_footprint();
+  }
+
+ private:
+  const unique_ptr<RandomAccessFile> wrapped_;
+  const MonoDelta delay_;
+  const uint64_t fail_at_;
+};
+
+class PrefetchingFileTest : public AntTest {
+ public:
+  PrefetchingFileTest()
+      : entity_(METRIC_ENTITY_server.Instantiate(&registry_, "prefetching-file-test")) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    Random rng(SeedRandom());
+    data_.resize(16 * 1024 * 1024);
+    RandomString(&data_[0], data_.size(), &rng);
+    path_ = GetTestPath("file");
+    ASSERT_OK(WriteStringToFile(env_, data_, path_));
+  }
+
+  void OpenSlowFile(const MonoDelta& delay, uint64_t fail_at,
+                    const PrefetchingSequentialFile::Options& options,
+                    unique_ptr<PrefetchingSequentialFile>* file) {
+    unique_ptr<RandomAccessFile> reader;
+    ASSERT_OK(env_->NewRandomAccessFile(path_, &reader));
+    reader.reset(new SlowRandomAccessFile(std::move(reader), delay, fail_at));
+    ASSERT_OK(PrefetchingSequentialFile::Open(std::move(reader), options, file));
+  }
+
+ protected:
+  MetricRegistry registry_;
+  scoped_refptr<MetricEntity> entity_;
+  string data_;
+  string path_;
+};
+
+TEST_F(PrefetchingFileTest, TestReadAndSkip) {
+  PrefetchingSequentialFile::Options options;
+  options.chunk_size = 256 * 1024;
+  options.metric_entity = entity_;
+  unique_ptr<PrefetchingSequentialFile> file;
+  ASSERT_OK(PrefetchingSequentialFile::Open(env_, path_, options, &file));
+
+  Random rng(SeedRandom());
+  unique_ptr<uint8_t[]> scratch(new uint8_t[1024 * 1024]);
+  uint64_t position = 0;
+  uint64_t bytes_read = 0;
+  while (position < data_.size()) {
+    if (rng.OneIn(5)) {
+      uint64_t n = rng.Uniform(2 * 1024 * 1024);
+      ASSERT_OK(file->Skip(n));
+      position = std::min<uint64_t>(position + n, data_.size());
+      continue;
+    }
+    size_t n = 1 + rng.Uniform(1024 * 1024);
+    Slice result;
+    ASSERT_OK(file->Read(n, &result, scratch.get()));
+    ASSERT_EQ(data_.substr(position, n), result.ToString());
+    position += result.size();
+    bytes_read += result.size();
+  }
+  Slice result;
+  ASSERT_OK(file->Read(1, &result, scratch.get()));
+  ASSERT_EQ(0, result.size());
+  ASSERT_EQ(bytes_read, METRIC_sequential_prefetch_bytes_read.Instantiate(entity_)->value());
+}
+
+TEST_F(PrefetchingFileTest, TestMmapFile) {
+  // The mapped file returns its own data rather than filling the chunks.
+  RandomAccessFileOptions opts;
+  opts.use_mmap = true;
+  unique_ptr<RandomAccessFile> reader;
+  ASSERT_OK(env_->NewRandomAccessFile(opts, path_, &reader));
+  PrefetchingSequentialFile::Options options;
+  options.chunk_size = 256 * 1024;
+  unique_ptr<PrefetchingSequentialFile> file;
+  ASSERT_OK(PrefetchingSequentialFile::Open(std::move(reader), options, &file));
+
+  const size_t kReadSize = 100 * 1000;
+  unique_ptr<uint8_t[]> scratch(new uint8_t[kReadSize]);
+  uint64_t position = 0;
+  while (position < data_.size()) {
+    Slice result;
+    ASSERT_OK(file->Read(kReadSize, &result, scratch.get()));
+    ASSERT_EQ(std::min<uint64_t>(kReadSize, data_.size() - position), result.size());
+    ASSERT_EQ(data_.substr(position, kReadSize), result.ToString());
+    position += result.size();
+  }
+}
+
+TEST_F(PrefetchingFileTest, TestSlowDevice) {
+  // The consumer keeps waiting: the reads go further ahead.
+  PrefetchingSequentialFile::Options options;
+  options.chunk_size = 128 * 1024;
+  options.max_chunks_in_flight = 8;
+  options.metric_entity = entity_;
+  unique_ptr<PrefetchingSequentialFile> file;
+  NO_FATALS(OpenSlowFile(MonoDelta::FromMilliseconds(10), data_.size(), options, &file));
+  unique_ptr<uint8_t[]> scratch(new uint8_t[options.chunk_size]);
+  for (int i = 0; i < 32; i++) {
+    Slice result;
+    ASSERT_OK(file->Read(options.chunk_size, &result, scratch.get()));
+    ASSERT_EQ(data_.substr(i * options.chunk_size, options.chunk_size), result.ToString());
+  }
+  ASSERT_EQ(options.max_chunks_in_flight, file->chunks_in_flight());
+  ASSERT_GT(file->stall_time().ToMilliseconds(), 0);
+  // Rounded down to microseconds at each wait.
+  ASSERT_NEAR(file->stall_time().ToMicroseconds(),
+              METRIC_sequential_prefetch_stall_time.Instantiate(entity_)->value(), 100);
+}
+
+TEST_F(PrefetchingFileTest, TestSlowConsumer) {
+  // The chunks are always ready: no need to read further ahead.
+  PrefetchingSequentialFile::Options options;
+  options.chunk_size = 128 * 1024;
+  unique_ptr<PrefetchingSequentialFile> file;
+  ASSERT_OK(PrefetchingSequentialFile::Open(env_, path_, options, &file));
+  unique_ptr<uint8_t[]> scratch(new uint8_t[options.chunk_size]);
+  for (int i = 0; i < 32; i++) {
+    SleepFor(MonoDelta::FromMilliseconds(5));
+    Slice result;
+    ASSERT_OK(file->Read(options.chunk_size, &result, scratch.get()));
+  }
+  ASSERT_EQ(options.min_chunks_in_flight, file->chunks_in_flight());
+}
+
+TEST_F(PrefetchingFileTest, TestReadError) {
+  PrefetchingSequentialFile::Options options;
+  options.chunk_size = 128 * 1024;
+  unique_ptr<PrefetchingSequentialFile> file;
+  NO_FATALS(OpenSlowFile(MonoDelta::FromMilliseconds(0), 4 * options.chunk_size, options,
+                         &file));
+  unique_ptr<uint8_t[]> scratch(new uint8_t[options.chunk_size]);
+  for (int i = 0; i < 4; i++) {
+    Slice result;
+    ASSERT_OK(file->Read(options.chunk_size, &result, scratch.get()));
+  }
+  Slice result;
+  Status s = file->Read(options.chunk_size, &result, scratch.get());
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+}
+
+} // namespace mprmpr
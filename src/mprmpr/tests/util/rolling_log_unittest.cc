@@ -2,16 +2,24 @@
 
 #include <glog/logging.h>
 #include <glog/stl_logging.h>
+#include <algorithm>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "mprmpr/base/strings/split.h"
 #include "mprmpr/base/strings/substitute.h"
 #include "mprmpr/base/strings/util.h"
 #include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
 #include "mprmpr/util/path_util.h"
 #include "mprmpr/util/test_util.h"
 
+METRIC_DECLARE_counter(rolling_log_dropped_appends);
+
 using std::string;
+using std::unique_ptr;
 using std::vector;
 using strings::Substitute;
 
@@ -24,6 +32,7 @@ class RollingLogTest : public AntTest {
   }
 
   virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
     ASSERT_OK(env_->CreateDir(log_dir_));
   }
 
@@ -36,16 +45,31 @@ class RollingLogTest : public AntTest {
     for (const string& child : dir_entries) {
       if (child == "." || child == "..") continue;
       children->push_back(child);
-      ASSERT_TRUE(HasPrefixString(child, "rolling_log-test."));
+      ASSERT_TRUE(HasPrefixString(child, "rolling_log_unittest."));
       ASSERT_STR_CONTAINS(child, ".mylog.");
 
       string pid_suffix = Substitute("$0", getpid());
       ASSERT_TRUE(HasSuffixString(child, pid_suffix) ||
-                  HasSuffixString(child, pid_suffix + ".gz")) << "bad child: " << child;
+                  HasSuffixString(child, pid_suffix + ".gz") ||
+                  HasSuffixString(child, pid_suffix + ".zst")) << "bad child: " << child;
     }
     ASSERT_EQ(children->size(), expected_count) << *children;
   }
 
+  // Stores in 'data' the contents of the uncompressed log files, in order.
+  void ReadLogs(string* data) {
+    vector<string> children;
+    ASSERT_OK(env_->GetChildren(log_dir_, &children));
+    std::sort(children.begin(), children.end());
+    data->clear();
+    for (const string& child : children) {
+      if (child == "." || child == "..") continue;
+      faststring contents;
+      ASSERT_OK(ReadFileToString(env_, JoinPathSegments(log_dir_, child), &contents));
+      data->append(contents.ToString());
+    }
+  }
+
   const string log_dir_;
 };
 
@@ -100,4 +124,178 @@ TEST_F(RollingLogTest, TestCompression) {
   ASSERT_GT(size, 0);
 }
 
+// Test that rolled files are compressed while the log is appended to.
+TEST_F(RollingLogTest, TestCompressionOnRoll) {
+  RollingLog log(env_, log_dir_, "mylog");
+  log.SetSizeLimitBytes(1000);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(log.Append("Hello world\n"));
+  }
+  ASSERT_OK(log.Close());
+
+  vector<string> children;
+  NO_FATALS(AssertLogCount(13, &children));
+  for (const string& child : children) {
+    ASSERT_TRUE(HasSuffixString(child, ".gz")) << child;
+  }
+}
+
+// Test with zstd compression, if built with zstd.
+TEST_F(RollingLogTest, TestZstdCompression) {
+  RollingLog log(env_, log_dir_, "mylog");
+  Status s = log.SetCompressionCodec(RollingLog::ZSTD);
+  if (s.IsNotSupported()) {
+    LOG(INFO) << "Skipping test: " << s.ToString();
+    return;
+  }
+  ASSERT_OK(s);
+
+  int raw_size = 0;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(log.Append("Hello world\n"));
+    raw_size += 12;
+  }
+  ASSERT_OK(log.Close());
+
+  vector<string> children;
+  NO_FATALS(AssertLogCount(1, &children));
+  ASSERT_TRUE(HasSuffixString(children[0], ".zst"));
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(JoinPathSegments(log_dir_, children[0]), &size));
+  ASSERT_LT(size, raw_size / 10);
+  ASSERT_GT(size, 0);
+}
+
+TEST_F(RollingLogTest, TestAsyncLog) {
+  unique_ptr<RollingLog> rolling_log(new RollingLog(env_, log_dir_, "mylog"));
+  rolling_log->SetCompressionEnabled(false);
+  rolling_log->SetSizeLimitBytes(10000);
+  AsyncRollingLog log(std::move(rolling_log), 64, nullptr);
+  ASSERT_OK(log.Start());
+
+  // Lines appended concurrently are written whole, and in order per thread.
+  const int kNumThreads = 4;
+  const int kLinesPerThread = 1000;
+  vector<std::thread> threads;
+  vector<int> appended(kNumThreads);
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kLinesPerThread; i++) {
+        if (log.Append(Substitute("$0 $1\n", t, i)).ok()) {
+          appended[t]++;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_OK(log.Flush());
+
+  string data;
+  NO_FATALS(ReadLogs(&data));
+  vector<int> last_lines(kNumThreads, -1);
+  int num_lines = 0;
+  vector<string> lines = strings::Split(data, "\n", strings::SkipEmpty());
+  for (const string& line : lines) {
+    int t, i;
+    ASSERT_EQ(2, sscanf(line.c_str(), "%d %d", &t, &i)) << line;
+    ASSERT_LT(last_lines[t], i);
+    last_lines[t] = i;
+    num_lines++;
+  }
+  int num_appended = 0;
+  for (int n : appended) {
+    num_appended += n;
+  }
+  ASSERT_EQ(num_appended, num_lines);
+  ASSERT_EQ(kNumThreads * kLinesPerThread, num_appended + log.dropped());
+  ASSERT_OK(log.Close());
+}
+
+TEST_F(RollingLogTest, TestAsyncLogDropsWhenFull) {
+  MetricRegistry registry;
+  scoped_refptr<MetricEntity> entity = METRIC_ENTITY_server.Instantiate(&registry, "test");
+  unique_ptr<RollingLog> rolling_log(new RollingLog(env_, log_dir_, "mylog"));
+  rolling_log->SetCompressionEnabled(false);
+  AsyncRollingLog log(std::move(rolling_log), 4, entity);
+
+  // Not written until started: the appends beyond the buffer are dropped.
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(log.Append(Substitute("line $0\n", i)));
+  }
+  Status s = log.Append("dropped\n");
+  ASSERT_TRUE(s.IsServiceUnavailable()) << s.ToString();
+  ASSERT_EQ(1, log.dropped());
+  ASSERT_EQ(1, METRIC_rolling_log_dropped_appends.Instantiate(entity)->value());
+
+  ASSERT_OK(log.Start());
+  ASSERT_OK(log.Flush());
+  ASSERT_OK(log.Append("line 4\n"));
+  ASSERT_OK(log.Close());
+  s = log.Append("closed\n");
+  ASSERT_TRUE(s.IsIllegalState()) << s.ToString();
+
+  string data;
+  NO_FATALS(ReadLogs(&data));
+  ASSERT_EQ("line 0\nline 1\nline 2\nline 3\nline 4\n", data);
+}
+
+// The appends which return OK while the log is being closed are all written.
+TEST_F(RollingLogTest, TestAsyncLogAppendsRacingWithClose) {
+  const int kNumThreads = 4;
+  for (int round = 0; round < 20; round++) {
+    ASSERT_OK(env_->DeleteRecursively(log_dir_));
+    ASSERT_OK(env_->CreateDir(log_dir_));
+    unique_ptr<RollingLog> rolling_log(new RollingLog(env_, log_dir_, "mylog"));
+    rolling_log->SetCompressionEnabled(false);
+    AsyncRollingLog log(std::move(rolling_log), 1024, nullptr);
+    ASSERT_OK(log.Start());
+
+    vector<std::thread> threads;
+    vector<int> appended(kNumThreads);
+    for (int t = 0; t < kNumThreads; t++) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; ; i++) {
+          Status s = log.Append(Substitute("$0 $1\n", t, i));
+          if (s.IsIllegalState()) {
+            break;
+          }
+          if (s.ok()) {
+            appended[t]++;
+          }
+        }
+      });
+    }
+    SleepFor(MonoDelta::FromMilliseconds(round % 4));
+    ASSERT_OK(log.Close());
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    string data;
+    NO_FATALS(ReadLogs(&data));
+    int num_appended = 0;
+    for (int n : appended) {
+      num_appended += n;
+    }
+    vector<string> lines = strings::Split(data, "\n", strings::SkipEmpty());
+    ASSERT_EQ(num_appended, lines.size());
+  }
+}
+
+// Closed without being started, the log writes the queued appends.
+TEST_F(RollingLogTest, TestAsyncLogCloseWithoutStart) {
+  unique_ptr<RollingLog> rolling_log(new RollingLog(env_, log_dir_, "mylog"));
+  rolling_log->SetCompressionEnabled(false);
+  AsyncRollingLog log(std::move(rolling_log), 4, nullptr);
+  ASSERT_OK(log.Append("line 0\n"));
+  ASSERT_OK(log.Append("line 1\n"));
+  ASSERT_OK(log.Close());
+
+  string data;
+  NO_FATALS(ReadLogs(&data));
+  ASSERT_EQ("line 0\nline 1\n", data);
+}
+
 } // namespace mprmpr
@@ -0,0 +1,218 @@
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "mprmpr/base/stringprintf.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/sampling_profiler.h"
+#include "mprmpr/util/test_util.h"
+
+DECLARE_int32(sampling_profiler_hz);
+
+namespace mprmpr {
+
+class SamplingProfilerTest : public AntTest {
+ public:
+  virtual void TearDown() OVERRIDE {
+    SamplingProfiler::Get()->Stop();
+    AntTest::TearDown();
+  }
+};
+
+// Keeps a CPU busy for 'delta'.
+static int64_t BurnCpu(const MonoDelta& delta) {
+  int64_t x = 0;
+  MonoTime deadline = MonoTime::Now() + delta;
+  while (MonoTime::Now() < deadline) {
+    for (int i = 0; i < 10000; i++) {
+      x += i * x + 1;
+    }
+  }
+  return x;
+}
+
+TEST_F(SamplingProfilerTest, TestCollectsSamples) {
+  FLAGS_sampling_profiler_hz = 1000;
+  SamplingProfiler* profiler = SamplingProfiler::Get();
+  ASSERT_OK(profiler->Start());
+  ASSERT_TRUE(profiler->running());
+  // Starting twice is fine.
+  ASSERT_OK(profiler->Start());
+
+  int64_t samples_before = profiler->num_samples();
+  LOG(INFO) << BurnCpu(MonoDelta::FromMilliseconds(500));
+  ASSERT_GT(profiler->num_samples(), samples_before);
+
+  // Two minutes, in case a minute ends during the test.
+  FoldedStacks stacks;
+  profiler->GetFoldedStacks(2, &stacks);
+  int64_t total = 0;
+  for (const auto& entry : stacks) {
+    ASSERT_FALSE(entry.first.empty());
+    ASSERT_GT(entry.second, 0);
+    total += entry.second;
+  }
+  ASSERT_GT(total, 0);
+  LOG(INFO) << "Collected " << total << " samples in " << stacks.size() << " stacks, "
+            << profiler->num_dropped_samples() << " dropped";
+
+  // The samples have been flushed out of the table: none are counted twice.
+  FoldedStacks again;
+  profiler->GetFoldedStacks(2, &again);
+  int64_t total_again = 0;
+  for (const auto& entry : again) {
+    total_again += entry.second;
+  }
+  ASSERT_GE(total_again, total);
+  ASSERT_LE(total_again, profiler->num_samples());
+
+  profiler->Stop();
+  ASSERT_FALSE(profiler->running());
+  int64_t samples_after_stop = profiler->num_samples();
+  BurnCpu(MonoDelta::FromMilliseconds(100));
+  ASSERT_EQ(samples_after_stop, profiler->num_samples());
+
+  // Profiles outlive the profiler, and it can be restarted.
+  FoldedStacks after_stop;
+  profiler->GetFoldedStacks(2, &after_stop);
+  ASSERT_FALSE(after_stop.empty());
+  ASSERT_OK(profiler->Start());
+}
+
+// Stands for the gperftools CPU profiler's SIGPROF handler.
+static AtomicInt<int64_t> g_foreign_samples(0);
+static void ForeignProfSignalHandler(int signum) {
+  g_foreign_samples.Increment();
+}
+
+// Sets the process CPU timer to fire every 'interval_us', or stops it if 0.
+static void SetProfTimer(int64_t interval_us) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  timer.it_interval.tv_usec = interval_us;
+  timer.it_value = timer.it_interval;
+  PCHECK(setitimer(ITIMER_PROF, &timer, nullptr) == 0);
+}
+
+TEST_F(SamplingProfilerTest, TestResumesAfterForeignProfiler) {
+  FLAGS_sampling_profiler_hz = 1000;
+  SamplingProfiler* profiler = SamplingProfiler::Get();
+  ASSERT_OK(profiler->Start());
+
+  for (int round = 0; round < 2; round++) {
+    SCOPED_TRACE(round);
+    profiler->PauseForForeignProfiler();
+    ASSERT_FALSE(profiler->running());
+
+    // Like ProfilerStart(): install the handler the first time only, then
+    // start the timer.
+    if (round == 0) {
+      struct sigaction act;
+      memset(&act, 0, sizeof(act));
+      act.sa_handler = &ForeignProfSignalHandler;
+      sigemptyset(&act.sa_mask);
+      ASSERT_EQ(0, sigaction(SIGPROF, &act, nullptr));
+    }
+    int64_t foreign_before = g_foreign_samples.Load();
+    SetProfTimer(1000);
+    BurnCpu(MonoDelta::FromMilliseconds(200));
+    // Like ProfilerStop(): stop the timer, leaving the handler installed.
+    SetProfTimer(0);
+    ASSERT_GT(g_foreign_samples.Load(), foreign_before);
+
+    // Sampling resumes, with the sampler's handler.
+    ASSERT_OK(profiler->ResumeAfterForeignProfiler());
+    ASSERT_TRUE(profiler->running());
+    int64_t samples_before = profiler->num_samples();
+    foreign_before = g_foreign_samples.Load();
+    BurnCpu(MonoDelta::FromMilliseconds(200));
+    ASSERT_GT(profiler->num_samples(), samples_before);
+    ASSERT_EQ(foreign_before, g_foreign_samples.Load());
+  }
+
+  // Nested pauses resume sampling once, at the end of the last.
+  profiler->PauseForForeignProfiler();
+  profiler->PauseForForeignProfiler();
+  ASSERT_OK(profiler->ResumeAfterForeignProfiler());
+  ASSERT_FALSE(profiler->running());
+  ASSERT_OK(profiler->ResumeAfterForeignProfiler());
+  ASSERT_TRUE(profiler->running());
+
+  // A stopped profiler is left stopped.
+  profiler->Stop();
+  profiler->PauseForForeignProfiler();
+  ASSERT_OK(profiler->ResumeAfterForeignProfiler());
+  ASSERT_FALSE(profiler->running());
+}
+
+// Does a fixed amount of CPU work.
+static int64_t DoWork(int64_t iterations) {
+  int64_t x = 0;
+  for (int64_t i = 0; i < iterations; i++) {
+    for (int j = 0; j < 1000; j++) {
+      x += j * x + 1;
+    }
+  }
+  return x;
+}
+
+// Measures the cost of the profiler, by timing the same work with and without
+// it. The cost per sample is measured at a high rate, where it stands out from
+// the noise, and extrapolated to the default rate.
+TEST_F(SamplingProfilerTest, TestOverhead) {
+  const int kRounds = AllowSlowTests() ? 5 : 3;
+  const MonoDelta kRoundTime = MonoDelta::FromMilliseconds(AllowSlowTests() ? 1000 : 200);
+  const int kDefaultHz = FLAGS_sampling_profiler_hz;
+  SamplingProfiler* profiler = SamplingProfiler::Get();
+
+  // Work taking about 'kRoundTime'.
+  int64_t iterations = 1000;
+  while (true) {
+    MonoTime start = MonoTime::Now();
+    LOG(INFO) << DoWork(iterations);
+    if (MonoTime::Now() - start >= kRoundTime) break;
+    iterations *= 2;
+  }
+  // The fastest of 'kRounds' runs of the work, in seconds.
+  auto best_time = [&]() {
+    double best = 1e9;
+    for (int r = 0; r < kRounds; r++) {
+      MonoTime start = MonoTime::Now();
+      LOG(INFO) << DoWork(iterations);
+      best = std::min(best, (MonoTime::Now() - start).ToSeconds());
+    }
+    return best;
+  };
+
+  double baseline = best_time();
+  double cost_per_sample = 0;
+  for (int hz : { kDefaultHz, 1000 }) {
+    FLAGS_sampling_profiler_hz = hz;
+    ASSERT_OK(profiler->Start());
+    int64_t samples_before = profiler->num_samples();
+    double with_profiler = best_time();
+    double samples_per_round = static_cast<double>(profiler->num_samples() - samples_before) /
+                               kRounds;
+    profiler->Stop();
+    LOG(INFO) << StringPrintf("%d Hz: %.3f%% slower", hz,
+                              100 * (with_profiler - baseline) / baseline);
+    if (hz == 1000 && samples_per_round > 0) {
+      cost_per_sample = std::max(0.0, with_profiler - baseline) / samples_per_round;
+    }
+  }
+  double overhead = cost_per_sample * kDefaultHz;
+  LOG(INFO) << StringPrintf("%.1f us per sample: %.3f%% of CPU time at %d Hz",
+                            cost_per_sample * 1e6, overhead * 100, kDefaultHz);
+  if (AllowSlowTests()) {
+    ASSERT_LT(overhead, 0.01);
+  }
+}
+
+} // namespace mprmpr
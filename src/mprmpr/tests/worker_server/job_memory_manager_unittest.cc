@@ -0,0 +1,236 @@
+#include "mprmpr/worker_server/job_memory_manager.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/file_system/file_system_manager.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/mem_tracker.h"
+#include "mprmpr/util/path_util.h"
+#include "mprmpr/util/test_util.h"
+
+DECLARE_int64(worker_jobs_memory_limit_mb);
+DECLARE_int64(worker_job_memory_limit_mb);
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace mprmpr {
+namespace worker_server {
+
+class JobMemoryManagerTest : public AntTest {
+ public:
+  virtual void SetUp() OVERRIDE {
+    AntTest::SetUp();
+    FileSystemManager::Options options;
+    options.wal_path = GetTestPath("wal");
+    options.data_paths = { GetTestPath("data-0"), GetTestPath("data-1") };
+    fs_manager_.reset(new FileSystemManager(env_, options));
+    ASSERT_OK(fs_manager_->CreateInitialFileSystemLayout());
+    ASSERT_OK(fs_manager_->Open());
+    parent_tracker_ = MemTracker::CreateTracker(-1, "job-memory-test");
+  }
+
+  // Creates the manager, with the current limits.
+  void CreateManager() {
+    manager_.reset(new JobMemoryManager(fs_manager_.get(), parent_tracker_));
+    ASSERT_OK(manager_->Init());
+  }
+
+  // Appends 'num_chunks' chunks of 'chunk_size' bytes to 'buffer'. Byte i of
+  // the buffer is (i % 251).
+  static Status AppendChunks(ChunkBuffer* buffer, int num_chunks, int chunk_size) {
+    string chunk(chunk_size, '\0');
+    for (int c = 0; c < num_chunks; c++) {
+      for (int i = 0; i < chunk_size; i++) {
+        chunk[i] = (buffer->size() + i) % 251;
+      }
+      RETURN_NOT_OK(buffer->Append(chunk));
+    }
+    return Status::OK();
+  }
+
+  static void VerifyContents(const ChunkBuffer& buffer) {
+    const size_t kReadSize = 10000;
+    unique_ptr<uint8_t[]> scratch(new uint8_t[kReadSize]);
+    for (size_t offset = 0; offset < buffer.size(); offset += kReadSize) {
+      size_t length = std::min(kReadSize, buffer.size() - offset);
+      Slice result;
+      ASSERT_OK(buffer.Read(offset, length, &result, scratch.get()));
+      ASSERT_EQ(length, result.size());
+      for (size_t i = 0; i < length; i++) {
+        ASSERT_EQ(static_cast<uint8_t>((offset + i) % 251), result[i]) << offset + i;
+      }
+    }
+  }
+
+ protected:
+  unique_ptr<FileSystemManager> fs_manager_;
+  shared_ptr<MemTracker> parent_tracker_;
+  unique_ptr<JobMemoryManager> manager_;
+};
+
+TEST_F(JobMemoryManagerTest, TestChargesJobTracker) {
+  FLAGS_worker_job_memory_limit_mb = 1;
+  NO_FATALS(CreateManager());
+  for (const auto& dir : fs_manager_->dd_manager()->data_dirs()) {
+    ASSERT_TRUE(env_->FileExists(JoinPathSegments(dir->dir(), "scratch")));
+  }
+
+  shared_ptr<MemTracker> tracker = manager_->CreateJobTracker("job-a");
+  ASSERT_EQ(1024 * 1024, tracker->limit());
+  ASSERT_EQ(manager_->jobs_tracker(), tracker->parent());
+  {
+    ChunkBuffer buffer(manager_.get(), tracker, "job-a");
+    ASSERT_OK(AppendChunks(&buffer, 100, 1000));
+    ASSERT_FALSE(buffer.spilled());
+    ASSERT_EQ(100 * 1000, buffer.size());
+    ASSERT_GE(tracker->consumption(), buffer.size());
+    ASSERT_EQ(tracker->consumption(), manager_->jobs_tracker()->consumption());
+    ASSERT_EQ(tracker->consumption(), parent_tracker_->consumption());
+    NO_FATALS(VerifyContents(buffer));
+
+    Slice result;
+    uint8_t scratch[10];
+    Status s = buffer.Read(buffer.size() - 5, 10, &result, scratch);
+    ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+
+    // Clearing the buffer releases its memory, and it can be reused.
+    buffer.Clear();
+    ASSERT_EQ(0, buffer.size());
+    ASSERT_EQ(0, tracker->consumption());
+    ASSERT_OK(AppendChunks(&buffer, 10, 1000));
+    ASSERT_GT(tracker->consumption(), 0);
+  }
+  // So does destroying it.
+  ASSERT_EQ(0, tracker->consumption());
+  ASSERT_EQ(0, parent_tracker_->consumption());
+}
+
+TEST_F(JobMemoryManagerTest, TestSpillsOverJobLimit) {
+  FLAGS_worker_job_memory_limit_mb = 1;
+  NO_FATALS(CreateManager());
+  shared_ptr<MemTracker> tracker = manager_->CreateJobTracker("job-a");
+  {
+    // Past the soft limit of the job, its buffer moves to a scratch file, and
+    // later appends go there too.
+    ChunkBuffer buffer(manager_.get(), tracker, "job-a");
+    ASSERT_OK(AppendChunks(&buffer, 1000, 1000));
+    ASSERT_TRUE(buffer.spilled());
+    ASSERT_EQ(1000 * 1000, buffer.size());
+    ASSERT_EQ(0, tracker->consumption());
+    ASSERT_EQ(buffer.size(), manager_->spilled_bytes());
+    NO_FATALS(VerifyContents(buffer));
+
+    // The scratch files are unlinked as soon as they are created.
+    for (const auto& dir : fs_manager_->dd_manager()->data_dirs()) {
+      vector<string> children;
+      ASSERT_OK(env_->GetChildren(JoinPathSegments(dir->dir(), "scratch"), &children));
+      for (const string& child : children) {
+        ASSERT_TRUE(child == "." || child == "..") << child;
+      }
+    }
+
+    // A buffer of another job is not affected.
+    shared_ptr<MemTracker> other_tracker = manager_->CreateJobTracker("job-b");
+    ChunkBuffer other(manager_.get(), other_tracker, "job-b");
+    ASSERT_OK(AppendChunks(&other, 100, 1000));
+    ASSERT_FALSE(other.spilled());
+    NO_FATALS(VerifyContents(other));
+  }
+  // Destroying the buffer releases the scratch space.
+  ASSERT_EQ(0, manager_->spilled_bytes());
+  ASSERT_EQ(0, tracker->consumption());
+}
+
+TEST_F(JobMemoryManagerTest, TestSpillsOverJobsLimit) {
+  // No limit per job, but one for all of them.
+  FLAGS_worker_job_memory_limit_mb = -1;
+  FLAGS_worker_jobs_memory_limit_mb = 1;
+  NO_FATALS(CreateManager());
+  shared_ptr<MemTracker> tracker_a = manager_->CreateJobTracker("job-a");
+  shared_ptr<MemTracker> tracker_b = manager_->CreateJobTracker("job-b");
+  ASSERT_FALSE(tracker_a->has_limit());
+
+  ChunkBuffer buffer_a(manager_.get(), tracker_a, "job-a");
+  ASSERT_OK(AppendChunks(&buffer_a, 400, 1000));
+  ASSERT_FALSE(buffer_a.spilled());
+
+  // Job b takes the jobs tracker over its limit, and spills.
+  ChunkBuffer buffer_b(manager_.get(), tracker_b, "job-b");
+  ASSERT_OK(AppendChunks(&buffer_b, 400, 1000));
+  ASSERT_TRUE(buffer_b.spilled());
+  ASSERT_FALSE(buffer_a.spilled());
+  ASSERT_EQ(0, tracker_b->consumption());
+  ASSERT_EQ(tracker_a->consumption(), manager_->jobs_tracker()->consumption());
+  NO_FATALS(VerifyContents(buffer_a));
+  NO_FATALS(VerifyContents(buffer_b));
+
+  // Once job a releases its memory, a new buffer of job b stays in memory.
+  buffer_a.Clear();
+  ChunkBuffer buffer_b2(manager_.get(), tracker_b, "job-b");
+  ASSERT_OK(AppendChunks(&buffer_b2, 400, 1000));
+  ASSERT_FALSE(buffer_b2.spilled());
+}
+
+TEST_F(JobMemoryManagerTest, TestExplicitSpill) {
+  FLAGS_worker_job_memory_limit_mb = -1;
+  NO_FATALS(CreateManager());
+  shared_ptr<MemTracker> tracker = manager_->CreateJobTracker("job-a");
+  ChunkBuffer buffer(manager_.get(), tracker, "job-a");
+
+  // Spilling an empty buffer works as well.
+  ASSERT_OK(buffer.Spill());
+  ASSERT_TRUE(buffer.spilled());
+  ASSERT_OK(AppendChunks(&buffer, 10, 1000));
+  ASSERT_EQ(0, tracker->consumption());
+  NO_FATALS(VerifyContents(buffer));
+
+  // Once cleared, it is in memory again.
+  buffer.Clear();
+  ASSERT_FALSE(buffer.spilled());
+  ASSERT_EQ(0, manager_->spilled_bytes());
+  ASSERT_OK(AppendChunks(&buffer, 10, 1000));
+  ASSERT_FALSE(buffer.spilled());
+  ASSERT_OK(buffer.Spill());
+  ASSERT_OK(buffer.Spill());
+  ASSERT_EQ(10 * 1000, manager_->spilled_bytes());
+  ASSERT_EQ(0, tracker->consumption());
+  NO_FATALS(VerifyContents(buffer));
+}
+
+TEST_F(JobMemoryManagerTest, TestSpillWithFailedDataDir) {
+  FLAGS_worker_job_memory_limit_mb = 1;
+  NO_FATALS(CreateManager());
+  DataDirManager* dd_manager = fs_manager_->dd_manager();
+  dd_manager->MarkDataDirFailed(dd_manager->data_dirs()[0].get(), "test");
+
+  // Buffers spill to the dir left.
+  shared_ptr<MemTracker> tracker = manager_->CreateJobTracker("job-a");
+  for (int i = 0; i < 4; i++) {
+    ChunkBuffer buffer(manager_.get(), tracker, "job-a");
+    ASSERT_OK(AppendChunks(&buffer, 10, 1000));
+    ASSERT_OK(buffer.Spill());
+    NO_FATALS(VerifyContents(buffer));
+  }
+
+  // Without any, they fail rather than spill, and keep their contents.
+  dd_manager->MarkDataDirFailed(dd_manager->data_dirs()[1].get(), "test");
+  ChunkBuffer buffer(manager_.get(), tracker, "job-a");
+  ASSERT_OK(AppendChunks(&buffer, 10, 1000));
+  ASSERT_FALSE(buffer.Spill().ok());
+  ASSERT_FALSE(buffer.spilled());
+  NO_FATALS(VerifyContents(buffer));
+}
+
+} // namespace worker_server
+} // namespace mprmpr
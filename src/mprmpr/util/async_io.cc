@@ -0,0 +1,640 @@
+#include "mprmpr/util/async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+
+#include <glog/logging.h>
+
+#include "mprmpr/base/gscoped_ptr.h"
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/util/condition_variable.h"
+#include "mprmpr/util/errno.h"
+#include "mprmpr/util/logging.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/slice.h"
+#include "mprmpr/util/threadpool.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+namespace {
+
+// The maximum number of threads of the fallback queue: past it, more
+// threads only add context switches.
+const int kMaxFallbackThreads = 32;
+
+Status IOError(const std::string& context, int err_number) {
+  return Status::IOError(context, ErrnoToString(err_number), err_number);
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////
+// AsyncFile
+////////////////////////////////////////////////////////////
+
+AsyncFile::AsyncFile(std::string filename, int fd)
+    : filename_(std::move(filename)),
+      fd_(fd) {
+}
+
+AsyncFile::~AsyncFile() {
+  int err;
+  do {
+    err = close(fd_);
+  } while (err == -1 && errno == EINTR);
+  if (err == -1) {
+    WARN_NOT_OK(IOError(filename_, errno), "Unable to close async file");
+  }
+}
+
+Status AsyncFile::OpenForRead(const std::string& fname, unique_ptr<AsyncFile>* file) {
+  int fd;
+  do {
+    fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (fd == -1 && errno == EINTR);
+  if (fd == -1) {
+    return IOError(fname, errno);
+  }
+  file->reset(new AsyncFile(fname, fd));
+  return Status::OK();
+}
+
+Status AsyncFile::OpenForWrite(const std::string& fname, Env::CreateMode mode,
+                               unique_ptr<AsyncFile>* file) {
+  int flags = O_RDWR | O_CLOEXEC;
+  switch (mode) {
+    case Env::CREATE_IF_NON_EXISTING_TRUNCATE:
+      flags |= O_CREAT | O_TRUNC;
+      break;
+    case Env::CREATE_NON_EXISTING:
+      flags |= O_CREAT | O_EXCL;
+      break;
+    case Env::OPEN_EXISTING:
+      break;
+  }
+  int fd;
+  do {
+    fd = open(fname.c_str(), flags, 0666);
+  } while (fd == -1 && errno == EINTR);
+  if (fd == -1) {
+    return IOError(fname, errno);
+  }
+  file->reset(new AsyncFile(fname, fd));
+  return Status::OK();
+}
+
+Status AsyncFile::Size(uint64_t* size) const {
+  struct stat st;
+  if (fstat(fd_, &st) == -1) {
+    return IOError(filename_, errno);
+  }
+  *size = st.st_size;
+  return Status::OK();
+}
+
+Status AsyncFile::Sync() {
+  if (fdatasync(fd_) == -1) {
+    return IOError(filename_, errno);
+  }
+  return Status::OK();
+}
+
+AsyncIoQueue::Options::Options()
+    : queue_depth(64),
+      use_io_uring(true) {
+}
+
+#ifdef HAVE_IO_URING
+
+////////////////////////////////////////////////////////////
+// IoUringQueue
+////////////////////////////////////////////////////////////
+
+// Drives an io_uring through its system calls and shared rings directly.
+// Needs Linux 5.1, for IORING_OP_READV, IORING_OP_WRITEV and the fixed
+// buffer variants.
+class IoUringQueue : public AsyncIoQueue {
+ public:
+  static Status Create(int queue_depth, unique_ptr<AsyncIoQueue>* queue);
+
+  virtual ~IoUringQueue();
+
+  virtual Status RegisterBuffers(const vector<Slice>& buffers) OVERRIDE;
+
+  virtual Status PrepareRead(AsyncFile* file, uint64_t offset, size_t length, uint8_t* buf,
+                             int buffer_index, Callback callback) OVERRIDE {
+    return PrepareOp(false, file, offset, buf, length, buffer_index, std::move(callback));
+  }
+
+  virtual Status PrepareWrite(AsyncFile* file, uint64_t offset, const Slice& data,
+                              int buffer_index, Callback callback) OVERRIDE {
+    return PrepareOp(true, file, offset, const_cast<uint8_t*>(data.data()), data.size(),
+                     buffer_index, std::move(callback));
+  }
+
+  virtual Status Submit() OVERRIDE;
+
+  virtual Status Poll(int min_completions, int* completed) OVERRIDE;
+
+  virtual int num_pending() const OVERRIDE {
+    return num_prepared_ + num_inflight_;
+  }
+
+  virtual const char* name() const OVERRIDE { return "io_uring"; }
+
+ private:
+  struct Op {
+    Callback callback;
+    const AsyncFile* file;
+    // The vector of IORING_OP_READV/WRITEV, which must outlive the
+    // submission.
+    struct iovec iov;
+  };
+
+  explicit IoUringQueue(int queue_depth);
+
+  Status Init();
+
+  Status PrepareOp(bool write, AsyncFile* file, uint64_t offset, uint8_t* buf, size_t length,
+                   int buffer_index, Callback callback);
+
+  // Consumes the completions posted so far, running their callbacks if
+  // 'run_callbacks'. Returns their number.
+  int ReapCompletions(bool run_callbacks);
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0);
+  }
+
+  const int queue_depth_;
+  int ring_fd_;
+
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Shared with the kernel.
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  // The tail of the submission queue, including the operations prepared
+  // but not submitted yet.
+  unsigned sq_local_tail_;
+  int num_prepared_;
+  int num_inflight_;
+
+  vector<Op> ops_;
+  vector<int> free_ops_;
+  bool buffers_registered_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringQueue);
+};
+
+IoUringQueue::IoUringQueue(int queue_depth)
+    : queue_depth_(queue_depth),
+      ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      cq_ring_(MAP_FAILED),
+      cq_ring_size_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqes_size_(0),
+      sq_local_tail_(0),
+      num_prepared_(0),
+      num_inflight_(0),
+      ops_(queue_depth),
+      buffers_registered_(false) {
+  for (int i = queue_depth - 1; i >= 0; i--) {
+    free_ops_.push_back(i);
+  }
+}
+
+IoUringQueue::~IoUringQueue() {
+  // The kernel may still write to the buffers of the operations in flight.
+  while (num_inflight_ > 0) {
+    if (ReapCompletions(false) == 0 &&
+        Enter(0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+      PLOG(ERROR) << "Unable to wait for the io_uring operations in flight";
+      break;
+    }
+  }
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+  }
+}
+
+Status IoUringQueue::Create(int queue_depth, unique_ptr<AsyncIoQueue>* queue) {
+  unique_ptr<IoUringQueue> q(new IoUringQueue(queue_depth));
+  RETURN_NOT_OK(q->Init());
+  queue->reset(q.release());
+  return Status::OK();
+}
+
+Status IoUringQueue::Init() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, queue_depth_, &params);
+  if (ring_fd_ == -1) {
+    return IOError("io_uring_setup", errno);
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    return IOError("mmap of the io_uring submission queue", errno);
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return IOError("mmap of the io_uring completion queue", errno);
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = static_cast<struct io_uring_sqe*>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+           ring_fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    return IOError("mmap of the io_uring submission entries", errno);
+  }
+
+  uint8_t* sq = static_cast<uint8_t*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  uint8_t* cq = static_cast<uint8_t*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  sq_local_tail_ = *sq_tail_;
+
+  // At most 'queue_depth_' operations are in flight, and the completion
+  // queue is larger than that: it cannot overflow.
+  DCHECK_GE(sq_entries_, queue_depth_);
+  DCHECK_GE(params.cq_entries, queue_depth_);
+  return Status::OK();
+}
+
+Status IoUringQueue::RegisterBuffers(const vector<Slice>& buffers) {
+  if (num_pending() > 0) {
+    return Status::IllegalState("Operations are prepared or in flight");
+  }
+  if (buffers_registered_) {
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0) == -1) {
+      return IOError("Unable to unregister the io_uring buffers", errno);
+    }
+    buffers_registered_ = false;
+  }
+  if (buffers.empty()) {
+    return Status::OK();
+  }
+  vector<struct iovec> iovecs(buffers.size());
+  for (int i = 0; i < buffers.size(); i++) {
+    iovecs[i].iov_base = const_cast<uint8_t*>(buffers[i].data());
+    iovecs[i].iov_len = buffers[i].size();
+  }
+  // Fails with ENOMEM past RLIMIT_MEMLOCK, since the pages are pinned.
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+              iovecs.data(), iovecs.size()) == -1) {
+    return IOError("Unable to register the io_uring buffers", errno);
+  }
+  buffers_registered_ = true;
+  return Status::OK();
+}
+
+Status IoUringQueue::PrepareOp(bool write, AsyncFile* file, uint64_t offset, uint8_t* buf,
+                               size_t length, int buffer_index, Callback callback) {
+  DCHECK(buffer_index < 0 || buffers_registered_);
+  if (free_ops_.empty()) {
+    return Status::ServiceUnavailable(
+        Substitute("$0 operations are already pending", queue_depth_));
+  }
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (sq_local_tail_ - head >= sq_entries_) {
+    return Status::ServiceUnavailable("The io_uring submission queue is full");
+  }
+  int op_index = free_ops_.back();
+  free_ops_.pop_back();
+  Op& op = ops_[op_index];
+  op.callback = std::move(callback);
+  op.file = file;
+
+  unsigned slot = sq_local_tail_ & sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = file->fd();
+  sqe->off = offset;
+  sqe->user_data = op_index;
+  if (buffer_index >= 0) {
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = length;
+    sqe->buf_index = buffer_index;
+  } else {
+    sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    op.iov.iov_base = buf;
+    op.iov.iov_len = length;
+    sqe->addr = reinterpret_cast<uint64_t>(&op.iov);
+    sqe->len = 1;
+  }
+  sq_array_[slot] = slot;
+  sq_local_tail_++;
+  num_prepared_++;
+  return Status::OK();
+}
+
+Status IoUringQueue::Submit() {
+  if (num_prepared_ == 0) {
+    return Status::OK();
+  }
+  __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+  while (num_prepared_ > 0) {
+    int submitted = Enter(num_prepared_, 0, 0);
+    if (submitted == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return IOError("io_uring_enter", errno);
+    }
+    num_prepared_ -= submitted;
+    num_inflight_ += submitted;
+  }
+  return Status::OK();
+}
+
+Status IoUringQueue::Poll(int min_completions, int* completed) {
+  int target = std::min(min_completions, num_inflight_);
+  int done = ReapCompletions(true);
+  while (done < target) {
+    if (Enter(0, target - done, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+      return IOError("io_uring_enter", errno);
+    }
+    done += ReapCompletions(true);
+  }
+  if (completed != nullptr) {
+    *completed = done;
+  }
+  return Status::OK();
+}
+
+int IoUringQueue::ReapCompletions(bool run_callbacks) {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  int reaped = 0;
+  for (; head != tail; head++) {
+    const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    int op_index = cqe.user_data;
+    int res = cqe.res;
+    Op& op = ops_[op_index];
+    Callback callback = std::move(op.callback);
+    const AsyncFile* file = op.file;
+    free_ops_.push_back(op_index);
+    num_inflight_--;
+    reaped++;
+    // The callback may prepare new operations: release the entry first.
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    if (run_callbacks) {
+      if (res < 0) {
+        callback(IOError(file->filename(), -res), 0);
+      } else {
+        callback(Status::OK(), res);
+      }
+    }
+  }
+  return reaped;
+}
+
+#endif // HAVE_IO_URING
+
+////////////////////////////////////////////////////////////
+// ThreadPoolQueue
+////////////////////////////////////////////////////////////
+
+// Runs blocking pread()/pwrite() on a thread pool, for kernels without
+// io_uring (before 5.1, or where it is disabled, e.g. by seccomp).
+class ThreadPoolQueue : public AsyncIoQueue {
+ public:
+  static Status Create(int queue_depth, unique_ptr<AsyncIoQueue>* queue);
+
+  virtual ~ThreadPoolQueue() {
+    pool_->Wait();
+    pool_->Shutdown();
+  }
+
+  virtual Status RegisterBuffers(const vector<Slice>& buffers) OVERRIDE {
+    if (num_pending() > 0) {
+      return Status::IllegalState("Operations are prepared or in flight");
+    }
+    return Status::OK();
+  }
+
+  virtual Status PrepareRead(AsyncFile* file, uint64_t offset, size_t length, uint8_t* buf,
+                             int buffer_index, Callback callback) OVERRIDE {
+    return PrepareOp(false, file, offset, buf, length, std::move(callback));
+  }
+
+  virtual Status PrepareWrite(AsyncFile* file, uint64_t offset, const Slice& data,
+                              int buffer_index, Callback callback) OVERRIDE {
+    return PrepareOp(true, file, offset, const_cast<uint8_t*>(data.data()), data.size(),
+                     std::move(callback));
+  }
+
+  virtual Status Submit() OVERRIDE;
+
+  virtual Status Poll(int min_completions, int* completed) OVERRIDE;
+
+  virtual int num_pending() const OVERRIDE {
+    return prepared_.size() + num_inflight_;
+  }
+
+  virtual const char* name() const OVERRIDE { return "thread pool"; }
+
+ private:
+  struct Op {
+    bool write;
+    const AsyncFile* file;
+    uint64_t offset;
+    uint8_t* buf;
+    size_t length;
+    Callback callback;
+
+    // Set on completion.
+    Status status;
+    size_t bytes;
+  };
+
+  ThreadPoolQueue(int queue_depth, gscoped_ptr<ThreadPool> pool)
+      : queue_depth_(queue_depth),
+        pool_(std::move(pool)),
+        num_inflight_(0),
+        completed_cond_(&lock_) {
+  }
+
+  Status PrepareOp(bool write, AsyncFile* file, uint64_t offset, uint8_t* buf, size_t length,
+                   Callback callback);
+
+  // Runs 'op' on the thread pool.
+  void RunOp(Op* op);
+
+  const int queue_depth_;
+  gscoped_ptr<ThreadPool> pool_;
+
+  vector<unique_ptr<Op>> prepared_;
+  int num_inflight_;
+
+  // Protects 'completed_'.
+  Mutex lock_;
+  ConditionVariable completed_cond_;
+  std::deque<unique_ptr<Op>> completed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPoolQueue);
+};
+
+Status ThreadPoolQueue::Create(int queue_depth, unique_ptr<AsyncIoQueue>* queue) {
+  gscoped_ptr<ThreadPool> pool;
+  RETURN_NOT_OK(ThreadPoolBuilder("async-io")
+                .set_max_threads(std::min(queue_depth, kMaxFallbackThreads))
+                .Build(&pool));
+  queue->reset(new ThreadPoolQueue(queue_depth, std::move(pool)));
+  return Status::OK();
+}
+
+Status ThreadPoolQueue::PrepareOp(bool write, AsyncFile* file, uint64_t offset, uint8_t* buf,
+                                  size_t length, Callback callback) {
+  if (num_pending() >= queue_depth_) {
+    return Status::ServiceUnavailable(
+        Substitute("$0 operations are already pending", queue_depth_));
+  }
+  unique_ptr<Op> op(new Op);
+  op->write = write;
+  op->file = file;
+  op->offset = offset;
+  op->buf = buf;
+  op->length = length;
+  op->callback = std::move(callback);
+  op->bytes = 0;
+  prepared_.push_back(std::move(op));
+  return Status::OK();
+}
+
+Status ThreadPoolQueue::Submit() {
+  for (auto& op : prepared_) {
+    Op* raw_op = op.release();
+    num_inflight_++;
+    Status s = pool_->SubmitFunc([this, raw_op]() { RunOp(raw_op); });
+    if (!s.ok()) {
+      raw_op->status = s;
+      MutexLock l(lock_);
+      completed_.emplace_back(raw_op);
+    }
+  }
+  prepared_.clear();
+  return Status::OK();
+}
+
+void ThreadPoolQueue::RunOp(Op* op) {
+  ssize_t res;
+  do {
+    res = op->write ? pwrite(op->file->fd(), op->buf, op->length, op->offset)
+                    : pread(op->file->fd(), op->buf, op->length, op->offset);
+  } while (res == -1 && errno == EINTR);
+  if (res == -1) {
+    op->status = IOError(op->file->filename(), errno);
+  } else {
+    op->bytes = res;
+  }
+  MutexLock l(lock_);
+  completed_.emplace_back(op);
+  completed_cond_.Signal();
+}
+
+Status ThreadPoolQueue::Poll(int min_completions, int* completed) {
+  int target = std::min(min_completions, num_inflight_);
+  std::deque<unique_ptr<Op>> done;
+  {
+    MutexLock l(lock_);
+    while (completed_.size() < target) {
+      completed_cond_.Wait();
+    }
+    done.swap(completed_);
+  }
+  num_inflight_ -= done.size();
+  for (auto& op : done) {
+    op->callback(op->status, op->bytes);
+  }
+  if (completed != nullptr) {
+    *completed = done.size();
+  }
+  return Status::OK();
+}
+
+////////////////////////////////////////////////////////////
+// AsyncIoQueue
+////////////////////////////////////////////////////////////
+
+Status AsyncIoQueue::Create(const Options& options, unique_ptr<AsyncIoQueue>* queue) {
+  CHECK_GT(options.queue_depth, 0);
+#ifdef HAVE_IO_URING
+  if (options.use_io_uring) {
+    Status s = IoUringQueue::Create(options.queue_depth, queue);
+    if (s.ok()) {
+      return s;
+    }
+    KLOG_FIRST_N(INFO, 1) << "io_uring is not available, asynchronous I/O falls back to "
+                          << "a thread pool: " << s.ToString();
+  }
+#endif
+  return ThreadPoolQueue::Create(options.queue_depth, queue);
+}
+
+} // namespace mprmpr
@@ -0,0 +1,116 @@
+#ifndef KUDU_UTIL_ASYNC_IO_H
+#define KUDU_UTIL_ASYNC_IO_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+// A file opened for asynchronous reads and writes, see AsyncIoQueue.
+//
+// This class is thread-safe.
+class AsyncFile {
+ public:
+  ~AsyncFile();
+
+  static Status OpenForRead(const std::string& fname, std::unique_ptr<AsyncFile>* file);
+
+  static Status OpenForWrite(const std::string& fname, Env::CreateMode mode,
+                             std::unique_ptr<AsyncFile>* file);
+
+  Status Size(uint64_t* size) const;
+
+  // Syncs the data written so far. Blocks.
+  Status Sync();
+
+  const std::string& filename() const { return filename_; }
+
+  int fd() const { return fd_; }
+
+ private:
+  AsyncFile(std::string filename, int fd);
+
+  const std::string filename_;
+  const int fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncFile);
+};
+
+// A queue of asynchronous reads and writes.
+//
+// Operations are first prepared, then submitted together with Submit(): a
+// batch costs a single system call, and keeps many operations in flight on
+// the device from one thread. Their callbacks run on the thread calling
+// Poll(), once they complete.
+//
+// Backed by io_uring if the kernel has it, and by a pool of threads doing
+// blocking pread()/pwrite() otherwise: see name().
+//
+// This class is not thread-safe: it is meant to be driven by one thread,
+// like an event loop.
+class AsyncIoQueue {
+ public:
+  // Called with the number of bytes read or written, which may be less than
+  // requested, e.g. when reading past the end of a file.
+  typedef std::function<void(const Status& s, size_t bytes)> Callback;
+
+  struct Options {
+    Options();
+
+    // The maximum number of operations prepared or in flight.
+    int queue_depth;
+
+    // If false, the thread pool is used even if the kernel has io_uring.
+    bool use_io_uring;
+  };
+
+  static Status Create(const Options& options, std::unique_ptr<AsyncIoQueue>* queue);
+
+  // Waits for the operations in flight, without running their callbacks.
+  virtual ~AsyncIoQueue() {}
+
+  // Registers 'buffers' with the kernel, so that operations on them spare
+  // mapping their pages each time. Buffer i is designated by index i in
+  // PrepareRead() and PrepareWrite(). Replaces the buffers registered
+  // before; no operation may be in flight.
+  virtual Status RegisterBuffers(const std::vector<Slice>& buffers) = 0;
+
+  // Prepares a read of 'length' bytes at 'offset' of 'file' into 'buf'. If
+  // 'buf' lies in a registered buffer, 'buffer_index' is its index, and -1
+  // otherwise. 'callback' is run by Poll() once the read completed: it may
+  // not be null.
+  //
+  // Returns ServiceUnavailable if 'queue_depth' operations are already
+  // prepared or in flight: Poll() first.
+  virtual Status PrepareRead(AsyncFile* file, uint64_t offset, size_t length, uint8_t* buf,
+                             int buffer_index, Callback callback) = 0;
+
+  // Like PrepareRead(), for writing 'data' at 'offset'.
+  virtual Status PrepareWrite(AsyncFile* file, uint64_t offset, const Slice& data,
+                              int buffer_index, Callback callback) = 0;
+
+  // Submits the prepared operations.
+  virtual Status Submit() = 0;
+
+  // Waits until at least 'min_completions' operations (no more than those
+  // in flight) have completed, and runs the callbacks of all the completed
+  // ones. The number of callbacks run is stored in 'completed' if not null.
+  virtual Status Poll(int min_completions, int* completed) = 0;
+
+  // The operations prepared or in flight.
+  virtual int num_pending() const = 0;
+
+  // "io_uring" or "thread pool".
+  virtual const char* name() const = 0;
+};
+
+} // namespace mprmpr
+#endif // KUDU_UTIL_ASYNC_IO_H
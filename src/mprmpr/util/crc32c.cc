@@ -1,9 +1,18 @@
 // A portable implementation of crc32c, optimized to handle
-// four bytes at a time.
+// four bytes at a time, and one using the crc32 instruction of SSE4.2 on
+// three interleaved streams. The implementation is selected according to
+// the CPU.
 
 #include "mprmpr/util/crc32c.h"
 
 #include <stdint.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#include "mprmpr/base/cpu.h"
 #include "mprmpr/util/coding.h"
 
 namespace mprmpr {
@@ -191,7 +200,9 @@ static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const uint8_t *>(p));
 }
 
-uint32 Extend(uint32 crc, const char *buf, size_t size) {
+namespace internal {
+
+uint32 ExtendPortable(uint32 crc, const char *buf, size_t size) {
   const uint8 *p = reinterpret_cast<const uint8 *>(buf);
   const uint8 *e = p + size;
   uint32 l = crc ^ 0xffffffffu;
@@ -240,5 +251,232 @@ uint32 Extend(uint32 crc, const char *buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+}  // namespace internal
+
+namespace {
+
+// The crc32c polynomial, bit-reflected.
+const uint32 kPolynomial = 0x82f63b78;
+
+// Return a * b modulo the polynomial, where a and b are bit-reflected:
+// the highest bit is the coefficient of x^0.
+uint32 MultModP(uint32 a, uint32 b) {
+  uint32 m = 1u << 31;
+  uint32 p = 0;
+  while (a & ((m << 1) - 1)) {
+    if (a & m) {
+      p ^= b;
+      a ^= m;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ kPolynomial : b >> 1;
+  }
+  return p;
+}
+
+// Return x^n modulo the polynomial, bit-reflected.
+uint32 XPowModP(uint64_t n) {
+  uint32 result = 1u << 31;  // x^0
+  uint32 square = 1u << 30;  // x^1
+  while (n != 0) {
+    if (n & 1) {
+      result = MultModP(square, result);
+    }
+    square = MultModP(square, square);
+    n >>= 1;
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+#if defined(__x86_64__)
+
+namespace {
+
+// The crc32 instruction has a latency of three cycles, but a throughput of
+// one per cycle: three independent streams, over three consecutive blocks,
+// keep it busy. The crcs of the blocks are then shifted into place and
+// added, see Extend3Way().
+const size_t kLongBlock = 8192;
+const size_t kShortBlock = 256;
+
+// The multipliers shifting the crc of a block past one and two blocks.
+struct ShiftConstants {
+  uint32 long1;
+  uint32 long2;
+  uint32 short1;
+  uint32 short2;
+};
+
+// With PCLMULQDQ, the crc 'c' is shifted by n bytes as
+// crc32(0, clmul(c, x^(8n-33))): the crc32 instruction multiplies by x^32,
+// and the product of two reflected 32-bit values by x once more. Otherwise
+// it is shifted by a multiplication by x^(8n) in software.
+ShiftConstants ComputeShiftConstants(bool pclmul) {
+  int64_t offset = pclmul ? 33 : 0;
+  ShiftConstants k;
+  k.long1 = XPowModP(8 * kLongBlock - offset);
+  k.long2 = XPowModP(16 * kLongBlock - offset);
+  k.short1 = XPowModP(8 * kShortBlock - offset);
+  k.short2 = XPowModP(16 * kShortBlock - offset);
+  return k;
+}
+
+const ShiftConstants& GetShiftConstants(bool pclmul) {
+  static const ShiftConstants kPclmulConstants = ComputeShiftConstants(true);
+  static const ShiftConstants kPortableConstants = ComputeShiftConstants(false);
+  return pclmul ? kPclmulConstants : kPortableConstants;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+inline uint64 ClMul(uint32 a, uint32 b) {
+  __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(a)),
+                                         _mm_cvtsi32_si128(static_cast<int>(b)), 0);
+  return static_cast<uint64>(_mm_cvtsi128_si64(product));
+}
+
+// Return the crc 'crc' of three consecutive blocks of 'block' bytes at 'p',
+// the crc of the data before them being 'crc'. 'k1' and 'k2' shift a crc
+// past one and two blocks.
+template <bool kPclmul>
+__attribute__((target("sse4.2,pclmul")))
+inline uint64 Extend3Way(uint64 crc, const uint8* p, size_t block, uint32 k1, uint32 k2) {
+  uint64 c0 = crc;
+  uint64 c1 = 0;
+  uint64 c2 = 0;
+  const uint8* end = p + block;
+  do {
+    c0 = _mm_crc32_u64(c0, UNALIGNED_LOAD64(p));
+    c1 = _mm_crc32_u64(c1, UNALIGNED_LOAD64(p + block));
+    c2 = _mm_crc32_u64(c2, UNALIGNED_LOAD64(p + 2 * block));
+    p += 8;
+  } while (p != end);
+
+  // crc(ABC) = crc(A) x^(16 block) + crc(B) x^(8 block) + crc(C), the crcs
+  // of B and C starting from zero.
+  if (kPclmul) {
+    return _mm_crc32_u64(0, ClMul(c0, k2) ^ ClMul(c1, k1)) ^ c2;
+  }
+  return MultModP(k2, c0) ^ MultModP(k1, c1) ^ c2;
+}
+
+template <bool kPclmul>
+__attribute__((target("sse4.2,pclmul")))
+uint32 ExtendHardware(uint32 crc, const char* buf, size_t size) {
+  const uint8* p = reinterpret_cast<const uint8*>(buf);
+  const uint8* e = p + size;
+  uint64 l = crc ^ 0xffffffffu;
+
+  // Process bytes until finished or p is 8-byte aligned
+  while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  if (e - p >= 3 * kShortBlock) {
+    const ShiftConstants& k = GetShiftConstants(kPclmul);
+    while (e - p >= 3 * kLongBlock) {
+      l = Extend3Way<kPclmul>(l, p, kLongBlock, k.long1, k.long2);
+      p += 3 * kLongBlock;
+    }
+    while (e - p >= 3 * kShortBlock) {
+      l = Extend3Way<kPclmul>(l, p, kShortBlock, k.short1, k.short2);
+      p += 3 * kShortBlock;
+    }
+  }
+  // Process bytes 8 at a time
+  while (e - p >= 8) {
+    l = _mm_crc32_u64(l, UNALIGNED_LOAD64(p));
+    p += 8;
+  }
+  // Process the last few bytes
+  while (p != e) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  return static_cast<uint32>(l) ^ 0xffffffffu;
+}
+
+}  // anonymous namespace
+
+namespace internal {
+
+uint32 ExtendSSE42(uint32 crc, const char* buf, size_t size) {
+  return ExtendHardware<false>(crc, buf, size);
+}
+
+uint32 ExtendSSE42Pclmul(uint32 crc, const char* buf, size_t size) {
+  return ExtendHardware<true>(crc, buf, size);
+}
+
+bool CpuHasSSE42() {
+  return base::CPU().has_sse42();
+}
+
+bool CpuHasPclmul() {
+  return base::CPU().has_pclmul();
+}
+
+}  // namespace internal
+
+#else
+
+namespace internal {
+
+// Never selected: only x86-64 has the crc32 instruction.
+uint32 ExtendSSE42(uint32 crc, const char* buf, size_t size) {
+  return ExtendPortable(crc, buf, size);
+}
+
+uint32 ExtendSSE42Pclmul(uint32 crc, const char* buf, size_t size) {
+  return ExtendPortable(crc, buf, size);
+}
+
+bool CpuHasSSE42() { return false; }
+bool CpuHasPclmul() { return false; }
+
+}  // namespace internal
+
+#endif  // defined(__x86_64__)
+
+namespace {
+
+struct Implementation {
+  uint32 (*extend)(uint32, const char*, size_t);
+  const char* name;
+};
+
+Implementation SelectImplementation() {
+  if (internal::CpuHasSSE42()) {
+    if (internal::CpuHasPclmul()) {
+      return { &internal::ExtendSSE42Pclmul, "sse4.2+pclmul" };
+    }
+    return { &internal::ExtendSSE42, "sse4.2" };
+  }
+  return { &internal::ExtendPortable, "portable" };
+}
+
+const Implementation& GetImplementation() {
+  static const Implementation kImplementation = SelectImplementation();
+  return kImplementation;
+}
+
+// Selects the implementation on startup rather than on the first checksum.
+const Implementation& kStartupImplementation ATTRIBUTE_UNUSED = GetImplementation();
+
+}  // anonymous namespace
+
+uint32 Extend(uint32 crc, const char* buf, size_t size) {
+  return GetImplementation().extend(crc, buf, size);
+}
+
+uint32 Combine(uint32 crc1, uint32 crc2, size_t len2) {
+  // The crc of concat(A, B) is the one of A shifted past B, plus the one of
+  // B: the pre- and post-conditioning cancel out.
+  return MultModP(XPowModP(8 * static_cast<uint64_t>(len2)), crc1) ^ crc2;
+}
+
+const char* ImplementationName() {
+  return GetImplementation().name;
+}
+
 }  // namespace crc32c
 }  // namespace mprmpr
@@ -10,8 +10,20 @@ namespace crc32c {
 // Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
 // crc32c of some string A.  Extend() is often used to maintain the
 // crc32c of a stream of data.
+//
+// Uses the crc32 instruction of SSE4.2 if the CPU has it, see
+// ImplementationName().
 extern uint32 Extend(uint32 init_crc, const char* data, size_t n);
 
+// Return the crc32c of concat(A, B) where crc1 is the crc32c of A, and
+// crc2 the crc32c of B, of length len2.  Lets the crc32c of a large buffer
+// be computed over several pieces in parallel.
+extern uint32 Combine(uint32 crc1, uint32 crc2, size_t len2);
+
+// The implementation of Extend() selected for the CPU: "portable",
+// "sse4.2" or "sse4.2+pclmul".
+extern const char* ImplementationName();
+
 // Return the crc32c of data[0,n-1]
 inline uint32 Value(const char* data, size_t n) { return Extend(0, data, n); }
 inline uint32 Crc32c(const char* data, size_t n) { return Value(data, n); }
@@ -34,6 +46,19 @@ inline uint32 Unmask(uint32 masked_crc) {
   return ((rot >> 17) | (rot << 15));
 }
 
+namespace internal {
+
+// The implementations of Extend(), exposed for tests and benchmarks. The
+// hardware ones must only be called if the CPU supports them.
+uint32 ExtendPortable(uint32 init_crc, const char* data, size_t n);
+uint32 ExtendSSE42(uint32 init_crc, const char* data, size_t n);
+uint32 ExtendSSE42Pclmul(uint32 init_crc, const char* data, size_t n);
+
+bool CpuHasSSE42();
+bool CpuHasPclmul();
+
+}  // namespace internal
+
 }  // namespace crc32c
 }  // namespace mprmpr
 
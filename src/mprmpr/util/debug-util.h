@@ -85,6 +85,11 @@ class StackTrace {
 
   uint64_t HashCode() const;
 
+  int num_frames() const { return num_frames_; }
+
+  // The return address of frame 'i', innermost first.
+  void* frame(int i) const { return frames_[i]; }
+
  private:
   enum {
     // The maximum number of stack frames to collect.
@@ -163,6 +163,13 @@ class Env {
   // *block_size. fname must exist but it may be a file or a directory.
   virtual Status GetBlockSize(const std::string& fname, uint64_t* block_size) = 0;
 
+  // Store the last modification time of fname, in microseconds since the
+  // epoch, in *timestamp.
+  //
+  // Filesystems update it from a coarse clock: it may be up to a few
+  // milliseconds earlier than the modification itself.
+  virtual Status GetFileModifiedTime(const std::string& fname, int64_t* timestamp) = 0;
+
   // Determine the number of bytes free on the filesystem specified by 'path'.
   // "Free space" accounting on the underlying filesystem may be more coarse
   // than single bytes.
@@ -172,6 +179,20 @@ class Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Copy 'length' bytes at 'src_offset' of the file src to 'dst_offset' of
+  // the file dst. dst is created if it does not exist; its other bytes are
+  // left as they are, and it grows as needed. The copy is not synced.
+  //
+  // The data is copied by the kernel where possible: the extents are shared
+  // on filesystems supporting reflinks, or copied without going through
+  // user space (and the CPU caches). Otherwise it is copied through a
+  // buffer.
+  //
+  // Returns an error if the range goes past the end of src.
+  virtual Status CopyRange(const std::string& src, uint64_t src_offset,
+                           const std::string& dst, uint64_t dst_offset,
+                           uint64_t length) = 0;
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores NULL in
   // *lock and returns non-OK.
@@ -259,6 +280,10 @@ class Env {
   // Get the total amount of RAM installed on this machine.
   virtual Status GetTotalRAMBytes(int64_t* ram) = 0;
 
+  // Get the maximum number of files the process may have open
+  // (RLIMIT_NOFILE).
+  virtual int64_t GetOpenFileLimit() = 0;
+
  private:
   // No copying allowed
   Env(const Env&);
@@ -305,8 +330,9 @@ class RandomAccessFile {
   // to the data that was read (including if fewer than "n" bytes were
   // successfully read).  May set "*result" to point at data in
   // "scratch[0..n-1]", so "scratch[0..n-1]" must be live when
-  // "*result" is used.  If an error was encountered, returns a non-OK
-  // status.
+  // "*result" is used, or, for a memory-mapped file, at data in the
+  // mapping, live until the file is destroyed.  If an error was
+  // encountered, returns a non-OK status.
   //
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
@@ -331,14 +357,38 @@ struct WritableFileOptions {
   // See CreateMode for details.
   Env::CreateMode mode;
 
+  // Bypass the page cache (O_DIRECT), e.g. for large media files written
+  // once, which would otherwise evict more useful pages. The appends are
+  // staged in an aligned buffer and written in whole blocks; the partial
+  // last block is padded, and the padding truncated on Close(). Buffered
+  // I/O is used instead if the filesystem does not support O_DIRECT.
+  bool direct_io;
+
   WritableFileOptions()
     : sync_on_close(false),
-      mode(Env::CREATE_IF_NON_EXISTING_TRUNCATE) { }
+      mode(Env::CREATE_IF_NON_EXISTING_TRUNCATE),
+      direct_io(false) { }
 };
 
 // Options specified when a file is opened for random access.
 struct RandomAccessFileOptions {
-  RandomAccessFileOptions() {}
+  // Bypass the page cache (O_DIRECT), see WritableFileOptions. Reads are
+  // widened to whole blocks, through an aligned buffer unless the offset,
+  // length and scratch buffer are already aligned. Best for large reads.
+  bool direct_io;
+
+  // Map the file in memory: Read() returns slices into the mapping rather
+  // than copying into the scratch buffer, and readahead follows the access
+  // pattern (random, or sequential with the next window prefetched). The
+  // file must not grow while open, as only its size at open time is
+  // mapped. If it shrinks, the reads of the truncated data fail, and the
+  // slices over it read zeros rather than crashing with SIGBUS. Ignored
+  // with 'direct_io'.
+  bool use_mmap;
+
+  RandomAccessFileOptions()
+    : direct_io(false),
+      use_mmap(false) {}
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -482,7 +532,8 @@ class RWFile {
 
   // Synchronously flushes all dirty file data and metadata to disk. Upon
   // returning successfully, all previously issued file changes have been
-  // made durable.
+  // made durable, including those made through earlier handles of an
+  // existing file.
   virtual Status Sync() = 0;
 
   // Closes the file, optionally calling Sync() on it if the file was
@@ -4,9 +4,14 @@
 #include <fts.h>
 #include <limits.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -16,7 +21,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <type_traits>
 #include <vector>
 
@@ -25,16 +33,21 @@
 #include "mprmpr/base/atomicops.h"
 #include "mprmpr/base/bind.h"
 #include "mprmpr/base/callback.h"
+#include "mprmpr/base/gscoped_ptr.h"
 #include "mprmpr/base/map-util.h"
 #include "mprmpr/base/strings/substitute.h"
 
+#include "mprmpr/util/alignment.h"
 #include "mprmpr/util/atomic.h"
 //#include "mprmpr/util/debug/trace_event.h"
 #include "mprmpr/util/env.h"
 #include "mprmpr/util/errno.h"
+#include "mprmpr/util/locks.h"
 //#include "mprmpr/util/flag_tags.h"
 #include "mprmpr/util/logging.h"
 #include "mprmpr/util/malloc.h"
+#include "mprmpr/util/memory/buffer_pool.h"
+#include "mprmpr/util/memory/memory.h"
 #include "mprmpr/util/monotime.h"
 #include "mprmpr/util/path_util.h"
 #include "mprmpr/util/slice.h"
@@ -43,6 +56,7 @@
 #include "mprmpr/util/trace.h"
 
 #include <linux/falloc.h>
+#include <linux/fs.h>
 #include <sys/sysinfo.h>
 
 // Copied from falloc.h. Useful for older kernels that lack support for
@@ -84,8 +98,10 @@ DEFINE_bool(writable_file_use_fsync, false,
             "data to disk.");
 //TAG_FLAG(writable_file_use_fsync, advanced);
 
-DEFINE_bool(suicide_on_eio, true,
-            "Kill the process if an I/O operation results in EIO");
+DEFINE_bool(suicide_on_eio, false,
+            "Kill the process if an I/O operation results in EIO. Otherwise, "
+            "the data directory of the failed operation is marked failed, and "
+            "the server keeps running on the others.");
 //TAG_FLAG(suicide_on_eio, advanced);
 
 DEFINE_bool(never_fsync, false,
@@ -94,6 +110,11 @@ DEFINE_bool(never_fsync, false,
 //TAG_FLAG(never_fsync, advanced);
 //TAG_FLAG(never_fsync, unsafe);
 
+DEFINE_bool(env_use_copy_offload, true,
+            "Whether Env::CopyRange() lets the kernel copy the data, rather than "
+            "copying it through a buffer. For testing.");
+//TAG_FLAG(env_use_copy_offload, hidden);
+
 using base::subtle::Atomic64;
 using base::subtle::Barrier_AtomicIncrement;
 using std::string;
@@ -188,6 +209,210 @@ static Status DoOpen(const string& filename, Env::CreateMode mode, int* fd) {
   return Status::OK();
 }
 
+// The alignment of the offsets, lengths and buffers of direct I/O. Covers
+// both 512 byte and 4KB logical block sizes.
+const size_t kDirectIoAlignment = 4096;
+
+// The size of the buffer staging the appends to a WritableFile doing direct
+// I/O.
+const size_t kDirectIoWriteBufferSize = 1024 * 1024;
+
+static bool IsDirectIoAligned(uint64_t value) {
+  return value % kDirectIoAlignment == 0;
+}
+
+// Switches 'fd' to direct I/O. Returns false if the filesystem does not
+// support it.
+static bool EnableDirectIo(int fd, const string& filename) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags | O_DIRECT) == -1) {
+    KLOG_FIRST_N(WARNING, 1) << "Unable to use direct I/O on " << filename << ": "
+                             << ErrnoToString(errno) << ". Using buffered I/O instead.";
+    return false;
+  }
+  return true;
+}
+
+// A buffer aligned for direct I/O.
+//
+// The buffers come from the buffer pool, so that they are reused rather than
+// allocated and faulted in for each read. The pooled slabs are page-aligned;
+// requests below the smallest size class are rounded up to it, as they would
+// be served unaligned from the heap otherwise.
+class AlignedBuffer {
+ public:
+  explicit AlignedBuffer(size_t size)
+      : size_(size),
+        heap_data_(nullptr) {
+    size_t pooled_size = std::max<size_t>(size, 1UL << PooledBufferAllocator::kMinSizeClassShift);
+    pooled_.reset(PooledBufferAllocator::Get()->Allocate(pooled_size));
+    if (pooled_) {
+      data_ = reinterpret_cast<uint8_t*>(pooled_->data());
+    } else {
+      // Over the limit of the pool.
+      CHECK_EQ(0, posix_memalign(&heap_data_, kDirectIoAlignment, size));
+      data_ = reinterpret_cast<uint8_t*>(heap_data_);
+    }
+    DCHECK(IsDirectIoAligned(reinterpret_cast<uintptr_t>(data_)));
+  }
+
+  ~AlignedBuffer() {
+    free(heap_data_);
+  }
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const size_t size_;
+  gscoped_ptr<Buffer> pooled_;
+  void* heap_data_;
+  uint8_t* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(AlignedBuffer);
+};
+
+// The largest copy asked of the kernel at once, below the 2GB limit of
+// sendfile(2) and copy_file_range(2).
+const size_t kMaxKernelCopy = 1024 * 1024 * 1024;
+
+// The size of the buffer of the copies done in user space.
+const size_t kCopyBufferSize = 1024 * 1024;
+
+// A range being copied by Env::CopyRange(), advanced as it is copied.
+//
+// Each of the ways to copy below copies what it can, and returns an error
+// only for an I/O error: when the kernel or the filesystems do not support
+// it, the next one picks up the rest of the range.
+struct CopyRangeState {
+  const string& src;
+  int src_fd;
+  uint64_t src_offset;
+  const string& dst;
+  int dst_fd;
+  uint64_t dst_offset;
+  uint64_t remaining;
+
+  void Advance(uint64_t n) {
+    src_offset += n;
+    dst_offset += n;
+    remaining -= n;
+  }
+};
+
+// Shares the extents of the range with dst, on filesystems supporting
+// reflinks. Whole blocks only: the tail of the range is left to the copies.
+static void CloneRange(CopyRangeState* state, uint64_t block_size) {
+#ifdef FICLONERANGE
+  if (state->src_offset % block_size != 0 || state->dst_offset % block_size != 0) {
+    return;
+  }
+  uint64_t length = KUDU_ALIGN_DOWN(state->remaining, block_size);
+  if (length == 0) {
+    return;
+  }
+  struct file_clone_range range;
+  range.src_fd = state->src_fd;
+  range.src_offset = state->src_offset;
+  range.src_length = length;
+  range.dest_offset = state->dst_offset;
+  int err;
+  RETRY_ON_EINTR(err, ioctl(state->dst_fd, FICLONERANGE, &range));
+  if (err == -1) {
+    // Typically EOPNOTSUPP or EXDEV. An actual I/O error shows in the copies.
+    VLOG(2) << "Unable to clone " << state->src << " into " << state->dst << ": "
+            << ErrnoToString(errno);
+    return;
+  }
+  TRACE_COUNTER_INCREMENT("copy_range_cloned_bytes", length);
+  state->Advance(length);
+#endif
+}
+
+// Copies the range in the kernel with copy_file_range(2), which may also
+// offload the copy to the storage.
+static Status CopyFileRange(CopyRangeState* state) {
+#ifdef __NR_copy_file_range
+  while (state->remaining > 0) {
+    loff_t src_offset = state->src_offset;
+    loff_t dst_offset = state->dst_offset;
+    ssize_t n;
+    RETRY_ON_EINTR(n, syscall(__NR_copy_file_range, state->src_fd, &src_offset,
+                              state->dst_fd, &dst_offset,
+                              std::min<uint64_t>(state->remaining, kMaxKernelCopy), 0));
+    if (n == -1) {
+      if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP) {
+        return Status::OK();
+      }
+      return IOError(Substitute("copy $0 to $1", state->src, state->dst), errno);
+    }
+    if (n == 0) {
+      // Some filesystems return 0 rather than failing.
+      return Status::OK();
+    }
+    TRACE_COUNTER_INCREMENT("copy_range_copied_bytes", n);
+    state->Advance(n);
+  }
+#endif
+  return Status::OK();
+}
+
+// Copies the range in the kernel with sendfile(2), through the page cache
+// of both files.
+static Status SendFile(CopyRangeState* state) {
+  if (lseek(state->dst_fd, state->dst_offset, SEEK_SET) == -1) {
+    return IOError(state->dst, errno);
+  }
+  while (state->remaining > 0) {
+    off_t src_offset = state->src_offset;
+    ssize_t n;
+    RETRY_ON_EINTR(n, sendfile(state->dst_fd, state->src_fd, &src_offset,
+                               std::min<uint64_t>(state->remaining, kMaxKernelCopy)));
+    if (n == -1) {
+      if (errno == ENOSYS || errno == EINVAL) {
+        return Status::OK();
+      }
+      return IOError(Substitute("copy $0 to $1", state->src, state->dst), errno);
+    }
+    if (n == 0) {
+      return Status::OK();
+    }
+    TRACE_COUNTER_INCREMENT("copy_range_sent_bytes", n);
+    state->Advance(n);
+  }
+  return Status::OK();
+}
+
+// Copies the range through a pooled buffer.
+static Status CopyThroughBuffer(CopyRangeState* state) {
+  AlignedBuffer buffer(std::min<uint64_t>(state->remaining, kCopyBufferSize));
+  while (state->remaining > 0) {
+    ssize_t r;
+    RETRY_ON_EINTR(r, pread(state->src_fd, buffer.data(),
+                            std::min<uint64_t>(state->remaining, buffer.size()),
+                            state->src_offset));
+    if (r == -1) {
+      return IOError(state->src, errno);
+    }
+    if (r == 0) {
+      return Status::IOError(Substitute("Unable to copy $0 bytes from $1", state->remaining,
+                                        state->src), "unexpected end of file");
+    }
+    ssize_t written = 0;
+    while (written < r) {
+      ssize_t w;
+      RETRY_ON_EINTR(w, pwrite(state->dst_fd, buffer.data() + written, r - written,
+                               state->dst_offset + written));
+      if (w == -1) {
+        return IOError(state->dst, errno);
+      }
+      written += w;
+    }
+    state->Advance(r);
+  }
+  return Status::OK();
+}
+
 class PosixSequentialFile: public SequentialFile {
  private:
   std::string filename_;
@@ -232,15 +457,48 @@ class PosixRandomAccessFile: public RandomAccessFile {
  private:
   std::string filename_;
   int fd_;
+  bool direct_io_;
+
+  // Reads the aligned blocks spanning [offset, offset + n) with direct I/O.
+  Status DirectRead(uint64_t offset, size_t n, Slice* result, uint8_t* scratch) const {
+    if (IsDirectIoAligned(offset) && IsDirectIoAligned(n) &&
+        IsDirectIoAligned(reinterpret_cast<uintptr_t>(scratch))) {
+      ssize_t r;
+      RETRY_ON_EINTR(r, pread(fd_, scratch, n, offset));
+      if (r < 0) {
+        return IOError(filename_, errno);
+      }
+      *result = Slice(scratch, r);
+      return Status::OK();
+    }
+
+    uint64_t start = KUDU_ALIGN_DOWN(offset, kDirectIoAlignment);
+    uint64_t end = KUDU_ALIGN_UP(offset + n, kDirectIoAlignment);
+    AlignedBuffer buffer(end - start);
+    ssize_t r;
+    RETRY_ON_EINTR(r, pread(fd_, buffer.data(), buffer.size(), start));
+    if (r < 0) {
+      return IOError(filename_, errno);
+    }
+    // Less may have been read than requested, e.g. at the end of the file.
+    size_t skipped = offset - start;
+    size_t length = r > skipped ? std::min<size_t>(r - skipped, n) : 0;
+    memcpy(scratch, buffer.data() + skipped, length);
+    *result = Slice(scratch, length);
+    return Status::OK();
+  }
 
  public:
-  PosixRandomAccessFile(std::string fname, int fd)
-      : filename_(std::move(fname)), fd_(fd) {}
+  PosixRandomAccessFile(std::string fname, int fd, bool direct_io)
+      : filename_(std::move(fname)), fd_(fd), direct_io_(direct_io) {}
   virtual ~PosixRandomAccessFile() { close(fd_); }
 
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       uint8_t *scratch) const OVERRIDE {
     ThreadRestrictions::AssertIOAllowed();
+    if (direct_io_) {
+      return DirectRead(offset, n, result, scratch);
+    }
     Status s;
     ssize_t r;
     RETRY_ON_EINTR(r, pread(fd_, scratch, n, offset));
@@ -270,6 +528,238 @@ class PosixRandomAccessFile: public RandomAccessFile {
   }
 };
 
+// A region of a file mapped in memory.
+struct MappedRegion {
+  MappedRegion(int fd, uint8_t* data, size_t length)
+      : fd(fd),
+        data(data),
+        length(length),
+        truncated(false) {
+  }
+
+  // Kept open to find the current size of the file on SIGBUS.
+  const int fd;
+  uint8_t* const data;
+  const size_t length;
+
+  // Set once a page of the region is found past the end of the file.
+  AtomicBool truncated;
+};
+
+// The mapped regions by address, for HandleSigbus(). The registry is only
+// read in the signal handler: a thread never faults on a mapping while
+// holding the lock.
+static simple_spinlock* mapped_regions_lock;
+static std::map<uintptr_t, MappedRegion*>* mapped_regions;
+static struct sigaction previous_sigbus_action;
+
+// Accessing the pages of a mapping past the end of its file, e.g. once
+// truncated by another process, raises SIGBUS, as do I/O errors. If the page
+// belongs to a registered region and is past the current end of the file,
+// maps zeros over the rest of the region and marks it truncated: the
+// faulting access then reads zeros, and the next reads of the file fail.
+// Otherwise, e.g. on an I/O error, the data cannot be made up: hands the
+// signal over to the previous handler.
+static void HandleSigbus(int signo, siginfo_t* info, void* context) {
+  uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+  bool handled = false;
+  {
+    std::lock_guard<simple_spinlock> l(*mapped_regions_lock);
+    auto it = mapped_regions->upper_bound(addr);
+    if (it != mapped_regions->begin()) {
+      --it;
+      MappedRegion* region = it->second;
+      uintptr_t end = it->first + region->length;
+      // fstat() is async-signal-safe.
+      struct stat st;
+      if (addr < end && fstat(region->fd, &st) == 0 &&
+          addr - it->first >= static_cast<uint64_t>(st.st_size)) {
+        uintptr_t page = KUDU_ALIGN_DOWN(addr, static_cast<uintptr_t>(getpagesize()));
+        void* zeros = mmap(reinterpret_cast<void*>(page), end - page, PROT_READ,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        region->truncated.Store(true);
+        handled = zeros != MAP_FAILED;
+      }
+    }
+  }
+  if (handled) {
+    return;
+  }
+  if (previous_sigbus_action.sa_flags & SA_SIGINFO) {
+    previous_sigbus_action.sa_sigaction(signo, info, context);
+  } else if (previous_sigbus_action.sa_handler != SIG_DFL &&
+             previous_sigbus_action.sa_handler != SIG_IGN) {
+    previous_sigbus_action.sa_handler(signo);
+  } else {
+    // Returning retries the access, which now kills the process.
+    signal(SIGBUS, SIG_DFL);
+  }
+}
+
+static pthread_once_t sigbus_handler_once = PTHREAD_ONCE_INIT;
+
+static void InstallSigbusHandler() {
+  mapped_regions_lock = new simple_spinlock();
+  mapped_regions = new std::map<uintptr_t, MappedRegion*>();
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = &HandleSigbus;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  PCHECK(sigaction(SIGBUS, &action, &previous_sigbus_action) == 0);
+}
+
+// The bytes prefetched ahead of sequential reads of a mapped file.
+const uint64_t kMmapReadaheadBytes = 8 * 1024 * 1024;
+
+// The number of consecutive sequential (or random) reads of a mapped file
+// after which the kernel is advised of the pattern.
+const int kMmapAccessPatternThreshold = 4;
+
+// mmap() based random-access.
+//
+// Reads are served from the mapping without a system call or a copy. The
+// kernel's default readahead suits neither the random lookups in an index
+// nor the streaming of a payload, so the access pattern is tracked and
+// advised: MADV_RANDOM for random reads, and MADV_SEQUENTIAL for sequential
+// reads, which also prefetch the next window of the file with
+// MADV_WILLNEED. The tracking is best-effort: concurrent readers race on it.
+class PosixMmapRandomAccessFile: public RandomAccessFile {
+ public:
+  // Maps the first 'size' bytes of 'fd', which the file takes over.
+  static Status Open(std::string fname, int fd, uint64_t size,
+                     unique_ptr<RandomAccessFile>* result) {
+    uint8_t* data = nullptr;
+    if (size > 0) {
+      void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        return IOError(fname, err);
+      }
+      data = reinterpret_cast<uint8_t*>(addr);
+    }
+    result->reset(new PosixMmapRandomAccessFile(std::move(fname), fd, data, size));
+    return Status::OK();
+  }
+
+  virtual ~PosixMmapRandomAccessFile() {
+    if (region_.length > 0) {
+      {
+        std::lock_guard<simple_spinlock> l(*mapped_regions_lock);
+        mapped_regions->erase(reinterpret_cast<uintptr_t>(region_.data));
+      }
+      munmap(region_.data, region_.length);
+    }
+    close(region_.fd);
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      uint8_t* /* scratch */) const OVERRIDE {
+    if (PREDICT_FALSE(region_.truncated.Load())) {
+      return Status::IOError(filename_, "the mapping is past the end of the file, or unreadable");
+    }
+    if (offset >= region_.length) {
+      *result = Slice();
+      return Status::OK();
+    }
+    n = std::min<uint64_t>(n, region_.length - offset);
+    *result = Slice(region_.data + offset, n);
+    Advise(offset, n);
+    return Status::OK();
+  }
+
+  virtual Status Size(uint64_t *size) const OVERRIDE {
+    *size = region_.length;
+    return Status::OK();
+  }
+
+  virtual string filename() const OVERRIDE { return filename_; }
+
+  // Includes the pages of the mapping in memory, which count towards the
+  // resident set of the process.
+  virtual size_t memory_footprint() const OVERRIDE {
+    size_t footprint = ant_malloc_usable_size(this) + filename_.capacity();
+    const size_t page_size = getpagesize();
+    const size_t kPagesPerCall = 4096;
+    unsigned char pages[kPagesPerCall];
+    for (size_t offset = 0; offset < region_.length; offset += kPagesPerCall * page_size) {
+      size_t length = std::min(region_.length - offset, kPagesPerCall * page_size);
+      if (mincore(region_.data + offset, length, pages) != 0) {
+        // E.g. once truncated: count the whole mapping.
+        return footprint + region_.length;
+      }
+      size_t num_pages = (length + page_size - 1) / page_size;
+      for (size_t i = 0; i < num_pages; i++) {
+        if (pages[i] & 1) {
+          footprint += page_size;
+        }
+      }
+    }
+    return footprint;
+  }
+
+ private:
+  PosixMmapRandomAccessFile(std::string fname, int fd, uint8_t* data, uint64_t size)
+      : filename_(std::move(fname)),
+        region_(fd, data, size),
+        next_offset_(0),
+        sequential_reads_(0),
+        random_reads_(0),
+        advice_(MADV_NORMAL),
+        prefetched_end_(0) {
+    if (size > 0) {
+      pthread_once(&sigbus_handler_once, &InstallSigbusHandler);
+      std::lock_guard<simple_spinlock> l(*mapped_regions_lock);
+      (*mapped_regions)[reinterpret_cast<uintptr_t>(data)] = &region_;
+    }
+  }
+
+  // Tracks the access pattern after a read of 'n' bytes at 'offset'.
+  void Advise(uint64_t offset, size_t n) const {
+    uint64_t end = offset + n;
+    bool sequential = next_offset_.Exchange(end) == offset;
+    int64_t streak;
+    if (sequential) {
+      streak = sequential_reads_.Increment();
+      random_reads_.Store(0);
+    } else {
+      streak = random_reads_.Increment();
+      sequential_reads_.Store(0);
+    }
+    int32_t advice = sequential ? MADV_SEQUENTIAL : MADV_RANDOM;
+    if (streak == kMmapAccessPatternThreshold && advice_.Exchange(advice) != advice) {
+      madvise(region_.data, region_.length, advice);
+      prefetched_end_.Store(end);
+    }
+
+    // Keep the next window of a sequentially read file coming in.
+    if (sequential && advice_.Load() == MADV_SEQUENTIAL) {
+      uint64_t prefetched = prefetched_end_.Load();
+      if (prefetched < region_.length && end + kMmapReadaheadBytes / 2 > prefetched) {
+        uint64_t from = KUDU_ALIGN_DOWN(std::max(end, prefetched),
+                                        static_cast<uint64_t>(getpagesize()));
+        uint64_t to = std::min(end + kMmapReadaheadBytes, region_.length);
+        if (from < to && prefetched_end_.CompareAndSet(prefetched, to)) {
+          madvise(region_.data + from, to - from, MADV_WILLNEED);
+        }
+      }
+    }
+  }
+
+  const std::string filename_;
+  MappedRegion region_;
+
+  // The access pattern, see Advise().
+  mutable AtomicInt<uint64_t> next_offset_;
+  mutable AtomicInt<int64_t> sequential_reads_;
+  mutable AtomicInt<int64_t> random_reads_;
+  mutable AtomicInt<int32_t> advice_;
+  mutable AtomicInt<uint64_t> prefetched_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(PosixMmapRandomAccessFile);
+};
+
 // Use non-memory mapped POSIX files to write data to a file.
 //
 // TODO (perf) investigate zeroing a pre-allocated allocated area in
@@ -283,7 +773,11 @@ class PosixWritableFile : public WritableFile {
         sync_on_close_(sync_on_close),
         filesize_(file_size),
         pre_allocated_size_(0),
-        pending_sync_(false) {}
+        pending_sync_(false),
+        buffer_offset_(0),
+        buffered_(0),
+        written_(0),
+        padded_size_(0) {}
 
   ~PosixWritableFile() {
     if (fd_ >= 0) {
@@ -297,10 +791,43 @@ class PosixWritableFile : public WritableFile {
     return AppendVector(data_vector);
   }
 
+  // Switches the file to direct I/O, if the filesystem supports it.
+  Status EnableDirectIo() {
+    if (!mprmpr::EnableDirectIo(fd_, filename_)) {
+      return Status::OK();
+    }
+    buffer_.reset(new AlignedBuffer(kDirectIoWriteBufferSize));
+
+    // Appends to an existing file continue its partial last block.
+    buffer_offset_ = KUDU_ALIGN_DOWN(filesize_, kDirectIoAlignment);
+    buffered_ = filesize_ - buffer_offset_;
+    written_ = buffered_;
+    padded_size_ = filesize_;
+    if (buffered_ > 0) {
+      ssize_t r;
+      RETRY_ON_EINTR(r, pread(fd_, buffer_->data(), kDirectIoAlignment, buffer_offset_));
+      if (r < 0) {
+        return IOError(filename_, errno);
+      }
+      if (r < buffered_) {
+        return Status::IOError(filename_, Substitute("expected to read $0 bytes at $1, read $2",
+                                                     buffered_, buffer_offset_, r));
+      }
+    }
+    return Status::OK();
+  }
+
   virtual Status AppendVector(const vector<Slice>& data_vector) OVERRIDE {
     ThreadRestrictions::AssertIOAllowed();
     static const size_t kIovMaxElements = IOV_MAX;
 
+    if (buffer_) {
+      for (const Slice& data : data_vector) {
+        RETURN_NOT_OK(BufferDirectAppend(data));
+      }
+      return Status::OK();
+    }
+
     Status s;
     for (size_t i = 0; i < data_vector.size() && s.ok(); i += kIovMaxElements) {
       size_t n = std::min(data_vector.size() - i, kIovMaxElements);
@@ -333,9 +860,15 @@ class PosixWritableFile : public WritableFile {
     ThreadRestrictions::AssertIOAllowed();
     Status s;
 
-    // If we've allocated more space than we used, truncate to the
-    // actual size of the file and perform Sync().
-    if (filesize_ < pre_allocated_size_) {
+    if (buffer_) {
+      s = WriteDirectBuffer();
+      buffer_.reset();
+    }
+
+    // If we've allocated more space than we used, or padded the last block
+    // for direct I/O, truncate to the actual size of the file and perform
+    // Sync().
+    if (filesize_ < std::max(pre_allocated_size_, padded_size_)) {
       int ret;
       RETRY_ON_EINTR(ret, ftruncate(fd_, filesize_));
       if (ret != 0) {
@@ -367,6 +900,10 @@ class PosixWritableFile : public WritableFile {
   virtual Status Flush(FlushMode mode) OVERRIDE {
 //    TRACE_EVENT1("io", "PosixWritableFile::Flush", "path", filename_);
     ThreadRestrictions::AssertIOAllowed();
+    if (buffer_) {
+      // Direct writes skip the page cache: there is nothing else to flush.
+      return WriteDirectBuffer();
+    }
     int flags = SYNC_FILE_RANGE_WRITE;
     if (mode == FLUSH_SYNC) {
       flags |= SYNC_FILE_RANGE_WAIT_AFTER;
@@ -380,6 +917,9 @@ class PosixWritableFile : public WritableFile {
   virtual Status Sync() OVERRIDE {
 //    TRACE_EVENT1("io", "PosixWritableFile::Sync", "path", filename_);
     ThreadRestrictions::AssertIOAllowed();
+    if (buffer_) {
+      RETURN_NOT_OK(WriteDirectBuffer());
+    }
     LOG_SLOW_EXECUTION(WARNING, 1000, Substitute("sync call for $0", filename_)) {
       if (pending_sync_) {
         pending_sync_ = false;
@@ -396,6 +936,57 @@ class PosixWritableFile : public WritableFile {
   virtual string filename() const OVERRIDE { return filename_; }
 
  private:
+  // Copies 'data' to the direct I/O buffer, writing it out whenever full.
+  Status BufferDirectAppend(const Slice& data) {
+    const uint8_t* src = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+      size_t n = std::min(remaining, buffer_->size() - buffered_);
+      memcpy(buffer_->data() + buffered_, src, n);
+      buffered_ += n;
+      filesize_ += n;
+      src += n;
+      remaining -= n;
+      pending_sync_ = true;
+      if (buffered_ == buffer_->size()) {
+        RETURN_NOT_OK(WriteDirectBuffer());
+      }
+    }
+    return Status::OK();
+  }
+
+  // Writes the direct I/O buffer at 'buffer_offset_', padding its partial
+  // last block with zeros. That block stays in the buffer, to be written
+  // again once the next appends complete it.
+  Status WriteDirectBuffer() {
+    if (buffered_ == written_) {
+      return Status::OK();
+    }
+    size_t length = KUDU_ALIGN_UP(buffered_, kDirectIoAlignment);
+    memset(buffer_->data() + buffered_, 0, length - buffered_);
+    ssize_t written;
+    RETRY_ON_EINTR(written, pwrite(fd_, buffer_->data(), length, buffer_offset_));
+    if (PREDICT_FALSE(written == -1)) {
+      return IOError(filename_, errno);
+    }
+    if (PREDICT_FALSE(written != length)) {
+      return Status::IOError(
+          Substitute("pwrite error: expected to write $0 bytes, wrote $1 bytes instead"
+                     " (perhaps the disk is out of space)",
+                     length, written));
+    }
+    padded_size_ = std::max(padded_size_, buffer_offset_ + length);
+
+    size_t whole_blocks = KUDU_ALIGN_DOWN(buffered_, kDirectIoAlignment);
+    buffered_ -= whole_blocks;
+    if (buffered_ > 0 && whole_blocks > 0) {
+      memmove(buffer_->data(), buffer_->data() + whole_blocks, buffered_);
+    }
+    buffer_offset_ += whole_blocks;
+    written_ = buffered_;
+    return Status::OK();
+  }
+
 
   Status DoWritev(const vector<Slice>& data_vector,
                   size_t offset, size_t n) {
@@ -441,15 +1032,32 @@ class PosixWritableFile : public WritableFile {
   uint64_t pre_allocated_size_;
 
   bool pending_sync_;
+
+  // With direct I/O: the appends not written yet, preceded by the beginning
+  // of the partial block they continue. Null with buffered I/O.
+  gscoped_ptr<AlignedBuffer> buffer_;
+
+  // The file offset of 'buffer_', aligned.
+  uint64_t buffer_offset_;
+
+  // The number of bytes in 'buffer_', of which the first 'written_' are
+  // already in the file.
+  size_t buffered_;
+  size_t written_;
+
+  // The end of the padding written past 'filesize_', truncated on Close().
+  uint64_t padded_size_;
 };
 
 class PosixRWFile : public RWFile {
  public:
-  PosixRWFile(string fname, int fd, bool sync_on_close)
+  // 'pending_sync' is set for a file which may hold the writes of an earlier
+  // handle, not synced yet.
+  PosixRWFile(string fname, int fd, bool sync_on_close, bool pending_sync)
       : filename_(std::move(fname)),
         fd_(fd),
         sync_on_close_(sync_on_close),
-        pending_sync_(false),
+        pending_sync_(pending_sync),
         closed_(false) {}
 
   ~PosixRWFile() {
@@ -672,7 +1280,18 @@ class PosixEnv : public Env {
       return IOError(fname, errno);
     }
 
-    result->reset(new PosixRandomAccessFile(fname, fd));
+    if (opts.use_mmap && !opts.direct_io) {
+      struct stat st;
+      if (fstat(fd, &st) == -1) {
+        int err = errno;
+        close(fd);
+        return IOError(fname, err);
+      }
+      return PosixMmapRandomAccessFile::Open(fname, fd, st.st_size, result);
+    }
+
+    bool direct_io = opts.direct_io && EnableDirectIo(fd, fname);
+    result->reset(new PosixRandomAccessFile(fname, fd, direct_io));
     return Status::OK();
   }
 
@@ -714,7 +1333,8 @@ class PosixEnv : public Env {
 //    TRACE_EVENT1("io", "PosixEnv::NewRWFile", "path", fname);
     int fd;
     RETURN_NOT_OK(DoOpen(fname, opts.mode, &fd));
-    result->reset(new PosixRWFile(fname, fd, opts.sync_on_close));
+    result->reset(new PosixRWFile(fname, fd, opts.sync_on_close,
+                                  opts.mode != CREATE_NON_EXISTING));
     return Status::OK();
   }
 
@@ -723,7 +1343,7 @@ class PosixEnv : public Env {
 //    TRACE_EVENT1("io", "PosixEnv::NewTempRWFile", "template", name_template);
     int fd;
     RETURN_NOT_OK(MkTmpFile(name_template, &fd, created_filename));
-    res->reset(new PosixRWFile(*created_filename, fd, opts.sync_on_close));
+    res->reset(new PosixRWFile(*created_filename, fd, opts.sync_on_close, false));
     return Status::OK();
   }
 
@@ -856,6 +1476,16 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status GetFileModifiedTime(const string& fname, int64_t* timestamp) OVERRIDE {
+    ThreadRestrictions::AssertIOAllowed();
+    struct stat sbuf;
+    if (stat(fname.c_str(), &sbuf) != 0) {
+      return IOError(fname, errno);
+    }
+    *timestamp = sbuf.st_mtim.tv_sec * 1000000LL + sbuf.st_mtim.tv_nsec / 1000;
+    return Status::OK();
+  }
+
   // Local convenience function for safely running statvfs().
   static Status StatVfs(const string& path, struct statvfs* buf) {
     ThreadRestrictions::AssertIOAllowed();
@@ -889,6 +1519,48 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status CopyRange(const string& src, uint64_t src_offset,
+                           const string& dst, uint64_t dst_offset,
+                           uint64_t length) OVERRIDE {
+    ThreadRestrictions::AssertIOAllowed();
+    int src_fd;
+    RETRY_ON_EINTR(src_fd, open(src.c_str(), O_RDONLY));
+    if (src_fd < 0) {
+      return IOError(src, errno);
+    }
+    ScopedFdCloser src_closer(src_fd);
+    struct stat st;
+    if (fstat(src_fd, &st) == -1) {
+      return IOError(src, errno);
+    }
+    if (src_offset + length > static_cast<uint64_t>(st.st_size)) {
+      return Status::InvalidArgument(
+          Substitute("Unable to copy $0 bytes at offset $1 of $2", length, src_offset, src),
+          Substitute("the file has $0 bytes", st.st_size));
+    }
+    int dst_fd;
+    RETRY_ON_EINTR(dst_fd, open(dst.c_str(), O_WRONLY | O_CREAT, 0644));
+    if (dst_fd < 0) {
+      return IOError(dst, errno);
+    }
+    ScopedFdCloser dst_closer(dst_fd);
+
+    CopyRangeState state = { src, src_fd, src_offset, dst, dst_fd, dst_offset, length };
+    if (FLAGS_env_use_copy_offload) {
+      CloneRange(&state, st.st_blksize);
+      if (state.remaining > 0) {
+        RETURN_NOT_OK(CopyFileRange(&state));
+      }
+      if (state.remaining > 0) {
+        RETURN_NOT_OK(SendFile(&state));
+      }
+    }
+    if (state.remaining > 0) {
+      RETURN_NOT_OK(CopyThroughBuffer(&state));
+    }
+    return Status::OK();
+  }
+
   virtual Status LockFile(const std::string& fname, FileLock** lock) OVERRIDE {
 //    TRACE_EVENT1("io", "PosixEnv::LockFile", "path", fname);
     ThreadRestrictions::AssertIOAllowed();
@@ -1081,6 +1753,15 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  virtual int64_t GetOpenFileLimit() OVERRIDE {
+    struct rlimit l;
+    PCHECK(getrlimit(RLIMIT_NOFILE, &l) == 0);
+    if (l.rlim_cur == RLIM_INFINITY) {
+      return std::numeric_limits<int64_t>::max();
+    }
+    return l.rlim_cur;
+  }
+
  private:
   // unique_ptr Deleter implementation for fts_close
   struct FtsCloser {
@@ -1111,7 +1792,12 @@ class PosixEnv : public Env {
     if (opts.mode == OPEN_EXISTING) {
       RETURN_NOT_OK(GetFileSize(fname, &file_size));
     }
-    result->reset(new PosixWritableFile(fname, fd, file_size, opts.sync_on_close));
+    unique_ptr<PosixWritableFile> file(
+        new PosixWritableFile(fname, fd, file_size, opts.sync_on_close));
+    if (opts.direct_io) {
+      RETURN_NOT_OK(file->EnableDirectIo());
+    }
+    result->reset(file.release());
     return Status::OK();
   }
 
@@ -20,6 +20,7 @@
 #include <glog/logging.h>
 
 #include "mprmpr/base/gscoped_ptr.h"
+#include "mprmpr/util/memory/memory.h"
 
 namespace mprmpr {
 
@@ -38,6 +39,10 @@ void faststring::GrowByAtLeast(size_t count) {
 
 void faststring::GrowArray(size_t newcapacity) {
   DCHECK_GE(newcapacity, capacity_);
+  if (allocator_ != nullptr) {
+    GrowBuffer(newcapacity);
+    return;
+  }
   gscoped_array<uint8_t> newdata(new uint8_t[newcapacity]);
   if (len_ > 0) {
     memcpy(&newdata[0], &data_[0], len_);
@@ -53,5 +58,30 @@ void faststring::GrowArray(size_t newcapacity) {
   ASAN_POISON_MEMORY_REGION(data_ + len_, capacity_ - len_);
 }
 
+void faststring::GrowBuffer(size_t newcapacity) {
+  if (buffer_ != nullptr) {
+    // Reallocate preserves the contents of the buffer.
+    ASAN_UNPOISON_MEMORY_REGION(data_, capacity_);
+    CHECK(allocator_->Reallocate(newcapacity, buffer_) != nullptr)
+        << "Unable to grow faststring to " << newcapacity << " bytes";
+  } else {
+    buffer_ = allocator_->Allocate(newcapacity);
+    CHECK(buffer_ != nullptr) << "Unable to allocate faststring of " << newcapacity << " bytes";
+    if (len_ > 0) {
+      memcpy(buffer_->data(), &data_[0], len_);
+    }
+    ASAN_POISON_MEMORY_REGION(initial_data_, arraysize(initial_data_));
+  }
+  data_ = reinterpret_cast<uint8_t*>(buffer_->data());
+  capacity_ = newcapacity;
+  ASAN_POISON_MEMORY_REGION(data_ + len_, capacity_ - len_);
+}
+
+void faststring::FreeBuffer() {
+  ASAN_UNPOISON_MEMORY_REGION(data_, capacity_);
+  delete buffer_;
+  buffer_ = nullptr;
+}
+
 
 } // namespace mprmpr
@@ -25,6 +25,9 @@
 
 namespace mprmpr {
 
+class Buffer;
+class BufferAllocator;
+
 // A faststring is similar to a std::string, except that it is faster for many
 // common use cases (in particular, resize() will fill with uninitialized data
 // instead of memsetting to \0)
@@ -33,14 +36,29 @@ class faststring {
   faststring() :
     data_(initial_data_),
     len_(0),
-    capacity_(kInitialCapacity) {
+    capacity_(kInitialCapacity),
+    allocator_(nullptr),
+    buffer_(nullptr) {
+  }
+
+  // Construct an empty string whose heap storage comes from 'allocator'
+  // (e.g. a PooledBufferAllocator) rather than new[]. 'allocator' must
+  // outlive the string. Allocation failures are fatal, as they are for new[].
+  explicit faststring(BufferAllocator* allocator) :
+    data_(initial_data_),
+    len_(0),
+    capacity_(kInitialCapacity),
+    allocator_(allocator),
+    buffer_(nullptr) {
   }
 
   // Construct a string with the given capacity, in bytes.
   explicit faststring(size_t capacity)
     : data_(initial_data_),
       len_(0),
-      capacity_(kInitialCapacity) {
+      capacity_(kInitialCapacity),
+      allocator_(nullptr),
+      buffer_(nullptr) {
     if (capacity > capacity_) {
       data_ = new uint8_t[capacity];
       capacity_ = capacity;
@@ -50,7 +68,9 @@ class faststring {
 
   ~faststring() {
     ASAN_UNPOISON_MEMORY_REGION(initial_data_, arraysize(initial_data_));
-    if (data_ != initial_data_) {
+    if (buffer_ != nullptr) {
+      FreeBuffer();
+    } else if (data_ != initial_data_) {
       delete[] data_;
     }
   }
@@ -82,9 +102,12 @@ class faststring {
   // NOTE: the data pointer returned by release() is not necessarily the pointer
   uint8_t *release() WARN_UNUSED_RESULT {
     uint8_t *ret = data_;
-    if (ret == initial_data_) {
+    if (ret == initial_data_ || buffer_ != nullptr) {
       ret = new uint8_t[len_];
       memcpy(ret, data_, len_);
+      if (buffer_ != nullptr) {
+        FreeBuffer();
+      }
     }
     len_ = 0;
     capacity_ = kInitialCapacity;
@@ -93,6 +116,20 @@ class faststring {
     return ret;
   }
 
+  // Free the underlying array; after this, the buffer is left empty, with its
+  // initial capacity.
+  void reset() {
+    if (buffer_ != nullptr) {
+      FreeBuffer();
+    } else if (data_ != initial_data_) {
+      delete[] data_;
+    }
+    len_ = 0;
+    capacity_ = kInitialCapacity;
+    data_ = initial_data_;
+    ASAN_POISON_MEMORY_REGION(data_, capacity_);
+  }
+
   // Reserve space for the given total amount of data. If the current capacity is already
   // larger than the newly requested capacity, this is a no-op (i.e. it does not ever free memory).
   //
@@ -227,6 +264,12 @@ class faststring {
   // the current capacity.
   void GrowArray(size_t newcapacity);
 
+  // Grow the array to the given capacity through 'allocator_'.
+  void GrowBuffer(size_t newcapacity);
+
+  // Free 'buffer_', which holds the array, leaving 'data_' dangling.
+  void FreeBuffer();
+
   enum {
     kInitialCapacity = 32
   };
@@ -235,6 +278,10 @@ class faststring {
   uint8_t initial_data_[kInitialCapacity];
   size_t len_;
   size_t capacity_;
+
+  // If set, the array is held by 'buffer_', obtained from 'allocator_'.
+  BufferAllocator* allocator_;
+  Buffer* buffer_;
 };
 
 } // namespace mprmpr
@@ -0,0 +1,388 @@
+#include "mprmpr/util/file_cache.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/malloc.h"
+
+METRIC_DEFINE_entity(file_cache);
+METRIC_DEFINE_counter(file_cache, file_cache_hits,
+                      "File Cache Hits",
+                      mprmpr::MetricUnit::kCacheHits,
+                      "Number of accesses to cached files which found the file open");
+METRIC_DEFINE_counter(file_cache, file_cache_misses,
+                      "File Cache Misses",
+                      mprmpr::MetricUnit::kCacheQueries,
+                      "Number of accesses to cached files which had to open the file");
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+namespace mprmpr {
+
+namespace {
+
+// The share of the open file limit used by default, in percent.
+const int kDefaultOpenFileLimitShare = 40;
+
+Status ReopenFile(Env* env, const string& file_name, shared_ptr<RandomAccessFile>* file) {
+  unique_ptr<RandomAccessFile> f;
+  RETURN_NOT_OK(env->NewRandomAccessFile(file_name, &f));
+  file->reset(f.release());
+  return Status::OK();
+}
+
+Status ReopenFile(Env* env, const string& file_name, shared_ptr<RWFile>* file) {
+  RWFileOptions opts;
+  opts.mode = Env::OPEN_EXISTING;
+  unique_ptr<RWFile> f;
+  RETURN_NOT_OK(env->NewRWFile(opts, file_name, &f));
+  file->reset(f.release());
+  return Status::OK();
+}
+
+int DefaultMaxOpenFiles(Env* env) {
+  int64_t limit = env->GetOpenFileLimit() / 100 * kDefaultOpenFileLimitShare;
+  return std::max<int64_t>(1, std::min<int64_t>(limit, std::numeric_limits<int>::max()));
+}
+
+} // anonymous namespace
+
+namespace internal {
+
+// The descriptors fetch the file from the cache for each operation, and
+// hold it for the duration of the operation only.
+
+template <>
+class Descriptor<RandomAccessFile> : public RandomAccessFile {
+ public:
+  Descriptor(FileCache<RandomAccessFile>* cache, string file_name)
+      : cache_(cache),
+        file_name_(std::move(file_name)) {
+  }
+
+  virtual ~Descriptor() {
+    cache_->DescriptorDestroyed(file_name_);
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      uint8_t *scratch) const OVERRIDE {
+    shared_ptr<RandomAccessFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Read(offset, n, result, scratch);
+  }
+
+  virtual Status Size(uint64_t *size) const OVERRIDE {
+    shared_ptr<RandomAccessFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Size(size);
+  }
+
+  virtual string filename() const OVERRIDE { return file_name_; }
+
+  virtual size_t memory_footprint() const OVERRIDE {
+    return ant_malloc_usable_size(this) + file_name_.capacity();
+  }
+
+ private:
+  FileCache<RandomAccessFile>* const cache_;
+  const string file_name_;
+
+  DISALLOW_COPY_AND_ASSIGN(Descriptor);
+};
+
+template <>
+class Descriptor<RWFile> : public RWFile {
+ public:
+  Descriptor(FileCache<RWFile>* cache, string file_name)
+      : cache_(cache),
+        file_name_(std::move(file_name)) {
+  }
+
+  virtual ~Descriptor() {
+    cache_->DescriptorDestroyed(file_name_);
+  }
+
+  virtual Status Read(uint64_t offset, size_t length,
+                      Slice* result, uint8_t* scratch) const OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Read(offset, length, result, scratch);
+  }
+
+  virtual Status Write(uint64_t offset, const Slice& data) OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Write(offset, data);
+  }
+
+  virtual Status PreAllocate(uint64_t offset, size_t length) OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->PreAllocate(offset, length);
+  }
+
+  virtual Status Truncate(uint64_t length) OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Truncate(length);
+  }
+
+  virtual Status PunchHole(uint64_t offset, size_t length) OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->PunchHole(offset, length);
+  }
+
+  virtual Status Flush(FlushMode mode, uint64_t offset, size_t length) OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Flush(mode, offset, length);
+  }
+
+  virtual Status Sync() OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Sync();
+  }
+
+  virtual Status Close() OVERRIDE {
+    // The file is shared: it is closed when evicted.
+    return Status::OK();
+  }
+
+  virtual Status Size(uint64_t* size) const OVERRIDE {
+    shared_ptr<RWFile> file;
+    RETURN_NOT_OK(cache_->GetFile(file_name_, &file));
+    return file->Size(size);
+  }
+
+  virtual string filename() const OVERRIDE { return file_name_; }
+
+ private:
+  FileCache<RWFile>* const cache_;
+  const string file_name_;
+
+  DISALLOW_COPY_AND_ASSIGN(Descriptor);
+};
+
+} // namespace internal
+
+template <class FileType>
+FileCache<FileType>::FileCache(const string& cache_name, Env* env, int max_open_files,
+                               MetricRegistry* metric_registry)
+    : cache_name_(cache_name),
+      env_(env),
+      max_open_files_(max_open_files > 0 ? max_open_files : DefaultMaxOpenFiles(env)),
+      hits_(0),
+      misses_(0) {
+  if (metric_registry) {
+    metric_entity_ = METRIC_ENTITY_file_cache.Instantiate(metric_registry, cache_name_);
+    hits_metric_ = METRIC_file_cache_hits.Instantiate(metric_entity_);
+    misses_metric_ = METRIC_file_cache_misses.Instantiate(metric_entity_);
+  }
+  VLOG(1) << Substitute("Constructed file cache $0 with capacity $1",
+                        cache_name_, max_open_files_);
+}
+
+template <class FileType>
+FileCache<FileType>::~FileCache() {
+  MutexLock l(lock_);
+  for (const auto& e : descriptors_) {
+    DCHECK(e.second.descriptor.expired()) << "Descriptor of " << e.first << " outlives "
+                                          << "the file cache " << cache_name_;
+  }
+}
+
+template <class FileType>
+Status FileCache<FileType>::OpenExistingFile(const string& file_name,
+                                             shared_ptr<FileType>* file) {
+  shared_ptr<internal::Descriptor<FileType>> descriptor;
+  {
+    MutexLock l(lock_);
+    auto it = descriptors_.find(file_name);
+    if (it != descriptors_.end()) {
+      if (it->second.deleted) {
+        return Status::NotFound(file_name, "File deleted, waiting for its descriptors");
+      }
+      descriptor = it->second.descriptor.lock();
+    }
+    if (!descriptor) {
+      descriptor.reset(new internal::Descriptor<FileType>(this, file_name));
+      DescriptorEntry& e = descriptors_[file_name];
+      e.descriptor = descriptor;
+      e.deleted = false;
+    }
+  }
+
+  // Open the file now, to report a missing file.
+  shared_ptr<FileType> f;
+  RETURN_NOT_OK(GetFile(file_name, &f));
+  *file = std::move(descriptor);
+  return Status::OK();
+}
+
+template <class FileType>
+Status FileCache<FileType>::DeleteFile(const string& file_name) {
+  vector<shared_ptr<FileType>> evicted;
+  MutexLock l(lock_);
+  auto it = open_files_.find(file_name);
+  if (it != open_files_.end()) {
+    evicted.push_back(std::move(it->second.file));
+    lru_.erase(it->second.lru_position);
+    open_files_.erase(it);
+  }
+  auto d = descriptors_.find(file_name);
+  if (d != descriptors_.end()) {
+    if (d->second.deleted) {
+      return Status::NotFound(file_name, "File already deleted");
+    }
+    if (!d->second.descriptor.expired()) {
+      d->second.deleted = true;
+      return Status::OK();
+    }
+  }
+  // Under the lock, so that the file is not opened again meanwhile.
+  return env_->DeleteFile(file_name);
+}
+
+template <class FileType>
+void FileCache<FileType>::Invalidate(const string& file_name) {
+  shared_ptr<FileType> evicted;
+  MutexLock l(lock_);
+  auto it = open_files_.find(file_name);
+  if (it != open_files_.end()) {
+    evicted = std::move(it->second.file);
+    lru_.erase(it->second.lru_position);
+    open_files_.erase(it);
+  }
+}
+
+template <class FileType>
+int FileCache<FileType>::num_open_files() const {
+  MutexLock l(lock_);
+  return open_files_.size();
+}
+
+template <class FileType>
+int64_t FileCache<FileType>::hits() const {
+  MutexLock l(lock_);
+  return hits_;
+}
+
+template <class FileType>
+int64_t FileCache<FileType>::misses() const {
+  MutexLock l(lock_);
+  return misses_;
+}
+
+template <class FileType>
+Status FileCache<FileType>::GetFile(const string& file_name, shared_ptr<FileType>* file) {
+  {
+    MutexLock l(lock_);
+    auto it = open_files_.find(file_name);
+    if (it != open_files_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+      *file = it->second.file;
+      hits_++;
+      if (hits_metric_) {
+        hits_metric_->Increment();
+      }
+      return Status::OK();
+    }
+    misses_++;
+    if (misses_metric_) {
+      misses_metric_->Increment();
+    }
+  }
+
+  // Open the file outside the lock, racing with other threads opening it.
+  shared_ptr<FileType> opened;
+  RETURN_NOT_OK(OpenFile(file_name, &opened));
+  vector<shared_ptr<FileType>> evicted;
+  MutexLock l(lock_);
+  auto it = open_files_.find(file_name);
+  if (it != open_files_.end()) {
+    *file = it->second.file;
+    return Status::OK();
+  }
+  lru_.push_front(file_name);
+  CachedFile& f = open_files_[file_name];
+  f.file = opened;
+  f.lru_position = lru_.begin();
+  EvictLocked(max_open_files_, &evicted);
+  *file = std::move(opened);
+  return Status::OK();
+}
+
+template <class FileType>
+Status FileCache<FileType>::OpenFile(const string& file_name, shared_ptr<FileType>* file) {
+  Status s = ReopenFile(env_, file_name, file);
+  if (s.posix_code() == EMFILE || s.posix_code() == ENFILE) {
+    // Out of file descriptors: close half of the cached files, and retry.
+    LOG(WARNING) << "Out of file descriptors opening " << file_name << " in file cache "
+                 << cache_name_ << ": closing cached files";
+    vector<shared_ptr<FileType>> evicted;
+    {
+      MutexLock l(lock_);
+      EvictLocked(open_files_.size() / 2, &evicted);
+    }
+    evicted.clear();
+    s = ReopenFile(env_, file_name, file);
+  }
+  return s;
+}
+
+template <class FileType>
+void FileCache<FileType>::EvictLocked(int max_open_files,
+                                      vector<shared_ptr<FileType>>* evicted) {
+  lock_.AssertAcquired();
+  while (open_files_.size() > static_cast<size_t>(max_open_files)) {
+    auto it = open_files_.find(lru_.back());
+    DCHECK(it != open_files_.end());
+    // Closed once the caller releases the lock, and the operations in
+    // flight on the file complete.
+    evicted->push_back(std::move(it->second.file));
+    open_files_.erase(it);
+    lru_.pop_back();
+  }
+}
+
+template <class FileType>
+void FileCache<FileType>::DescriptorDestroyed(const string& file_name) {
+  shared_ptr<FileType> evicted;
+  MutexLock l(lock_);
+  auto it = descriptors_.find(file_name);
+  if (it == descriptors_.end() || !it->second.descriptor.expired()) {
+    // Replaced by a new descriptor.
+    return;
+  }
+  bool deleted = it->second.deleted;
+  descriptors_.erase(it);
+  if (deleted) {
+    auto f = open_files_.find(file_name);
+    if (f != open_files_.end()) {
+      evicted = std::move(f->second.file);
+      lru_.erase(f->second.lru_position);
+      open_files_.erase(f);
+    }
+    WARN_NOT_OK(env_->DeleteFile(file_name),
+                Substitute("Unable to delete $0 from file cache $1", file_name, cache_name_));
+  }
+}
+
+// The file types supported by the cache.
+template class FileCache<RandomAccessFile>;
+template class FileCache<RWFile>;
+
+} // namespace mprmpr
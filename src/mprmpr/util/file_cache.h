@@ -0,0 +1,144 @@
+#ifndef KUDU_UTIL_FILE_CACHE_H
+#define KUDU_UTIL_FILE_CACHE_H
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class Env;
+
+namespace internal {
+template <class FileType>
+class Descriptor;
+} // namespace internal
+
+// A cache of open files, so that the files opened again and again (e.g. a
+// source asset read for each of its renditions, or read again on retry) do
+// not cost a path lookup and a new file each time, while capping the number
+// of file descriptors held open.
+//
+// OpenExistingFile() returns a descriptor standing for the file, shared by
+// all the threads opening the same file. The underlying file is opened on
+// first use and kept open in an LRU cache; a descriptor whose file was
+// evicted reopens it transparently. Evicted files are closed once the
+// operations using them complete.
+//
+// FileType is RandomAccessFile or RWFile. RWFiles are reopened with
+// Env::OPEN_EXISTING; their Close() is a no-op, the file is closed when
+// evicted.
+//
+// Files must be deleted through DeleteFile(), which defers the deletion
+// until the descriptors of the file are destroyed. A file replaced or
+// deleted behind the back of the cache must be invalidated.
+//
+// This class is thread-safe. It must outlive the descriptors it returned.
+template <class FileType>
+class FileCache {
+ public:
+  // Keeps up to 'max_open_files' files open. If not positive, a share of
+  // the open file limit of the process, leaving the rest for the other
+  // files and the sockets.
+  //
+  // If 'metric_registry' is not null, the hits and misses are reported
+  // there, under a 'file_cache' entity with the name of the cache as ID:
+  // each cache needs its own name.
+  FileCache(const std::string& cache_name, Env* env, int max_open_files,
+            MetricRegistry* metric_registry);
+
+  ~FileCache();
+
+  // Returns a descriptor for the existing file 'file_name', opening the
+  // file if it was not. Returns NotFound if the file does not exist or was
+  // deleted through DeleteFile().
+  Status OpenExistingFile(const std::string& file_name,
+                          std::shared_ptr<FileType>* file);
+
+  // Deletes 'file_name'. If descriptors of the file exist, the file is
+  // deleted when the last one is destroyed, and can no longer be opened
+  // until then.
+  Status DeleteFile(const std::string& file_name);
+
+  // Closes 'file_name' if open, so that it is reopened on next use, e.g.
+  // after the file was replaced by a rename.
+  void Invalidate(const std::string& file_name);
+
+  const std::string& name() const { return cache_name_; }
+
+  int max_open_files() const { return max_open_files_; }
+
+  // The number of files open in the cache.
+  int num_open_files() const;
+
+  // The accesses to the descriptors that found the file open or not.
+  int64_t hits() const;
+  int64_t misses() const;
+
+ private:
+  friend class internal::Descriptor<FileType>;
+
+  typedef std::list<std::string> LruList;
+
+  struct CachedFile {
+    std::shared_ptr<FileType> file;
+    LruList::iterator lru_position;
+  };
+
+  struct DescriptorEntry {
+    std::weak_ptr<internal::Descriptor<FileType>> descriptor;
+
+    // Deleted through DeleteFile(): unlinked once the descriptor is gone.
+    bool deleted;
+  };
+
+  // Stores in 'file' the open file 'file_name', opening it if needed.
+  Status GetFile(const std::string& file_name, std::shared_ptr<FileType>* file);
+
+  // Opens 'file_name', making room in the cache if the process is out of
+  // file descriptors.
+  Status OpenFile(const std::string& file_name, std::shared_ptr<FileType>* file);
+
+  // Removes the least recently used files until 'max_open_files' are open,
+  // moving them to 'evicted' to be closed outside the lock.
+  void EvictLocked(int max_open_files, std::vector<std::shared_ptr<FileType>>* evicted);
+
+  // Called by the descriptors of 'file_name' when destroyed.
+  void DescriptorDestroyed(const std::string& file_name);
+
+  const std::string cache_name_;
+  Env* const env_;
+  const int max_open_files_;
+
+  mutable Mutex lock_;
+
+  // The open files, and their use order, most recent first.
+  std::unordered_map<std::string, CachedFile> open_files_;
+  LruList lru_;
+
+  // The live descriptors, and the files deleted while they were.
+  std::unordered_map<std::string, DescriptorEntry> descriptors_;
+
+  int64_t hits_;
+  int64_t misses_;
+  scoped_refptr<MetricEntity> metric_entity_;
+  scoped_refptr<Counter> hits_metric_;
+  scoped_refptr<Counter> misses_metric_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileCache);
+};
+
+} // namespace mprmpr
+
+#endif // KUDU_UTIL_FILE_CACHE_H
@@ -0,0 +1,385 @@
+#include "mprmpr/util/memory/buffer_pool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/bits.h"
+#include "mprmpr/base/sysinfo.h"
+#include "mprmpr/util/alignment.h"
+#include "mprmpr/util/mem_tracker.h"
+#include "mprmpr/util/thread.h"
+
+DEFINE_int64(buffer_pool_limit_mb, -1,
+             "Maximum amount of memory, in MB, held by the process-wide buffer "
+             "pool, including slabs cached for reuse. -1 means no limit beyond "
+             "the process-wide --memory_limit_hard_bytes.");
+
+DEFINE_int32(buffer_pool_idle_release_ms, 30000,
+             "Slabs cached by the buffer pool which have not been reused for "
+             "this long are returned to the operating system.");
+
+namespace mprmpr {
+
+namespace {
+
+const size_t kPageSize = 4096;
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+// The most memory a per-CPU cache holds for a single size class. Larger slabs
+// go straight to the central freelists.
+const size_t kCpuCacheBytes = 4 * 1024 * 1024;
+
+char dummy_buffer[0] = {};
+
+size_t SizeClassBytes(int size_class) {
+  return static_cast<size_t>(1) << (size_class + PooledBufferAllocator::kMinSizeClassShift);
+}
+
+size_t MaxCachedSlabs(int size_class) {
+  return kCpuCacheBytes / SizeClassBytes(size_class);
+}
+
+} // anonymous namespace
+
+PooledBufferAllocator::PooledBufferAllocator()
+    : PooledBufferAllocator(MemTracker::FindOrCreateGlobalTracker(
+          FLAGS_buffer_pool_limit_mb < 0 ? -1 : FLAGS_buffer_pool_limit_mb * 1024 * 1024,
+          "buffer_pool")) {
+}
+
+PooledBufferAllocator::PooledBufferAllocator(std::shared_ptr<MemTracker> mem_tracker)
+    : mem_tracker_(std::move(mem_tracker)),
+      num_cpus_(base::MaxCPUIndex() + 1),
+      cpu_lists_(new FreeLists[num_cpus_]),
+      bytes_in_use_(0),
+      bytes_cached_(0),
+      last_release_nanos_(0),
+      release_thread_stop_latch_(1) {
+  CHECK_GT(num_cpus_, 0);
+  CHECK_OK(Thread::Create("buffer-pool", "idle-release", &PooledBufferAllocator::RunReleaseThread,
+                          this, &release_thread_));
+}
+
+PooledBufferAllocator::~PooledBufferAllocator() {
+  release_thread_stop_latch_.CountDown();
+  release_thread_->Join();
+  DCHECK_EQ(0, bytes_in_use_.Load());
+  ReleaseAllCachedMemory();
+}
+
+PooledBufferAllocator* PooledBufferAllocator::Get() {
+  return Singleton<PooledBufferAllocator>::get();
+}
+
+size_t PooledBufferAllocator::Available() const {
+  if (!mem_tracker_->has_limit()) {
+    return numeric_limits<size_t>::max();
+  }
+  // Cached slabs are released on demand, so they count as available.
+  return std::max<int64_t>(0, mem_tracker_->SpareCapacity() + bytes_cached_.Load());
+}
+
+int PooledBufferAllocator::SizeClassFor(size_t size) {
+  if (size <= (static_cast<size_t>(1) << (kMinSizeClassShift - 1)) ||
+      size > (static_cast<size_t>(1) << kMaxSizeClassShift)) {
+    return -1;
+  }
+  int shift = Bits::Log2Ceiling64(size);
+  return std::max(shift, kMinSizeClassShift) - kMinSizeClassShift;
+}
+
+size_t PooledBufferAllocator::BlockSize(size_t size) {
+  int size_class = SizeClassFor(size);
+  if (size_class >= 0) {
+    return SizeClassBytes(size_class);
+  }
+  if (size > (static_cast<size_t>(1) << kMaxSizeClassShift)) {
+    return KUDU_ALIGN_UP(size, kHugePageSize);
+  }
+  return size;
+}
+
+Buffer* PooledBufferAllocator::AllocateInternal(size_t requested,
+                                                size_t minimal,
+                                                BufferAllocator* originator) {
+  DCHECK_LE(minimal, requested);
+  if (requested == 0) {
+    return CreateBuffer(&dummy_buffer[0], 0, originator);
+  }
+  void* data = AllocateBlock(requested);
+  if (data != nullptr) {
+    return CreateBuffer(data, requested, originator);
+  }
+  if (minimal == requested) {
+    return nullptr;
+  }
+  if (minimal == 0) {
+    return CreateBuffer(&dummy_buffer[0], 0, originator);
+  }
+  data = AllocateBlock(minimal);
+  return data == nullptr ? nullptr : CreateBuffer(data, minimal, originator);
+}
+
+bool PooledBufferAllocator::ReallocateInternal(size_t requested,
+                                               size_t minimal,
+                                               Buffer* buffer,
+                                               BufferAllocator* /* originator */) {
+  DCHECK_LE(minimal, requested);
+  size_t old_size = buffer->size();
+
+  // Resizing within the same slab is free.
+  int old_class = SizeClassFor(old_size);
+  if (requested == old_size || (old_class >= 0 && old_class == SizeClassFor(requested))) {
+    UpdateBuffer(buffer->data(), requested, buffer);
+    return true;
+  }
+
+  size_t new_size = requested;
+  void* new_data = new_size == 0 ? &dummy_buffer[0] : AllocateBlock(new_size);
+  if (new_data == nullptr && minimal < requested) {
+    new_size = minimal;
+    new_data = new_size == 0 ? &dummy_buffer[0] : AllocateBlock(new_size);
+  }
+  if (new_data == nullptr) {
+    return false;
+  }
+  if (old_size > 0) {
+    memcpy(new_data, buffer->data(), std::min(old_size, new_size));
+    FreeBlock(buffer->data(), old_size);
+  }
+  UpdateBuffer(new_data, new_size, buffer);
+  return true;
+}
+
+void PooledBufferAllocator::FreeInternal(Buffer* buffer) {
+  if (buffer->size() > 0) {
+    FreeBlock(buffer->data(), buffer->size());
+  }
+}
+
+void* PooledBufferAllocator::AllocateBlock(size_t size) {
+  DCHECK_GT(size, 0);
+  int size_class = SizeClassFor(size);
+  void* data = nullptr;
+  if (size_class < 0) {
+    if (size > (static_cast<size_t>(1) << kMaxSizeClassShift)) {
+      data = MapBlock(BlockSize(size));
+    } else if (TryConsume(size)) {
+      data = malloc(size);
+      if (data == nullptr) {
+        mem_tracker_->Release(size);
+      }
+    }
+  } else {
+    size_t slab_size = SizeClassBytes(size_class);
+    for (FreeLists* lists : { CpuFreeLists(), &central_lists_ }) {
+      std::lock_guard<simple_spinlock> l(lists->lock);
+      std::deque<FreeSlab>* slabs = &lists->slabs[size_class];
+      if (!slabs->empty()) {
+        // Reuse the most recently freed slab: it is the most likely to
+        // still be resident and in cache.
+        data = slabs->back().data;
+        slabs->pop_back();
+        bytes_cached_.IncrementBy(-slab_size);
+        break;
+      }
+    }
+    if (data == nullptr) {
+      // Mapping a new slab is expensive enough to be worth checking whether
+      // another CPU has one cached, e.g. because the thread migrated.
+      data = StealCachedSlab(size_class);
+    }
+    if (data == nullptr) {
+      data = MapBlock(slab_size);
+    }
+  }
+  if (data != nullptr) {
+    bytes_in_use_.IncrementBy(BlockSize(size));
+  }
+  return data;
+}
+
+void* PooledBufferAllocator::StealCachedSlab(int size_class) {
+  for (int i = 0; i < num_cpus_; i++) {
+    FreeLists* lists = &cpu_lists_[i];
+    std::lock_guard<simple_spinlock> l(lists->lock);
+    std::deque<FreeSlab>* slabs = &lists->slabs[size_class];
+    if (!slabs->empty()) {
+      void* data = slabs->back().data;
+      slabs->pop_back();
+      bytes_cached_.IncrementBy(-SizeClassBytes(size_class));
+      return data;
+    }
+  }
+  return nullptr;
+}
+
+void PooledBufferAllocator::FreeBlock(void* data, size_t size) {
+  bytes_in_use_.IncrementBy(-BlockSize(size));
+  int size_class = SizeClassFor(size);
+  if (size_class < 0) {
+    if (size > (static_cast<size_t>(1) << kMaxSizeClassShift)) {
+      UnmapBlock(data, BlockSize(size));
+    } else {
+      free(data);
+      mem_tracker_->Release(size);
+    }
+    return;
+  }
+
+  FreeSlab slab = { data, MonoTime::Now() };
+  FreeLists* lists = CpuFreeLists();
+  {
+    std::lock_guard<simple_spinlock> l(lists->lock);
+    if (lists->slabs[size_class].size() >= MaxCachedSlabs(size_class)) {
+      lists = &central_lists_;
+    } else {
+      lists->slabs[size_class].push_back(slab);
+      lists = nullptr;
+    }
+  }
+  if (lists != nullptr) {
+    std::lock_guard<simple_spinlock> l(lists->lock);
+    lists->slabs[size_class].push_back(slab);
+  }
+  bytes_cached_.IncrementBy(SizeClassBytes(size_class));
+
+  MaybeReleaseIdleMemory();
+}
+
+void* PooledBufferAllocator::MapBlock(size_t length) {
+  if (!TryConsume(length)) {
+    return nullptr;
+  }
+  // Huge-page sized blocks are mapped with an extra huge page of slack, then
+  // trimmed so that they start on a huge page boundary.
+  size_t alignment = length >= kHugePageSize ? kHugePageSize : kPageSize;
+  size_t map_length = length + (alignment > kPageSize ? alignment : 0);
+  void* mapped = mmap(nullptr, map_length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    PLOG(WARNING) << "Unable to map " << map_length << " bytes for buffer pool";
+    mem_tracker_->Release(length);
+    return nullptr;
+  }
+  uint8_t* start = reinterpret_cast<uint8_t*>(mapped);
+  uint8_t* aligned = reinterpret_cast<uint8_t*>(
+      KUDU_ALIGN_UP(reinterpret_cast<uintptr_t>(start), alignment));
+  if (aligned > start) {
+    munmap(start, aligned - start);
+  }
+  uint8_t* end = start + map_length;
+  if (aligned + length < end) {
+    munmap(aligned + length, end - (aligned + length));
+  }
+#ifdef MADV_HUGEPAGE
+  if (alignment == kHugePageSize) {
+    // Only a hint: transparent huge pages may be disabled.
+    madvise(aligned, length, MADV_HUGEPAGE);
+  }
+#endif
+  return aligned;
+}
+
+void PooledBufferAllocator::UnmapBlock(void* data, size_t length) {
+  PCHECK(munmap(data, length) == 0);
+  mem_tracker_->Release(length);
+}
+
+bool PooledBufferAllocator::TryConsume(int64_t bytes) {
+  if (mem_tracker_->TryConsume(bytes)) {
+    return true;
+  }
+  if (bytes_cached_.Load() == 0) {
+    return false;
+  }
+  // The cached slabs count against the limit too: give them back and retry.
+  ReleaseAllCachedMemory();
+  return mem_tracker_->TryConsume(bytes);
+}
+
+PooledBufferAllocator::FreeLists* PooledBufferAllocator::CpuFreeLists() {
+  int cpu = sched_getcpu();
+  if (PREDICT_FALSE(cpu < 0 || cpu >= num_cpus_)) {
+    cpu = 0;
+  }
+  return &cpu_lists_[cpu];
+}
+
+void PooledBufferAllocator::MaybeReleaseIdleMemory() {
+  if (FLAGS_buffer_pool_idle_release_ms < 0) {
+    return;
+  }
+  // Scan for idle slabs at most twice per release interval. Only the thread
+  // winning the CAS scans; everyone else carries on.
+  int64_t now = (MonoTime::Now() - MonoTime::Min()).ToNanoseconds();
+  int64_t last = last_release_nanos_.Load();
+  int64_t interval = FLAGS_buffer_pool_idle_release_ms * MonoTime::kNanosecondsPerMillisecond;
+  if (now - last < interval / 2 || !last_release_nanos_.CompareAndSet(last, now)) {
+    return;
+  }
+  int64_t released = ReleaseIdleMemory(
+      MonoDelta::FromMilliseconds(FLAGS_buffer_pool_idle_release_ms));
+  VLOG_IF(1, released > 0) << "Released " << released << " idle bytes from buffer pool";
+}
+
+void PooledBufferAllocator::RunReleaseThread() {
+  // Frees only trigger a release while the pool is in use: this thread takes
+  // care of the slabs left cached once it is not.
+  while (true) {
+    int32_t interval_ms = FLAGS_buffer_pool_idle_release_ms;
+    MonoDelta wait = MonoDelta::FromMilliseconds(interval_ms < 0 ? 1000 : interval_ms / 2 + 1);
+    if (release_thread_stop_latch_.WaitFor(wait)) {
+      return;
+    }
+    if (bytes_cached_.Load() > 0) {
+      MaybeReleaseIdleMemory();
+    }
+  }
+}
+
+int64_t PooledBufferAllocator::ReleaseIdleMemory(const MonoDelta& idle_for) {
+  MonoTime cutoff = MonoTime::Now();
+  cutoff -= idle_for;
+  int64_t released = 0;
+  for (int i = 0; i < num_cpus_; i++) {
+    released += ReleaseSlabsFreedBefore(&cpu_lists_[i], cutoff);
+  }
+  released += ReleaseSlabsFreedBefore(&central_lists_, cutoff);
+  return released;
+}
+
+int64_t PooledBufferAllocator::ReleaseSlabsFreedBefore(FreeLists* lists,
+                                                       const MonoTime& cutoff) {
+  // Collect the slabs under the lock, but unmap them outside of it.
+  std::vector<std::pair<void*, size_t>> to_unmap;
+  {
+    std::lock_guard<simple_spinlock> l(lists->lock);
+    for (int size_class = 0; size_class < kNumSizeClasses; size_class++) {
+      std::deque<FreeSlab>* slabs = &lists->slabs[size_class];
+      // Slabs are pushed in the order they are freed, so the idle ones are
+      // at the front.
+      while (!slabs->empty() && !cutoff.ComesBefore(slabs->front().freed)) {
+        to_unmap.emplace_back(slabs->front().data, SizeClassBytes(size_class));
+        slabs->pop_front();
+      }
+    }
+  }
+  int64_t released = 0;
+  for (const auto& slab : to_unmap) {
+    UnmapBlock(slab.first, slab.second);
+    released += slab.second;
+  }
+  bytes_cached_.IncrementBy(-released);
+  return released;
+}
+
+}  // namespace mprmpr
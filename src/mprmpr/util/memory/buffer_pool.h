@@ -0,0 +1,173 @@
+#ifndef KUDU_UTIL_MEMORY_BUFFER_POOL_H_
+#define KUDU_UTIL_MEMORY_BUFFER_POOL_H_
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/port.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/countdown_latch.h"
+#include "mprmpr/util/locks.h"
+#include "mprmpr/util/memory/memory.h"
+#include "mprmpr/util/monotime.h"
+
+namespace mprmpr {
+
+class MemTracker;
+class Thread;
+
+// BufferAllocator for large, short-lived buffers such as media chunks
+// (64KB-16MB), which would otherwise fragment the heap and make the RSS of a
+// long-running process creep up.
+//
+// Requests are rounded up to a power-of-two size class and served from
+// mmap'd slabs. Freed slabs are kept on a per-size-class freelist for reuse:
+// first on a small per-CPU cache, which is uncontended in the common case
+// where a buffer is freed on the same CPU it was allocated on, then on a
+// central list. Slabs of 2MB and above are 2MB aligned and advised as huge
+// pages. Slabs that stay unused for --buffer_pool_idle_release_ms are
+// unmapped by a background thread, returning the memory to the OS even if the
+// pool is no longer used at all.
+//
+// Requests below the smallest size class are served from the heap, and
+// requests above the largest are mapped and unmapped directly. All the other
+// buffers are page-aligned, as direct I/O requires.
+//
+// Every byte the pool holds from the OS, whether handed out or cached, is
+// charged to its MemTracker. If the tracker's limit is reached, the cached
+// slabs are released and the request retried; if that is not enough, the
+// allocation fails. Note that layering a MemoryTrackingBufferAllocator on top
+// (e.g. for a MemoryTrackingArena) charges the buffers to that tracker too.
+//
+// This class is thread-safe.
+class PooledBufferAllocator : public BufferAllocator {
+ public:
+  // Smallest and largest pooled size classes, as powers of two.
+  static const int kMinSizeClassShift = 16;
+  static const int kMaxSizeClassShift = 24;
+  static const int kNumSizeClasses = kMaxSizeClassShift - kMinSizeClassShift + 1;
+
+  // Creates a pool charging 'mem_tracker', whose limit (if any) is the upper
+  // bound on the memory held by the pool.
+  explicit PooledBufferAllocator(std::shared_ptr<MemTracker> mem_tracker);
+
+  // Unmaps all cached slabs. All buffers must have been freed.
+  virtual ~PooledBufferAllocator();
+
+  // Returns the process-wide pool, charging the "buffer_pool" tracker limited
+  // to --buffer_pool_limit_mb.
+  static PooledBufferAllocator* Get();
+
+  virtual size_t Available() const OVERRIDE;
+
+  // Unmaps the cached slabs which have not been used for at least 'idle_for'.
+  // Returns the number of bytes released.
+  int64_t ReleaseIdleMemory(const MonoDelta& idle_for);
+
+  // Unmaps all cached slabs. Returns the number of bytes released.
+  int64_t ReleaseAllCachedMemory() {
+    return ReleaseIdleMemory(MonoDelta::FromNanoseconds(0));
+  }
+
+  // The number of bytes currently handed out to buffers.
+  int64_t bytes_in_use() const { return bytes_in_use_.Load(); }
+
+  // The number of bytes held in freelists for reuse.
+  int64_t bytes_cached() const { return bytes_cached_.Load(); }
+
+  const std::shared_ptr<MemTracker>& mem_tracker() const { return mem_tracker_; }
+
+ private:
+  friend class Singleton<PooledBufferAllocator>;
+
+  struct FreeSlab {
+    void* data;
+    MonoTime freed;
+  };
+
+  // A freelist per size class, protected by 'lock'.
+  struct FreeLists {
+    simple_spinlock lock;
+    std::deque<FreeSlab> slabs[kNumSizeClasses];
+  };
+
+  PooledBufferAllocator();
+
+  virtual Buffer* AllocateInternal(size_t requested,
+                                   size_t minimal,
+                                   BufferAllocator* originator) OVERRIDE;
+
+  virtual bool ReallocateInternal(size_t requested,
+                                  size_t minimal,
+                                  Buffer* buffer,
+                                  BufferAllocator* originator) OVERRIDE;
+
+  virtual void FreeInternal(Buffer* buffer) OVERRIDE;
+
+  // Returns the size class for a request of 'size' bytes, or -1 if the
+  // request is not pooled.
+  static int SizeClassFor(size_t size);
+
+  // Returns the number of bytes actually backing a request of 'size' bytes.
+  static size_t BlockSize(size_t size);
+
+  // Allocates the memory backing a buffer of 'size' bytes, or returns NULL
+  // if it would exceed the tracker's limit or the OS is out of memory.
+  void* AllocateBlock(size_t size);
+
+  // Takes a slab of 'size_class' from any CPU's cache, or returns NULL.
+  void* StealCachedSlab(int size_class);
+
+  // Frees memory obtained from AllocateBlock(size).
+  void FreeBlock(void* data, size_t size);
+
+  // Maps 'length' bytes from the OS, charging the tracker. Returns NULL on
+  // failure.
+  void* MapBlock(size_t length);
+  void UnmapBlock(void* data, size_t length);
+
+  // Charges 'bytes' to the tracker, releasing cached slabs if needed to stay
+  // under its limit.
+  bool TryConsume(int64_t bytes);
+
+  // Returns the freelists for the calling thread's CPU.
+  FreeLists* CpuFreeLists();
+
+  // Runs ReleaseIdleMemory() if it hasn't run for a while.
+  void MaybeReleaseIdleMemory();
+
+  // Body of 'release_thread_': calls MaybeReleaseIdleMemory() periodically
+  // until 'release_thread_stop_latch_' is counted down.
+  void RunReleaseThread();
+
+  // Unmaps the slabs of 'lists' freed before 'cutoff'. Returns the number of
+  // bytes released.
+  int64_t ReleaseSlabsFreedBefore(FreeLists* lists, const MonoTime& cutoff);
+
+  std::shared_ptr<MemTracker> mem_tracker_;
+
+  // Per-CPU caches, each holding up to kCpuCacheBytes per size class.
+  const int num_cpus_;
+  gscoped_array<FreeLists> cpu_lists_;
+
+  FreeLists central_lists_;
+
+  AtomicInt<int64_t> bytes_in_use_;
+  AtomicInt<int64_t> bytes_cached_;
+
+  // When ReleaseIdleMemory() last ran, in nanoseconds since the epoch of
+  // MonoTime.
+  AtomicInt<int64_t> last_release_nanos_;
+
+  scoped_refptr<Thread> release_thread_;
+  CountDownLatch release_thread_stop_latch_;
+
+  DISALLOW_COPY_AND_ASSIGN(PooledBufferAllocator);
+};
+
+}  // namespace mprmpr
+
+#endif  // KUDU_UTIL_MEMORY_BUFFER_POOL_H_
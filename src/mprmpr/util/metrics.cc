@@ -30,6 +30,11 @@ TAG_FLAG(metrics_retirement_age_ms, runtime);
 TAG_FLAG(metrics_retirement_age_ms, advanced);
 #endif
 
+DEFINE_int32(metrics_tombstone_retention_ms, 10 * 60 * 1000,
+  "The number of milliseconds a retired metric or entity is still reported "
+  "to delta scrapers (those passing since_epoch) after it has been retired. "
+  "Scrapers which poll less often than this may miss retirements. (Advanced option)");
+
 
 // Process/server-wide metrics should go into the 'server' entity.
 // More complex applications will define other entities.
@@ -148,7 +153,8 @@ MetricEntity::MetricEntity(const MetricEntityPrototype* prototype,
                            std::string id, AttributeMap attributes)
     : prototype_(prototype),
       id_(std::move(id)),
-      attributes_(std::move(attributes)) {}
+      attributes_(std::move(attributes)),
+      attributes_epoch_(Metric::current_epoch()) {}
 
 MetricEntity::~MetricEntity() {
 }
@@ -179,6 +185,14 @@ bool MatchMetricInList(const string& metric_name,
   return false;
 }
 
+// Drops the tombstones older than FLAGS_metrics_tombstone_retention_ms.
+void PruneTombstones(const MonoTime& now, std::deque<MetricTombstone>* tombstones) {
+  MonoDelta retention = MonoDelta::FromMilliseconds(FLAGS_metrics_tombstone_retention_ms);
+  while (!tombstones->empty() && tombstones->front().retire_time + retention < now) {
+    tombstones->pop_front();
+  }
+}
+
 } // anonymous namespace
 
 
@@ -191,23 +205,43 @@ Status MetricEntity::WriteAsJson(JsonWriter* writer,
   typedef std::map<const char*, scoped_refptr<Metric> > OrderedMetricMap;
   OrderedMetricMap metrics;
   AttributeMap attrs;
+  vector<string> retired_metrics;
+  bool attrs_modified;
+  const int64_t since_epoch = opts.only_modified_in_or_after_epoch;
   {
     // Snapshot the metrics in this registry (not guaranteed to be a consistent snapshot)
     std::lock_guard<simple_spinlock> l(lock_);
     attrs = attributes_;
+    attrs_modified = attributes_epoch_ >= since_epoch;
     for (const MetricMap::value_type& val : metric_map_) {
       const MetricPrototype* prototype = val.first;
       const scoped_refptr<Metric>& metric = val.second;
 
-      if (select_all || MatchMetricInList(prototype->name(), requested_metrics)) {
+      if ((select_all || MatchMetricInList(prototype->name(), requested_metrics)) &&
+          metric->ModifiedInOrAfterEpoch(since_epoch)) {
         InsertOrDie(&metrics, prototype->name(), metric);
       }
     }
+    if (since_epoch > 0) {
+      for (const MetricTombstone& t : tombstones_) {
+        if (t.epoch >= since_epoch &&
+            (select_all || MatchMetricInList(t.name, requested_metrics))) {
+          retired_metrics.push_back(t.name);
+        }
+      }
+    }
   }
 
   // If we had a filter, and we didn't either match this entity or any metrics inside
   // it, don't print the entity at all.
-  if (!requested_metrics.empty() && !select_all && metrics.empty()) {
+  if (!requested_metrics.empty() && !select_all &&
+      metrics.empty() && retired_metrics.empty()) {
+    return Status::OK();
+  }
+
+  // Likewise, a delta scrape skips entities in which nothing has changed.
+  if (since_epoch > 0 && !attrs_modified &&
+      metrics.empty() && retired_metrics.empty()) {
     return Status::OK();
   }
 
@@ -234,6 +268,14 @@ Status MetricEntity::WriteAsJson(JsonWriter* writer,
                 strings::Substitute("Failed to write $0 as JSON", val.first));
 
   }
+  for (const string& name : retired_metrics) {
+    writer->StartObject();
+    writer->String("name");
+    writer->String(name);
+    writer->String("retired");
+    writer->Bool(true);
+    writer->EndObject();
+  }
   writer->EndArray();
 
   writer->EndObject();
@@ -282,8 +324,11 @@ void MetricEntity::RetireOldMetrics() {
 
 
     VLOG(2) << "Retiring metric " << it->first;
+    tombstones_.push_back({ it->first->name(), Metric::current_epoch(), now });
     metric_map_.erase(it++);
   }
+
+  PruneTombstones(now, &tombstones_);
 }
 
 void MetricEntity::NeverRetire(const scoped_refptr<Metric>& metric) {
@@ -294,11 +339,13 @@ void MetricEntity::NeverRetire(const scoped_refptr<Metric>& metric) {
 void MetricEntity::SetAttributes(const AttributeMap& attrs) {
   std::lock_guard<simple_spinlock> l(lock_);
   attributes_ = attrs;
+  attributes_epoch_ = Metric::current_epoch();
 }
 
 void MetricEntity::SetAttribute(const string& key, const string& val) {
   std::lock_guard<simple_spinlock> l(lock_);
   attributes_[key] = val;
+  attributes_epoch_ = Metric::current_epoch();
 }
 
 //
@@ -315,9 +362,17 @@ Status MetricRegistry::WriteAsJson(JsonWriter* writer,
                                    const vector<string>& requested_metrics,
                                    const MetricJsonOptions& opts) const {
   EntityMap entities;
+  vector<MetricTombstone> retired_entities;
   {
     std::lock_guard<simple_spinlock> l(lock_);
     entities = entities_;
+    if (opts.only_modified_in_or_after_epoch > 0) {
+      for (const MetricTombstone& t : tombstones_) {
+        if (t.epoch >= opts.only_modified_in_or_after_epoch) {
+          retired_entities.push_back(t);
+        }
+      }
+    }
   }
 
   writer->StartArray();
@@ -325,6 +380,14 @@ Status MetricRegistry::WriteAsJson(JsonWriter* writer,
     WARN_NOT_OK(e.second->WriteAsJson(writer, requested_metrics, opts),
                 Substitute("Failed to write entity $0 as JSON", e.second->id()));
   }
+  for (const MetricTombstone& t : retired_entities) {
+    writer->StartObject();
+    writer->String("id");
+    writer->String(t.name);
+    writer->String("retired");
+    writer->Bool(true);
+    writer->EndObject();
+  }
   writer->EndArray();
 
   // Rather than having a thread poll metrics periodically to retire old ones,
@@ -338,6 +401,8 @@ Status MetricRegistry::WriteAsJson(JsonWriter* writer,
 }
 
 void MetricRegistry::RetireOldMetrics() {
+  MonoTime now(MonoTime::Now());
+
   std::lock_guard<simple_spinlock> l(lock_);
   for (auto it = entities_.begin(); it != entities_.end();) {
     it->second->RetireOldMetrics();
@@ -347,11 +412,14 @@ void MetricRegistry::RetireOldMetrics() {
       // Unlike retiring the metrics themselves, we don't wait for any timeout
       // to retire them -- we assume that that timed retention has been satisfied
       // by holding onto the metrics inside the entity.
+      tombstones_.push_back({ it->first, Metric::current_epoch(), now });
       entities_.erase(it++);
     } else {
       ++it;
     }
   }
+
+  PruneTombstones(now, &tombstones_);
 }
 
 //
@@ -469,8 +537,13 @@ scoped_refptr<MetricEntity> MetricRegistry::FindOrCreateEntity(
 //
 // Metric
 //
+
+// Start at 1 so that an epoch of 0 selects every metric.
+AtomicInt<int64_t> Metric::g_epoch_(1);
+
 Metric::Metric(const MetricPrototype* prototype)
-  : prototype_(prototype) {
+  : prototype_(prototype),
+    m_epoch_(current_epoch()) {
 }
 
 Metric::~Metric() {
@@ -507,6 +580,7 @@ std::string StringGauge::value() const {
 }
 
 void StringGauge::set_value(const std::string& value) {
+  UpdateModificationEpoch();
   std::lock_guard<simple_spinlock> l(lock_);
   value_ = value;
 }
@@ -536,6 +610,7 @@ void Counter::Increment() {
 }
 
 void Counter::IncrementBy(int64_t amount) {
+  UpdateModificationEpoch();
   value_.IncrementBy(amount);
 }
 
@@ -585,10 +660,12 @@ Histogram::Histogram(const HistogramPrototype* proto)
 }
 
 void Histogram::Increment(int64_t value) {
+  UpdateModificationEpoch();
   histogram_->Increment(value);
 }
 
 void Histogram::IncrementBy(int64_t value, int64_t amount) {
+  UpdateModificationEpoch();
   histogram_->IncrementBy(value, amount);
 }
 
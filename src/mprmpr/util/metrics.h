@@ -2,6 +2,7 @@
 #define KUDU_UTIL_METRICS_H
 
 #include <algorithm>
+#include <deque>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -169,7 +170,8 @@ class MetricType {
 struct MetricJsonOptions {
   MetricJsonOptions() :
     include_raw_histograms(false),
-    include_schema_info(false) {
+    include_schema_info(false),
+    only_modified_in_or_after_epoch(0) {
   }
 
   // Include the raw histogram values and counts in the JSON output.
@@ -182,6 +184,13 @@ struct MetricJsonOptions {
   // unit, etc).
   // Default: false
   bool include_schema_info;
+
+  // Only include metrics which have been modified in or after this epoch,
+  // along with tombstones for any metrics or entities retired since then.
+  // Scrapers obtain the epoch to pass on their next call from
+  // Metric::IncrementEpoch(). See Metric::current_epoch().
+  // Default: 0 (all metrics, no tombstones)
+  int64_t only_modified_in_or_after_epoch;
 };
 
 class MetricEntityPrototype {
@@ -211,6 +220,20 @@ class MetricEntityPrototype {
   DISALLOW_COPY_AND_ASSIGN(MetricEntityPrototype);
 };
 
+// A record of a retired metric or entity, kept for a while after retirement so
+// that scrapers using MetricJsonOptions::only_modified_in_or_after_epoch learn
+// about the removal.
+struct MetricTombstone {
+  // The metric name or entity ID which was retired.
+  std::string name;
+
+  // The epoch in which it was retired.
+  int64_t epoch;
+
+  // The time at which it was retired.
+  MonoTime retire_time;
+};
+
 class MetricEntity : public base::RefCountedThreadSafe<MetricEntity> {
  public:
   typedef std::unordered_map<const MetricPrototype*, scoped_refptr<Metric> > MetricMap;
@@ -264,6 +287,11 @@ class MetricEntity : public base::RefCountedThreadSafe<MetricEntity> {
     return metric_map_.size();
   }
 
+  int num_tombstones() const {
+    std::lock_guard<simple_spinlock> l(lock_);
+    return tombstones_.size();
+  }
+
  private:
   friend class MetricRegistry;
   friend class base::RefCountedThreadSafe<MetricEntity>;
@@ -290,6 +318,13 @@ class MetricEntity : public base::RefCountedThreadSafe<MetricEntity> {
 
   // The set of metrics which should never be retired. Protected by lock_.
   std::vector<scoped_refptr<Metric> > never_retire_metrics_;
+
+  // The epoch in which the attributes were last changed. Protected by lock_.
+  int64_t attributes_epoch_;
+
+  // Metrics retired by RetireOldMetrics(), in retirement order, so that delta
+  // scrapes can report them as removed. Protected by lock_.
+  std::deque<MetricTombstone> tombstones_;
 };
 
 // Base class to allow for putting all metrics into a single container.
@@ -302,10 +337,42 @@ class Metric : public base::RefCountedThreadSafe<Metric> {
 
   const MetricPrototype* prototype() const { return prototype_; }
 
+  // Return true if this metric has been modified in or after the given epoch.
+  virtual bool ModifiedInOrAfterEpoch(int64_t epoch) const {
+    return m_epoch_.Load() >= epoch;
+  }
+
+  // Return the current epoch.
+  //
+  // The epoch is a process-wide counter which is advanced by each delta scrape.
+  // Every metric remembers the epoch in which it was last modified, so a scraper
+  // which passes the epoch returned by its previous IncrementEpoch() call as
+  // MetricJsonOptions::only_modified_in_or_after_epoch only receives the metrics
+  // which changed in the meantime.
+  static int64_t current_epoch() {
+    return g_epoch_.Load();
+  }
+
+  // Advance the current epoch, returning the new value.
+  static int64_t IncrementEpoch() {
+    return g_epoch_.Increment();
+  }
+
  protected:
   explicit Metric(const MetricPrototype* prototype);
   virtual ~Metric();
 
+  // Record that this metric was modified in the current epoch.
+  //
+  // This is on the hot path of every metric update, so the common case where
+  // the metric was already touched in this epoch is a pair of loads.
+  void UpdateModificationEpoch() {
+    int64_t current = current_epoch();
+    if (PREDICT_FALSE(m_epoch_.Load() < current)) {
+      m_epoch_.StoreMax(current);
+    }
+  }
+
   const MetricPrototype* const prototype_;
 
  private:
@@ -317,6 +384,11 @@ class Metric : public base::RefCountedThreadSafe<Metric> {
   // uninitialized.
   MonoTime retire_time_;
 
+  // The epoch in which this metric was last modified.
+  AtomicInt<int64_t> m_epoch_;
+
+  static AtomicInt<int64_t> g_epoch_;
+
   DISALLOW_COPY_AND_ASSIGN(Metric);
 };
 
@@ -362,6 +434,9 @@ class MetricRegistry {
   typedef std::unordered_map<std::string, scoped_refptr<MetricEntity> > EntityMap;
   EntityMap entities_;
 
+  // Entities removed by RetireOldMetrics(), in retirement order. Protected by lock_.
+  std::deque<MetricTombstone> tombstones_;
+
   mutable simple_spinlock lock_;
   DISALLOW_COPY_AND_ASSIGN(MetricRegistry);
 };
@@ -538,12 +613,15 @@ class AtomicGauge : public Gauge {
     return static_cast<T>(value_.Load(kMemOrderRelease));
   }
   virtual void set_value(const T& value) {
+    UpdateModificationEpoch();
     value_.Store(static_cast<int64_t>(value), kMemOrderNoBarrier);
   }
   void Increment() {
+    UpdateModificationEpoch();
     value_.IncrementBy(1, kMemOrderNoBarrier);
   }
   virtual void IncrementBy(int64_t amount) {
+    UpdateModificationEpoch();
     value_.IncrementBy(amount, kMemOrderNoBarrier);
   }
   void Decrement() {
@@ -632,6 +710,11 @@ class FunctionGauge : public Gauge {
     writer->Value(value());
   }
 
+  // The value is computed on demand, so we can't know whether it changed.
+  virtual bool ModifiedInOrAfterEpoch(int64_t epoch) const OVERRIDE {
+    return true;
+  }
+
   // Reset this FunctionGauge to return a specific value.
   // This should be used during destruction. If you want a settable
   // Gauge, use a normal Gauge instead of a FunctionGauge.
@@ -0,0 +1,121 @@
+#ifndef KUDU_UTIL_MPSC_RING_BUFFER_H
+#define KUDU_UTIL_MPSC_RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/port.h"
+#include "mprmpr/util/atomic.h"
+
+namespace mprmpr {
+
+// A bounded queue for many producers and one consumer, without locks.
+//
+// Each slot carries a sequence number telling whether it is free for the
+// producer claiming it or holds an element for the consumer. Producers
+// claim a slot with a compare-and-swap on the enqueue position, then
+// publish the element by bumping the sequence number of the slot, so they
+// neither wait on each other nor on the consumer (see D. Vyukov's bounded
+// MPMC queue, here with a single consumer).
+//
+// TryPush() fails rather than waits when the buffer is full; TryPop() may
+// fail while an element claimed before the next ones is being published.
+template <typename T>
+class MpscRingBuffer {
+ public:
+  // Holds up to 'capacity' elements, rounded up to a power of 2.
+  explicit MpscRingBuffer(size_t capacity)
+      : mask_(RoundUpToPowerOf2(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for (size_t i = 0; i <= mask_; i++) {
+      cells_[i].sequence.Store(i, kMemOrderNoBarrier);
+    }
+  }
+
+  // Moves 'value' to the buffer. Returns false, leaving 'value' unchanged,
+  // if the buffer is full.
+  //
+  // Thread-safe.
+  bool TryPush(T&& value) {
+    Cell* cell;
+    int64_t pos = enqueue_pos_.Load(kMemOrderNoBarrier);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      int64_t seq = cell->sequence.Load(kMemOrderAcquire);
+      if (seq == pos) {
+        int64_t prev = enqueue_pos_.CompareAndSwap(pos, pos + 1, kMemOrderNoBarrier);
+        if (prev == pos) {
+          break;
+        }
+        pos = prev;
+      } else if (seq < pos) {
+        // The slot still holds the element pushed one lap ago.
+        return false;
+      } else {
+        // Claimed by another producer since 'pos' was loaded.
+        pos = enqueue_pos_.Load(kMemOrderNoBarrier);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.Store(pos + 1, kMemOrderRelease);
+    return true;
+  }
+
+  // Moves the oldest element to 'value'. Returns false if there is none
+  // published.
+  //
+  // Must not be called concurrently.
+  bool TryPop(T* value) {
+    Cell* cell = &cells_[dequeue_pos_ & mask_];
+    if (cell->sequence.Load(kMemOrderAcquire) != dequeue_pos_ + 1) {
+      return false;
+    }
+    *value = std::move(cell->value);
+    cell->sequence.Store(dequeue_pos_ + mask_ + 1, kMemOrderRelease);
+    dequeue_pos_++;
+    return true;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    Cell() : sequence(0) {}
+
+    AtomicInt<int64_t> sequence;
+    T value;
+  };
+
+  static size_t RoundUpToPowerOf2(size_t n) {
+    CHECK_GT(n, 0);
+    size_t rounded = 1;
+    while (rounded < n) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+
+  // Written by the producers and the consumer respectively; kept on
+  // separate cache lines.
+  char pad0_[CACHELINE_SIZE];
+  AtomicInt<int64_t> enqueue_pos_;
+  char pad1_[CACHELINE_SIZE];
+  int64_t dequeue_pos_;
+
+  DISALLOW_COPY_AND_ASSIGN(MpscRingBuffer);
+};
+
+} // namespace mprmpr
+
+#endif // KUDU_UTIL_MPSC_RING_BUFFER_H
@@ -27,6 +27,7 @@
 
 #include "mprmpr/base/bind.h"
 #include "mprmpr/base/callback.h"
+#include "mprmpr/base/gscoped_ptr.h"
 #include "mprmpr/base/map-util.h"
 #include "mprmpr/base/strings/escaping.h"
 #include "mprmpr/base/strings/fastmem.h"
@@ -34,17 +35,36 @@
 
 #include "mprmpr/util/coding-inl.h"
 #include "mprmpr/util/coding.h"
+#include "mprmpr/util/countdown_latch.h"
 #include "mprmpr/util/crc32c.h"
 //#include "mprmpr/util/debug/sanitizer_scopes.h"
 //#include "mprmpr/util/debug/trace_event.h"
 #include "mprmpr/util/env.h"
 #include "mprmpr/util/env_util.h"
 #include "mprmpr/util/jsonwriter.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
 #include "mprmpr/util/mutex.h"
 #include "mprmpr/util/path_util.h"
 #include "mprmpr/util/pb_util-internal.h"
 #include "mprmpr/util/pb_util.pb.h"
+#include "mprmpr/util/scoped_cleanup.h"
 #include "mprmpr/util/status.h"
+#include "mprmpr/util/threadpool.h"
+
+METRIC_DEFINE_histogram(server, pb_container_group_commit_latency,
+                        "PB Container Group Commit Latency",
+                        mprmpr::MetricUnit::kMicroseconds,
+                        "Number of microseconds from the append of a record to a "
+                        "protobuf container file by group commit until it is durable.",
+                        60000000LU, 2);
+
+METRIC_DEFINE_histogram(server, pb_container_group_commit_batch_size,
+                        "PB Container Group Commit Batch Size",
+                        mprmpr::MetricUnit::kEntries,
+                        "Number of records written and synced to a protobuf "
+                        "container file per group commit.",
+                        100000LU, 2);
 
 using google::protobuf::Descriptor;
 using google::protobuf::DescriptorPool;
@@ -225,11 +245,9 @@ Status ValidateAndReadData(ReadableFileType* reader, uint64_t file_size,
 Status ParseAndCompareChecksum(const uint8_t* checksum_buf,
                                const initializer_list<Slice>& slices) {
   uint32_t written_checksum = DecodeFixed32(checksum_buf);
-  uint64_t actual_checksum = 0;
-  //Crc* crc32c = crc32::GetCrc32cInstance();
+  uint32_t actual_checksum = 0;
   for (Slice s : slices) {
-    //crc32c->Compute(s.data(), s.size(), &actual_checksum);
-    actual_checksum = mprmpr::crc32c::Crc32c((const char *)s.data(), s.size());
+    actual_checksum = crc32c::Extend(actual_checksum, (const char *)s.data(), s.size());
   }
   if (PREDICT_FALSE(actual_checksum != written_checksum)) {
     return Status::Corruption(Substitute("Checksum does not match. Expected: $0. Actual: $1",
@@ -739,6 +757,94 @@ void WritablePBContainerFile::PopulateDescriptorSet(
   all_descs.Swap(output);
 }
 
+// A caller of AppendAndSync(), waiting for its record to be committed.
+struct GroupCommitPBContainerFile::Writer {
+  Writer() : done(false) {}
+
+  faststring record;
+  MonoTime queued_time;
+
+  // Set by the writer committing the record.
+  Status status;
+  bool done;
+};
+
+GroupCommitPBContainerFile::Options::Options()
+    : max_batch_bytes(4 * 1024 * 1024) {
+}
+
+GroupCommitPBContainerFile::GroupCommitPBContainerFile(WritablePBContainerFile* container,
+                                                       const Options& options,
+                                                       const scoped_refptr<MetricEntity>& entity)
+  : container_(container),
+    options_(options),
+    committed_(&lock_) {
+  if (entity) {
+    commit_latency_ = METRIC_pb_container_group_commit_latency.Instantiate(entity);
+    batch_size_ = METRIC_pb_container_group_commit_batch_size.Instantiate(entity);
+  }
+}
+
+GroupCommitPBContainerFile::~GroupCommitPBContainerFile() {
+  DCHECK(queue_.empty());
+}
+
+Status GroupCommitPBContainerFile::AppendAndSync(const Message& msg) {
+  DCHECK_EQ(FileState::OPEN, container_->state_);
+
+  Writer w;
+  RETURN_NOT_OK_PREPEND(container_->AppendMsgToBuffer(msg, &w.record),
+                        "Failed to prepare buffer for writing");
+
+  MutexLock l(lock_);
+  w.queued_time = MonoTime::Now();
+  queue_.push_back(&w);
+  while (!w.done && queue_.front() != &w) {
+    committed_.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // First in the queue: commit the records queued so far. The writers queued
+  // during the commit wait for the next one.
+  faststring batch;
+  size_t num_records = 0;
+  for (const Writer* writer : queue_) {
+    if (num_records > 0 &&
+        batch.size() + writer->record.size() > options_.max_batch_bytes) {
+      break;
+    }
+    batch.append(writer->record.data(), writer->record.size());
+    num_records++;
+  }
+  l.Unlock();
+
+  Status s = container_->AppendBytes(batch);
+  if (s.ok()) {
+    s = container_->Sync();
+  } else {
+    s = s.CloneAndPrepend("Failed to append data to file");
+  }
+  MonoTime now = MonoTime::Now();
+
+  l.Lock();
+  for (size_t i = 0; i < num_records; i++) {
+    Writer* writer = queue_.front();
+    queue_.pop_front();
+    writer->status = s;
+    writer->done = true;
+    if (commit_latency_) {
+      commit_latency_->Increment((now - writer->queued_time).ToMicroseconds());
+    }
+  }
+  if (batch_size_) {
+    batch_size_->Increment(num_records);
+  }
+  committed_.Broadcast();
+  return s;
+}
+
 ReadablePBContainerFile::ReadablePBContainerFile(unique_ptr<RandomAccessFile> reader)
   : state_(FileState::NOT_INITIALIZED),
     version_(kPBContainerInvalidVersion),
@@ -833,6 +939,250 @@ uint64_t ReadablePBContainerFile::offset() const {
   return offset_;
 }
 
+// A record of a window, checked and parsed by a parser thread.
+struct BulkReadablePBContainerFile::Record {
+  uint64_t offset;
+  uint64_t length;
+
+  // The data, and the bytes covered by its checksum.
+  Slice body;
+  Slice checksummed;
+  const uint8_t* checksum;
+};
+
+struct BulkReadablePBContainerFile::Batch {
+  Batch() : done(1) {}
+
+  // Holds the data of the records, if not mapped.
+  shared_ptr<faststring> window;
+  vector<Record> records;
+
+  // Set by the parser: the messages of the records up to the first bad one,
+  // and its error.
+  vector<unique_ptr<Message>> messages;
+  Status status;
+  CountDownLatch done;
+};
+
+BulkReadablePBContainerFile::Options::Options()
+    : window_size(8 * 1024 * 1024),
+      batch_size(256 * 1024),
+      num_parser_threads(4) {
+}
+
+BulkReadablePBContainerFile::BulkReadablePBContainerFile(unique_ptr<RandomAccessFile> reader,
+                                                         const Options& options)
+  : options_(options),
+    state_(FileState::NOT_INITIALIZED),
+    version_(kPBContainerInvalidVersion),
+    offset_(0),
+    records_read_(0),
+    bytes_read_(0),
+    reader_(std::move(reader)) {
+  CHECK_GE(options_.window_size, 64);
+}
+
+BulkReadablePBContainerFile::~BulkReadablePBContainerFile() {
+}
+
+Status BulkReadablePBContainerFile::Open() {
+  DCHECK_EQ(FileState::NOT_INITIALIZED, state_);
+  RETURN_NOT_OK(ParsePBFileHeader(reader_.get(), &offset_, &version_));
+  ContainerSupHeaderPB sup_header;
+  RETURN_NOT_OK(ReadSupplementalHeader(reader_.get(), version_, &offset_, &sup_header));
+  pb_type_ = sup_header.pb_type();
+  state_ = FileState::OPEN;
+  return Status::OK();
+}
+
+Status BulkReadablePBContainerFile::ReadAll(const Message& prototype,
+                                            const MessageCallback& callback) {
+  DCHECK_EQ(FileState::OPEN, state_);
+  uint64_t file_size;
+  RETURN_NOT_OK(reader_->Size(&file_size));
+
+  gscoped_ptr<ThreadPool> pool;
+  if (options_.num_parser_threads > 0) {
+    RETURN_NOT_OK(ThreadPoolBuilder("pb-parse")
+                  .set_max_threads(options_.num_parser_threads)
+                  .Build(&pool));
+  }
+
+  // The batches submitted and not delivered yet, in file order. Waited for
+  // on error, as they point to the windows.
+  deque<unique_ptr<Batch>> pending;
+  auto wait_for_pending = MakeScopedCleanup([&]() {
+    for (const auto& batch : pending) {
+      batch->done.Wait();
+    }
+  });
+  auto submit = [&](unique_ptr<Batch> batch) {
+    Batch* b = batch.get();
+    pending.push_back(std::move(batch));
+    if (!pool || !pool->SubmitFunc([this, &prototype, b]() { ParseBatch(&prototype, b); }).ok()) {
+      ParseBatch(&prototype, b);
+    }
+  };
+
+  const uint64_t header_len = (version_ == 1) ? sizeof(uint32_t)
+                                              : sizeof(uint32_t) + kPBContainerChecksumLen;
+  uint64_t window_offset = offset_;
+  uint64_t next_record_len = 0;
+  Status scan_status;
+  while (window_offset < file_size) {
+    // Read the next window, starting at the first record not read whole.
+    uint64_t window_len = std::min<uint64_t>(std::max<uint64_t>(options_.window_size,
+                                                                next_record_len),
+                                             file_size - window_offset);
+    shared_ptr<faststring> window(new faststring());
+    window->resize(window_len);
+    Slice data;
+    RETURN_NOT_OK_PREPEND(env_util::ReadFully(reader_.get(), window_offset, window_len,
+                                              &data, window->data()),
+                          Substitute("Could not read proto container file $0 at offset $1",
+                                     reader_->filename(), window_offset));
+    if (data.data() != window->data()) {
+      // Mapped.
+      window.reset();
+    }
+
+    // Split the records of the window in batches, checking the lengths.
+    size_t num_previous = pending.size();
+    unique_ptr<Batch> batch;
+    size_t batch_bytes = 0;
+    uint64_t pos = 0;
+    while (window_offset + pos < file_size) {
+      uint64_t record_offset = window_offset + pos;
+      if (record_offset + header_len > file_size) {
+        scan_status = Status::Incomplete("File size not large enough to be valid",
+            Substitute("Proto container file $0: Tried to read $1 bytes at offset "
+                       "$2 but file size is only $3 bytes",
+                       reader_->filename(), header_len, record_offset, file_size));
+        break;
+      }
+      if (pos + header_len > data.size()) {
+        break;
+      }
+      const uint8_t* record = data.data() + pos;
+      uint32_t length = DecodeFixed32(record);
+      if (version_ >= 2) {
+        uint32_t length_checksum = crc32c::Crc32c(reinterpret_cast<const char*>(record),
+                                                  sizeof(uint32_t));
+        if (PREDICT_FALSE(length_checksum != DecodeFixed32(record + sizeof(uint32_t)))) {
+          scan_status = Status::Corruption(
+              CHECKSUM_ERR_MSG("Data length checksum does not match",
+                               reader_->filename(), record_offset + sizeof(uint32_t)),
+              Substitute("Expected: $0. Actual: $1",
+                         DecodeFixed32(record + sizeof(uint32_t)), length_checksum));
+          break;
+        }
+      }
+      uint64_t record_len = header_len + length + kPBContainerChecksumLen;
+      if (record_offset + record_len > file_size) {
+        scan_status = Status::Incomplete("File size not large enough to be valid",
+            Substitute("Proto container file $0: Tried to read $1 bytes at offset "
+                       "$2 but file size is only $3 bytes",
+                       reader_->filename(), length + kPBContainerChecksumLen,
+                       record_offset + header_len, file_size));
+        break;
+      }
+      if (pos + record_len > data.size()) {
+        next_record_len = record_len;
+        break;
+      }
+
+      if (!batch) {
+        batch.reset(new Batch());
+        batch->window = window;
+      }
+      Record r;
+      r.offset = record_offset;
+      r.length = record_len;
+      r.body = Slice(record + header_len, length);
+      r.checksummed = (version_ == 1) ? Slice(record, sizeof(uint32_t) + length) : r.body;
+      r.checksum = record + header_len + length;
+      batch->records.push_back(r);
+      batch_bytes += record_len;
+      pos += record_len;
+      if (batch_bytes >= options_.batch_size) {
+        submit(std::move(batch));
+        batch_bytes = 0;
+      }
+    }
+    if (batch) {
+      submit(std::move(batch));
+    }
+    window_offset += pos;
+
+    // Return the messages of the previous windows while this one is parsed.
+    for (size_t i = 0; i < num_previous; i++) {
+      RETURN_NOT_OK(DeliverBatch(pending.front().get(), callback));
+      pending.pop_front();
+    }
+    if (!scan_status.ok()) {
+      break;
+    }
+  }
+  while (!pending.empty()) {
+    RETURN_NOT_OK(DeliverBatch(pending.front().get(), callback));
+    pending.pop_front();
+  }
+
+  // As in ReadFullPB(), version 1 records can't be told truncated.
+  if (PREDICT_FALSE(scan_status.IsIncomplete() && version_ == 1)) {
+    return Status::Corruption("Unrecoverable incomplete record", scan_status.ToString());
+  }
+  return scan_status;
+}
+
+void BulkReadablePBContainerFile::ParseBatch(const Message* prototype, Batch* batch) {
+  batch->messages.reserve(batch->records.size());
+  for (const Record& r : batch->records) {
+    uint32_t written_checksum = DecodeFixed32(r.checksum);
+    uint32_t actual_checksum = crc32c::Crc32c(reinterpret_cast<const char*>(r.checksummed.data()),
+                                              r.checksummed.size());
+    if (PREDICT_FALSE(actual_checksum != written_checksum)) {
+      batch->status = Status::Corruption(
+          CHECKSUM_ERR_MSG(version_ == 1 ? "Length and data checksum does not match"
+                                         : "Data checksum does not match",
+                           reader_->filename(), r.offset + r.length - kPBContainerChecksumLen),
+          Substitute("Expected: $0. Actual: $1", written_checksum, actual_checksum));
+      break;
+    }
+    unique_ptr<Message> msg(prototype->New());
+    ArrayInputStream ais(r.body.data(), r.body.size());
+    CodedInputStream cis(&ais);
+    cis.SetTotalBytesLimit(512 * 1024 * 1024, -1);
+    if (PREDICT_FALSE(!msg->ParseFromCodedStream(&cis))) {
+      batch->status = Status::IOError("Unable to parse PB from path", reader_->filename());
+      break;
+    }
+    batch->messages.push_back(std::move(msg));
+  }
+  batch->done.CountDown();
+}
+
+Status BulkReadablePBContainerFile::DeliverBatch(Batch* batch, const MessageCallback& callback) {
+  batch->done.Wait();
+  for (size_t i = 0; i < batch->messages.size(); i++) {
+    RETURN_NOT_OK(callback(std::move(batch->messages[i])));
+    offset_ += batch->records[i].length;
+    bytes_read_ += batch->records[i].length;
+    records_read_++;
+  }
+  return batch->status;
+}
+
+int BulkReadablePBContainerFile::version() const {
+  DCHECK_EQ(FileState::OPEN, state_);
+  return version_;
+}
+
+uint64_t BulkReadablePBContainerFile::offset() const {
+  DCHECK_EQ(FileState::OPEN, state_);
+  return offset_;
+}
+
 Status ReadPBContainerFromPath(Env* env, const std::string& path, Message* msg) {
   unique_ptr<RandomAccessFile> file;
   RETURN_NOT_OK(env->NewRandomAccessFile(path, &file));
@@ -4,11 +4,16 @@
 #ifndef KUDU_UTIL_PB_UTIL_H
 #define KUDU_UTIL_PB_UTIL_H
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <string>
 
 #include <gtest/gtest_prod.h>
 
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/condition_variable.h"
 #include "mprmpr/util/faststring.h"
 #include "mprmpr/util/mutex.h"
 
@@ -24,6 +29,8 @@ class Message;
 namespace mprmpr {
 
 class Env;
+class Histogram;
+class MetricEntity;
 class RandomAccessFile;
 class SequentialFile;
 class Slice;
@@ -294,6 +301,8 @@ class WritablePBContainerFile {
   std::string filename() const;
 
  private:
+  friend class BulkPBContainerReaderTest;
+  friend class GroupCommitPBContainerFile;
   friend class TestPBUtil;
   FRIEND_TEST(TestPBUtil, TestPopulateDescriptorSet);
 
@@ -332,6 +341,63 @@ class WritablePBContainerFile {
   std::unique_ptr<RWFile> writer_;
 };
 
+// Appends to a WritablePBContainerFile with group commit, for many threads
+// each appending a record and waiting for it to be durable, e.g. the
+// checkpoints of concurrent jobs.
+//
+// Rather than an Append() and a Sync() per record, the callers queue their
+// records; the first one in the queue commits the records queued so far in
+// one write and one Sync() of the container, while the others wait for it.
+// AppendAndSync() returns once its record is durable, as Append() and Sync()
+// would: the records of a failed commit all get its error.
+//
+// The records are written in the order AppendAndSync() was called. Each
+// commit writes at most 'max_batch_bytes', unless a record is larger.
+//
+// This class is thread-safe.
+class GroupCommitPBContainerFile {
+ public:
+  struct Options {
+    Options();
+
+    // The size of the records committed at once. Default: 4MB.
+    size_t max_batch_bytes;
+  };
+
+  // Appends to 'container', which must be open and outlive this object.
+  //
+  // If 'entity' is not null, the commit latencies and batch sizes are
+  // reported there.
+  GroupCommitPBContainerFile(WritablePBContainerFile* container,
+                             const Options& options,
+                             const scoped_refptr<MetricEntity>& entity);
+
+  ~GroupCommitPBContainerFile();
+
+  // Appends 'msg' to the container and syncs it, like Append() then Sync().
+  Status AppendAndSync(const google::protobuf::Message& msg);
+
+ private:
+  struct Writer;
+
+  WritablePBContainerFile* const container_;
+  const Options options_;
+
+  Mutex lock_;
+
+  // Signaled when a commit completes.
+  ConditionVariable committed_;
+
+  // The writers waiting for their record to be committed, in order. The
+  // first one commits.
+  std::deque<Writer*> queue_;
+
+  scoped_refptr<Histogram> commit_latency_;
+  scoped_refptr<Histogram> batch_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(GroupCommitPBContainerFile);
+};
+
 // Protobuf container file opened for reading.
 //
 // Can be built around a file with existing contents or an empty file (in
@@ -406,6 +472,94 @@ class ReadablePBContainerFile {
   std::unique_ptr<RandomAccessFile> reader_;
 };
 
+// Protobuf container file read in bulk, e.g. to replay a large log on
+// startup, where ReadablePBContainerFile is bound by its reads (two per
+// record) and its single thread.
+//
+// The file is read in large windows. The records of a window are split in
+// batches, whose checksums are validated and messages parsed on a pool of
+// threads while the next window is read. The messages are returned in file
+// order. If the file was opened with RandomAccessFileOptions::use_mmap,
+// the windows are slices of the mapping rather than copies.
+//
+// The errors are those of ReadablePBContainerFile::ReadNextPB(), returned
+// once all the preceding records were returned; offset() is then the
+// offset of the bad record.
+//
+// Not thread-safe.
+class BulkReadablePBContainerFile {
+ public:
+  struct Options {
+    Options();
+
+    // The size of the reads. A record larger than this is read whole.
+    size_t window_size;
+
+    // The size of the records checked and parsed by each task.
+    size_t batch_size;
+
+    // The number of parser threads. If 0, the records are parsed by the
+    // calling thread.
+    int num_parser_threads;
+  };
+
+  // Called with each message, in file order. Stops the reading if not OK.
+  typedef std::function<Status(std::unique_ptr<google::protobuf::Message>)> MessageCallback;
+
+  // Initializes the class instance; reader must be open.
+  BulkReadablePBContainerFile(std::unique_ptr<RandomAccessFile> reader,
+                              const Options& options);
+
+  ~BulkReadablePBContainerFile();
+
+  // Reads the header information from the container and validates it.
+  // Must be called before any of the other methods.
+  Status Open();
+
+  // Reads the records from offset() to the end of the file, parsing each
+  // into a new message of the type of 'prototype', passed to 'callback'.
+  // Returns OK at the end of the file. File must be open.
+  Status ReadAll(const google::protobuf::Message& prototype,
+                 const MessageCallback& callback);
+
+  // Expected PB type for each message to be read.
+  //
+  // Only valid after a successful call to Open().
+  const std::string& pb_type() const { return pb_type_; }
+
+  // Return the protobuf container file format version.
+  // File must be open.
+  int version() const;
+
+  // Return the offset of the next record to read.
+  // File must be open.
+  uint64_t offset() const;
+
+  // The records returned, and their size in the file.
+  int64_t records_read() const { return records_read_; }
+  uint64_t bytes_read() const { return bytes_read_; }
+
+ private:
+  struct Record;
+  struct Batch;
+
+  // Checks and parses the records of 'batch'.
+  void ParseBatch(const google::protobuf::Message* prototype, Batch* batch);
+
+  // Waits for 'batch' to be parsed and passes its messages to 'callback'.
+  Status DeliverBatch(Batch* batch, const MessageCallback& callback);
+
+  const Options options_;
+  FileState state_;
+  int version_;
+  uint64_t offset_;
+  std::string pb_type_;
+  int64_t records_read_;
+  uint64_t bytes_read_;
+
+  std::unique_ptr<RandomAccessFile> reader_;
+};
+
 // Convenience functions for protobuf containers holding just one record.
 
 // Load a "containerized" protobuf from the given path.
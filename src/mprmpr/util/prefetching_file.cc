@@ -0,0 +1,260 @@
+#include "mprmpr/util/prefetching_file.h"
+
+#include <algorithm>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/gscoped_ptr.h"
+#include "mprmpr/base/once.h"
+#include "mprmpr/util/logging.h"
+#include "mprmpr/util/memory/buffer_pool.h"
+#include "mprmpr/util/memory/memory.h"
+#include "mprmpr/util/threadpool.h"
+
+DEFINE_int32(sequential_prefetch_threads, 8,
+             "Number of threads reading ahead for the prefetching sequential files.");
+
+METRIC_DEFINE_counter(server, sequential_prefetch_stall_time,
+                      "Sequential Prefetch Stall Time",
+                      mprmpr::MetricUnit::kMicroseconds,
+                      "Time spent by the readers of prefetching sequential files "
+                      "waiting for data to be read from disk");
+METRIC_DEFINE_counter(server, sequential_prefetch_bytes_read,
+                      "Sequential Prefetch Bytes Read",
+                      mprmpr::MetricUnit::kBytes,
+                      "Number of bytes returned by the prefetching sequential files");
+
+using std::string;
+using std::unique_ptr;
+
+namespace mprmpr {
+
+namespace {
+
+GoogleOnceType prefetch_pool_once = GOOGLE_ONCE_INIT;
+ThreadPool* prefetch_pool;
+
+void CreatePrefetchPool() {
+  gscoped_ptr<ThreadPool> pool;
+  CHECK_OK(ThreadPoolBuilder("seq-prefetch")
+           .set_max_threads(FLAGS_sequential_prefetch_threads)
+           .Build(&pool));
+  prefetch_pool = pool.release();
+}
+
+ThreadPool* PrefetchPool() {
+  GoogleOnceInit(&prefetch_pool_once, &CreatePrefetchPool);
+  return prefetch_pool;
+}
+
+} // anonymous namespace
+
+PrefetchingSequentialFile::Options::Options()
+    : chunk_size(1024 * 1024),
+      min_chunks_in_flight(2),
+      max_chunks_in_flight(16) {
+}
+
+Status PrefetchingSequentialFile::Open(Env* env, const string& fname, const Options& options,
+                                       unique_ptr<PrefetchingSequentialFile>* file) {
+  unique_ptr<RandomAccessFile> reader;
+  RETURN_NOT_OK(env->NewRandomAccessFile(fname, &reader));
+  return Open(std::move(reader), options, file);
+}
+
+Status PrefetchingSequentialFile::Open(unique_ptr<RandomAccessFile> reader,
+                                       const Options& options,
+                                       unique_ptr<PrefetchingSequentialFile>* file) {
+  CHECK_GT(options.chunk_size, 0);
+  CHECK_GT(options.min_chunks_in_flight, 0);
+  CHECK_GE(options.max_chunks_in_flight, options.min_chunks_in_flight);
+  uint64_t size;
+  RETURN_NOT_OK(reader->Size(&size));
+  file->reset(new PrefetchingSequentialFile(std::move(reader), size, options));
+  return Status::OK();
+}
+
+PrefetchingSequentialFile::PrefetchingSequentialFile(unique_ptr<RandomAccessFile> file,
+                                                     uint64_t size,
+                                                     const Options& options)
+    : file_(std::move(file)),
+      size_(size),
+      options_(options),
+      position_(0),
+      next_chunk_offset_(0),
+      max_chunks_(options.min_chunks_in_flight),
+      chunks_ready_in_time_(0),
+      stall_nanos_(0),
+      chunk_done_(&lock_) {
+  if (options.metric_entity) {
+    stall_time_metric_ = METRIC_sequential_prefetch_stall_time.Instantiate(options.metric_entity);
+    bytes_read_metric_ = METRIC_sequential_prefetch_bytes_read.Instantiate(options.metric_entity);
+  }
+}
+
+PrefetchingSequentialFile::~PrefetchingSequentialFile() {
+  MutexLock l(lock_);
+  for (const auto& chunk : chunks_) {
+    while (!chunk->done) {
+      chunk_done_.Wait();
+    }
+  }
+}
+
+Status PrefetchingSequentialFile::Read(size_t n, Slice* result, uint8_t* scratch) {
+  size_t copied = 0;
+  while (copied < n && position_ < size_) {
+    Refill();
+    if (chunks_.empty()) {
+      // No buffer to read ahead into: read in place.
+      Slice data;
+      RETURN_NOT_OK(file_->Read(position_, n - copied, &data, scratch + copied));
+      if (data.empty()) {
+        break;
+      }
+      if (data.data() != scratch + copied) {
+        memcpy(scratch + copied, data.data(), data.size());
+      }
+      copied += data.size();
+      position_ += data.size();
+      next_chunk_offset_ = position_;
+      continue;
+    }
+
+    Chunk* chunk = chunks_.front().get();
+    WaitForChunk(chunk);
+    RETURN_NOT_OK(chunk->status);
+    uint64_t chunk_end = chunk->offset + chunk->length;
+    if (position_ >= chunk_end) {
+      // The file is shorter than when opened.
+      break;
+    }
+    size_t length = std::min<uint64_t>(chunk_end - position_, n - copied);
+    memcpy(scratch + copied,
+           reinterpret_cast<uint8_t*>(chunk->buffer->data()) + (position_ - chunk->offset),
+           length);
+    copied += length;
+    position_ += length;
+    if (position_ == chunk->offset + chunk->requested) {
+      PopChunk(true);
+    }
+  }
+  if (bytes_read_metric_) {
+    bytes_read_metric_->IncrementBy(copied);
+  }
+  *result = Slice(scratch, copied);
+  return Status::OK();
+}
+
+Status PrefetchingSequentialFile::Skip(uint64_t n) {
+  position_ = std::min(size_, position_ + n);
+  while (!chunks_.empty() &&
+         chunks_.front()->offset + chunks_.front()->requested <= position_) {
+    // The buffer of a chunk is reused once read.
+    WaitForChunk(chunks_.front().get());
+    PopChunk(false);
+  }
+  if (chunks_.empty()) {
+    next_chunk_offset_ = position_;
+  }
+  return Status::OK();
+}
+
+void PrefetchingSequentialFile::Refill() {
+  while (chunks_.size() < max_chunks_ && next_chunk_offset_ < size_) {
+    unique_ptr<Buffer> buffer;
+    if (!free_buffers_.empty()) {
+      buffer = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    } else {
+      buffer.reset(PooledBufferAllocator::Get()->Allocate(options_.chunk_size));
+      if (!buffer) {
+        // The buffer pool is full: make do with the chunks in flight.
+        KLOG_EVERY_N(WARNING, 100) << "Unable to allocate a buffer to read ahead "
+                                   << filename();
+        return;
+      }
+    }
+    unique_ptr<Chunk> chunk(new Chunk());
+    chunk->buffer = std::move(buffer);
+    chunk->offset = next_chunk_offset_;
+    chunk->requested = std::min<uint64_t>(options_.chunk_size, size_ - next_chunk_offset_);
+    chunk->done = false;
+    chunk->stalled = false;
+    chunk->length = 0;
+    next_chunk_offset_ += chunk->requested;
+
+    Chunk* c = chunk.get();
+    chunks_.push_back(std::move(chunk));
+    Status s = PrefetchPool()->SubmitFunc([this, c]() { this->ReadChunk(c); });
+    if (!s.ok()) {
+      MutexLock l(lock_);
+      c->status = s;
+      c->done = true;
+    }
+  }
+}
+
+void PrefetchingSequentialFile::ReadChunk(Chunk* chunk) {
+  uint8_t* data = reinterpret_cast<uint8_t*>(chunk->buffer->data());
+  size_t length = 0;
+  Status s;
+  while (length < chunk->requested) {
+    Slice result;
+    s = file_->Read(chunk->offset + length, chunk->requested - length, &result, data + length);
+    if (!s.ok() || result.empty()) {
+      break;
+    }
+    // E.g. a memory-mapped file returns its own data rather than the scratch.
+    if (result.data() != data + length) {
+      memcpy(data + length, result.data(), result.size());
+    }
+    length += result.size();
+  }
+
+  MutexLock l(lock_);
+  chunk->status = s;
+  chunk->length = length;
+  chunk->done = true;
+  chunk_done_.Broadcast();
+}
+
+void PrefetchingSequentialFile::WaitForChunk(Chunk* chunk) {
+  MutexLock l(lock_);
+  if (chunk->done) {
+    return;
+  }
+  MonoTime start = MonoTime::Now();
+  while (!chunk->done) {
+    chunk_done_.Wait();
+  }
+  int64_t stall_nanos = (MonoTime::Now() - start).ToNanoseconds();
+  stall_nanos_ += stall_nanos;
+  if (stall_time_metric_) {
+    stall_time_metric_->IncrementBy(stall_nanos / 1000);
+  }
+  chunk->stalled = true;
+}
+
+void PrefetchingSequentialFile::PopChunk(bool adapt) {
+  unique_ptr<Chunk> chunk = std::move(chunks_.front());
+  chunks_.pop_front();
+
+  if (adapt) {
+    if (chunk->stalled) {
+      // The consumer caught up with the reads: read further ahead.
+      max_chunks_ = std::min(max_chunks_ + 1, options_.max_chunks_in_flight);
+      chunks_ready_in_time_ = 0;
+    } else if (++chunks_ready_in_time_ >= max_chunks_) {
+      // The reads keep ahead: free a buffer.
+      max_chunks_ = std::max(max_chunks_ - 1, options_.min_chunks_in_flight);
+      chunks_ready_in_time_ = 0;
+    }
+  }
+  if (chunks_.size() + free_buffers_.size() < max_chunks_) {
+    free_buffers_.push_back(std::move(chunk->buffer));
+  }
+}
+
+} // namespace mprmpr
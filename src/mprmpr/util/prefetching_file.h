@@ -0,0 +1,143 @@
+#ifndef KUDU_UTIL_PREFETCHING_FILE_H
+#define KUDU_UTIL_PREFETCHING_FILE_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/util/condition_variable.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/metrics.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class Buffer;
+
+// A SequentialFile reading ahead of its consumer, so that e.g. a decrypt
+// stage works on chunk N while chunk N+1 is read, instead of waiting on the
+// disk for each chunk.
+//
+// The file is read in chunks of 'chunk_size', up to K of them in flight at
+// a time on a shared pool of I/O threads, into buffers of the buffer pool.
+// K adapts to the consumer: it grows when Read() has to wait for a chunk
+// (the device is slower than the consumer, and may go faster with more
+// reads in flight), and shrinks when K chunks in a row were ready in time
+// (the consumer is slower, and the extra buffers only hold memory).
+//
+// The time Read() spends waiting for the chunks is reported by
+// stall_time(), and by the sequential_prefetch_stall_time metric: a job
+// stalled for most of its run time is I/O-bound.
+//
+// This class is not thread-safe.
+class PrefetchingSequentialFile : public SequentialFile {
+ public:
+  struct Options {
+    Options();
+
+    // The size of the reads.
+    size_t chunk_size;
+
+    // The bounds of K, the number of chunks read ahead.
+    int min_chunks_in_flight;
+    int max_chunks_in_flight;
+
+    // If not null, where the metrics are reported.
+    scoped_refptr<MetricEntity> metric_entity;
+  };
+
+  static Status Open(Env* env, const std::string& fname, const Options& options,
+                     std::unique_ptr<PrefetchingSequentialFile>* file);
+
+  // Like the above, reading from 'reader', e.g. opened with direct I/O.
+  static Status Open(std::unique_ptr<RandomAccessFile> reader, const Options& options,
+                     std::unique_ptr<PrefetchingSequentialFile>* file);
+
+  // Waits for the chunks in flight.
+  virtual ~PrefetchingSequentialFile();
+
+  virtual Status Read(size_t n, Slice* result, uint8_t* scratch) OVERRIDE;
+
+  virtual Status Skip(uint64_t n) OVERRIDE;
+
+  virtual std::string filename() const OVERRIDE { return file_->filename(); }
+
+  // The time Read() waited for chunks to be read.
+  MonoDelta stall_time() const { return MonoDelta::FromNanoseconds(stall_nanos_); }
+
+  // The current number of chunks read ahead.
+  int chunks_in_flight() const { return max_chunks_; }
+
+ private:
+  struct Chunk {
+    std::unique_ptr<Buffer> buffer;
+    uint64_t offset;
+    size_t requested;
+
+    // Whether Read() had to wait for the chunk.
+    bool stalled;
+
+    // Set by the I/O thread once the chunk is read, under 'lock_'.
+    bool done;
+    Status status;
+    size_t length;
+  };
+
+  PrefetchingSequentialFile(std::unique_ptr<RandomAccessFile> file, uint64_t size,
+                            const Options& options);
+
+  // Starts reading chunks until K are in flight or the end of the file is
+  // reached, as buffers are available.
+  void Refill();
+
+  // Reads 'chunk' on the I/O thread.
+  void ReadChunk(Chunk* chunk);
+
+  // Waits until 'chunk' is read, counting the time waited as stalled.
+  void WaitForChunk(Chunk* chunk);
+
+  // Drops the first chunk, keeping its buffer for the next chunks. If
+  // 'adapt', adapts K after whether the chunk stalled Read().
+  void PopChunk(bool adapt);
+
+  const std::unique_ptr<RandomAccessFile> file_;
+  const uint64_t size_;
+  const Options options_;
+
+  // The offset of the next byte returned by Read().
+  uint64_t position_;
+
+  // The offset of the next chunk to read.
+  uint64_t next_chunk_offset_;
+
+  // K, and the consecutive chunks ready in time.
+  int max_chunks_;
+  int chunks_ready_in_time_;
+
+  // The chunks read or being read, in file order.
+  std::deque<std::unique_ptr<Chunk>> chunks_;
+
+  // Buffers of consumed chunks, for the next ones.
+  std::vector<std::unique_ptr<Buffer>> free_buffers_;
+
+  int64_t stall_nanos_;
+
+  // Protects the fields of the chunks set by the I/O threads.
+  Mutex lock_;
+  ConditionVariable chunk_done_;
+
+  scoped_refptr<Counter> stall_time_metric_;
+  scoped_refptr<Counter> bytes_read_metric_;
+
+  DISALLOW_COPY_AND_ASSIGN(PrefetchingSequentialFile);
+};
+
+} // namespace mprmpr
+#endif // KUDU_UTIL_PREFETCHING_FILE_H
@@ -1,23 +1,41 @@
 #include "mprmpr/util/rolling_log.h"
 
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
 #include <iomanip>
+#include <limits>
 #include <memory>
 #include <ostream>
 #include <string>
 
 #include <zlib.h>
+#ifdef MPRMPR_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "mprmpr/base/strings/numbers.h"
 #include "mprmpr/base/strings/substitute.h"
 #include "mprmpr/base/walltime.h"
 #include "mprmpr/util/env.h"
+#include "mprmpr/util/logging.h"
+#include "mprmpr/util/metrics.h"
 #include "mprmpr/util/net/net_util.h"
 #include "mprmpr/util/path_util.h"
+#include "mprmpr/util/scoped_cleanup.h"
+#include "mprmpr/util/thread.h"
 #include "mprmpr/util/thread_restrictions.h"
+#include "mprmpr/util/threadpool.h"
 #include "mprmpr/util/user.h"
+#include "mprmpr/util/yield.h"
+
+METRIC_DEFINE_counter(server, rolling_log_dropped_appends,
+                      "Rolling Log Dropped Appends",
+                      mprmpr::MetricUnit::kEntries,
+                      "Number of appends to rolling logs, e.g. the metrics log, "
+                      "dropped because too many were queued to be written.");
 
 using std::ostringstream;
 using std::setw;
@@ -34,7 +52,8 @@ RollingLog::RollingLog(Env* env, string log_dir, string log_name)
       log_dir_(std::move(log_dir)),
       log_name_(std::move(log_name)),
       size_limit_bytes_(kDefaultSizeLimitBytes),
-      compress_after_close_(true) {}
+      compress_after_close_(true),
+      codec_(GZIP) {}
 
 RollingLog::~RollingLog() {
   WARN_NOT_OK(Close(), "Unable to close RollingLog");
@@ -49,6 +68,16 @@ void RollingLog::SetCompressionEnabled(bool compress) {
   compress_after_close_ = compress;
 }
 
+Status RollingLog::SetCompressionCodec(CompressionCodec codec) {
+#ifndef MPRMPR_HAVE_ZSTD
+  if (codec == ZSTD) {
+    return Status::NotSupported("Built without zstd");
+  }
+#endif
+  codec_ = codec;
+  return Status::OK();
+}
+
 string RollingLog::GetLogFileName(int sequence) const {
   ostringstream str;
 
@@ -107,6 +136,10 @@ Status RollingLog::Open() {
 
     string path = JoinPathSegments(log_dir_,
                                    GetLogFileName(sequence));
+    // A file compressed since it was rolled no longer holds the name.
+    if (env_->FileExists(path + ".gz") || env_->FileExists(path + ".zst")) {
+      continue;
+    }
 
     WritableFileOptions opts;
     // Logs aren't worth the performance cost of durability.
@@ -127,27 +160,74 @@ Status RollingLog::Open() {
   return Status::OK();
 }
 
-Status RollingLog::Close() {
-  if (!file_) {
-    return Status::OK();
+namespace {
+
+// Lowers the CPU and I/O priority of the calling thread, so that the
+// compression of the logs yields to the other threads.
+void LowerThreadPriority() {
+  int64_t tid = Thread::CurrentThreadId();
+  // On Linux, the nice value is per thread.
+  if (setpriority(PRIO_PROCESS, tid, 19) != 0) {
+    VLOG(1) << "Unable to lower the CPU priority of thread " << tid;
+  }
+#ifdef SYS_ioprio_set
+  const int kIoprioWhoProcess = 1;
+  const int kIoprioClassIdle = 3;
+  const int kIoprioClassShift = 13;
+  if (syscall(SYS_ioprio_set, kIoprioWhoProcess, tid,
+              kIoprioClassIdle << kIoprioClassShift) != 0) {
+    VLOG(1) << "Unable to lower the I/O priority of thread " << tid;
   }
+#endif
+}
+
+} // anonymous namespace
+
+Status RollingLog::CloseFile() {
   string path = file_->filename();
   RETURN_NOT_OK_PREPEND(file_->Close(),
                         Substitute("Unable to close $0", path));
   file_.reset();
-  if (compress_after_close_) {
-    WARN_NOT_OK(CompressFile(path), "Unable to compress old log file");
+  if (!compress_after_close_) {
+    return Status::OK();
+  }
+
+  if (!compress_pool_) {
+    WARN_NOT_OK(ThreadPoolBuilder("log-compress").set_max_threads(1).Build(&compress_pool_),
+                "Unable to start log compression thread");
+  }
+  CompressionCodec codec = codec_;
+  auto compress = [this, path, codec]() {
+    WARN_NOT_OK(CompressFile(path, codec), "Unable to compress old log file");
+  };
+  if (!compress_pool_ ||
+      !compress_pool_->SubmitFunc([compress]() {
+          LowerThreadPriority();
+          compress();
+        }).ok()) {
+    compress();
   }
   return Status::OK();
 }
 
+Status RollingLog::Close() {
+  Status s;
+  if (file_) {
+    s = CloseFile();
+  }
+  if (compress_pool_) {
+    compress_pool_->Wait();
+  }
+  return s;
+}
+
 Status RollingLog::Append(StringPiece s) {
   if (!file_) {
     RETURN_NOT_OK_PREPEND(Open(), "Unable to open log");
   }
 
   if (file_->Size() + s.size() > size_limit_bytes_) {
-    RETURN_NOT_OK_PREPEND(Close(), "Unable to roll log");
+    RETURN_NOT_OK_PREPEND(CloseFile(), "Unable to roll log");
     RETURN_NOT_OK_PREPEND(Open(), "Unable to roll log");
   }
   RETURN_NOT_OK(file_->Append(s));
@@ -193,19 +273,8 @@ class ScopedGzipCloser {
  private:
   gzFile file_;
 };
-} // anonymous namespace
 
-// We implement CompressFile() manually using zlib APIs rather than forking
-// out to '/bin/gzip' since fork() can be expensive on processes that use a large
-// amount of memory. During the time of the fork, other threads could end up
-// blocked. Implementing it using the zlib stream APIs isn't too much code
-// and is less likely to be problematic.
-Status RollingLog::CompressFile(const std::string& path) const {
-  unique_ptr<SequentialFile> in_file;
-  RETURN_NOT_OK_PREPEND(env_->NewSequentialFile(path, &in_file),
-                        "Unable to open input file to compress");
-
-  string gz_path = path + ".gz";
+Status GzipCompress(SequentialFile* in_file, const string& gz_path) {
   gzFile gzf = gzopen(gz_path.c_str(), "w");
   if (!gzf) {
     return Status::IOError("Unable to open gzip stream");
@@ -232,10 +301,231 @@ Status RollingLog::CompressFile(const std::string& path) const {
   closer.Cancel();
   RETURN_NOT_OK_PREPEND(GzClose(gzf),
                         "Unable to close gzip output");
+  return Status::OK();
+}
+
+#ifdef MPRMPR_HAVE_ZSTD
+Status ZstdCompress(Env* env, SequentialFile* in_file, const string& zst_path) {
+  WritableFileOptions opts;
+  opts.sync_on_close = false;
+  unique_ptr<WritableFile> out_file;
+  RETURN_NOT_OK_PREPEND(env->NewWritableFile(opts, zst_path, &out_file),
+                        "Unable to open zstd output");
+
+  unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+  if (!cctx) {
+    return Status::RuntimeError("Out of memory");
+  }
+
+  // Loop reading data from the input file and writing the compressed data
+  // out, until the end of the frame is flushed.
+  uint8_t buf[32 * 1024];
+  faststring out_buf;
+  out_buf.resize(ZSTD_CStreamOutSize());
+  while (true) {
+    Slice result;
+    RETURN_NOT_OK_PREPEND(in_file->Read(arraysize(buf), &result, buf),
+                          "Unable to read from zstd input");
+    ZSTD_EndDirective mode = result.size() == 0 ? ZSTD_e_end : ZSTD_e_continue;
+    ZSTD_inBuffer in = { result.data(), result.size(), 0 };
+    bool done;
+    do {
+      ZSTD_outBuffer out = { out_buf.data(), out_buf.size(), 0 };
+      size_t remaining = ZSTD_compressStream2(cctx.get(), &out, &in, mode);
+      if (ZSTD_isError(remaining)) {
+        return Status::IOError("Unable to compress zstd output",
+                               ZSTD_getErrorName(remaining));
+      }
+      RETURN_NOT_OK_PREPEND(out_file->Append(Slice(out_buf.data(), out.pos)),
+                            "Unable to write to zstd output");
+      done = (mode == ZSTD_e_end) ? remaining == 0 : in.pos == in.size;
+    } while (!done);
+    if (mode == ZSTD_e_end) {
+      break;
+    }
+  }
+  RETURN_NOT_OK_PREPEND(out_file->Close(), "Unable to close zstd output");
+  return Status::OK();
+}
+#endif // MPRMPR_HAVE_ZSTD
+
+} // anonymous namespace
+
+// We implement CompressFile() manually using zlib APIs rather than forking
+// out to '/bin/gzip' since fork() can be expensive on processes that use a large
+// amount of memory. During the time of the fork, other threads could end up
+// blocked. Implementing it using the zlib stream APIs isn't too much code
+// and is less likely to be problematic.
+Status RollingLog::CompressFile(const std::string& path, CompressionCodec codec) const {
+  unique_ptr<SequentialFile> in_file;
+  RETURN_NOT_OK_PREPEND(env_->NewSequentialFile(path, &in_file),
+                        "Unable to open input file to compress");
+
+  switch (codec) {
+    case GZIP:
+      RETURN_NOT_OK(GzipCompress(in_file.get(), path + ".gz"));
+      break;
+    case ZSTD:
+#ifdef MPRMPR_HAVE_ZSTD
+      RETURN_NOT_OK(ZstdCompress(env_, in_file.get(), path + ".zst"));
+      break;
+#else
+      return Status::NotSupported("Built without zstd");
+#endif
+  }
 
   WARN_NOT_OK(env_->DeleteFile(path),
-              "Unable to delete gzip input file after compression");
+              "Unable to delete input file after compression");
+  return Status::OK();
+}
+
+AsyncRollingLog::AsyncRollingLog(unique_ptr<RollingLog> log, size_t max_queued_appends,
+                                 const scoped_refptr<MetricEntity>& entity)
+    : log_(std::move(log)),
+      buffer_(max_queued_appends),
+      appended_(0),
+      dropped_(0),
+      writer_sleeping_(false),
+      appended_cond_(&lock_),
+      written_cond_(&lock_),
+      written_(0),
+      closing_(false),
+      appends_in_flight_(0) {
+  if (entity) {
+    dropped_metric_ = METRIC_rolling_log_dropped_appends.Instantiate(entity);
+  }
+}
+
+AsyncRollingLog::~AsyncRollingLog() {
+  WARN_NOT_OK(Close(), "Unable to close AsyncRollingLog");
+}
+
+Status AsyncRollingLog::Start() {
+  return Thread::Create("rolling-log", "rolling-log-writer", &AsyncRollingLog::WriterThread,
+                        this, &thread_);
+}
+
+Status AsyncRollingLog::Append(StringPiece data) {
+  // Counted before the check, with a barrier, so that Close() either waits
+  // for this append or makes it fail.
+  appends_in_flight_.Increment(kMemOrderBarrier);
+  auto done = MakeScopedCleanup([this]() {
+      appends_in_flight_.IncrementBy(-1, kMemOrderBarrier);
+    });
+  if (PREDICT_FALSE(closing_.Load(kMemOrderAcquire))) {
+    return Status::IllegalState("Log is closed");
+  }
+  if (PREDICT_FALSE(!buffer_.TryPush(data.as_string()))) {
+    dropped_.Increment(kMemOrderNoBarrier);
+    if (dropped_metric_) {
+      dropped_metric_->Increment();
+    }
+    return Status::ServiceUnavailable("Too many appends queued, dropped");
+  }
+  // The barrier orders the append before the check of writer_sleeping_,
+  // which the thread sets before checking appended_.
+  appended_.Increment(kMemOrderBarrier);
+  if (writer_sleeping_.Load(kMemOrderAcquire)) {
+    MutexLock l(lock_);
+    appended_cond_.Signal();
+  }
   return Status::OK();
 }
 
+Status AsyncRollingLog::Flush() {
+  int64_t target = appended_.Load(kMemOrderAcquire);
+  MutexLock l(lock_);
+  while (written_ < target) {
+    if (!thread_) {
+      return Status::IllegalState("Log writer is not running");
+    }
+    written_cond_.Wait();
+  }
+  Status s = error_;
+  error_ = Status::OK();
+  return s;
+}
+
+Status AsyncRollingLog::Close() {
+  {
+    MutexLock l(lock_);
+    if (closing_.Load(kMemOrderNoBarrier)) {
+      return Status::OK();
+    }
+    closing_.Store(true, kMemOrderRelease);
+  }
+  // The appends which saw the log open finish quickly: they do not block.
+  base::subtle::MemoryBarrier();
+  for (int i = 0; appends_in_flight_.Load(kMemOrderAcquire) > 0; i++) {
+    yield(i);
+  }
+  {
+    MutexLock l(lock_);
+    appended_cond_.Signal();
+  }
+  if (thread_) {
+    thread_->Join();
+  }
+
+  // Write what the thread left, e.g. if it was never started.
+  Status error;
+  int64_t num_written = WriteQueued(std::numeric_limits<int64_t>::max(), &error);
+
+  MutexLock l(lock_);
+  thread_.reset();
+  written_ += num_written;
+  written_cond_.Broadcast();
+  Status s = error_.ok() ? error : error_;
+  error_ = Status::OK();
+  RETURN_NOT_OK(s);
+  return log_->Close();
+}
+
+int64_t AsyncRollingLog::WriteQueued(int64_t max_appends, Status* error) {
+  string data;
+  int64_t num_written = 0;
+  while (num_written < max_appends && buffer_.TryPop(&data)) {
+    Status s = log_->Append(data);
+    if (PREDICT_FALSE(!s.ok()) && error->ok()) {
+      *error = s;
+    }
+    num_written++;
+  }
+  return num_written;
+}
+
+void AsyncRollingLog::WriterThread() {
+  while (true) {
+    // Write the appends queued, a buffer full at most between the updates
+    // of 'written_'.
+    Status error;
+    int64_t num_written = WriteQueued(buffer_.capacity(), &error);
+
+    MutexLock l(lock_);
+    if (!error.ok()) {
+      KLOG_EVERY_N_SECS(WARNING, 60) << "Unable to write to log: " << error.ToString();
+      if (error_.ok()) {
+        error_ = error;
+      }
+    }
+    if (num_written > 0) {
+      written_ += num_written;
+      written_cond_.Broadcast();
+      continue;
+    }
+
+    // Sleep until appended to. Otherwise an append was queued since the last
+    // pop, or one queued before it is being published: try again.
+    writer_sleeping_.Store(true, kMemOrderNoBarrier);
+    base::subtle::MemoryBarrier();
+    if (appended_.Load(kMemOrderNoBarrier) == written_) {
+      if (closing_.Load(kMemOrderAcquire)) {
+        break;
+      }
+      appended_cond_.Wait();
+    }
+    writer_sleeping_.Store(false, kMemOrderNoBarrier);
+  }
+}
+
 } // namespace mprmpr
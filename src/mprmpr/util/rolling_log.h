@@ -4,13 +4,23 @@
 #include <memory>
 #include <string>
 
+#include "mprmpr/base/gscoped_ptr.h"
 #include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
 #include "mprmpr/base/strings/stringpiece.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/condition_variable.h"
+#include "mprmpr/util/mpsc_ring_buffer.h"
+#include "mprmpr/util/mutex.h"
 #include "mprmpr/util/status.h"
 
 namespace mprmpr {
 
+class Counter;
 class Env;
+class MetricEntity;
+class Thread;
+class ThreadPool;
 class WritableFile;
 
 // A simple rolling log.
@@ -35,8 +45,17 @@ class WritableFile;
 //
 // The log implementation does not ensure durability of the log or its files in any way.
 // This class is not thread-safe and must be externally synchronized.
+//
+// The rolled files are compressed in the background, by a thread of low CPU and
+// I/O priority; see AsyncRollingLog to take the writes off the appending threads
+// too.
 class RollingLog {
  public:
+  enum CompressionCodec {
+    GZIP,
+    ZSTD
+  };
+
   RollingLog(Env* env, std::string log_dir, std::string log_name);
 
   ~RollingLog();
@@ -56,6 +75,11 @@ class RollingLog {
   // NOTE: this requires that the passed-in Env instance is the local file system.
   void SetCompressionEnabled(bool compress);
 
+  // Set the codec of the compressed log files: GZIP ('.gz', the default) or
+  // ZSTD ('.zst'). ZSTD is only available when built with zstd (WITH_ZSTD=1
+  // in build_config.mk); otherwise returns NotSupported.
+  Status SetCompressionCodec(CompressionCodec codec);
+
   // Append the given data to the current log file.
   //
   // If appending this data would cross the configured file size limit, a new file
@@ -63,17 +87,21 @@ class RollingLog {
   //
   // Note that this is a synchronous API and causes potentially-blocking IO on the
   // current thread. However, this does not fsync() or otherwise ensure durability
-  // of the appended data.
+  // of the appended data. The previous file is compressed in the background.
   Status Append(StringPiece data);
 
-  // Close the log.
+  // Close the log, waiting for the compression of the log files.
   Status Close();
 
  private:
   std::string GetLogFileName(int sequence) const;
 
-  // Compress the given path, writing a new file '<path>.gz'.
-  Status CompressFile(const std::string& path) const;
+  // Close the current file, and compress it in the background if enabled.
+  Status CloseFile();
+
+  // Compress the given path, writing a new file '<path>.gz' or '<path>.zst',
+  // then delete it.
+  Status CompressFile(const std::string& path, CompressionCodec codec) const;
 
   Env* const env_;
   const std::string log_dir_;
@@ -83,9 +111,96 @@ class RollingLog {
 
   std::unique_ptr<WritableFile> file_;
   bool compress_after_close_;
+  CompressionCodec codec_;
+
+  // Compresses the closed files; created on first use.
+  gscoped_ptr<ThreadPool> compress_pool_;
 
   DISALLOW_COPY_AND_ASSIGN(RollingLog);
 };
 
+// A RollingLog appended to by many threads without waiting on it: appends
+// are queued in a lock-free ring buffer and written by a background thread.
+//
+// When the buffer is full, e.g. because the disk stalls, appends are dropped
+// and counted rather than waited for. The errors of the writes are returned
+// by the next call to Flush() or Close().
+//
+//   AsyncRollingLog log(std::move(rolling_log), 1024, metric_entity);
+//   RETURN_NOT_OK(log.Start());
+//   WARN_NOT_OK(log.Append(line), "Unable to log");
+//
+// This class is thread-safe.
+class AsyncRollingLog {
+ public:
+  // Writes to 'log', queuing up to 'max_queued_appends' appends.
+  //
+  // If 'entity' is not null, the dropped appends are reported there.
+  AsyncRollingLog(std::unique_ptr<RollingLog> log, size_t max_queued_appends,
+                  const scoped_refptr<MetricEntity>& entity);
+
+  // Writes the queued appends and closes the log, see Close().
+  ~AsyncRollingLog();
+
+  // Starts the thread writing the appends.
+  Status Start();
+
+  // Queues 'data' to be appended to the log. Returns ServiceUnavailable,
+  // dropping 'data', if too many appends are queued.
+  Status Append(StringPiece data);
+
+  // Waits for the appends queued so far to be written. Returns the first
+  // error since the last call to Flush(), if any.
+  Status Flush();
+
+  // Writes the queued appends, stops the thread and closes the log. The
+  // appends which returned OK are all written, even if they raced with
+  // Close(); later ones fail.
+  Status Close();
+
+  // The number of appends dropped.
+  int64_t dropped() const { return dropped_.Load(kMemOrderNoBarrier); }
+
+ private:
+  void WriterThread();
+
+  // Appends the queued data to the log, returning the number of appends and
+  // the first error.
+  int64_t WriteQueued(int64_t max_appends, Status* error);
+
+  const std::unique_ptr<RollingLog> log_;
+  MpscRingBuffer<std::string> buffer_;
+
+  // The appends queued, and dropped.
+  AtomicInt<int64_t> appended_;
+  AtomicInt<int64_t> dropped_;
+
+  // Set while the thread waits for appends, to be woken up.
+  AtomicBool writer_sleeping_;
+
+  Mutex lock_;
+
+  // Signaled on appends while the thread sleeps, and on Close().
+  ConditionVariable appended_cond_;
+
+  // Signaled when the thread wrote appends.
+  ConditionVariable written_cond_;
+
+  int64_t written_;
+  Status error_;
+
+  // Set by Close(); read by Append() without the lock.
+  AtomicBool closing_;
+
+  // The calls to Append() in progress, waited for by Close().
+  AtomicInt<int64_t> appends_in_flight_;
+
+  scoped_refptr<Thread> thread_;
+
+  scoped_refptr<Counter> dropped_metric_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncRollingLog);
+};
+
 } // namespace mprmpr
 #endif /* KUDU_UTIL_ROLLING_LOG_H */
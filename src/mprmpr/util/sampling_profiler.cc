@@ -0,0 +1,356 @@
+#include "mprmpr/util/sampling_profiler.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/atomicops.h"
+#include "mprmpr/base/spinlock.h"
+#include "mprmpr/base/stringprintf.h"
+#include "mprmpr/base/walltime.h"
+#include "mprmpr/util/debug-util.h"
+#include "mprmpr/util/errno.h"
+#include "mprmpr/util/monotime.h"
+#include "mprmpr/util/thread.h"
+
+DEFINE_int32(sampling_profiler_hz, 49,
+             "Number of stack samples the sampling CPU profiler takes per second "
+             "of CPU time consumed by the process. Each sample costs a few "
+             "microseconds.");
+
+DEFINE_int32(sampling_profiler_history_minutes, 60,
+             "Number of minutes of CPU profiles kept by the sampling profiler.");
+
+using base::SpinLock;
+using base::SpinLockHolder;
+using std::string;
+
+// Symbolizes a program counter. See debug-util.cc.
+namespace google {
+bool Symbolize(void *pc, char *out, int out_size);
+}
+
+namespace mprmpr {
+
+namespace {
+
+// The symbol cache is cleared when it grows past this many entries, e.g. after
+// a burst of JIT-like code or of many distinct stacks.
+const int kMaxCachedSymbols = 100000;
+
+// A fixed-size, linear-probing hashtable of sampled stacks and their counts.
+//
+// The signal handler adds stacks without blocking: an entry that is locked by
+// the collector, or by a sample being recorded on another CPU, is skipped.
+class SampleTable {
+ public:
+  // Records a sample of 's'. Returns false if no entry could be claimed.
+  // This is async-signal-safe.
+  bool Add(const StackTrace& s);
+
+  // Returns the next recorded stack at or after '*iterator', and resets its
+  // count. Callers should initially set '*iterator' to 0.
+  bool Collect(uint64_t* iterator, StackTrace* s, int64_t* count);
+
+ private:
+  struct Entry {
+    Entry() : count(0), hash(0) {
+    }
+
+    // Protects all other fields.
+    SpinLock lock;
+
+    // The number of samples of 'trace'. If 0, the entry is unclaimed.
+    int64_t count;
+
+    uint64_t hash;
+    StackTrace trace;
+  };
+
+  enum {
+    kNumEntries = 2048,
+    kNumLinearProbeAttempts = 4
+  };
+  Entry entries_[kNumEntries];
+};
+
+bool SampleTable::Add(const StackTrace& s) {
+  uint64_t hash = s.HashCode();
+  for (int i = 0; i < kNumLinearProbeAttempts; i++) {
+    Entry* e = &entries_[(hash + i) % kNumEntries];
+    if (!e->lock.TryLock()) {
+      continue;
+    }
+    if (e->count == 0) {
+      e->hash = hash;
+      e->trace.CopyFrom(s);
+    } else if (e->hash != hash || !e->trace.Equals(s)) {
+      e->lock.Unlock();
+      continue;
+    }
+    e->count++;
+    e->lock.Unlock();
+    return true;
+  }
+  return false;
+}
+
+bool SampleTable::Collect(uint64_t* iterator, StackTrace* s, int64_t* count) {
+  while (*iterator < kNumEntries) {
+    Entry* e = &entries_[(*iterator)++];
+    SpinLockHolder l(&e->lock);
+    if (e->count == 0) continue;
+
+    *count = e->count;
+    s->CopyFrom(e->trace);
+    e->count = 0;
+    return true;
+  }
+  return false;
+}
+
+SampleTable* g_sample_table = nullptr;
+
+int64_t CurrentMinute() {
+  return GetCurrentTimeMicros() / (60 * 1000000LL);
+}
+
+} // anonymous namespace
+
+SamplingProfiler::SamplingProfiler()
+    : running_(false),
+      stop_latch_(1),
+      foreign_profiler_pauses_(0),
+      resume_after_foreign_profiler_(false),
+      has_foreign_action_(false),
+      num_samples_(0),
+      num_dropped_samples_(0) {
+  g_sample_table = new SampleTable();
+}
+
+SamplingProfiler* SamplingProfiler::Get() {
+  return Singleton<SamplingProfiler>::get();
+}
+
+void SamplingProfiler::HandleProfSignal(int signum) {
+  int saved_errno = errno;
+  SamplingProfiler* profiler = Singleton<SamplingProfiler>::get();
+  StackTrace trace;
+  trace.Collect(2);
+  profiler->num_samples_.Increment();
+  if (!g_sample_table->Add(trace)) {
+    profiler->num_dropped_samples_.Increment();
+  }
+  errno = saved_errno;
+}
+
+Status SamplingProfiler::Start() {
+  MutexLock l(lock_);
+  return StartUnlocked();
+}
+
+Status SamplingProfiler::StartUnlocked() {
+  if (running_) {
+    return Status::OK();
+  }
+  RETURN_NOT_OK(StartSamplingUnlocked());
+  stop_latch_.Reset(1);
+  Status s = Thread::Create("profiler", "sampling-profiler",
+                            &SamplingProfiler::CollectorThread, this,
+                            &collector_thread_);
+  if (!s.ok()) {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    return s;
+  }
+  running_ = true;
+  LOG(INFO) << "Started the sampling CPU profiler at "
+            << FLAGS_sampling_profiler_hz << " samples per CPU second";
+  return Status::OK();
+}
+
+Status SamplingProfiler::StartSamplingUnlocked() {
+  if (FLAGS_sampling_profiler_hz <= 0) {
+    return Status::InvalidArgument("invalid sampling frequency",
+                                   std::to_string(FLAGS_sampling_profiler_hz));
+  }
+
+  struct sigaction old_act;
+  PCHECK(sigaction(SIGPROF, nullptr, &old_act) == 0);
+  if (old_act.sa_handler != SIG_DFL &&
+      old_act.sa_handler != SIG_IGN &&
+      old_act.sa_handler != &HandleProfSignal) {
+    return Status::IllegalState("SIGPROF handler is already in use");
+  }
+
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = &HandleProfSignal;
+  act.sa_flags = SA_RESTART;
+  sigemptyset(&act.sa_mask);
+  if (sigaction(SIGPROF, &act, nullptr) != 0) {
+    int err = errno;
+    return Status::IOError("unable to install SIGPROF handler", ErrnoToString(err), err);
+  }
+
+  int64_t interval_us = std::max<int64_t>(1, 1000000 / FLAGS_sampling_profiler_hz);
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval_us / 1000000;
+  timer.it_interval.tv_usec = interval_us % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    int err = errno;
+    signal(SIGPROF, SIG_IGN);
+    return Status::IOError("unable to start profiling timer", ErrnoToString(err), err);
+  }
+  return Status::OK();
+}
+
+void SamplingProfiler::Stop() {
+  MutexLock l(lock_);
+  StopUnlocked();
+}
+
+void SamplingProfiler::StopUnlocked() {
+  if (!running_) {
+    return;
+  }
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  PCHECK(setitimer(ITIMER_PROF, &timer, nullptr) == 0);
+  // The default action of SIGPROF is to terminate the process, so any signal
+  // still pending must be ignored rather than left to it.
+  signal(SIGPROF, SIG_IGN);
+
+  stop_latch_.CountDown();
+  collector_thread_->Join();
+  collector_thread_.reset();
+  running_ = false;
+  LOG(INFO) << "Stopped the sampling CPU profiler";
+}
+
+void SamplingProfiler::PauseForForeignProfiler() {
+  MutexLock l(lock_);
+  if (foreign_profiler_pauses_++ > 0) {
+    return;
+  }
+  resume_after_foreign_profiler_ = running_;
+  StopUnlocked();
+  // The gperftools CPU profiler installs its handler only once per process,
+  // so it must be put back for the profiler to get any sample.
+  if (has_foreign_action_) {
+    PCHECK(sigaction(SIGPROF, &foreign_action_, nullptr) == 0);
+  }
+}
+
+Status SamplingProfiler::ResumeAfterForeignProfiler() {
+  MutexLock l(lock_);
+  DCHECK_GT(foreign_profiler_pauses_, 0);
+  if (--foreign_profiler_pauses_ > 0) {
+    return Status::OK();
+  }
+  struct sigaction act;
+  PCHECK(sigaction(SIGPROF, nullptr, &act) == 0);
+  if (act.sa_handler != SIG_DFL && act.sa_handler != SIG_IGN &&
+      act.sa_handler != &HandleProfSignal) {
+    // Its timer is stopped, but its handler is left installed: replace it,
+    // ignoring the signals still pending.
+    foreign_action_ = act;
+    has_foreign_action_ = true;
+    signal(SIGPROF, SIG_IGN);
+  }
+  if (!resume_after_foreign_profiler_) {
+    return Status::OK();
+  }
+  resume_after_foreign_profiler_ = false;
+  return StartUnlocked();
+}
+
+bool SamplingProfiler::running() const {
+  MutexLock l(lock_);
+  return running_;
+}
+
+void SamplingProfiler::CollectorThread() {
+  while (!stop_latch_.WaitFor(MonoDelta::FromSeconds(1))) {
+    Flush();
+  }
+  Flush();
+}
+
+void SamplingProfiler::Flush() {
+  MutexLock l(profiles_lock_);
+  int64_t minute = CurrentMinute();
+  if (profiles_.empty() || profiles_.back().minute != minute) {
+    profiles_.emplace_back();
+    profiles_.back().minute = minute;
+    while (profiles_.size() > std::max(FLAGS_sampling_profiler_history_minutes, 1)) {
+      profiles_.pop_front();
+    }
+  }
+
+  FoldedStacks* stacks = &profiles_.back().stacks;
+  uint64_t iterator = 0;
+  StackTrace trace;
+  int64_t count;
+  while (g_sample_table->Collect(&iterator, &trace, &count)) {
+    (*stacks)[Fold(trace)] += count;
+  }
+
+  if (symbols_.size() > kMaxCachedSymbols) {
+    symbols_.clear();
+  }
+}
+
+void SamplingProfiler::GetFoldedStacks(int minutes, FoldedStacks* stacks) {
+  Flush();
+
+  MutexLock l(profiles_lock_);
+  int64_t first_minute = CurrentMinute() - minutes + 1;
+  for (const MinuteProfile& profile : profiles_) {
+    if (profile.minute < first_minute) {
+      continue;
+    }
+    for (const auto& entry : profile.stacks) {
+      (*stacks)[entry.first] += entry.second;
+    }
+  }
+}
+
+string SamplingProfiler::Fold(const StackTrace& trace) {
+  if (trace.num_frames() == 0) {
+    return "[unknown]";
+  }
+
+  string folded;
+  for (int i = trace.num_frames() - 1; i >= 0; i--) {
+    void* pc = trace.frame(i);
+    auto it = symbols_.find(pc);
+    if (it == symbols_.end()) {
+      // 'pc' is a return address: look up the call instruction before it, as
+      // StackTrace::Symbolize() does.
+      char buf[1024];
+      string symbol;
+      if (google::Symbolize(reinterpret_cast<char*>(pc) - 1, buf, sizeof(buf))) {
+        symbol = buf;
+      } else {
+        symbol = StringPrintf("%p", pc);
+      }
+      it = symbols_.emplace(pc, std::move(symbol)).first;
+    }
+    if (!folded.empty()) {
+      folded.push_back(';');
+    }
+    folded.append(it->second);
+  }
+  return folded;
+}
+
+} // namespace mprmpr
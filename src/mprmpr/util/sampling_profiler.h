@@ -0,0 +1,138 @@
+#ifndef KUDU_UTIL_SAMPLING_PROFILER_H
+#define KUDU_UTIL_SAMPLING_PROFILER_H
+
+#include <signal.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/base/ref_counted.h"
+#include "mprmpr/base/singleton.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/countdown_latch.h"
+#include "mprmpr/util/mutex.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class StackTrace;
+class Thread;
+
+// Folded ("collapsed") stacks, as consumed by flamegraph.pl: each key is a
+// stack of symbolized frames separated by ';', outermost first, and each value
+// the number of samples taken in it.
+typedef std::map<std::string, int64_t> FoldedStacks;
+
+// An always-on, low-overhead sampling CPU profiler which does not depend on
+// gperftools.
+//
+// While running, the process receives SIGPROF every 1/--sampling_profiler_hz
+// seconds of CPU time it consumes, and the thread receiving it records its
+// stack (see StackTrace::Collect()) into a fixed-size hashtable, without
+// allocating or blocking. Once a second, a background thread drains the
+// hashtable, symbolizes the stacks and aggregates them into the profile of the
+// current wall-clock minute. The profiles of the last
+// --sampling_profiler_history_minutes minutes are kept.
+//
+// Samples are dropped rather than waited for if the hashtable is busy or too
+// full; see num_dropped_samples().
+//
+// This class is thread-safe.
+class SamplingProfiler {
+ public:
+  // Returns the process-wide profiler.
+  static SamplingProfiler* Get();
+
+  // Installs the SIGPROF handler and starts sampling. Fails if another
+  // SIGPROF handler (e.g. the gperftools CPU profiler's) is installed. No-op if
+  // already running.
+  Status Start();
+
+  // Stops sampling. The profiles collected so far are kept.
+  void Stop();
+
+  // Stops sampling for a profiler with its own SIGPROF handler, such as the
+  // gperftools CPU profiler, reinstating the handler that profiler left
+  // installed the last time ResumeAfterForeignProfiler() took over.
+  void PauseForForeignProfiler();
+
+  // Takes SIGPROF back once the profiler paused for is done, saving its
+  // handler for the next pause, and restarts sampling if it was running at
+  // the time of the pause. Pauses nest: only the last resume takes effect.
+  Status ResumeAfterForeignProfiler();
+
+  bool running() const;
+
+  // Aggregates into 'stacks' the profiles of the last 'minutes' minutes,
+  // including the current one.
+  void GetFoldedStacks(int minutes, FoldedStacks* stacks);
+
+  // Moves the samples recorded so far into the profile of the current minute.
+  // This is done by the background thread every second.
+  void Flush();
+
+  // The number of samples taken since the process started.
+  int64_t num_samples() const { return num_samples_.Load(); }
+
+  // The number of samples that could not be recorded.
+  int64_t num_dropped_samples() const { return num_dropped_samples_.Load(); }
+
+ private:
+  friend class Singleton<SamplingProfiler>;
+
+  // The profile of one wall-clock minute.
+  struct MinuteProfile {
+    int64_t minute;
+    FoldedStacks stacks;
+  };
+
+  SamplingProfiler();
+
+  static void HandleProfSignal(int signum);
+
+  void CollectorThread();
+
+  // Returns the folded form of 'trace', caching the symbols of its frames.
+  std::string Fold(const StackTrace& trace);
+
+  // Start() and Stop(), with 'lock_' held.
+  Status StartUnlocked();
+  void StopUnlocked();
+
+  // Installs the signal handler and the timer. Requires 'lock_'.
+  Status StartSamplingUnlocked();
+
+  // Protects the fields below and the signal handler.
+  mutable Mutex lock_;
+  bool running_;
+  scoped_refptr<Thread> collector_thread_;
+  CountDownLatch stop_latch_;
+
+  // The number of PauseForForeignProfiler() calls not followed yet by
+  // ResumeAfterForeignProfiler(), and whether sampling was running at the
+  // first of them.
+  int foreign_profiler_pauses_;
+  bool resume_after_foreign_profiler_;
+
+  // The SIGPROF handler of the foreign profiler, if ever replaced.
+  bool has_foreign_action_;
+  struct sigaction foreign_action_;
+
+  // Protects the profiles and the symbol cache.
+  Mutex profiles_lock_;
+
+  // Most recent last, the last one being the current minute.
+  std::deque<MinuteProfile> profiles_;
+  std::unordered_map<void*, std::string> symbols_;
+
+  AtomicInt<int64_t> num_samples_;
+  AtomicInt<int64_t> num_dropped_samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(SamplingProfiler);
+};
+
+} // namespace mprmpr
+#endif /* KUDU_UTIL_SAMPLING_PROFILER_H */
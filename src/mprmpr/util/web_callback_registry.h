@@ -16,6 +16,8 @@ class WebCallbackRegistry {
   typedef std::map<std::string, std::string> ArgumentMap;
 
   struct WebRequest {
+    // The request URI, without the query string.
+    std::string path;
     ArgumentMap parsed_args;
     std::string query_string;
     std::string request_method;
@@ -27,9 +29,13 @@ class WebCallbackRegistry {
 
   virtual ~WebCallbackRegistry() {}
 
+  // Registers 'callback' for requests to 'path'. If 'is_prefix' is set, the
+  // callback also handles the requests to any path starting with 'path' which
+  // has no handler of its own.
   virtual void RegisterPathHandler(const std::string& path, const std::string& alias,
                                    const PathHandlerCallback& callback,
-                                   bool is_styled = true, bool is_on_nav_bar = true) = 0;
+                                   bool is_styled = true, bool is_on_nav_bar = true,
+                                   bool is_prefix = false) = 0;
 };
 
 } // namespace mprmpr
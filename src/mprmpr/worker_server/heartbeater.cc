@@ -13,6 +13,7 @@
 #include "mprmpr/master/master.h"
 //#include "mprmpr/master/master_rpc.h"
 #include "mprmpr/master/master.proxy.pb.h"
+#include "mprmpr/server/job_trace.h"
 #include "mprmpr/server/web_server.h"
 
 #include "mprmpr/worker_server/worker_server.h"
@@ -33,6 +34,9 @@ DEFINE_int32(heartbeat_max_failures_before_backoff, 3,
     "Worker Server backs off to the normal heartbeat interval, "
     "rather than retrying.");
 
+DEFINE_int32(heartbeat_max_job_spans, 1000,
+    "Maximum number of finished job spans sent to the master with a single heartbeat.");
+
 using google::protobuf::RepeatedPtrField;
 using mprmpr::HostPortPB;
 using mprmpr::master::Master;
@@ -200,15 +204,23 @@ Status Heartbeater::Thread::DoHeartbeat() {
     RETURN_NOT_OK_PREPEND(SetupRegistration(req.mutable_registration()), "Unable to set up registration");
   }
 
+  server_->job_trace_store()->TakeSpans(FLAGS_heartbeat_max_job_spans, req.mutable_job_spans());
+
   RpcController rpc;
   rpc.set_timeout(MonoDelta::FromMilliseconds(FLAGS_heartbeat_rpc_timeout_ms));
 
   VLOG(2) << "Sending hearbeat: \n" << req.DebugString();
   master::WorkerHeartbeatResponsePB resp;
-  RETURN_NOT_OK_PREPEND(proxy_->WorkerHeartbeat(req, &resp, &rpc),
-                        "Failed to send heartbeat to master");
-  if (resp.has_error()) {
-    return StatusFromPB(resp.error().status());
+  Status s = proxy_->WorkerHeartbeat(req, &resp, &rpc);
+  if (s.ok() && resp.has_error()) {
+    s = StatusFromPB(resp.error().status());
+  }
+  if (!s.ok()) {
+    // Keep the spans for the next heartbeat.
+    for (const JobSpanPB& span : req.job_spans()) {
+      server_->job_trace_store()->AddSpan(span);
+    }
+    return s.CloneAndPrepend("Failed to send heartbeat to master");
   }
 
   VLOG(2) << strings::Substitute("Received heartbeat response from $0:\n$1",
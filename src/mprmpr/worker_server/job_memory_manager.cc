@@ -0,0 +1,222 @@
+#include "mprmpr/worker_server/job_memory_manager.h"
+
+#include <algorithm>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/file_system/data_dirs.h"
+#include "mprmpr/file_system/file_system_manager.h"
+#include "mprmpr/util/env.h"
+#include "mprmpr/util/mem_tracker.h"
+#include "mprmpr/util/path_util.h"
+
+DEFINE_int64(worker_jobs_memory_limit_mb, -1,
+             "Maximum amount of memory, in MB, which all jobs running on a worker "
+             "may use for their buffers together. -1 means no limit beyond the "
+             "process-wide --memory_limit_hard_bytes.");
+
+DEFINE_int64(worker_job_memory_limit_mb, 1024,
+             "Maximum amount of memory, in MB, a single job may use for its buffers "
+             "before they are spilled to scratch files. -1 means no limit.");
+
+using std::shared_ptr;
+using std::string;
+using strings::Substitute;
+
+namespace mprmpr {
+namespace worker_server {
+
+namespace {
+
+int64_t LimitFromMb(int64_t mb) {
+  return mb < 0 ? -1 : mb * 1024 * 1024;
+}
+
+} // anonymous namespace
+
+const char* JobMemoryManager::kScratchDirName = "scratch";
+
+JobMemoryManager::JobMemoryManager(FileSystemManager* fs_manager,
+                                   const shared_ptr<MemTracker>& parent_tracker)
+    : env_(fs_manager->env()),
+      fs_manager_(fs_manager),
+      jobs_tracker_(MemTracker::CreateTracker(LimitFromMb(FLAGS_worker_jobs_memory_limit_mb),
+                                              "jobs", parent_tracker)),
+      spilled_bytes_(0) {
+}
+
+JobMemoryManager::~JobMemoryManager() {
+}
+
+Status JobMemoryManager::Init() {
+  DataDirManager* dd_manager = fs_manager_->dd_manager();
+  for (const auto& dir : dd_manager->data_dirs()) {
+    if (dir->is_failed()) {
+      continue;
+    }
+    string scratch_dir = JoinPathSegments(dir->dir(), kScratchDirName);
+    Status s = fs_manager_->CreateDirIfMissing(scratch_dir);
+    if (!s.ok()) {
+      // Jobs can do without this dir, as long as another one is left.
+      dd_manager->MarkDataDirFailed(
+          dir.get(), Substitute("Unable to create scratch dir $0: $1", scratch_dir, s.ToString()));
+    }
+  }
+  if (dd_manager->data_dirs().empty()) {
+    LOG(WARNING) << "No data dirs configured (--fs_data_dirs or --fs_wal_dir): "
+                 << "job buffers will fail rather than spill when over their memory limit";
+  } else if (dd_manager->num_healthy_data_dirs() == 0) {
+    return Status::IOError("Unable to create a scratch dir in any data dir");
+  }
+  return Status::OK();
+}
+
+shared_ptr<MemTracker> JobMemoryManager::CreateJobTracker(const string& job_uuid) {
+  return MemTracker::CreateTracker(LimitFromMb(FLAGS_worker_job_memory_limit_mb),
+                                   Substitute("job $0", job_uuid), jobs_tracker_);
+}
+
+Status JobMemoryManager::NewScratchFile(const string& job_uuid,
+                                        std::unique_ptr<RWFile>* file,
+                                        DataDir** dir) {
+  DataDirManager* dd_manager = fs_manager_->dd_manager();
+  if (PREDICT_FALSE(dd_manager->data_dirs().empty())) {
+    return Status::IllegalState("No data dirs available for job scratch files");
+  }
+  // Retries on another dir if the one picked turns out to be broken.
+  while (true) {
+    RETURN_NOT_OK(dd_manager->GetNextDataDir(dir));
+    string tmpl = JoinPathSegments(JoinPathSegments((*dir)->dir(), kScratchDirName),
+                                   Substitute("$0.XXXXXX", job_uuid));
+    string path;
+    Status s = env_->NewTempRWFile(RWFileOptions(), tmpl, &path, file);
+    if (!s.ok()) {
+      HandleIOError(*dir, s);
+      if ((*dir)->is_failed()) {
+        continue;
+      }
+      return s;
+    }
+    // Nobody else needs to find the file, so unlink it right away: the space is
+    // reclaimed when the file is closed, even if the worker crashes first.
+    WARN_NOT_OK(env_->DeleteFile(path),
+                Substitute("Unable to unlink scratch file $0", path));
+    return Status::OK();
+  }
+}
+
+Status JobMemoryManager::HandleIOError(DataDir* dir, const Status& s) {
+  return fs_manager_->dd_manager()->HandleIOError(dir, s);
+}
+
+////////////////////////////////////////////////////////////
+// ChunkBuffer
+////////////////////////////////////////////////////////////
+
+ChunkBuffer::ChunkBuffer(JobMemoryManager* manager,
+                         shared_ptr<MemTracker> tracker,
+                         string job_uuid)
+    : manager_(manager),
+      tracker_(std::move(tracker)),
+      job_uuid_(std::move(job_uuid)),
+      consumption_(0),
+      spill_dir_(nullptr),
+      size_(0) {
+}
+
+ChunkBuffer::~ChunkBuffer() {
+  Clear();
+}
+
+bool ChunkBuffer::TryReserve(size_t capacity) {
+  if (capacity <= buffer_.capacity()) {
+    return true;
+  }
+  // Grow by at least 50% so that a sequence of small appends stays linear.
+  size_t new_capacity = std::max(capacity, buffer_.capacity() * 3 / 2);
+  int64_t delta = new_capacity - consumption_;
+  if (!tracker_->TryConsume(delta)) {
+    return false;
+  }
+  if (tracker_->AnySoftLimitExceeded(nullptr)) {
+    tracker_->Release(delta);
+    return false;
+  }
+  buffer_.reserve(new_capacity);
+  consumption_ += delta;
+  return true;
+}
+
+Status ChunkBuffer::Append(const Slice& data) {
+  if (!spilled() && !TryReserve(size_ + data.size())) {
+    VLOG(1) << Substitute("Job $0 over its memory limit, spilling $1 byte chunk",
+                          job_uuid_, size_);
+    RETURN_NOT_OK(Spill());
+  }
+
+  if (spilled()) {
+    DataDir::IoScope io(spill_dir_);
+    RETURN_NOT_OK(manager_->HandleIOError(spill_dir_, spill_file_->Write(size_, data)));
+    manager_->AddSpilledBytes(data.size());
+  } else {
+    buffer_.append(data.data(), data.size());
+  }
+  size_ += data.size();
+  return Status::OK();
+}
+
+Status ChunkBuffer::Read(uint64_t offset, size_t length,
+                         Slice* result, uint8_t* scratch) const {
+  if (offset + length > size_) {
+    return Status::InvalidArgument(
+        Substitute("Read of $0 bytes at offset $1 past end of $2 byte chunk",
+                   length, offset, size_));
+  }
+  if (spilled()) {
+    DataDir::IoScope io(spill_dir_);
+    return manager_->HandleIOError(spill_dir_,
+                                   spill_file_->Read(offset, length, result, scratch));
+  }
+  *result = Slice(buffer_.data() + offset, length);
+  return Status::OK();
+}
+
+Status ChunkBuffer::Spill() {
+  if (spilled()) {
+    return Status::OK();
+  }
+
+  std::unique_ptr<RWFile> file;
+  DataDir* dir;
+  RETURN_NOT_OK(manager_->NewScratchFile(job_uuid_, &file, &dir));
+  if (size_ > 0) {
+    DataDir::IoScope io(dir);
+    RETURN_NOT_OK(manager_->HandleIOError(dir, file->Write(0, Slice(buffer_.data(), size_))));
+    manager_->AddSpilledBytes(size_);
+  }
+  spill_file_ = std::move(file);
+  spill_dir_ = dir;
+
+  buffer_.reset();
+  tracker_->Release(consumption_);
+  consumption_ = 0;
+  return Status::OK();
+}
+
+void ChunkBuffer::Clear() {
+  if (spill_file_) {
+    WARN_NOT_OK(spill_file_->Close(), "Unable to close scratch file");
+    spill_file_.reset();
+    spill_dir_ = nullptr;
+    manager_->AddSpilledBytes(-static_cast<int64_t>(size_));
+  }
+  buffer_.reset();
+  tracker_->Release(consumption_);
+  consumption_ = 0;
+  size_ = 0;
+}
+
+} // namespace worker_server
+} // namespace mprmpr
@@ -0,0 +1,136 @@
+#ifndef ANT_WORKER_SERVER_JOB_MEMORY_MANAGER_H_
+#define ANT_WORKER_SERVER_JOB_MEMORY_MANAGER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mprmpr/base/macros.h"
+#include "mprmpr/util/atomic.h"
+#include "mprmpr/util/faststring.h"
+#include "mprmpr/util/locks.h"
+#include "mprmpr/util/slice.h"
+#include "mprmpr/util/status.h"
+
+namespace mprmpr {
+
+class DataDir;
+class Env;
+class FileSystemManager;
+class MemTracker;
+class RWFile;
+
+namespace worker_server {
+
+// Accounts for the memory used by the jobs running on a worker.
+//
+// Every job gets its own MemTracker (with a hard limit of
+// --worker_job_memory_limit_mb) parented to a worker-wide "jobs" tracker
+// (--worker_jobs_memory_limit_mb), which is in turn parented to the server's
+// tracker. Buffers allocated by a job pipeline are charged to the job's tracker
+// through ChunkBuffer, which spills to a scratch file in one of the
+// FileSystemManager data dirs rather than exceed those limits.
+//
+// This class is thread-safe.
+class JobMemoryManager {
+ public:
+  JobMemoryManager(FileSystemManager* fs_manager,
+                   const std::shared_ptr<MemTracker>& parent_tracker);
+  ~JobMemoryManager();
+
+  // Create the scratch directories. Requires the FileSystemManager to be
+  // open.
+  Status Init();
+
+  // Create the tracker for the job identified by 'job_uuid'. The tracker lives
+  // for as long as the job (or any of its buffers) holds a reference to it.
+  std::shared_ptr<MemTracker> CreateJobTracker(const std::string& job_uuid);
+
+  // Create an anonymous scratch file for spilling a buffer of 'job_uuid'.
+  // The scratch dir is chosen by the DataDirManager, by free space and I/O
+  // load, and another one is tried if its disk has failed. The file is
+  // unlinked on creation, so its space is reclaimed as soon as 'file' is
+  // closed, even after a crash. Sets 'dir' to the data dir of the file.
+  Status NewScratchFile(const std::string& job_uuid, std::unique_ptr<RWFile>* file,
+                        DataDir** dir);
+
+  // Marks 'dir' failed if 's' denotes a broken disk. Returns 's'.
+  Status HandleIOError(DataDir* dir, const Status& s);
+
+  // Record that 'bytes' were spilled to or released from scratch files.
+  void AddSpilledBytes(int64_t bytes) { spilled_bytes_.IncrementBy(bytes); }
+
+  // The number of bytes currently held in scratch files.
+  int64_t spilled_bytes() const { return spilled_bytes_.Load(); }
+
+  const std::shared_ptr<MemTracker>& jobs_tracker() const { return jobs_tracker_; }
+
+ private:
+  static const char* kScratchDirName;
+
+  Env* const env_;
+  FileSystemManager* const fs_manager_;
+  std::shared_ptr<MemTracker> jobs_tracker_;
+
+  AtomicInt<int64_t> spilled_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobMemoryManager);
+};
+
+// A buffer holding one intermediate chunk of a job pipeline (e.g. a decrypted
+// or transcoded segment).
+//
+// Memory is charged to the job's MemTracker as the buffer grows. If the
+// tracker (or any of its ancestors) would exceed its hard limit, or its soft
+// limit is exceeded, the contents are spilled to a scratch file and further
+// appends go straight to disk. Either way, readers see the same bytes.
+//
+// This class is not thread-safe.
+class ChunkBuffer {
+ public:
+  ChunkBuffer(JobMemoryManager* manager,
+              std::shared_ptr<MemTracker> tracker,
+              std::string job_uuid);
+  ~ChunkBuffer();
+
+  // Append 'data' to the end of the buffer.
+  Status Append(const Slice& data);
+
+  // Read 'length' bytes starting at 'offset'. '*result' may point into the
+  // buffer itself or into 'scratch', which must be at least 'length' bytes.
+  Status Read(uint64_t offset, size_t length, Slice* result, uint8_t* scratch) const;
+
+  // Move the contents of the buffer to a scratch file, releasing its memory.
+  // No-op if the buffer has already been spilled.
+  Status Spill();
+
+  // Discard the contents of the buffer, releasing memory and scratch space.
+  void Clear();
+
+  size_t size() const { return size_; }
+  bool spilled() const { return spill_file_ != nullptr; }
+
+ private:
+  // Grow 'buffer_' to hold at least 'capacity' bytes, charging the job's
+  // tracker for the growth. Returns false if the memory should not be used.
+  bool TryReserve(size_t capacity);
+
+  JobMemoryManager* const manager_;
+  const std::shared_ptr<MemTracker> tracker_;
+  const std::string job_uuid_;
+
+  faststring buffer_;
+
+  // The number of bytes of 'buffer_' capacity charged to 'tracker_'.
+  int64_t consumption_;
+
+  std::unique_ptr<RWFile> spill_file_;
+  DataDir* spill_dir_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkBuffer);
+};
+
+} // namespace worker_server
+} // namespace mprmpr
+#endif // ANT_WORKER_SERVER_JOB_MEMORY_MANAGER_H_
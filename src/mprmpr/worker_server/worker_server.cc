@@ -5,14 +5,18 @@
 #include <vector>
 
 #include "mprmpr/base/strings/substitute.h"
+#include "mprmpr/file_system/file_system_manager.h"
 #include "mprmpr/rpc/service_if.h"
+#include "mprmpr/server/job_trace.h"
 #include "mprmpr/server/rpc_server.h"
 #include "mprmpr/server/web_server.h"
 
 #include "mprmpr/worker_server/heartbeater.h"
+#include "mprmpr/worker_server/job_memory_manager.h"
 //#include "mprmpr/worker_server/worker_service.h"
 //
 //
+#include "mprmpr/util/env.h"
 #include "mprmpr/util/net/net_util.h"
 #include "mprmpr/util/net/sockaddr.h"
 #include "mprmpr/util/status.h"
@@ -28,7 +32,8 @@ WorkerServer::WorkerServer(const WorkerServerOptions& opts)
   : ServerBase("WorkerServer", opts, "mprmpr.workerserver"),
     initted_(false),
     fail_heartbeats_for_tests_(false),
-    opts_(opts) {
+    opts_(opts),
+    job_trace_store_(new server::JobTraceStore()) {
 }
 
 WorkerServer::~WorkerServer() {
@@ -56,6 +61,23 @@ Status WorkerServer::Init() {
 
   RETURN_NOT_OK(ServerBase::Init());
 
+  FileSystemManager::Options fs_opts;
+  fs_opts.metric_entity = metric_entity_;
+  fs_opts.parent_mem_tracker = mem_tracker_;
+  fs_manager_.reset(new FileSystemManager(Env::Default(), fs_opts));
+  Status s = fs_manager_->Open();
+  if (s.IsNotFound()) {
+    LOG(INFO) << "Could not load existing FS layout: " << s.ToString();
+    LOG(INFO) << "Creating new FS layout";
+    RETURN_NOT_OK_PREPEND(fs_manager_->CreateInitialFileSystemLayout(),
+                          "Could not create new FS layout");
+    s = fs_manager_->Open();
+  }
+  RETURN_NOT_OK_PREPEND(s, "Failed to load FS layout");
+
+  job_memory_manager_.reset(new JobMemoryManager(fs_manager_.get(), mem_tracker_));
+  RETURN_NOT_OK_PREPEND(job_memory_manager_->Init(), "Unable to initialize job memory");
+
   heartbeater_.reset(new Heartbeater(opts_, this));
 
   initted_ = true;
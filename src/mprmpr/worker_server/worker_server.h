@@ -17,9 +17,17 @@
 #include "mprmpr/util/status.h"
 
 namespace mprmpr {
+
+class FileSystemManager;
+
+namespace server {
+class JobTraceStore;
+} // namespace server
+
 namespace worker_server {
 
 class Heartbeater;
+class JobMemoryManager;
 
 class WorkerServer : public server::ServerBase {
  public:
@@ -40,6 +48,14 @@ class WorkerServer : public server::ServerBase {
 
   Heartbeater* heartbeater() { return heartbeater_.get(); }
 
+  FileSystemManager* fs_manager() { return fs_manager_.get(); }
+
+  JobMemoryManager* job_memory_manager() { return job_memory_manager_.get(); }
+
+  // Job spans finished on this worker, waiting to be sent to the master with
+  // the next heartbeat.
+  server::JobTraceStore* job_trace_store() { return job_trace_store_.get(); }
+
   void set_fail_heartbeats_for_tests(bool fail_heartbeats_for_tests) {
     base::subtle::NoBarrier_Store(&fail_heartbeats_for_tests_, 1);
   } 
@@ -59,6 +75,12 @@ class WorkerServer : public server::ServerBase {
 
   gscoped_ptr<Heartbeater> heartbeater_;
 
+  gscoped_ptr<FileSystemManager> fs_manager_;
+
+  gscoped_ptr<JobMemoryManager> job_memory_manager_;
+
+  gscoped_ptr<server::JobTraceStore> job_trace_store_;
+
   DISALLOW_COPY_AND_ASSIGN(WorkerServer);
 };
 